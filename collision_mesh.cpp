@@ -0,0 +1,340 @@
+#include "collision_mesh.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+#include "model.hpp"
+#include "btBulletDynamicsCommon.h"
+#include "BulletCollision/NarrowPhaseCollision/btRaycastCallback.h"
+#include "netcode/shared/logger.hpp"
+#include "netcode/shared/utils/state_hash.hpp"
+
+namespace {
+    /* Triangles thinner than this can't hold a wheel, they only make the BVH deeper */
+    constexpr float SLIVER_HEIGHT = 0.001f;
+
+    /* Rays per side of the grid the raycast cost is measured with */
+    constexpr int RAYCAST_GRID = 64;
+
+    enum class Surface {
+        Skipped,
+        Drivable,
+        OffRoad
+    };
+
+    /* Positions are welded only when bit-identical, the meshes of a track share their seams exactly. Also keys the
+     * cells of the decimation grid. */
+    struct GridKey {
+        uint32_t bits[3];
+
+        bool operator==(const GridKey &other) const {
+            return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+        }
+    };
+
+    struct GridKeyHash {
+        size_t operator()(const GridKey &key) const {
+            StateHash hash;
+            hash.add(key.bits, sizeof(key.bits));
+            return hash.value();
+        }
+    };
+
+    std::string lowercase(std::string text) {
+        std::ranges::transform(text, text.begin(), [](const unsigned char ch) { return std::tolower(ch); });
+        return text;
+    }
+
+    bool matches(const std::string &name, const std::vector<std::string> &keywords) {
+        const auto lowered = lowercase(name);
+        return std::ranges::any_of(keywords, [&lowered](const std::string &keyword) {
+            return !keyword.empty() && lowered.find(lowercase(keyword)) != std::string::npos;
+        });
+    }
+
+    Surface classify(const Mesh &mesh, const CollisionMeshSettings &settings) {
+        if (matches(mesh.name, settings.skipKeywords) || matches(mesh.materialName, settings.skipKeywords))
+            return Surface::Skipped;
+        if (matches(mesh.name, settings.drivableKeywords) || matches(mesh.materialName, settings.drivableKeywords))
+            return Surface::Drivable;
+        return Surface::OffRoad;
+    }
+
+    std::vector<std::string> keywordsFromEnv(const char *name, std::vector<std::string> keywords) {
+        const char *value = std::getenv(name);
+        if (!value)
+            return keywords;
+
+        keywords.clear();
+        std::string list(value);
+        size_t start = 0;
+        while (start <= list.size()) {
+            const size_t end = std::min(list.find(',', start), list.size());
+            if (end > start)
+                keywords.push_back(list.substr(start, end - start));
+            start = end + 1;
+        }
+
+        return keywords;
+    }
+
+    btVector3 vertexAt(const std::vector<float> &vertices, const int32_t index) {
+        return {vertices[index * 3], vertices[index * 3 + 1], vertices[index * 3 + 2]};
+    }
+
+    bool isSliver(const std::vector<float> &vertices, const int32_t a, const int32_t b, const int32_t c) {
+        const btVector3 va = vertexAt(vertices, a);
+        const btVector3 vb = vertexAt(vertices, b);
+        const btVector3 vc = vertexAt(vertices, c);
+
+        const btScalar longestEdge = std::max({va.distance(vb), vb.distance(vc), vc.distance(va)});
+        if (longestEdge <= 0)
+            return true;
+
+        /* Twice the area over the base is the height onto the longest edge */
+        return (vb - va).cross(vc - va).length() / longestEdge < SLIVER_HEIGHT;
+    }
+
+    /* Drops collapsed, degenerate and sliver triangles along with their flags, returns how many */
+    size_t removeDegenerate(const std::vector<float> &vertices, std::vector<int32_t> &indices,
+                            std::vector<bool> &drivable) {
+        size_t kept = 0;
+        const size_t triangles = indices.size() / 3;
+
+        for (size_t t = 0; t < triangles; ++t) {
+            const int32_t a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+            if (a == b || b == c || a == c || isSliver(vertices, a, b, c))
+                continue;
+
+            indices[kept * 3] = a;
+            indices[kept * 3 + 1] = b;
+            indices[kept * 3 + 2] = c;
+            drivable[kept] = drivable[t];
+            ++kept;
+        }
+
+        indices.resize(kept * 3);
+        drivable.resize(kept);
+        return triangles - kept;
+    }
+
+    /* Vertex clustering. Every off-road vertex of a grid cell collapses onto the first one found in it, the cell
+     * diagonal is the error bound so none moves further than that. Vertices of drivable triangles, the seams with
+     * the off-road included, stay where they are so no gap opens along the track. */
+    void decimate(const std::vector<float> &vertices, std::vector<int32_t> &indices, const std::vector<bool> &drivable,
+                  const float error) {
+        const size_t vertexCount = vertices.size() / 3;
+
+        std::vector<bool> pinned(vertexCount, false);
+        for (size_t t = 0; t < drivable.size(); ++t) {
+            if (drivable[t])
+                pinned[indices[t * 3]] = pinned[indices[t * 3 + 1]] = pinned[indices[t * 3 + 2]] = true;
+        }
+
+        const float cellSize = error / std::sqrt(3.0f);
+        std::unordered_map<GridKey, int32_t, GridKeyHash> representatives;
+        std::vector<int32_t> remap(vertexCount);
+
+        for (size_t v = 0; v < vertexCount; ++v) {
+            if (pinned[v]) {
+                remap[v] = static_cast<int32_t>(v);
+                continue;
+            }
+
+            GridKey cell{};
+            for (int axis = 0; axis < 3; ++axis)
+                cell.bits[axis] = static_cast<uint32_t>(static_cast<int32_t>(std::floor(vertices[v * 3 + axis] /
+                                                                                       cellSize)));
+
+            remap[v] = representatives.try_emplace(cell, static_cast<int32_t>(v)).first->second;
+        }
+
+        for (size_t t = 0; t < drivable.size(); ++t) {
+            if (drivable[t])
+                continue;
+            for (int corner = 0; corner < 3; ++corner)
+                indices[t * 3 + corner] = remap[indices[t * 3 + corner]];
+        }
+    }
+
+    /* Leaves only the vertices some triangle still uses */
+    void compact(std::vector<float> &vertices, std::vector<int32_t> &indices) {
+        std::vector<int32_t> newIndex(vertices.size() / 3, -1);
+        std::vector<float> kept;
+
+        for (auto &index: indices) {
+            if (newIndex[index] < 0) {
+                newIndex[index] = static_cast<int32_t>(kept.size() / 3);
+                kept.insert(kept.end(), vertices.begin() + index * 3, vertices.begin() + index * 3 + 3);
+            }
+            index = newIndex[index];
+        }
+
+        vertices = std::move(kept);
+    }
+
+    /* Shortens the ray to every hit, so only the closest one is left at the end like for a wheel */
+    struct ClosestHit : btTriangleRaycastCallback {
+        using btTriangleRaycastCallback::btTriangleRaycastCallback;
+
+        btScalar reportHit(const btVector3 &, const btScalar hitFraction, int, int) override {
+            return hitFraction;
+        }
+    };
+
+    /* Microseconds per vertical ray, cast on a grid over the given bounds like the wheels of cars spread around the
+     * track would. Both meshes are measured over the bounds of the source, so they answer the same rays. */
+    double raycastCost(btBvhTriangleMeshShape &shape, const btVector3 &aabbMin, const btVector3 &aabbMax) {
+        const btVector3 extent = aabbMax - aabbMin;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int x = 0; x < RAYCAST_GRID; ++x) {
+            for (int z = 0; z < RAYCAST_GRID; ++z) {
+                const btScalar px = aabbMin.x() + extent.x() * (static_cast<btScalar>(x) + 0.5f) / RAYCAST_GRID;
+                const btScalar pz = aabbMin.z() + extent.z() * (static_cast<btScalar>(z) + 0.5f) / RAYCAST_GRID;
+                const btVector3 from(px, aabbMax.y() + 1, pz);
+                const btVector3 to(px, aabbMin.y() - 1, pz);
+
+                ClosestHit callback(from, to);
+                shape.performRaycast(&callback, from, to);
+            }
+        }
+
+        const auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+        return elapsed.count() / (RAYCAST_GRID * RAYCAST_GRID);
+    }
+}
+
+CollisionMeshSettings CollisionMeshSettings::fromEnv() {
+    CollisionMeshSettings settings;
+    settings.skipKeywords = keywordsFromEnv("NFSPUT_COLLISION_SKIP", std::move(settings.skipKeywords));
+    settings.drivableKeywords = keywordsFromEnv("NFSPUT_COLLISION_DRIVABLE", std::move(settings.drivableKeywords));
+
+    if (const char *value = std::getenv("NFSPUT_COLLISION_DECIMATION"); value && *value) {
+        char *end;
+        const float error = std::strtof(value, &end);
+        if (*end != '\0' || !(error >= 0.0f && error <= 10.0f))
+            LOG_WARN("Ignoring invalid NFSPUT_COLLISION_DECIMATION {}", value);
+        else
+            settings.decimationError = error;
+    }
+
+    return settings;
+}
+
+void CollisionMeshSettings::hash(StateHash &hash) const {
+    for (const auto *keywords: {&skipKeywords, &drivableKeywords}) {
+        hash.add(keywords->size());
+        for (const auto &keyword: *keywords) {
+            hash.add(keyword.size());
+            hash.add(keyword.data(), keyword.size());
+        }
+    }
+    hash.add(decimationError);
+}
+
+CollisionMesh CollisionMesh::build(const std::vector<Mesh> &meshes, const CollisionMeshSettings &settings) {
+    CollisionMesh result;
+    /* Per triangle, drivable triangles are never decimated */
+    std::vector<bool> drivable;
+    std::unordered_map<GridKey, int32_t, GridKeyHash> welded;
+
+    /* What the shape used to be built from, every triangle of every mesh */
+    btTriangleIndexVertexArray sourceInterface;
+    size_t sourceTriangles = 0, skippedTriangles = 0;
+
+    for (const auto &mesh: meshes) {
+        const size_t triangles = mesh.indices.size() / 3;
+        if (triangles == 0)
+            continue;
+
+        btIndexedMesh source;
+        source.m_numTriangles = static_cast<int>(triangles);
+        source.m_triangleIndexBase = reinterpret_cast<const unsigned char *>(mesh.indices.data());
+        source.m_triangleIndexStride = 3 * sizeof(unsigned int);
+        source.m_numVertices = static_cast<int>(mesh.vertices.size());
+        source.m_vertexBase = reinterpret_cast<const unsigned char *>(&mesh.vertices.data()->Position);
+        source.m_vertexStride = sizeof(Vertex);
+        source.m_vertexType = PHY_FLOAT;
+        sourceInterface.addIndexedMesh(source, PHY_INTEGER);
+        sourceTriangles += triangles;
+
+        const Surface surface = classify(mesh, settings);
+        if (surface == Surface::Skipped) {
+            LOG_DEBUG("Leaving {} ({}) out of the collision mesh", mesh.name, mesh.materialName);
+            skippedTriangles += triangles;
+            continue;
+        }
+
+        std::vector<int32_t> remap(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+            const auto &position = mesh.vertices[i].Position;
+
+            GridKey key{};
+            std::memcpy(key.bits, &position, sizeof(key.bits));
+
+            const auto [it, inserted] = welded.try_emplace(key, static_cast<int32_t>(result.vertices.size() / 3));
+            if (inserted)
+                result.vertices.insert(result.vertices.end(), {position.x, position.y, position.z});
+            remap[i] = it->second;
+        }
+
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            result.indices.insert(result.indices.end(),
+                                  {remap[mesh.indices[i]], remap[mesh.indices[i + 1]], remap[mesh.indices[i + 2]]});
+            drivable.push_back(surface == Surface::Drivable);
+        }
+    }
+
+    const size_t degenerateTriangles = removeDegenerate(result.vertices, result.indices, drivable);
+
+    size_t decimatedTriangles = 0;
+    if (settings.decimationError > 0.0f) {
+        decimate(result.vertices, result.indices, drivable, settings.decimationError);
+        decimatedTriangles = removeDegenerate(result.vertices, result.indices, drivable);
+    }
+
+    compact(result.vertices, result.indices);
+
+    LOG_INFO("Collision mesh: {} source triangles, {} decorative, {} degenerate or sliver, {} decimated, {} left "
+             "on {} vertices", sourceTriangles, skippedTriangles, degenerateTriangles, decimatedTriangles,
+             result.triangleCount(), result.vertexCount());
+
+    if (sourceTriangles > 0 && result.triangleCount() > 0) {
+        btTriangleIndexVertexArray resultInterface;
+        btIndexedMesh built;
+        built.m_numTriangles = static_cast<int>(result.triangleCount());
+        built.m_triangleIndexBase = reinterpret_cast<const unsigned char *>(result.indices.data());
+        built.m_triangleIndexStride = 3 * sizeof(int32_t);
+        built.m_numVertices = static_cast<int>(result.vertexCount());
+        built.m_vertexBase = reinterpret_cast<const unsigned char *>(result.vertices.data());
+        built.m_vertexStride = 3 * sizeof(float);
+        built.m_vertexType = PHY_FLOAT;
+        resultInterface.addIndexedMesh(built, PHY_INTEGER);
+
+        btBvhTriangleMeshShape sourceShape(&sourceInterface, true, true);
+        btBvhTriangleMeshShape resultShape(&resultInterface, true, true);
+        const btVector3 &aabbMin = sourceShape.getLocalAabbMin();
+        const btVector3 &aabbMax = sourceShape.getLocalAabbMax();
+
+        const double before = raycastCost(sourceShape, aabbMin, aabbMax);
+        const double after = raycastCost(resultShape, aabbMin, aabbMax);
+        LOG_INFO("Collision raycast: {} us per ray over every mesh, {} us over the collision mesh", before, after);
+    }
+
+    return result;
+}
+
+uint32_t CollisionMesh::vertexCount() const {
+    return static_cast<uint32_t>(vertices.size() / 3);
+}
+
+uint32_t CollisionMesh::triangleCount() const {
+    return static_cast<uint32_t>(indices.size() / 3);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Mesh;
+class StateHash;
+
+/* Decides which track meshes end up in the collision shape. A mesh is matched by its name or its material name,
+ * case-insensitively against keywords. */
+struct CollisionMeshSettings {
+    /* Never touched by a car, left out entirely. NFSPUT_COLLISION_SKIP, comma separated. */
+    std::vector<std::string> skipKeywords = {
+        "tree", "grandstand", "tribune", "crowd", "spectator", "sign", "banner", "billboard", "flag", "building",
+        "tent", "sky"
+    };
+
+    /* Kept exactly as modelled. NFSPUT_COLLISION_DRIVABLE, comma separated. Everything else is off-road. */
+    std::vector<std::string> drivableKeywords = {"road", "asphalt", "tarmac", "track", "kerb", "curb", "pit"};
+
+    /* Metres an off-road vertex may move when decimating, 0 keeps them all. NFSPUT_COLLISION_DECIMATION. */
+    float decimationError = 0.0f;
+
+    static CollisionMeshSettings fromEnv();
+
+    /* Part of the collision cache key, a cache built with other settings is stale */
+    void hash(StateHash &hash) const;
+};
+
+/* Welded, indexed collision geometry of a track */
+struct CollisionMesh {
+    /* 3 floats per vertex, 3 indices per triangle */
+    std::vector<float> vertices;
+    std::vector<int32_t> indices;
+
+    /* Logs the triangle counts of every stage, and the raycast cost against all the meshes and against the result */
+    static CollisionMesh build(const std::vector<Mesh> &meshes, const CollisionMeshSettings &settings);
+
+    [[nodiscard]]
+    uint32_t vertexCount() const;
+
+    [[nodiscard]]
+    uint32_t triangleCount() const;
+};
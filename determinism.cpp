@@ -0,0 +1,154 @@
+#include "determinism.hpp"
+
+#include <cfenv>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE__)
+#include <pmmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+#include "netcode/shared/logger.hpp"
+#include "netcode/shared/utils/state_hash.hpp"
+
+Determinism::Determinism() {
+    const char *value = std::getenv("NFSPUT_DETERMINISTIC");
+    enabled = value && std::strcmp(value, "1") == 0;
+    if (!enabled)
+        return;
+
+    if (const char *seedValue = std::getenv("NFSPUT_SEED"); seedValue && *seedValue) {
+        char *end;
+        const auto parsed = std::strtoull(seedValue, &end, 10);
+        if (*end == '\0')
+            seed = parsed;
+        else
+            LOG_WARN("Ignoring invalid NFSPUT_SEED {}", seedValue);
+    }
+
+    recordFile = openFromEnv("NFSPUT_INPUT_RECORD", "wb");
+    hashLogFile = openFromEnv("NFSPUT_STATE_HASH_LOG", "w");
+
+    if (FILE *replayFile = openFromEnv("NFSPUT_INPUT_REPLAY", "rb")) {
+        loadReplay(replayFile);
+        std::fclose(replayFile);
+    }
+
+    LOG_INFO("Deterministic mode, seed {}", seed);
+}
+
+Determinism::~Determinism() {
+    closeLogs();
+}
+
+void Determinism::closeLogs() {
+    if (recordFile)
+        std::fclose(recordFile);
+    if (hashLogFile)
+        std::fclose(hashLogFile);
+
+    recordFile = nullptr;
+    hashLogFile = nullptr;
+}
+
+void Determinism::finish() {
+    closeLogs();
+
+    if (enabled)
+        LOG_INFO("Deterministic run ended after {} steps with state hash {}", step, lastStateHash);
+}
+
+Determinism &Determinism::getInstance() {
+    static Determinism instance;
+    return instance;
+}
+
+FILE *Determinism::openFromEnv(const char *variable, const char *mode) {
+    const char *path = std::getenv(variable);
+    if (!path || !*path)
+        return nullptr;
+
+    FILE *file = std::fopen(path, mode);
+    if (!file)
+        LOG_WARN("Can't open {} {}: {}", variable, path, strerror(errno));
+
+    return file;
+}
+
+void Determinism::loadReplay(FILE *file) {
+    uint8_t record[2];
+    while (std::fread(record, 1, sizeof(record), file) == sizeof(record))
+        replay.push_back({.inputs = record[0], .raceStarted = record[1] != 0});
+
+    LOG_INFO("Replaying {} recorded steps", replay.size());
+}
+
+bool Determinism::isEnabled() const {
+    return enabled;
+}
+
+std::mt19937 Determinism::makeRandomEngine() {
+    if (!enabled)
+        return std::mt19937(std::random_device{}());
+
+    std::seed_seq sequence{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                           static_cast<uint32_t>(streams++)};
+    return std::mt19937(sequence);
+}
+
+void Determinism::configureFloatingPoint() const {
+    if (!enabled)
+        return;
+
+    std::fesetround(FE_TONEAREST);
+
+#if defined(__SSE__)
+    /* Whatever a library may have switched on, denormals are computed the same way on every run */
+    _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_OFF);
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_OFF);
+#endif
+}
+
+PlayerTick Determinism::onTick(PlayerTick tick) {
+    if (!enabled)
+        return tick;
+
+    if (!replay.empty()) {
+        /* Past the end of the log the car coasts, the keyboard never takes over mid replay */
+        tick = replayPosition < replay.size() ? replay[replayPosition++] : PlayerTick{0, true};
+    }
+
+    if (recordFile) {
+        const uint8_t record[2] = {tick.inputs, static_cast<uint8_t>(tick.raceStarted)};
+        std::fwrite(record, 1, sizeof(record), recordFile);
+    }
+
+    return tick;
+}
+
+void Determinism::onStepFinished(const std::vector<std::shared_ptr<Vehicle> > &vehicles) {
+    if (!enabled)
+        return;
+
+    StateHash hash;
+    hash.add(step);
+    for (const auto &vehicle: vehicles)
+        vehicle->hashState(hash);
+
+    lastStateHash = hash.value();
+
+    if (hashLogFile)
+        std::fprintf(hashLogFile, "%llu %016llx\n", static_cast<unsigned long long>(step),
+                     static_cast<unsigned long long>(lastStateHash));
+
+    step++;
+}
+
+uint64_t Determinism::getStep() const {
+    return step;
+}
+
+uint64_t Determinism::getLastStateHash() const {
+    return lastStateHash;
+}
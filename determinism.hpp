@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "vehicle.hpp"
+#include "netcode/shared/client_inputs.hpp"
+
+/* What the player fed into one fixed step */
+struct PlayerTick {
+    ClientInputs inputs;
+    bool raceStarted;
+};
+
+/* Deterministic mode, NFSPUT_DETERMINISTIC=1. Random engines are seeded from NFSPUT_SEED, the floating point
+ * environment is pinned and a hash of every vehicle is taken after each fixed step. The player's ticks can be
+ * recorded to NFSPUT_INPUT_RECORD and played back from NFSPUT_INPUT_REPLAY, the same log on the same build gives
+ * the same hashes, written per step to NFSPUT_STATE_HASH_LOG. Opponent states arriving over the network aren't
+ * part of the log, a run with opponents only repeats itself when they do. */
+class Determinism {
+    static constexpr uint64_t DEFAULT_SEED = 1;
+
+    bool enabled = false;
+    uint64_t seed = DEFAULT_SEED;
+    /* Random engines handed out so far, each gets its own stream of the seed */
+    uint64_t streams = 0;
+
+    uint64_t step = 0;
+    uint64_t lastStateHash = 0;
+
+    FILE *recordFile = nullptr;
+    FILE *hashLogFile = nullptr;
+
+    std::vector<PlayerTick> replay;
+    size_t replayPosition = 0;
+
+    Determinism();
+
+    ~Determinism();
+
+    static FILE *openFromEnv(const char *variable, const char *mode);
+
+    void loadReplay(FILE *file);
+
+    void closeLogs();
+
+public:
+    static Determinism &getInstance();
+
+    Determinism(const Determinism &) = delete;
+
+    Determinism &operator=(const Determinism &) = delete;
+
+    [[nodiscard]]
+    bool isEnabled() const;
+
+    /* Seeded from the seed in deterministic mode, from std::random_device otherwise */
+    std::mt19937 makeRandomEngine();
+
+    /* Round to nearest with denormals kept, per thread. Call on every thread that steps the simulation. */
+    void configureFloatingPoint() const;
+
+    /* Physics pre tick. Records the tick or, when replaying, replaces it with the logged one. */
+    PlayerTick onTick(PlayerTick tick);
+
+    /* Physics post step. Hashes the vehicles in the order they were created. */
+    void onStepFinished(const std::vector<std::shared_ptr<Vehicle> > &vehicles);
+
+    /* Closes the logs and reports the final hash, before the logger goes away */
+    void finish();
+
+    [[nodiscard]]
+    uint64_t getStep() const;
+
+    [[nodiscard]]
+    uint64_t getLastStateHash() const;
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "model.hpp"
+#include "LinearMath/btTransform.h"
+
+/* Everything drawScene needs to know about one vehicle */
+struct VehicleFrame {
+    static constexpr int MAX_WHEELS = 4;
+
+    std::shared_ptr<Model> model;
+    glm::mat4 modelMatrix;
+    glm::vec4 bodyColor;
+    std::array<glm::vec3, 2> brakeLights;
+    bool isBraking;
+    bool isPlayerVehicle;
+    std::string nickname;
+
+    int wheelCount;
+    std::array<btTransform, MAX_WHEELS> wheelTransforms;
+    std::array<float, MAX_WHEELS> wheelRotations;
+};
+
+/* One simulated frame as the render thread sees it. Only the simulation thread fills it, the render thread
+ * never has to touch Bullet. Slots are reused, so the vectors keep their capacity from frame to frame. */
+struct FrameState {
+    /* Counts up from 1, see LatencyTracer::onFramePresented */
+    uint64_t frame = 0;
+
+    /* Drawn pose of the player's chassis, the camera follows it */
+    btTransform playerTransform;
+
+    std::vector<VehicleFrame> vehicles;
+
+    /* Physics wireframe, empty unless the debug drawer is on */
+    std::vector<float> debugLines;
+};
@@ -1,9 +1,10 @@
 #include "laps.hpp"
 
 #include <algorithm>
-#include <iostream>
+#include <ranges>
 
 #include "lap_checkpoints.hpp"
+#include "netcode/shared/logger.hpp"
 #include "BulletCollision/CollisionDispatch/btGhostObject.h"
 #include "BulletCollision/CollisionShapes/btBoxShape.h"
 #include "BulletDynamics/Dynamics/btRigidBody.h"
@@ -42,7 +43,7 @@ void Laps::initializeTracker(btDynamicsWorld *world) {
 
 void Laps::addOpponent(const uint16_t playerId) {
     if (opponentsLaps.contains(playerId)) {
-        std::cerr << "Tried to add a player to the laps system that was already added." << std::endl;
+        LOG_WARN("Tried to add player {} to the laps system that was already added.", playerId);
         return;
     }
 
@@ -54,6 +55,11 @@ void Laps::addLocalPlayer(btRigidBody *rigidBody) {
     localPlayerProgress = PlayerProgress{0, 0};
 }
 
+void Laps::resetProgress() {
+    localPlayerProgress = PlayerProgress{0, 0};
+    leaderboard.clear();
+}
+
 void Laps::setLapIncreaseCallback(const std::function<void(int)> &fun) {
     onLocalPlayerLapIncrease = fun;
 }
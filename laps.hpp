@@ -61,6 +61,10 @@ public:
 
     void addLocalPlayer(btRigidBody *rigidBody);
 
+    /* The local player back to lap 0 before the first checkpoint, the checkpoints stay in the world. The opponents'
+     * laps come from the server and are left alone. */
+    void resetProgress();
+
     void setLapIncreaseCallback(const std::function<void(int)> &fun);
 
     void updateLocalPlayer();
@@ -24,14 +24,24 @@
 #include "opponent_path.hpp"
 #include "debug.hpp"
 #include "netcode/client/udp_client.hpp"
+#include "netcode/client/latency_tracer.hpp"
 #include <chrono>
 #include <thread>
+#include <utility>
 
 #include "default_vehicle_model.hpp"
+#include "determinism.hpp"
+#include "simulation_thread.hpp"
+#include "track_collision.hpp"
 #include "laps.hpp"
 #include "netcode/shared/starting_positions.hpp"
+#include "netcode/client/game_events.hpp"
+#include "netcode/client/network_reactor.hpp"
 #include "netcode/client/opponent_manager.hpp"
+#include "netcode/client/rollback.hpp"
+#include "netcode/client/state_uploader.hpp"
 #include "netcode/shared/client_inputs.hpp"
+#include "netcode/shared/logger.hpp"
 #include "netcode/client/tcp_client.hpp"
 #include "netcode/shared/packets/tcp/client/client_game_loaded_packet.hpp"
 #include "netcode/shared/packets/tcp/client/udp_info_packet.hpp"
@@ -65,9 +75,16 @@ std::shared_ptr<Vehicle> opponentVehicle;
 OpponentPathGenerator *pathGenerator;
 Opponent *opponent;
 
+/* Relative to MODELS_PATH, its collision cache is kept next to it */
+constexpr auto TRACK_FILE = "spielberg.glb";
+
 /* Switching between windowed and fullscreen */
 constexpr float DEFAULT_WINDOW_WIDTH = 800.0f, DEFAULT_WINDOW_HEIGHT = 600.0f;
 bool isFullscreen = false;
+
+/* Set by key callbacks on the render thread, see FrameInput */
+bool addWaypointRequested = false, saveWaypointsRequested = false, printPositionRequested = false,
+     resetToGridRequested = false;
 int windowedX, windowedY, windowedWidth, windowedHeight;
 float currentWindowWidth = DEFAULT_WINDOW_WIDTH, currentWindowHeight = DEFAULT_WINDOW_HEIGHT;
 
@@ -108,20 +125,23 @@ void processKeyCallbacks(GLFWwindow *window, const int key, const int scancode,
     if (key == GLFW_KEY_V && action == GLFW_PRESS) camera.setNextCameraMode();
     if (key == GLFW_KEY_F6 && action == GLFW_PRESS) Physics::getInstance().getDebugDrawer()->toggle();
     if (key == GLFW_KEY_F11 && action == GLFW_PRESS) toggleFullscreen(window);
-    if (key == GLFW_KEY_X && action == GLFW_PRESS) pathGenerator->addWaypointFromVehicle(playerVehicle);
-    if (key == GLFW_KEY_F10 && action == GLFW_PRESS)
-        pathGenerator->saveWaypointsToFile("paths.json");
-    if (key == GLFW_KEY_F7 && action == GLFW_PRESS) playerVehicle->printDebugPosition();
+    /* These read the vehicles, they are handed to the simulation thread with the next frame */
+    if (key == GLFW_KEY_X && action == GLFW_PRESS) addWaypointRequested = true;
+    if (key == GLFW_KEY_F10 && action == GLFW_PRESS) saveWaypointsRequested = true;
+    if (key == GLFW_KEY_F7 && action == GLFW_PRESS) printPositionRequested = true;
+    if (key == GLFW_KEY_F8 && action == GLFW_PRESS) LatencyTracer::getInstance().toggleOverlay();
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS) resetToGridRequested = true;
 }
 
-void processVehicleInputs(GLFWwindow *window, const std::shared_ptr<Vehicle> &vehicle, const float deltaTime) {
+/* Keys held this frame, applied to the player's vehicle in every fixed step of the frame */
+ClientInputs readVehicleInputs(GLFWwindow *window) {
     const bool left = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
     const bool right = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
     const bool handbrake = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
     const bool forward = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
     const bool backward = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
 
-    vehicle->updateControls(forward, backward, handbrake, left, right, deltaTime);
+    return buildInputBitmap(left, right, handbrake, forward, backward);
 }
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
@@ -253,8 +273,7 @@ void setupWheelGeometry(int segments = 24) {
     glBindVertexArray(0);
 }
 
-void drawWheel(const btWheelInfo &wheel, Shader *shader, const int wheelID, const float rollingRotation) {
-    const btTransform trans = wheel.m_worldTransform;
+void drawWheel(const btTransform &trans, Shader *shader, const int wheelID, const float rollingRotation) {
     btScalar mat[16];
     trans.getOpenGLMatrix(mat);
     glm::mat4 model = glm::make_mat4(mat);
@@ -295,39 +314,22 @@ bool worldToScreen(
     return true;
 }
 
-void drawScene(GLFWwindow *window, const std::shared_ptr<TCPClient> &tcpClient) {
+void drawScene(GLFWwindow *window, const std::shared_ptr<TCPClient> &tcpClient, const FrameState &frame) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
     ImGuiIO& io = ImGui::GetIO();
     io.DisplaySize = ImVec2(currentWindowWidth, currentWindowHeight);
 
-    const auto currentFrame = static_cast<float>(glfwGetTime());
-    deltaTime = currentFrame - lastFrame;
-    lastFrame = currentFrame;
-    if (deltaTime > 0.1f) deltaTime = 0.1f;
     processInput(window);
 
     glClearColor(0.1f, 0.8f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    const auto chassisOrigin = playerVehicle->getBtVehicle()->getChassisWorldTransform().getOrigin();
-    const auto vehPos = new glm::vec3();
-    vehPos->x = chassisOrigin.getX();
-    vehPos->y = chassisOrigin.getY();
-    vehPos->z = chassisOrigin.getZ();
-
-    btTransform transform = playerVehicle->getBtVehicle()->getChassisWorldTransform();
-    btMatrix3x3 rotMatrix = transform.getBasis();
-
-    //Car has different Y and Z axis
-    float vehYaw = atan2(rotMatrix[0][0], rotMatrix[0][2]);
-    vehYaw = glm::degrees(vehYaw);
+    const auto chassisOrigin = frame.playerTransform.getOrigin();
+    const glm::vec3 vehPos(chassisOrigin.getX(), chassisOrigin.getY(), chassisOrigin.getZ());
 
-    btVector3 linearVelocity = playerVehicle->getBtVehicle()->getRigidBody()->getLinearVelocity();
-    float vehicleSpeed = linearVelocity.length();
-
-    camera.updateCamera(*vehPos);
+    camera.updateCamera(vehPos);
 
     // view/projection transformations
     const auto aspectRatio = currentWindowWidth / currentWindowHeight;
@@ -346,19 +348,14 @@ void drawScene(GLFWwindow *window, const std::shared_ptr<TCPClient> &tcpClient)
     ImDrawList *drawList = ImGui::GetForegroundDrawList();
 
     // Draw chassis
-    for (const auto &vehicle: VehicleManager::getInstance().getVehicles()) {
-        const auto config = vehicle->getConfig();
-        // const auto chassisTrans = vehicle->getBtVehicle()->getChassisWorldTransform();
-        const auto vehicleModel = vehicle->getModel();
-
-        glm::mat4 modelMatrix = vehicle->getOpenGLModelMatrix();
-        const auto vehiclePos = modelMatrix[3];
+    for (const auto &vehicle: frame.vehicles) {
+        const glm::mat4 &modelMatrix = vehicle.modelMatrix;
         const auto forwardVector = modelMatrix[2];
 
-        if (vehicle->getIsBraking() && brakeLightCount <= brakeLightLimit - 2) {
+        if (vehicle.isBraking && brakeLightCount <= brakeLightLimit - 2) {
             brakeLightCount += 2;
-            brakeLightPositions.emplace_back(modelMatrix * glm::vec4(config.brakeLights[0], 1.0f));
-            brakeLightPositions.emplace_back(modelMatrix * glm::vec4(config.brakeLights[1], 1.0f));
+            brakeLightPositions.emplace_back(modelMatrix * glm::vec4(vehicle.brakeLights[0], 1.0f));
+            brakeLightPositions.emplace_back(modelMatrix * glm::vec4(vehicle.brakeLights[1], 1.0f));
             brakeLightDirections.emplace_back(-forwardVector);
             brakeLightDirections.emplace_back(-forwardVector);
         }
@@ -367,29 +364,23 @@ void drawScene(GLFWwindow *window, const std::shared_ptr<TCPClient> &tcpClient)
         carShader->setUniform("V", view);
         carShader->setUniform("P", projection);
         carShader->setUniform("M", modelMatrix);
-        carShader->setUniform("u_braking", vehicle->getIsBraking());
+        carShader->setUniform("u_braking", vehicle.isBraking);
 
         carShader->setUniform("u_lightColor", glm::vec3(1.0f, 0.95f, 0.95f));
         carShader->setUniform("u_lightPos", glm::vec3(-200.0f, 300.0f, 20.0f));
         carShader->setUniform("u_lightIntensity", 0.85f);
         carShader->setUniform("u_camPos", glm::inverse(view)[3]);
 
-        carShader->setUniform("u_bodyColor", config.bodyColor);
-        vehicleModel->Draw(*carShader);
+        carShader->setUniform("u_bodyColor", vehicle.bodyColor);
+        vehicle.model->Draw(*carShader);
 
         glDisable(GL_CULL_FACE);
-        for (int i = 0; i < vehicle->getBtVehicle()->getNumWheels(); ++i) {
-            const float speed = vehicle->getBtVehicle()->getCurrentSpeedKmHour() / 3.6f;
-            const float distanceTraveled = speed * deltaTime;
-            const float deltaRotation = distanceTraveled / config.wheelRadius;
-            const float wheelRotation = vehicle->applyRotationToWheel(i, deltaRotation);
-
-            drawWheel(vehicle->getBtVehicle()->getWheelInfo(i), carShader, i, wheelRotation);
-        }
+        for (int i = 0; i < vehicle.wheelCount; ++i)
+            drawWheel(vehicle.wheelTransforms[i], carShader, i, vehicle.wheelRotations[i]);
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
 
-        const auto vehicleWorldPos = glm::vec3(vehicle->getOpenGLModelMatrix()[3]);
+        const auto vehicleWorldPos = glm::vec3(modelMatrix[3]);
 
         // offset above roof
         glm::vec3 nickPos = vehicleWorldPos + glm::vec3(0.0f, 1.5f, 0.0f);
@@ -397,9 +388,9 @@ void drawScene(GLFWwindow *window, const std::shared_ptr<TCPClient> &tcpClient)
         ImVec2 screenPos;
         if (worldToScreen(nickPos, view, projection, currentWindowWidth, currentWindowHeight, screenPos)) {
             const std::string& nick =
-                config.isPlayerVehicle
+                vehicle.isPlayerVehicle
                     ? tcpClient->getPlayerNickname()
-                    : config.nickname;
+                    : vehicle.nickname;
 
             float distance = glm::distance(camera.getPosition(), nickPos);
             float scale = glm::clamp(10.0f / distance, 0.5f, 2.0f);
@@ -443,10 +434,7 @@ void drawScene(GLFWwindow *window, const std::shared_ptr<TCPClient> &tcpClient)
 
     trackModel->Draw(*trackShader);
 
-    const auto debugDrawer = Physics::getInstance().getDebugDrawer();
-
-    if (debugDrawer->isEnabled())
-        debugDrawer->draw(projection * view * model);
+    Physics::getInstance().getDebugDrawer()->draw(projection * view * model, frame.debugLines);
 
     // simpleShader->use();
     // simpleShader->setUniform("V", view);
@@ -455,17 +443,22 @@ void drawScene(GLFWwindow *window, const std::shared_ptr<TCPClient> &tcpClient)
     //     drawWaypoint(waypoint, simpleShader);
     // }
 
+    LatencyTracer::getInstance().drawOverlay();
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
 int main() {
+    Determinism::getInstance().configureFloatingPoint();
 
     auto state = std::make_shared<ClientState>();
     auto tcpClient = std::make_shared<TCPClient>(state);
-    std::thread tcpListenThread([tcpClient] {
-        tcpClient->connect("127.0.0.1","1313");
-    });
+    tcpClient->connect(getServerHost(), getServerPort());
+
+    NetworkReactor reactor(tcpClient, state);
+    reactor.start();
+
     {
         std::unique_lock<std::mutex> lock(state->mtx);
         state->cv.wait(lock, [&] { return state->ready; });
@@ -541,29 +534,12 @@ int main() {
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
 
-    trackModel = new Model("spielberg.glb", true);
+    trackModel = new Model(TRACK_FILE, true);
     wheelModel = new Model("wheel.glb", false);
     simpleShader = new Shader("simplest_vert.glsl", nullptr, "simplest_frag.glsl");
     trackShader = new Shader("track_vert.glsl", nullptr, "track_frag.glsl");
     carShader = new Shader("car_vert.glsl", nullptr, "car_frag.glsl");
 
-    auto meshes = trackModel->getMeshes();
-
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-
-    unsigned int vertexOffset = 0;
-
-    for (const auto &mesh: meshes) {
-        vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
-
-        for (unsigned int index: mesh.indices) {
-            indices.push_back(index + vertexOffset);
-        }
-
-        vertexOffset += mesh.vertices.size();
-    }
-
     // const auto vehicleModel = std::make_shared<Model>("skyline.glb", true,
     //                                                   aiProcess_Triangulate |
     //                                                   aiProcess_PreTransformVertices |
@@ -584,8 +560,11 @@ int main() {
     ImGui_ImplOpenGL3_Init("#version 450");
 
     auto &physics = Physics::getInstance();
-    const auto triMesh = Physics::btTriMeshFromModel(vertices, indices);
-    physics.initPhysics(triMesh);
+    if (!physics.swapTrack(TRACK_FILE, *trackModel)) {
+        std::cerr << "Failed to load the track collision" << std::endl;
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
 
     const VehicleConfig defaultConfig;
     const auto gridPositionIndex = tcpClient->getGridPosition();
@@ -600,14 +579,14 @@ int main() {
     defaultConfig.bodyColor=glm::vec4(vehicleColor.rNormalized(), vehicleColor.gNormalized(), vehicleColor.bNormalized(),
                                  1.0f);
 
+    /* Every car of a full grid is built now, cars joining later take their parts from the pool */
+    VehicleFactory::getInstance().reserve(defaultConfig, physics.getDynamicsWorld(), std::size(startingPositions));
     playerVehicle = VehicleManager::getInstance().createVehicle(defaultConfig, vehicleModel);
     playerVehicle->freeze();
 
-    std::thread udpListenThread([udpClient] {
-        const auto packet = UDPPacket::create<PingPacket>(0, nullptr, 0);
-        udpClient->send(UDPPacket::serialize(packet), sizeof(PingPacket));
-        udpClient->listen();
-    });
+    const auto pingPacket = UDPPacket::create<PingPacket>(0, nullptr, 0);
+    udpClient->send(UDPPacket::serialize(pingPacket), sizeof(PingPacket));
+    reactor.attachUdp(udpClient);
 
     // const VehicleConfig opponentConfig;
     // opponentConfig.rotation = btQuaternion(btVector3(0, -1, 0), SIMD_HALF_PI);
@@ -639,44 +618,138 @@ int main() {
 
     bool didStart = false;
 
-    auto lastTick = steady_clock::now();
-    while (!glfwWindowShouldClose(window)) {
-        physics.stepSimulation(deltaTime);
+    auto &latencyTracer = LatencyTracer::getInstance();
+    auto &vehicleManager = VehicleManager::getInstance();
+    auto &determinism = Determinism::getInstance();
+    auto &gameEvents = GameEventQueue::getInstance();
 
-        if (!didStart && tcpClient->isRaceStartCountdownActive() && tcpClient->getTimeUntilRaceStart() == 0) {
+    /* Simulation thread only, the keys of the frame being simulated */
+    ClientInputs playerInputs = 0;
+
+    /* Controls and the race start are applied per fixed step so handling doesn't depend on the frame rate and a
+     * recorded run can be stepped through again */
+    physics.setPreTickCallback([&](const btScalar timeStep) {
+        const auto tick = determinism.onTick({
+            .inputs = playerInputs,
+            .raceStarted = tcpClient->hasRaceStarted()
+        });
+
+        if (!didStart && tick.raceStarted) {
             playerVehicle->unfreeze();
             didStart = true;
         }
 
-        // playerVehicle->getBtVehicle()->updateVehicle(deltaTime);
-        if (steady_clock::now() - lastTick > milliseconds(1000 / 32)) {
-            const bool left = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
-            const bool right = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
-            const bool handbrake = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
-            const bool forward = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
-            const bool backward = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+        applyInputs(*playerVehicle, tick.inputs, timeStep);
+        opponentManager.applyLastInputs(timeStep);
+    });
+    physics.setPreVehiclesCallback([&] {
+        vehicleManager.castWheelRays();
+    });
+    physics.setPostStepCallback([&] {
+        vehicleManager.recordPhysicsStates();
+        determinism.onStepFinished(vehicleManager.getVehicles());
+    });
 
-            const auto inputBitmap = buildInputBitmap(left, right, handbrake, forward, backward);
+    /* Back to the grid slot in a clean world, the track stays loaded. Determinism doesn't record it, so a recorded
+     * run can't have one. Once the race is on, the opponents race on and the server keeps counting laps, so only the
+     * countdown allows it. */
+    const auto resetToGrid = [&] {
+        if (determinism.isEnabled()) {
+            LOG_WARN("Ignoring reset to grid in deterministic mode");
+            return;
+        }
 
-            udpClient->sendVehicleState(playerVehicle, inputBitmap);
-            lastTick = steady_clock::now();
+        if (tcpClient->hasRaceStarted()) {
+            LOG_WARN("Ignoring reset to grid during the race");
+            return;
         }
 
-        processInput(window);
-        processVehicleInputs(window, playerVehicle, deltaTime);
+        physics.resetDynamics();
+        playerVehicle->restoreState(gridPosition, btVector3(0, 0, 0), btVector3(0, 0, 0), 0.0f);
+        lapsInstance.resetProgress();
+    };
 
-        opponentManager.applyLastInputs(deltaTime);
+    StateUploader stateUploader(udpClient);
+    stateUploader.start();
 
-        // opponent->updateSteering();
+    /* Everything touching Bullet runs here, drawScene only gets the FrameState */
+    SimulationThread simulation([&](const FrameInput &input, FrameState &out) {
+        if (input.addWaypoint)
+            pathGenerator->addWaypointFromVehicle(playerVehicle);
+        if (input.saveWaypoints)
+            pathGenerator->saveWaypointsToFile("paths.json");
+        if (input.printPosition)
+            playerVehicle->printDebugPosition();
+        if (input.resetToGrid)
+            resetToGrid();
+
+        gameEvents.apply(*tcpClient);
+        opponentManager.drainUpdates();
+
+        playerInputs = input.inputs;
 
-        drawScene(window, tcpClient);
+        physics.stepSimulation(input.frameTime);
+        vehicleManager.updateRenderTransforms(physics.getInterpolationAlpha());
+        latencyTracer.onPhysicsStepped(out.frame);
+
+        /* Uploaded at the network tick by StateUploader, whatever the frame rate */
+        stateUploader.publish(*playerVehicle, input.inputs, input.inputSampledUs);
+
+        opponentManager.interpolateOpponents(input.frameTime);
+
+        // opponent->updateSteering();
 
         lapsInstance.updateLocalPlayer();
 
+        const auto &vehicles = vehicleManager.getVehicles();
+        out.vehicles.resize(vehicles.size());
+        for (size_t i = 0; i < vehicles.size(); ++i)
+            vehicles[i]->captureFrame(out.vehicles[i], input.frameTime);
+
+        out.playerTransform = playerVehicle->getRenderTransform();
+        physics.getDebugDrawer()->collect(out.debugLines);
+    });
+
+    /* The keys read below are only as fresh as the last glfwPollEvents */
+    uint32_t inputSampledUs = traceTimestampUs();
+    lastFrame = static_cast<float>(glfwGetTime());
+
+    simulation.start();
+    simulation.submit({.frameTime = 0.0f, .inputs = 0, .inputSampledUs = inputSampledUs});
+
+    while (!glfwWindowShouldClose(window) && reactor.isConnected()) {
+        const auto currentFrame = static_cast<float>(glfwGetTime());
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+        if (deltaTime > 0.1f) deltaTime = 0.1f;
+
+        /* Drawn while the simulation already works on the frame submitted below */
+        const auto &frame = simulation.fetch();
+
+        simulation.submit({
+            .frameTime = deltaTime,
+            .inputs = readVehicleInputs(window),
+            .inputSampledUs = inputSampledUs,
+            .addWaypoint = std::exchange(addWaypointRequested, false),
+            .saveWaypoints = std::exchange(saveWaypointsRequested, false),
+            .printPosition = std::exchange(printPositionRequested, false),
+            .resetToGrid = std::exchange(resetToGridRequested, false)
+        });
+
+        drawScene(window, tcpClient, frame);
+
         glfwSwapBuffers(window);
+        latencyTracer.onFramePresented(frame.frame);
+
         glfwPollEvents();
+        inputSampledUs = traceTimestampUs();
     }
 
+    simulation.stop();
+    stateUploader.stop();
+    reactor.stop();
+    determinism.finish();
+
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -1,10 +1,10 @@
 #include "model.hpp"
-#include <iostream>
 #include "stb_image.h"
 #include <cstring>
 #include "assimp/Importer.hpp"
 #include "assimp/postprocess.h"
 #include "glm/gtc/type_ptr.inl"
+#include "netcode/shared/logger.hpp"
 
 unsigned int UploadTexture(const unsigned char *data, const int width, const int height, const int nrComponents) {
     if (!data) return 0;
@@ -24,7 +24,7 @@ unsigned int UploadTexture(const unsigned char *data, const int width, const int
             format = GL_RGBA;
             break;
         default:
-            std::cerr << "Unsupported number of components: " << nrComponents << std::endl;
+            LOG_ERROR("Unsupported number of components: {}", nrComponents);
             return 0;
     }
 
@@ -48,9 +48,7 @@ unsigned int TextureFromMemory(const unsigned char *dataBuffer, const size_t dat
         stbi_load_from_memory(dataBuffer, static_cast<int>(dataSize), &width, &height, &nrComponents, 0);
 
     if (!data) {
-        std::cerr << "Embedded texture failed to load";
-        if (!nameHint.empty()) std::cerr << " (" << nameHint << ")";
-        std::cerr << std::endl;
+        LOG_ERROR("Embedded texture failed to load ({})", nameHint);
         return 0;
     }
 
@@ -66,7 +64,7 @@ unsigned int TextureFromFile(const char *path, const std::string &directory) {
     unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
 
     if (!data) {
-        std::cerr << "Texture failed to load at path: " << filename << std::endl;
+        LOG_ERROR("Texture failed to load at path: {}", filename);
         return 0;
     }
 
@@ -161,25 +159,25 @@ void Model::Draw(Shader &shader) {
         mesh.Draw(shader);
 }
 
-std::vector<Mesh> Model::getMeshes() {
+const std::vector<Mesh> &Model::getMeshes() const {
     return meshes;
 }
 
 void Model::loadModel(const std::string &path, unsigned int pFlags) {
-    std::cout << "Loading model " << path << std::endl;
+    LOG_INFO("Loading model {}", path);
 
     Assimp::Importer import;
     const aiScene   *scene =
         import.ReadFile(std::string(MODELS_PATH) + path, aiProcess_Triangulate | aiProcess_PreTransformVertices);
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
+        LOG_ERROR("ASSIMP: {}", import.GetErrorString());
         return;
     }
     directory = path.substr(0, path.find_last_of('/'));
     processNode(scene->mRootNode, scene);
 
-    std::cout << "Finished loading model " << path << std::endl;
+    LOG_INFO("Finished loading model {}", path);
 }
 
 void Model::processNode(const aiNode *node, const aiScene *scene) {
@@ -215,7 +213,7 @@ Mesh Model::processMesh(const aiMesh *mesh, const aiScene *scene) {
             indices.push_back(mesh->mFaces[i].mIndices[j]);
     }
 
-    std::cout << "material id: " << mesh->mMaterialIndex << std::endl;
+    LOG_DEBUG("material id: {}", mesh->mMaterialIndex);
     const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
 
     /* Debug */
@@ -226,7 +224,7 @@ Mesh Model::processMesh(const aiMesh *mesh, const aiScene *scene) {
 
     for (const auto textureType: textureTypes) {
         if (material->GetTextureCount(textureType) > 0)
-            std::cout << "Found type of texture with id " << textureType << std::endl;
+            LOG_DEBUG("Found type of texture with id {}", textureType);
     }
 
     auto diffuseMaps = loadMaterialTextures(material, scene, aiTextureType_DIFFUSE, "texture_diffuse");
@@ -247,6 +245,8 @@ Mesh Model::processMesh(const aiMesh *mesh, const aiScene *scene) {
     textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
 
     auto newMesh = new Mesh(vertices, indices, textures, mesh->mMaterialIndex);
+    newMesh->name = mesh->mName.C_Str();
+    newMesh->materialName = material->GetName().C_Str();
     if (material->GetTextureCount(aiTextureType_DIFFUSE) == 0 &&
         material->GetTextureCount(aiTextureType_BASE_COLOR) == 0) {
         aiColor4D color;
@@ -268,7 +268,7 @@ std::vector<Texture> Model::loadMaterialTextures(const aiMaterial *mat, const ai
         mat->GetTexture(type, i, &str, &uvIndex);
 
         if (uvIndex != 0) {
-            std::cout << "uvIndex is " << uvIndex << std::endl;
+            LOG_DEBUG("uvIndex is {}", uvIndex);
         }
 
         auto it = std::find_if(loadedTextures.begin(), loadedTextures.end(),
@@ -284,12 +284,12 @@ std::vector<Texture> Model::loadMaterialTextures(const aiMaterial *mat, const ai
             const int  textureIndex = std::stoi(str.C_Str() + 1);
             aiTexture *embeddedTexture = scene->mTextures[textureIndex];
 
-            std::cout << str.C_Str() << std::endl;
+            LOG_DEBUG("Loading embedded texture {}", str.C_Str());
             if (embeddedTexture->mHeight == 0) {
                 texture.id = TextureFromMemory(reinterpret_cast<unsigned char *>(embeddedTexture->pcData),
                                                embeddedTexture->mWidth, str.C_Str());
             } else {
-                std::cout << "Tried to load unknown texture format (uncompressed): " << str.C_Str() << std::endl;
+                LOG_WARN("Tried to load unknown texture format (uncompressed): {}", str.C_Str());
                 continue;
             }
         } else {
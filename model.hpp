@@ -28,6 +28,9 @@ class Mesh {
     std::vector<Texture>      textures;
     glm::vec4 baseColor;
     unsigned int materialID{};
+    /* As named in the model file, the collision mesh is picked by them */
+    std::string name;
+    std::string materialName;
 
     Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
          unsigned int materialID);
@@ -45,7 +48,8 @@ class Model {
 
     void Draw(Shader &shader);
 
-    std::vector<Mesh> getMeshes();
+    [[nodiscard]]
+    const std::vector<Mesh> &getMeshes() const;
 
   private:
     std::vector<Mesh>    meshes;
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+
+#include <benchmark/benchmark.h>
+
+/* Heap allocations made by the whole process so far, counted by the replaced global operator new */
+uint64_t allocationCount();
+
+/* Adds an "allocs/op" counter to the benchmark with the allocations made while it was alive */
+class AllocationReporter {
+public:
+    explicit AllocationReporter(benchmark::State &state);
+
+    ~AllocationReporter();
+
+    AllocationReporter(const AllocationReporter &) = delete;
+
+    AllocationReporter &operator=(const AllocationReporter &) = delete;
+
+private:
+    benchmark::State &state;
+    uint64_t startCount;
+};
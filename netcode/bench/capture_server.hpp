@@ -0,0 +1,45 @@
+#pragma once
+#include <cstring>
+#include <vector>
+
+#include "../server/bsd_server.hpp"
+
+/* Stands in for UDPServer and copies every datagram into one reusable buffer instead of calling sendto */
+class CaptureServer final : public BSDServer {
+public:
+    void listen(const char *) override {
+    }
+
+    void send(const ClientHandle &client, const std::unique_ptr<char[]> &data, const ssize_t size) const override {
+        if (!client.connected)
+            return;
+
+        const auto offset = captured.size();
+        captured.resize(offset + size);
+        std::memcpy(captured.data() + offset, data.get(), size);
+        datagrams++;
+    }
+
+    void sendToAll(const std::unique_ptr<char[]> &, ssize_t) const override {
+    }
+
+    /* Keeps the capacity so steady state ticks don't allocate on our side */
+    void clear() const {
+        captured.clear();
+        datagrams = 0;
+    }
+
+    [[nodiscard]]
+    size_t getBytes() const {
+        return captured.size();
+    }
+
+    [[nodiscard]]
+    size_t getDatagrams() const {
+        return datagrams;
+    }
+
+private:
+    mutable std::vector<char> captured;
+    mutable size_t datagrams = 0;
+};
@@ -0,0 +1,168 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocation_counter.hpp"
+#include "../shared/client_state.hpp"
+#include "../shared/crc32.hpp"
+#include "../shared/opponent_info.hpp"
+#include "../shared/vehicle_state.hpp"
+#include "../shared/packets/tcp/server/opponents_info_packet.hpp"
+#include "../shared/packets/udp/udp_packet.hpp"
+#include "../shared/packets/udp/client/state_packet.hpp"
+#include "../shared/packets/udp/server/opponent_states_packet.hpp"
+
+namespace {
+    /* Loop splits the opponents' states into datagrams of at most 5 */
+    constexpr int STATES_PER_PACKET = 5;
+    constexpr int MAX_PLAYERS = 8;
+
+    VehicleState makeVehicleState(const int seed) {
+        btTransform transform;
+        transform.setIdentity();
+        transform.setOrigin(btVector3(12.5f * seed, 0.4f, -340.0f + seed));
+        transform.setRotation(btQuaternion(btVector3(0, 1, 0), 0.1f * seed));
+
+        return {transform, btVector3(27.0f, -0.2f, 4.5f), 0.05f, buildInputBitmap(false, true, false, true, false)};
+    }
+
+    OpponentStatesPacket makeOpponentStatesPacket(const int opponents) {
+        OpponentStatesPacket packet;
+        packet.statesCount = static_cast<uint8_t>(opponents);
+
+        for (int i = 0; i < opponents; ++i) {
+            ClientState state{};
+            state.clientId = static_cast<uint16_t>(i + 1);
+            packVehicleState(makeVehicleState(i), state.state);
+            packet.states.push_back(state);
+        }
+
+        const auto buffer = serializeOpponentState(packet);
+        packet.checksum = UDPPacket::calculatePacketChecksum(buffer, getOpponentStatePacketSize(packet));
+
+        return packet;
+    }
+
+    std::vector<OpponentInfo> makeOpponentsInfo(const int players) {
+        std::vector<OpponentInfo> info;
+        for (int i = 0; i < players; ++i) {
+            info.push_back({
+                static_cast<uint16_t>(i + 1), {200, static_cast<uint8_t>(20 * i), 40}, static_cast<uint8_t>(i),
+                "player_" + std::to_string(i) + "_nickname"
+            });
+        }
+
+        return info;
+    }
+
+    void BM_CRC32(benchmark::State &state) {
+        const std::vector<char> data(state.range(0), 'x');
+        AllocationReporter allocations(state);
+
+        for (auto _: state)
+            benchmark::DoNotOptimize(CRC32::calculate(data.data(), data.size()));
+
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    }
+
+    void BM_PackVehicleState(benchmark::State &state) {
+        const auto vehicleState = makeVehicleState(3);
+        StateBuffer buf;
+        AllocationReporter allocations(state);
+
+        for (auto _: state) {
+            packVehicleState(vehicleState, buf);
+            benchmark::DoNotOptimize(buf);
+        }
+    }
+
+    void BM_UnpackVehicleState(benchmark::State &state) {
+        StateBuffer buf;
+        packVehicleState(makeVehicleState(3), buf);
+        AllocationReporter allocations(state);
+
+        for (auto _: state)
+            benchmark::DoNotOptimize(unpackVehicleState(buf));
+    }
+
+    /* What UDPClient::sendVehicleState does every frame, minus the write */
+    void BM_CreateStatePacket(benchmark::State &state) {
+        const auto vehicleState = makeVehicleState(3);
+        uint32_t id = 0;
+        AllocationReporter allocations(state);
+
+        for (auto _: state) {
+            StatePacket packet;
+            packet.header.id = id++;
+            packVehicleState(vehicleState, packet.payload);
+            packet.checksum = UDPPacket::calculatePacketChecksum(packet);
+            benchmark::DoNotOptimize(UDPPacket::serialize(packet));
+        }
+    }
+
+    void BM_ValidateStatePacket(benchmark::State &state) {
+        StatePacket statePacket;
+        packVehicleState(makeVehicleState(3), statePacket.payload);
+        statePacket.checksum = UDPPacket::calculatePacketChecksum(statePacket);
+        const auto packet = UDPPacket::serialize(statePacket);
+        AllocationReporter allocations(state);
+
+        for (auto _: state)
+            benchmark::DoNotOptimize(UDPPacket::validate(packet, sizeof(StatePacket)));
+    }
+
+    void BM_SerializeOpponentStates(benchmark::State &state) {
+        const auto packet = makeOpponentStatesPacket(static_cast<int>(state.range(0)));
+        const auto size = getOpponentStatePacketSize(packet);
+        AllocationReporter allocations(state);
+
+        for (auto _: state)
+            benchmark::DoNotOptimize(serializeOpponentState(packet));
+
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+    }
+
+    void BM_DeserializeOpponentStates(benchmark::State &state) {
+        const auto packet = makeOpponentStatesPacket(static_cast<int>(state.range(0)));
+        const auto size = getOpponentStatePacketSize(packet);
+        const auto buffer = serializeOpponentState(packet);
+        AllocationReporter allocations(state);
+
+        for (auto _: state)
+            benchmark::DoNotOptimize(deserializeOpponentState(buffer, static_cast<ssize_t>(size)));
+
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+    }
+
+    void BM_BuildOpponentsInfo(benchmark::State &state) {
+        const auto info = makeOpponentsInfo(static_cast<int>(state.range(0)));
+        AllocationReporter allocations(state);
+
+        for (auto _: state) {
+            OpponentsInfoPacket packet(info);
+            benchmark::DoNotOptimize(TCPPacket::serialize(packet));
+        }
+    }
+
+    void BM_ParseOpponentsInfo(benchmark::State &state) {
+        const OpponentsInfoPacket packet(makeOpponentsInfo(static_cast<int>(state.range(0))));
+        auto payload = std::make_unique<char[]>(packet.header.payloadSize);
+        std::memcpy(payload.get(), packet.payload, packet.header.payloadSize);
+        AllocationReporter allocations(state);
+
+        for (auto _: state)
+            benchmark::DoNotOptimize(OpponentsInfoPacket::deserialize(payload, packet.header.payloadSize));
+    }
+}
+
+BENCHMARK(BM_CRC32)->Arg(sizeof(StatePacket) - sizeof(uint32_t))->Arg(256)->Arg(MAX_UDP_PAYLOAD_SIZE);
+BENCHMARK(BM_PackVehicleState);
+BENCHMARK(BM_UnpackVehicleState);
+BENCHMARK(BM_CreateStatePacket);
+BENCHMARK(BM_ValidateStatePacket);
+BENCHMARK(BM_SerializeOpponentStates)->Arg(1)->Arg(3)->Arg(STATES_PER_PACKET);
+BENCHMARK(BM_DeserializeOpponentStates)->Arg(1)->Arg(3)->Arg(STATES_PER_PACKET);
+BENCHMARK(BM_BuildOpponentsInfo)->Arg(2)->Arg(4)->Arg(MAX_PLAYERS);
+BENCHMARK(BM_ParseOpponentsInfo)->Arg(2)->Arg(4)->Arg(MAX_PLAYERS);
@@ -0,0 +1,4 @@
+#include <benchmark/benchmark.h>
+
+/* Pass --benchmark_format=json or --benchmark_out=<file> to get results that can be compared between builds */
+BENCHMARK_MAIN();
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "../shared/physics_world.hpp"
+#include "../shared/track_raycaster.hpp"
+
+namespace {
+    constexpr btScalar TIME_STEP = btScalar(1) / 120;
+
+    /* Cars with the default VehicleConfig tuning, driving in lanes across a flat ground */
+    class Grid {
+        PhysicsWorld &physicsWorld;
+
+        btBoxShape chassisBox{btVector3(0.87f, 0.55f, 2.4f)};
+        btCompoundShape chassisShape;
+        btStaticPlaneShape groundShape{btVector3(0, 1, 0), 0};
+        std::unique_ptr<btRigidBody> ground;
+
+        std::vector<std::unique_ptr<btDefaultMotionState> > motions;
+        std::vector<std::unique_ptr<btRigidBody> > chassis;
+        std::vector<std::unique_ptr<btVehicleRaycaster> > raycasters;
+        std::vector<std::unique_ptr<btRaycastVehicle> > vehicles;
+
+    public:
+        Grid(PhysicsWorld &physicsWorld, const int count) : physicsWorld(physicsWorld) {
+            btDynamicsWorld *world = physicsWorld.get();
+            world->setGravity(btVector3(0, -9.81f, 0));
+
+            ground = std::make_unique<btRigidBody>(0.0f, nullptr, &groundShape);
+            world->addRigidBody(ground.get());
+
+            constexpr btScalar centerOfMassOffset = 0.8f;
+            btTransform massTransform;
+            massTransform.setIdentity();
+            massTransform.setOrigin(btVector3(0, centerOfMassOffset, 0));
+            chassisShape.addChildShape(massTransform, &chassisBox);
+
+            constexpr btScalar mass = 1200.0f;
+            btVector3 inertia(0, 0, 0);
+            chassisShape.calculateLocalInertia(mass, inertia);
+
+            const btRaycastVehicle::btVehicleTuning tuning;
+            constexpr int lanes = 8;
+
+            for (int i = 0; i < count; ++i) {
+                btTransform transform;
+                transform.setIdentity();
+                transform.setOrigin(btVector3(static_cast<btScalar>(i % lanes) * 4.0f, 1.0f,
+                                              static_cast<btScalar>(i / lanes) * 8.0f));
+
+                auto &motion = motions.emplace_back(std::make_unique<btDefaultMotionState>(transform));
+                auto &body = chassis.emplace_back(std::make_unique<btRigidBody>(mass, motion.get(), &chassisShape,
+                                                                                inertia));
+                body->setActivationState(DISABLE_DEACTIVATION);
+
+                auto &raycaster = raycasters.emplace_back(PhysicsWorld::createRaycaster(world));
+                auto &vehicle = vehicles.emplace_back(std::make_unique<btRaycastVehicle>(tuning, body.get(),
+                                                                                         raycaster.get()));
+
+                for (const auto &[x, z, isFrontWheel]: {
+                         std::tuple{-0.8f, 1.6f, true}, std::tuple{0.8f, 1.6f, true},
+                         std::tuple{-0.8f, -1.32f, false}, std::tuple{0.8f, -1.32f, false}
+                     }) {
+                    vehicle->addWheel(btVector3(x, -0.22f + centerOfMassOffset, z), btVector3(0, -1, 0),
+                                      btVector3(-1, 0, 0), 0.3f, 0.4f, tuning, isFrontWheel);
+                }
+
+                for (int wheel = 0; wheel < vehicle->getNumWheels(); ++wheel) {
+                    btWheelInfo &info = vehicle->getWheelInfo(wheel);
+                    info.m_suspensionStiffness = 40;
+                    info.m_wheelsDampingRelaxation = 2.0f;
+                    info.m_wheelsDampingCompression = 1.6f;
+                    info.m_frictionSlip = 2.0f;
+                    info.m_rollInfluence = 0.2f;
+                }
+
+                /* Rear wheel drive, like the game */
+                vehicle->applyEngineForce(5000.0f, 2);
+                vehicle->applyEngineForce(5000.0f, 3);
+
+                world->addRigidBody(body.get());
+                PhysicsWorld::addVehicle(world, vehicle.get());
+            }
+        }
+
+        ~Grid() {
+            btDynamicsWorld *world = physicsWorld.get();
+            for (size_t i = 0; i < vehicles.size(); ++i) {
+                PhysicsWorld::removeVehicle(world, vehicles[i].get());
+                world->removeRigidBody(chassis[i].get());
+            }
+            world->removeRigidBody(ground.get());
+        }
+    };
+
+    /* One fixed step of a world full of cars, the work a race grid puts on the physics every tick. The cars drop
+     * onto the ground and start driving before timing begins. */
+    void BM_PhysicsStep(benchmark::State &state) {
+        const auto vehicles = static_cast<int>(state.range(0));
+        const auto threads = static_cast<int>(state.range(1));
+
+        if (threads > 1 && !PhysicsWorld::multithreadingAvailable()) {
+            state.SkipWithError("Built without NFSPUT_BULLET_MULTITHREADED");
+            return;
+        }
+
+        PhysicsWorld physicsWorld(threads);
+        Grid grid(physicsWorld, vehicles);
+
+        for (int i = 0; i < 120; ++i)
+            physicsWorld.get()->stepSimulation(TIME_STEP, 0);
+
+        for (auto _: state)
+            physicsWorld.get()->stepSimulation(TIME_STEP, 0);
+
+        state.counters["vehicles/s"] = benchmark::Counter(static_cast<double>(vehicles),
+                                                          benchmark::Counter::kIsIterationInvariantRate);
+    }
+
+    /* Every grid size once on a single thread and once on all hardware threads */
+    void physicsArgs(benchmark::internal::Benchmark *benchmark) {
+        const auto hardwareThreads = static_cast<int64_t>(std::max(2u, std::thread::hardware_concurrency()));
+
+        benchmark->ArgNames({"vehicles", "threads"});
+        for (const int64_t vehicles: {8, 32, 64, 128}) {
+            benchmark->Args({vehicles, 1});
+            benchmark->Args({vehicles, hardwareThreads});
+        }
+    }
+
+    /* A rolling 1 km square of 2 m quads, about as many triangles as a track's collision mesh */
+    class Terrain {
+        static constexpr int QUADS = 500;
+        static constexpr float QUAD_SIZE = 2.0f;
+
+        std::vector<float> vertices;
+        std::vector<int32_t> indices;
+        std::unique_ptr<btTriangleIndexVertexArray> meshInterface;
+        std::unique_ptr<btBvhTriangleMeshShape> shape;
+        std::unique_ptr<btRigidBody> body;
+        btDynamicsWorld *world;
+
+    public:
+        std::unique_ptr<TrackRaycaster> raycaster;
+
+        explicit Terrain(btDynamicsWorld *world) : world(world) {
+            for (int z = 0; z <= QUADS; ++z) {
+                for (int x = 0; x <= QUADS; ++x) {
+                    vertices.push_back(static_cast<float>(x) * QUAD_SIZE);
+                    vertices.push_back(std::sin(static_cast<float>(x) * 0.05f) * std::cos(static_cast<float>(z) *
+                                           0.07f) * 4.0f);
+                    vertices.push_back(static_cast<float>(z) * QUAD_SIZE);
+                }
+            }
+
+            for (int z = 0; z < QUADS; ++z) {
+                for (int x = 0; x < QUADS; ++x) {
+                    const int corner = z * (QUADS + 1) + x;
+                    indices.insert(indices.end(), {
+                                       corner, corner + QUADS + 1, corner + 1,
+                                       corner + 1, corner + QUADS + 1, corner + QUADS + 2
+                                   });
+                }
+            }
+
+            const auto triangleCount = static_cast<int>(indices.size() / 3);
+            meshInterface = std::make_unique<btTriangleIndexVertexArray>(
+                triangleCount, indices.data(), 3 * static_cast<int>(sizeof(int32_t)),
+                static_cast<int>(vertices.size() / 3), vertices.data(), 3 * static_cast<int>(sizeof(float)));
+            shape = std::make_unique<btBvhTriangleMeshShape>(meshInterface.get(), true);
+            body = std::make_unique<btRigidBody>(0.0f, nullptr, shape.get());
+            world->addRigidBody(body.get());
+
+            raycaster = std::make_unique<TrackRaycaster>(shape.get(), vertices.data(), indices.data(),
+                                                         static_cast<uint32_t>(triangleCount));
+        }
+
+        ~Terrain() {
+            world->removeRigidBody(body.get());
+        }
+
+        /* Wheel rays spread over the terrain, from above the ground to below it */
+        [[nodiscard]]
+        std::vector<std::pair<btVector3, btVector3> > wheelRays(const int count) const {
+            std::vector<std::pair<btVector3, btVector3> > rays;
+            for (int i = 0; i < count; ++i) {
+                const float x = 20.0f + static_cast<float>(i * 37 % 960);
+                const float z = 20.0f + static_cast<float>(i * 91 % 960);
+                rays.emplace_back(btVector3(x, 5.0f, z), btVector3(x, -5.0f, z));
+            }
+            return rays;
+        }
+    };
+
+    /* How BM_WheelRays answers the rays */
+    enum class WheelRayMode {
+        /* btDefaultVehicleRaycaster, a world raycast per wheel */
+        Bullet,
+        /* TrackRaycaster::castRays alone, the track part of the wheel rays */
+        Grid,
+        /* What a vehicle runs in the game, rays batched through the grid and then a WheelRaycaster per car looking
+         * through the world for anything before the track */
+        Wheel
+    };
+
+    /* The wheel rays of a race grid, 4 per car */
+    void BM_WheelRays(benchmark::State &state) {
+        const auto vehicles = static_cast<int>(state.range(0));
+        const auto rayCount = vehicles * 4;
+        const auto mode = static_cast<WheelRayMode>(state.range(1));
+
+        PhysicsWorld physicsWorld;
+        btDynamicsWorld *world = physicsWorld.get();
+        Terrain terrain(world);
+        world->updateAabbs();
+
+        const auto rays = terrain.wheelRays(rayCount);
+        btDefaultVehicleRaycaster bulletRaycaster(world);
+        std::vector<TrackRaycaster::Hit> hits(rays.size());
+        std::vector<TrackRaycaster::Ray> batch;
+        for (size_t i = 0; i < rays.size(); ++i)
+            batch.push_back({rays[i].first, rays[i].second, &hits[i]});
+
+        std::vector<std::unique_ptr<WheelRaycaster> > wheelRaycasters;
+        for (int i = 0; i < vehicles; ++i)
+            wheelRaycasters.emplace_back(WheelRaycaster::create(*terrain.raycaster, world));
+
+        for (auto _: state) {
+            switch (mode) {
+                case WheelRayMode::Bullet:
+                    for (const auto &[from, to]: rays) {
+                        btVehicleRaycaster::btVehicleRaycasterResult result;
+                        benchmark::DoNotOptimize(bulletRaycaster.castRay(from, to, result));
+                    }
+                    break;
+
+                case WheelRayMode::Grid:
+                    terrain.raycaster->castRays(batch);
+                    benchmark::DoNotOptimize(hits.data());
+                    break;
+
+                case WheelRayMode::Wheel:
+                    batch.clear();
+                    for (size_t i = 0; i < rays.size(); ++i) {
+                        auto &raycaster = *wheelRaycasters[i / 4];
+                        if (i % 4 == 0)
+                            raycaster.clearQueued();
+                        raycaster.queueRay(rays[i].first, rays[i].second, batch);
+                    }
+                    terrain.raycaster->castRays(batch);
+
+                    for (size_t i = 0; i < rays.size(); ++i) {
+                        btVehicleRaycaster::btVehicleRaycasterResult result;
+                        benchmark::DoNotOptimize(wheelRaycasters[i / 4]->castRay(rays[i].first, rays[i].second,
+                                                                                 result));
+                    }
+                    break;
+            }
+        }
+
+        state.counters["rays/s"] = benchmark::Counter(static_cast<double>(rayCount),
+                                                      benchmark::Counter::kIsIterationInvariantRate);
+    }
+}
+
+BENCHMARK(BM_PhysicsStep)->Apply(physicsArgs)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_WheelRays)->ArgNames({"vehicles", "mode"})->ArgsProduct({{8, 32, 128}, {0, 1, 2}})
+        ->Unit(benchmark::kMicrosecond);
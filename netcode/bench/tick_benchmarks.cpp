@@ -0,0 +1,140 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocation_counter.hpp"
+#include "capture_server.hpp"
+#include "../server/client_handle.hpp"
+#include "../server/loop.hpp"
+#include "../shared/client_state.hpp"
+#include "../shared/room_limits.hpp"
+#include "../shared/vehicle_state.hpp"
+
+namespace {
+    struct SyntheticClients {
+        std::vector<ClientHandle> handles;
+        std::vector<ClientState> states;
+    };
+
+    SyntheticClients makeClients(const size_t count, const uint16_t firstId) {
+        SyntheticClients clients;
+        clients.handles = std::vector<ClientHandle>(count);
+        clients.states.reserve(count);
+
+        for (size_t i = 0; i < count; ++i) {
+            const auto id = static_cast<uint16_t>(firstId + i);
+
+            auto &handle = clients.handles[i];
+            handle.id = id;
+            handle.connected = true;
+            handle.nick = "player_" + std::to_string(id);
+            handle.state = ClientStateLobby::InGame;
+
+            btTransform transform;
+            transform.setIdentity();
+            transform.setOrigin(btVector3(static_cast<float>(i), 0.4f, -340.0f));
+
+            ClientState state{};
+            state.clientId = id;
+            packVehicleState({transform, btVector3(27.0f, 0.0f, 4.5f), 0.0f, INPUT_THROTTLE}, state.state);
+            clients.states.push_back(state);
+        }
+
+        return clients;
+    }
+
+    std::vector<const ClientHandle *> rosterOf(const SyntheticClients &clients) {
+        std::vector<const ClientHandle *> roster;
+        for (const auto &handle: clients.handles)
+            roster.push_back(&handle);
+        return roster;
+    }
+
+    void reportTick(benchmark::State &state, const size_t bytes, const size_t datagrams, const uint64_t allocations) {
+        state.counters["bytes/tick"] = benchmark::Counter(static_cast<double>(bytes),
+                                                          benchmark::Counter::kAvgIterations);
+        state.counters["datagrams/tick"] = benchmark::Counter(static_cast<double>(datagrams),
+                                                              benchmark::Counter::kAvgIterations);
+        state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(allocations),
+                                                         benchmark::Counter::kAvgIterations);
+        state.SetBytesProcessed(static_cast<int64_t>(bytes));
+        state.SetComplexityN(state.range(0));
+    }
+
+    /* Every client of a single Loop sends a state, then the loop ticks. Only the tick is timed, which is the
+     * snapshot build and send for the whole roster. A real room caps at 8 players, larger N shows the scaling. */
+    void BM_LoopTick(benchmark::State &state) {
+        const auto capture = std::make_shared<CaptureServer>();
+        Loop loop(capture);
+
+        const auto clients = makeClients(state.range(0), 1);
+        const auto roster = rosterOf(clients);
+
+        size_t bytes = 0, datagrams = 0;
+        uint64_t allocations = 0;
+
+        for (auto _: state) {
+            state.PauseTiming();
+            capture->clear();
+            for (const auto &clientState: clients.states)
+                loop.enqueueStateUpdate(clientState);
+            const auto allocationsBefore = allocationCount();
+            state.ResumeTiming();
+
+            loop.tick(roster);
+
+            allocations += allocationCount() - allocationsBefore;
+            bytes += capture->getBytes();
+            datagrams += capture->getDatagrams();
+        }
+
+        reportTick(state, bytes, datagrams, allocations);
+    }
+
+    /* The same N clients split into full rooms, like a MatchManager worker ticking every room it owns */
+    void BM_RoomsTick(benchmark::State &state) {
+        const auto capture = std::make_shared<CaptureServer>();
+        const auto roomCount = (static_cast<size_t>(state.range(0)) + MAX_PLAYERS_PER_ROOM - 1) / MAX_PLAYERS_PER_ROOM;
+
+        std::vector<std::unique_ptr<Loop> > loops;
+        std::vector<SyntheticClients> clients;
+        std::vector<std::vector<const ClientHandle *> > rosters;
+
+        for (size_t i = 0; i < roomCount; ++i) {
+            loops.push_back(std::make_unique<Loop>(capture));
+            clients.push_back(makeClients(MAX_PLAYERS_PER_ROOM, static_cast<uint16_t>(1 + i * MAX_PLAYERS_PER_ROOM)));
+        }
+        for (const auto &roomClients: clients)
+            rosters.push_back(rosterOf(roomClients));
+
+        size_t bytes = 0, datagrams = 0;
+        uint64_t allocations = 0;
+
+        for (auto _: state) {
+            state.PauseTiming();
+            capture->clear();
+            for (size_t i = 0; i < roomCount; ++i) {
+                for (const auto &clientState: clients[i].states)
+                    loops[i]->enqueueStateUpdate(clientState);
+            }
+            const auto allocationsBefore = allocationCount();
+            state.ResumeTiming();
+
+            for (size_t i = 0; i < roomCount; ++i)
+                loops[i]->tick(rosters[i]);
+
+            allocations += allocationCount() - allocationsBefore;
+            bytes += capture->getBytes();
+            datagrams += capture->getDatagrams();
+        }
+
+        reportTick(state, bytes, datagrams, allocations);
+    }
+}
+
+BENCHMARK(BM_LoopTick)->Arg(8)->Arg(32)->Arg(128)->Arg(1024)->Complexity(benchmark::oNSquared)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RoomsTick)->Arg(8)->Arg(32)->Arg(128)->Arg(1024)->Complexity(benchmark::oN)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,171 @@
+#include "clock_sync.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "netcode/shared/packets/udp/udp_packet.hpp"
+#include "netcode/shared/server_time.hpp"
+
+using namespace std::chrono;
+
+ClockSync &ClockSync::getInstance() {
+    static ClockSync instance;
+    return instance;
+}
+
+bool ClockSync::isRequestDue(const steady_clock::time_point now) const {
+    std::lock_guard lock(mtx);
+
+    const auto interval = nextRequestId < BURST_REQUESTS
+                              ? duration_cast<steady_clock::duration>(BURST_INTERVAL)
+                              : duration_cast<steady_clock::duration>(POLL_INTERVAL);
+    return now - lastRequestTime >= interval;
+}
+
+TimeSyncRequestPacket ClockSync::createRequest() {
+    std::lock_guard lock(mtx);
+    lastRequestTime = steady_clock::now();
+
+    TimeSyncRequestPacket packet;
+    packet.header.id = nextRequestId++;
+    packet.clientSentUs = monotonicTimeUs();
+    packet.checksum = UDPPacket::calculatePacketChecksum(packet);
+
+    return packet;
+}
+
+void ClockSync::onResponse(const TimeSyncResponsePacket &packet) {
+    const auto t3 = static_cast<int64_t>(monotonicTimeUs());
+    const auto t0 = static_cast<int64_t>(packet.clientSentUs);
+    const auto t1 = static_cast<int64_t>(packet.serverReceivedUs);
+    const auto t2 = static_cast<int64_t>(packet.serverSentUs);
+
+    const int64_t roundTripUs = (t3 - t0) - (t2 - t1);
+    if (t3 < t0 || t2 < t1 || roundTripUs < 0)
+        return;
+
+    const Sample sample{
+        .localUs = static_cast<uint64_t>(t0 + (t3 - t0) / 2),
+        .offsetUs = ((t1 - t0) + (t2 - t3)) / 2,
+        .roundTripUs = roundTripUs
+    };
+
+    std::lock_guard lock(mtx);
+    samples[sampleCount % WINDOW] = sample;
+    sampleCount++;
+
+    const auto filled = std::min<uint64_t>(sampleCount, WINDOW);
+    const auto best = *std::min_element(samples.begin(), samples.begin() + filled,
+                                        [](const Sample &a, const Sample &b) {
+                                            return a.roundTripUs < b.roundTripUs;
+                                        });
+
+    const auto now = static_cast<uint64_t>(t3);
+    const double drift = estimateDriftPpm(best.roundTripUs);
+    const double target = static_cast<double>(best.offsetUs) +
+                          drift * 1e-6 * static_cast<double>(static_cast<int64_t>(now - best.localUs));
+
+    const double current = offsetAt(now);
+    if (!synchronized || std::abs(target - current) > STEP_THRESHOLD_US) {
+        anchorOffsetUs = target;
+        slewUs = 0;
+        synchronized = true;
+    } else {
+        anchorOffsetUs = current;
+        slewUs = target - current;
+    }
+
+    anchorLocalUs = now;
+    driftPpm = drift;
+    bestRoundTripUs = best.roundTripUs;
+}
+
+double ClockSync::offsetAt(const uint64_t localUs) const {
+    const auto elapsedUs = static_cast<double>(static_cast<int64_t>(localUs - anchorLocalUs));
+
+    double slewed = 0;
+    if (elapsedUs > 0)
+        slewed = std::copysign(std::min(std::abs(slewUs), MAX_SLEW_PPM * 1e-6 * elapsedUs), slewUs);
+
+    return anchorOffsetUs + driftPpm * 1e-6 * elapsedUs + slewed;
+}
+
+double ClockSync::estimateDriftPpm(const int64_t shortestRoundTripUs) const {
+    constexpr size_t MIN_SAMPLES = 4;
+    constexpr uint64_t MIN_SPAN_US = 4'000'000;
+
+    /* Samples that queued noticeably longer than the best one carry more asymmetry than drift */
+    const int64_t limitUs = shortestRoundTripUs + std::max<int64_t>(shortestRoundTripUs / 2, 1000);
+    const auto filled = std::min<uint64_t>(sampleCount, WINDOW);
+
+    size_t count = 0;
+    uint64_t first = UINT64_MAX, last = 0;
+    double meanX = 0, meanY = 0;
+    for (size_t i = 0; i < filled; ++i) {
+        if (samples[i].roundTripUs > limitUs)
+            continue;
+
+        count++;
+        first = std::min(first, samples[i].localUs);
+        last = std::max(last, samples[i].localUs);
+        meanX += static_cast<double>(samples[i].localUs);
+        meanY += static_cast<double>(samples[i].offsetUs);
+    }
+
+    if (count < MIN_SAMPLES || last - first < MIN_SPAN_US)
+        return driftPpm;
+
+    meanX /= static_cast<double>(count);
+    meanY /= static_cast<double>(count);
+
+    double covariance = 0, variance = 0;
+    for (size_t i = 0; i < filled; ++i) {
+        if (samples[i].roundTripUs > limitUs)
+            continue;
+
+        const double dx = static_cast<double>(samples[i].localUs) - meanX;
+        covariance += dx * (static_cast<double>(samples[i].offsetUs) - meanY);
+        variance += dx * dx;
+    }
+
+    return std::clamp(covariance / variance * 1e6, -MAX_DRIFT_PPM, MAX_DRIFT_PPM);
+}
+
+bool ClockSync::isSynchronized() const {
+    std::lock_guard lock(mtx);
+    return synchronized;
+}
+
+uint64_t ClockSync::serverTimeUs() const {
+    return toServerTimeUs(monotonicTimeUs());
+}
+
+uint64_t ClockSync::toServerTimeUs(const uint64_t localUs) const {
+    std::lock_guard lock(mtx);
+    return localUs + std::llround(offsetAt(localUs));
+}
+
+uint64_t ClockSync::toLocalTimeUs(const uint64_t serverUs) const {
+    std::lock_guard lock(mtx);
+
+    /* The offset barely moves over a race countdown, one refinement is plenty */
+    const auto guess = serverUs - std::llround(offsetAt(monotonicTimeUs()));
+    return serverUs - std::llround(offsetAt(guess));
+}
+
+steady_clock::time_point ClockSync::toLocalTime(const uint64_t serverUs) const {
+    return steady_clock::time_point(duration_cast<steady_clock::duration>(microseconds(toLocalTimeUs(serverUs))));
+}
+
+ClockSync::Status ClockSync::getStatus() const {
+    const auto now = monotonicTimeUs();
+
+    std::lock_guard lock(mtx);
+    return {
+        .synchronized = synchronized,
+        .offsetUs = std::llround(offsetAt(now)),
+        .roundTripUs = bestRoundTripUs,
+        .driftPpm = driftPpm,
+        .samples = sampleCount
+    };
+}
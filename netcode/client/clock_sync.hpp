@@ -0,0 +1,108 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "netcode/shared/packets/udp/client/time_sync_request_packet.hpp"
+#include "netcode/shared/packets/udp/server/time_sync_response_packet.hpp"
+
+/* Estimates the server's monotonicTimeUs from NTP style request/response pairs over UDP.
+ *
+ * Every exchange gives an offset sample, ((t1 - t0) + (t2 - t3)) / 2, that is only as good as the
+ * path was symmetric. Queueing makes it asymmetric and always shows up as a longer round trip, so only
+ * the samples with the shortest round trips in the window are trusted. Their slope over local time is
+ * the drift between the two clocks, which keeps the estimate right between samples.
+ *
+ * Small corrections are slewed in so server time never jumps backwards under the interpolation,
+ * only errors above STEP_THRESHOLD_US (first sync, route changes) are applied at once. */
+class ClockSync {
+public:
+    /* A quick burst right after connecting, then a steady trickle to follow the drift */
+    static constexpr int BURST_REQUESTS = 8;
+    static constexpr auto BURST_INTERVAL = std::chrono::milliseconds(100);
+    static constexpr auto POLL_INTERVAL = std::chrono::seconds(1);
+
+    static constexpr int64_t STEP_THRESHOLD_US = 20'000;
+    /* How fast a correction is slewed in, 5000 ppm is 5 ms per second */
+    static constexpr double MAX_SLEW_PPM = 5000.0;
+    /* Anything beyond is a bad fit, not a real crystal */
+    static constexpr double MAX_DRIFT_PPM = 500.0;
+
+    static ClockSync &getInstance();
+
+    ClockSync(const ClockSync &) = delete;
+
+    ClockSync &operator=(const ClockSync &) = delete;
+
+    /* Polled by the UDP thread, createRequest stamps the request and restarts the interval */
+    [[nodiscard]]
+    bool isRequestDue(std::chrono::steady_clock::time_point now) const;
+
+    TimeSyncRequestPacket createRequest();
+
+    /* Must be called as soon as the response is read from the socket */
+    void onResponse(const TimeSyncResponsePacket &packet);
+
+    [[nodiscard]]
+    bool isSynchronized() const;
+
+    /* Current estimate of the server's monotonicTimeUs */
+    [[nodiscard]]
+    uint64_t serverTimeUs() const;
+
+    [[nodiscard]]
+    uint64_t toServerTimeUs(uint64_t localUs) const;
+
+    [[nodiscard]]
+    uint64_t toLocalTimeUs(uint64_t serverUs) const;
+
+    [[nodiscard]]
+    std::chrono::steady_clock::time_point toLocalTime(uint64_t serverUs) const;
+
+    struct Status {
+        bool synchronized;
+        int64_t offsetUs;
+        int64_t roundTripUs;
+        double driftPpm;
+        uint64_t samples;
+    };
+
+    [[nodiscard]]
+    Status getStatus() const;
+
+private:
+    static constexpr size_t WINDOW = 16;
+
+    struct Sample {
+        /* Local time halfway through the exchange, where the offset was measured */
+        uint64_t localUs;
+        int64_t offsetUs;
+        int64_t roundTripUs;
+    };
+
+    mutable std::mutex mtx;
+
+    std::array<Sample, WINDOW> samples{};
+    uint64_t sampleCount = 0;
+
+    uint32_t nextRequestId = 0;
+    std::chrono::steady_clock::time_point lastRequestTime{};
+
+    /* offset(t) = anchorOffsetUs + drift * (t - anchorLocalUs) + slew applied so far */
+    bool synchronized = false;
+    uint64_t anchorLocalUs = 0;
+    double anchorOffsetUs = 0;
+    double driftPpm = 0;
+    double slewUs = 0;
+    /* Shortest round trip in the window, the error bound of the estimate is half of it */
+    int64_t bestRoundTripUs = 0;
+
+    ClockSync() = default;
+
+    [[nodiscard]]
+    double offsetAt(uint64_t localUs) const;
+
+    [[nodiscard]]
+    double estimateDriftPpm(int64_t shortestRoundTripUs) const;
+};
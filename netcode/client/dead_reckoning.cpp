@@ -0,0 +1,121 @@
+#include "dead_reckoning.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "snapshot_interpolation.hpp"
+#include "netcode/shared/client_inputs.hpp"
+#include "netcode/shared/logger.hpp"
+
+VehicleState DeadReckoning::extrapolate(const VehicleSnapshot *previous, const VehicleSnapshot &newest,
+                                        const uint64_t aheadUs) {
+    VehicleState state = newest.state;
+    if (aheadUs == 0)
+        return state;
+
+    btVector3 turnAxis(0, 1, 0);
+    btScalar turnRate = 0;
+    btScalar acceleration = 0;
+
+    if (previous && previous->serverTimeUs < newest.serverTimeUs &&
+        newest.serverTimeUs - previous->serverTimeUs <= MAX_HISTORY_SPAN_US) {
+        const btScalar span = static_cast<btScalar>(newest.serverTimeUs - previous->serverTimeUs) * btScalar(1e-6);
+        const auto turn = angularVelocity(*previous, newest);
+        turnRate = turn.length();
+        if (turnRate > SIMD_EPSILON)
+            turnAxis = turn / turnRate;
+
+        acceleration = (newest.state.velocity.length() - previous->state.velocity.length()) / span;
+    }
+
+    /* Rolling without throttle or brake, or on the handbrake, the car can only slow down */
+    const auto inputs = newest.state.inputs;
+    if ((inputs & (INPUT_THROTTLE | INPUT_BRAKE)) == 0 || (inputs & INPUT_HANDBRAKE) != 0)
+        acceleration = std::min(acceleration, btScalar(0));
+    acceleration = std::clamp(acceleration, -MAX_DECELERATION, MAX_ACCELERATION);
+
+    btVector3 position = state.transform.getOrigin();
+    btVector3 velocity = state.velocity;
+    btQuaternion rotation = state.transform.getRotation();
+
+    btScalar remaining = static_cast<btScalar>(aheadUs) * btScalar(1e-6);
+    while (remaining > 0) {
+        const btScalar h = std::min(STEP, remaining);
+
+        if (turnRate > 0) {
+            const btQuaternion stepTurn(turnAxis, turnRate * h);
+            velocity = quatRotate(stepTurn, velocity);
+            rotation = stepTurn * rotation;
+        }
+
+        if (const btScalar speed = velocity.length(); speed > SIMD_EPSILON)
+            velocity *= std::max(btScalar(0), speed + acceleration * h) / speed;
+
+        position += velocity * h;
+        remaining -= h;
+    }
+
+    state.transform.setOrigin(position);
+    state.transform.setRotation(rotation.normalized());
+    state.velocity = velocity;
+
+    return state;
+}
+
+btVector3 DeadReckoning::angularVelocity(const VehicleSnapshot &previous, const VehicleSnapshot &newest) {
+    if (previous.serverTimeUs >= newest.serverTimeUs ||
+        newest.serverTimeUs - previous.serverTimeUs > MAX_HISTORY_SPAN_US)
+        return {0, 0, 0};
+
+    const btScalar span = static_cast<btScalar>(newest.serverTimeUs - previous.serverTimeUs) * btScalar(1e-6);
+
+    btQuaternion turn = newest.state.transform.getRotation() * previous.state.transform.getRotation().inverse();
+    if (turn.w() < 0)
+        turn = -turn;
+
+    const btScalar angle = turn.getAngle();
+    if (angle <= SIMD_EPSILON)
+        return {0, 0, 0};
+
+    return turn.getAxis() * std::min(angle / span, MAX_ANGULAR_SPEED);
+}
+
+uint64_t DeadReckoning::maxExtrapolationFromEnv() {
+    const char *value = std::getenv("NFSPUT_MAX_EXTRAPOLATION_MS");
+    if (!value || !*value)
+        return DEFAULT_MAX_EXTRAPOLATION_US;
+
+    char *end;
+    const auto ms = std::strtoul(value, &end, 10);
+    if (*end != '\0' || ms > 1000) {
+        LOG_WARN("Ignoring invalid NFSPUT_MAX_EXTRAPOLATION_MS {}", value);
+        return DEFAULT_MAX_EXTRAPOLATION_US;
+    }
+
+    return ms * 1000;
+}
+
+void PoseSmoother::addError(const btTransform &shown, const btTransform &target) {
+    positionError += shown.getOrigin() - target.getOrigin();
+    rotationError = rotationError * shown.getRotation() * target.getRotation().inverse();
+
+    if (positionError.length() > SNAP_DISTANCE)
+        reset();
+}
+
+void PoseSmoother::update(const float dt) {
+    const btScalar keep = std::exp(-dt / TIME_CONSTANT);
+
+    positionError *= keep;
+    rotationError = btQuaternion::getIdentity().slerp(rotationError, keep);
+}
+
+btTransform PoseSmoother::apply(const btTransform &target) const {
+    return {(rotationError * target.getRotation()).normalized(), target.getOrigin() + positionError};
+}
+
+void PoseSmoother::reset() {
+    positionError.setZero();
+    rotationError = btQuaternion::getIdentity();
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+
+#include "LinearMath/btTransform.h"
+#include "netcode/shared/vehicle_state.hpp"
+
+struct VehicleSnapshot;
+
+/* Predicts a vehicle past its newest snapshot with a constant turn rate and acceleration model.
+ * The turn rate and the change of speed come from the two newest snapshots, the inputs of the newest
+ * one decide whether the speed may keep growing or shrinking (no speeding up off the throttle). */
+class DeadReckoning {
+public:
+    static constexpr uint64_t DEFAULT_MAX_EXTRAPOLATION_US = 250'000;
+
+    /* Integration step, the turn is applied piecewise so the car follows an arc, not its tangent */
+    static constexpr btScalar STEP = btScalar(0.01);
+
+    static constexpr btScalar MAX_ANGULAR_SPEED = 3;
+    static constexpr btScalar MAX_ACCELERATION = 12;
+    static constexpr btScalar MAX_DECELERATION = 20;
+
+    /* Snapshots further apart than this say little about the current turn, extrapolate straight instead */
+    static constexpr uint64_t MAX_HISTORY_SPAN_US = 250'000;
+
+    /* previous may be null when only one snapshot is known */
+    static VehicleState extrapolate(const VehicleSnapshot *previous, const VehicleSnapshot &newest, uint64_t aheadUs);
+
+    /* Turn rate between two snapshots as axis times radians per second, zero if they are too far apart */
+    static btVector3 angularVelocity(const VehicleSnapshot &previous, const VehicleSnapshot &newest);
+
+    /* NFSPUT_MAX_EXTRAPOLATION_MS, how long a silent opponent keeps moving before it is held in place */
+    static uint64_t maxExtrapolationFromEnv();
+};
+
+/* Hides the jump between a guessed pose and the snapshot that turned out to be true. The difference is
+ * added on top of the real pose and decays exponentially, big ones (respawns) are applied at once. */
+class PoseSmoother {
+public:
+    static constexpr btScalar TIME_CONSTANT = btScalar(0.1);
+    static constexpr btScalar SNAP_DISTANCE = 10;
+
+    /* shown is what would have been drawn, target is the corrected pose for the same moment */
+    void addError(const btTransform &shown, const btTransform &target);
+
+    void update(float dt);
+
+    [[nodiscard]]
+    btTransform apply(const btTransform &target) const;
+
+    void reset();
+
+private:
+    btVector3 positionError{0, 0, 0};
+    btQuaternion rotationError = btQuaternion::getIdentity();
+};
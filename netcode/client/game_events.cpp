@@ -0,0 +1,56 @@
+#include "game_events.hpp"
+
+#include <thread>
+
+#include "laps.hpp"
+#include "opponent_manager.hpp"
+#include "tcp_client.hpp"
+#include "netcode/shared/logger.hpp"
+
+GameEventQueue &GameEventQueue::getInstance() {
+    static GameEventQueue instance;
+    return instance;
+}
+
+bool GameEventQueue::push(const GameEvent &event) {
+    if (ring.tryPush(event))
+        return true;
+
+    LOG_WARN("Game event queue is full, waiting for the main thread");
+    while (!ring.tryPush(event)) {
+        if (closed.load(std::memory_order_relaxed)) {
+            LOG_WARN("Game event queue closed, dropping the event");
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+void GameEventQueue::close() {
+    closed.store(true, std::memory_order_relaxed);
+}
+
+void GameEventQueue::apply(TCPClient &tcpClient) {
+    GameEvent event;
+    while (ring.tryPop(event)) {
+        switch (event.type) {
+            case GameEvent::Type::OpponentJoined: {
+                const auto &[id, vehicleColor, gridPosition, nickname] = event.opponent;
+                OpponentManager::getInstance().addNewOpponent(id, gridPosition, vehicleColor, nickname);
+                Laps::getInstance().addOpponent(id);
+                break;
+            }
+
+            case GameEvent::Type::LapsUpdate:
+                Laps::getInstance().setOpponentLaps(event.opponentId, event.laps);
+                break;
+
+            case GameEvent::Type::RaceStartCountdown:
+                tcpClient.setRaceStartTime(event.raceStartServerUs, event.fallbackStartTime);
+                break;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "netcode/shared/opponent_info.hpp"
+#include "netcode/shared/utils/spsc_ring.hpp"
+
+class TCPClient;
+
+/* Something the network reactor learned over TCP that changes the game world */
+struct GameEvent {
+    enum class Type : uint8_t {
+        OpponentJoined,
+        LapsUpdate,
+        RaceStartCountdown
+    };
+
+    Type type;
+
+    /* OpponentJoined */
+    OpponentInfo opponent;
+
+    /* LapsUpdate */
+    uint16_t opponentId;
+    uint8_t laps;
+
+    /* RaceStartCountdown */
+    uint64_t raceStartServerUs;
+    std::chrono::steady_clock::time_point fallbackStartTime;
+};
+
+/* Hands game events from the network reactor to the main thread, which owns the physics world and everything
+ * the events touch. Nothing is applied before the main loop runs, so no event can race the world's setup. */
+class GameEventQueue {
+    /* A whole room joining plus the lap updates of a few seconds */
+    static constexpr size_t CAPACITY = 64;
+
+    SpscRing<GameEvent, CAPACITY> ring;
+    std::atomic<bool> closed{false};
+
+    GameEventQueue() = default;
+
+public:
+    static GameEventQueue &getInstance();
+
+    GameEventQueue(const GameEventQueue &) = delete;
+
+    GameEventQueue &operator=(const GameEventQueue &) = delete;
+
+    /* Reactor thread. TCP events can't be dropped, when the main thread falls this far behind the reactor waits.
+     * Returns false when the queue was closed before the event fit, the event is dropped then. */
+    bool push(const GameEvent &event);
+
+    /* Any thread, once the main thread stops applying events. Wakes a waiting push and drops everything after. */
+    void close();
+
+    /* Main thread, once per frame before anything reads the opponents, laps or the race start */
+    void apply(TCPClient &tcpClient);
+};
@@ -1,5 +1,5 @@
 #pragma once
-#include "laps.hpp"
+#include "netcode/client/game_events.hpp"
 
 class LapsUpdateHandler {
 public:
@@ -13,6 +13,10 @@ public:
         std::memcpy(&opponentId, payload.get(), sizeof(opponentId));
         std::memcpy(&laps, payload.get() + sizeof(opponentId), sizeof(laps));
 
-        Laps::getInstance().setOpponentLaps(opponentId, laps);
+        GameEventQueue::getInstance().push({
+            .type = GameEvent::Type::LapsUpdate,
+            .opponentId = opponentId,
+            .laps = laps
+        });
     }
 };
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "netcode/client/opponent_manager.hpp"
+#include "netcode/shared/server_time.hpp"
+#include "netcode/shared/vehicle_state.hpp"
 #include "netcode/shared/packets/udp/server/opponent_states_packet.hpp"
 
 class OpponentStatesHandler {
@@ -8,9 +10,22 @@ public:
     static void handle(const PacketBuffer &buf, const ssize_t size) {
         auto packet = deserializeOpponentState(buf, size);
 
-        for (const auto [clientId, state]: packet.states) {
-            OpponentManager::getInstance().updateOpponentState(clientId, state);
+        const auto arrivalUs = monotonicTimeUs();
+        const auto traceReceivedUs = traceTimestampUs();
+
+        for (const auto &[clientId, state, trace, recentInputs]: packet.states) {
+            OpponentUpdate update{
+                .clientId = clientId,
+                .serverTimeUs = packet.serverTimeUs,
+                .arrivalUs = arrivalUs,
+                .state = unpackVehicleState(state),
+                .trace = trace,
+                .traceReceivedUs = traceReceivedUs,
+                .recentInputs = {}
+            };
+            std::memcpy(update.recentInputs.data(), recentInputs, sizeof(recentInputs));
+
+            OpponentManager::getInstance().enqueueUpdate(update);
         }
     }
 };
-
@@ -1,7 +1,6 @@
 #pragma once
 
-#include "laps.hpp"
-#include "netcode/client/opponent_manager.hpp"
+#include "netcode/client/game_events.hpp"
 #include "netcode/shared/packets/tcp/tcp_packet.hpp"
 #include "netcode/shared/packets/tcp/server/opponents_info_packet.hpp"
 
@@ -10,9 +9,8 @@ public:
     static void handle(const PacketBuffer &payload, const ssize_t size) {
         const auto opponentInfos = OpponentsInfoPacket::deserialize(payload, size);
 
-        for (const auto &info: opponentInfos) {
-            OpponentManager::getInstance().addNewOpponent(info.id, info.gridPosition, info.vehicleColor, info.nickname);
-            Laps::getInstance().addOpponent(info.id);
-        }
+        /* Vehicles and lap tracking belong to the main thread */
+        for (const auto &info: opponentInfos)
+            GameEventQueue::getInstance().push({.type = GameEvent::Type::OpponentJoined, .opponent = info});
     }
 };
@@ -1,14 +1,26 @@
 #pragma once
 
+#include "netcode/client/game_events.hpp"
+#include "netcode/shared/packets/tcp/server/race_start_countdown_packet.hpp"
+
 class RaceStartCountdownHandler {
 public:
-    static void handle(const PacketBuffer &buf, const ssize_t size, TCPClient *tcpClient) {
-        if (size != sizeof(uint8_t))
+    static void handle(const PacketBuffer &buf, const ssize_t size) {
+        if (size != RACE_START_COUNTDOWN_PAYLOAD_SIZE)
             throw DeserializationError("Received RaceStartCountdown packet with invalid payload!");
 
-        const auto secondsUntilStart = static_cast<uint8_t>(*buf.get());
-        const auto raceStartTime = std::chrono::steady_clock::now() + std::chrono::seconds(secondsUntilStart);
+        uint8_t secondsUntilStart;
+        uint64_t raceStartServerUs;
+        std::memcpy(&secondsUntilStart, buf.get(), sizeof(secondsUntilStart));
+        std::memcpy(&raceStartServerUs, buf.get() + sizeof(secondsUntilStart), sizeof(raceStartServerUs));
+
+        const auto fallbackTime = std::chrono::steady_clock::now() + std::chrono::seconds(secondsUntilStart);
 
-        tcpClient->setRaceStartTime(raceStartTime);
+        /* The main thread polls the start every frame, it takes the new time from the queue */
+        GameEventQueue::getInstance().push({
+            .type = GameEvent::Type::RaceStartCountdown,
+            .raceStartServerUs = raceStartServerUs,
+            .fallbackStartTime = fallbackTime
+        });
     }
 };
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "netcode/client/clock_sync.hpp"
+#include "netcode/shared/packets/udp/server/time_sync_response_packet.hpp"
+
+class TimeSyncResponseHandler {
+public:
+    static void handle(const PacketBuffer &buf, const ssize_t size) {
+        ClockSync::getInstance().onResponse(UDPPacket::deserialize<TimeSyncResponsePacket>(buf, size));
+    }
+};
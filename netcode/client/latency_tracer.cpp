@@ -0,0 +1,197 @@
+#include "latency_tracer.hpp"
+
+#include <cinttypes>
+#include <cstdlib>
+
+#include "clock_sync.hpp"
+#include "imgui.h"
+#include "nlohmann/json.hpp"
+#include "netcode/shared/logger.hpp"
+
+using namespace std::chrono;
+
+namespace {
+    constexpr size_t STAGE_COUNT = static_cast<size_t>(LatencyStage::Count);
+
+    constexpr std::array<const char *, STAGE_COUNT> STAGE_NAMES = {
+        "input_to_send", "uplink", "server_tick", "downlink", "receive_to_physics", "physics_to_photon", "total"
+    };
+
+    constexpr std::array<const char *, STAGE_COUNT> STAGE_LABELS = {
+        "Input -> send", "Client -> server", "Server tick wait", "Server -> client", "Receive -> physics",
+        "Physics -> photon", "Input -> photon"
+    };
+}
+
+LatencyTracer &LatencyTracer::getInstance() {
+    static LatencyTracer instance;
+    return instance;
+}
+
+LatencyTracer::LatencyTracer() {
+    if (const char *path = std::getenv("NFSPUT_LATENCY_LOG"); path && *path) {
+        log = fopen(path, "a");
+        if (!log)
+            LOG_WARN("Failed to open latency log {}", path);
+    }
+
+    nextLogTime = steady_clock::now() + LOG_INTERVAL;
+}
+
+LatencyTracer::~LatencyTracer() {
+    if (log)
+        fclose(log);
+}
+
+void LatencyTracer::onStateReceived(const LatencyTrace &trace, const uint32_t receivedUs) {
+    /* States from clients that don't stamp, like the load generator, can't be traced */
+    if (trace.inputSampledUs == 0 || trace.clientSentUs == 0 || trace.serverReceivedUs == 0 ||
+        trace.serverSentUs == 0)
+        return;
+
+    received.push_back({trace, receivedUs, 0, 0});
+}
+
+void LatencyTracer::onPhysicsStepped(const uint64_t frame) {
+    if (received.empty())
+        return;
+
+    const auto now = traceTimestampUs();
+
+    std::lock_guard<std::mutex> lock(steppedMtx);
+    for (auto &sample: received) {
+        sample.physicsUs = now;
+        sample.frame = frame;
+        stepped.push_back(sample);
+    }
+    received.clear();
+}
+
+void LatencyTracer::onFramePresented(const uint64_t frame) {
+    const auto now = traceTimestampUs();
+
+    /* The simulation may already be a frame ahead, its samples wait for the swap that shows them */
+    {
+        std::lock_guard<std::mutex> lock(steppedMtx);
+        for (const auto &sample: stepped) {
+            if (sample.frame <= frame)
+                swapBuffer.push_back(sample);
+        }
+        std::erase_if(stepped, [frame](const InFlight &sample) { return sample.frame <= frame; });
+    }
+
+    for (const auto &sample: swapBuffer)
+        record(sample, now);
+    swapBuffer.clear();
+
+    if (log && steady_clock::now() >= nextLogTime) {
+        writeLog();
+        nextLogTime += LOG_INTERVAL;
+    }
+}
+
+void LatencyTracer::toggleOverlay() {
+    overlayVisible = !overlayVisible;
+}
+
+void LatencyTracer::record(const InFlight &sample, const uint32_t presentedUs) {
+    const auto &trace = sample.trace;
+
+    const std::array<int64_t, STAGE_COUNT> elapsed = {
+        traceElapsedUs(trace.inputSampledUs, trace.clientSentUs),
+        traceElapsedUs(trace.clientSentUs, trace.serverReceivedUs),
+        traceElapsedUs(trace.serverReceivedUs, trace.serverSentUs),
+        traceElapsedUs(trace.serverSentUs, sample.receivedUs),
+        traceElapsedUs(sample.receivedUs, sample.physicsUs),
+        traceElapsedUs(sample.physicsUs, presentedUs),
+        traceElapsedUs(trace.inputSampledUs, presentedUs)
+    };
+
+    for (const auto value: elapsed) {
+        if (value < 0) {
+            clockSkewSamples++;
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < STAGE_COUNT; ++i)
+        histograms[i].observe(static_cast<uint64_t>(elapsed[i]));
+}
+
+void LatencyTracer::drawOverlay() const {
+    if (!overlayVisible)
+        return;
+
+    ImGui::SetNextWindowBgAlpha(0.6f);
+    ImGui::Begin("Input to photon latency", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+    if (ImGui::BeginTable("stages", 5)) {
+        ImGui::TableSetupColumn("Stage");
+        ImGui::TableSetupColumn("p50 ms");
+        ImGui::TableSetupColumn("p99 ms");
+        ImGui::TableSetupColumn("max ms");
+        ImGui::TableSetupColumn("samples");
+        ImGui::TableHeadersRow();
+
+        for (size_t i = 0; i < STAGE_COUNT; ++i) {
+            const auto snapshot = histograms[i].snapshot();
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(STAGE_LABELS[i]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", static_cast<double>(snapshot.quantile(0.5)) / 1000.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", static_cast<double>(snapshot.quantile(0.99)) / 1000.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", static_cast<double>(snapshot.quantile(1.0)) / 1000.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%" PRIu64, snapshot.count);
+        }
+
+        ImGui::EndTable();
+    }
+
+    if (clockSkewSamples > 0)
+        ImGui::Text("%" PRIu64 " samples dropped, are the clocks in sync?", clockSkewSamples);
+
+    if (const auto clock = ClockSync::getInstance().getStatus(); clock.synchronized)
+        ImGui::Text("Server clock offset %.2f ms, rtt %.2f ms, drift %.1f ppm", clock.offsetUs / 1000.0,
+                    clock.roundTripUs / 1000.0, clock.driftPpm);
+    else
+        ImGui::TextUnformatted("Server clock not synchronized");
+
+    ImGui::End();
+}
+
+void LatencyTracer::writeLog() const {
+    nlohmann::json line;
+    line["timestampUs"] = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    line["clockSkewSamples"] = clockSkewSamples;
+
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const auto snapshot = histograms[i].snapshot();
+
+        auto &stage = line["stages"][STAGE_NAMES[i]];
+        stage["count"] = snapshot.count;
+        stage["sumUs"] = snapshot.sum;
+        stage["p50Us"] = snapshot.quantile(0.5);
+        stage["p90Us"] = snapshot.quantile(0.9);
+        stage["p99Us"] = snapshot.quantile(0.99);
+        stage["maxUs"] = snapshot.quantile(1.0);
+
+        /* Cumulative like the Prometheus export, only the buckets that changed the count */
+        auto &buckets = stage["buckets"];
+        buckets = nlohmann::json::array();
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket < Histogram::BUCKET_COUNT; ++bucket) {
+            if (snapshot.buckets[bucket] == 0)
+                continue;
+            cumulative += snapshot.buckets[bucket];
+            buckets.push_back({Histogram::bucketUpperBound(bucket), cumulative});
+        }
+    }
+
+    fprintf(log, "%s\n", line.dump().c_str());
+    fflush(log);
+}
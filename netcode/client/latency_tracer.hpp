@@ -0,0 +1,84 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "netcode/shared/histogram.hpp"
+#include "netcode/shared/latency_trace.hpp"
+
+/* Hops between a key press on one client and the opponent's car moving on another client's screen */
+enum class LatencyStage {
+    InputToSend,
+    Uplink,
+    ServerTick,
+    Downlink,
+    ReceiveToPhysics,
+    PhysicsToPhoton,
+    Total,
+    Count
+};
+
+/* Finishes the LatencyTrace of every opponent state on this client and keeps a histogram per stage.
+ * Press F8 for the overlay, set NFSPUT_LATENCY_LOG to a file to get them as JSON lines every few seconds. */
+class LatencyTracer {
+public:
+    static constexpr auto LOG_INTERVAL = std::chrono::seconds(5);
+
+    static LatencyTracer &getInstance();
+
+    LatencyTracer(const LatencyTracer &) = delete;
+
+    LatencyTracer &operator=(const LatencyTracer &) = delete;
+
+    /* Simulation thread, for every state drained from the OpponentManager's update ring.
+     * receivedUs is the traceTimestampUs taken when the reactor read the datagram. */
+    void onStateReceived(const LatencyTrace &trace, uint32_t receivedUs);
+
+    /* Simulation thread, after the physics steps of the given simulation frame */
+    void onPhysicsStepped(uint64_t frame);
+
+    /* Render thread, after the glfwSwapBuffers that put the given simulation frame on screen */
+    void onFramePresented(uint64_t frame);
+
+    void toggleOverlay();
+
+    /* Must be called between ImGui::NewFrame and ImGui::Render */
+    void drawOverlay() const;
+
+private:
+    struct InFlight {
+        LatencyTrace trace;
+        uint32_t receivedUs;
+        uint32_t physicsUs;
+        /* Simulation frame that stepped it */
+        uint64_t frame;
+    };
+
+    /* Received but not yet seen by a physics step, simulation thread only */
+    std::vector<InFlight> received;
+
+    /* Stepped but not on screen yet, handed from the simulation thread to the render thread */
+    std::mutex steppedMtx;
+    std::vector<InFlight> stepped;
+    /* Render thread only */
+    std::vector<InFlight> swapBuffer;
+
+    std::array<Histogram, static_cast<size_t>(LatencyStage::Count)> histograms;
+    /* Samples thrown away because a later hop was stamped before an earlier one */
+    uint64_t clockSkewSamples = 0;
+
+    bool overlayVisible = false;
+
+    FILE *log = nullptr;
+    std::chrono::steady_clock::time_point nextLogTime;
+
+    LatencyTracer();
+
+    ~LatencyTracer();
+
+    void record(const InFlight &sample, uint32_t presentedUs);
+
+    void writeLog() const;
+};
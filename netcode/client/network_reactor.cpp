@@ -0,0 +1,177 @@
+#include "network_reactor.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "clock_sync.hpp"
+#include "game_events.hpp"
+#include "opponent_manager.hpp"
+#include "netcode/shared/logger.hpp"
+
+NetworkReactor::NetworkReactor(std::shared_ptr<TCPClient> tcpClient, std::shared_ptr<ClientState> state)
+    : tcpClient(std::move(tcpClient)), state(std::move(state)) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+        throw std::runtime_error(strerror(errno));
+
+    stopEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stopEventFd < 0)
+        throw std::runtime_error(strerror(errno));
+
+    /* Replaces the lobby countdown's sleeping thread, ticks once a second */
+    countdownTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (countdownTimerFd < 0)
+        throw std::runtime_error(strerror(errno));
+
+    constexpr itimerspec interval{.it_interval = {.tv_sec = 1, .tv_nsec = 0}, .it_value = {.tv_sec = 1, .tv_nsec = 0}};
+    timerfd_settime(countdownTimerFd, 0, &interval, nullptr);
+
+    addFd(this->tcpClient->getSocketFd(), EPOLLIN | EPOLLRDHUP);
+    addFd(STDIN_FILENO, EPOLLIN);
+    addFd(countdownTimerFd, EPOLLIN);
+    addFd(stopEventFd, EPOLLIN);
+}
+
+NetworkReactor::~NetworkReactor() {
+    stop();
+
+    ::close(countdownTimerFd);
+    ::close(stopEventFd);
+    ::close(epollFd);
+}
+
+void NetworkReactor::addFd(const int fd, const uint32_t events) const {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        LOG_WARN("Can't watch fd {}: {}", fd, strerror(errno));
+}
+
+void NetworkReactor::start() {
+    if (running.exchange(true))
+        return;
+
+    thread = std::thread(&NetworkReactor::run, this);
+}
+
+void NetworkReactor::stop() {
+    running.store(false, std::memory_order_relaxed);
+    /* The main thread applies no more events, a reactor waiting on a full queue would never be joined */
+    GameEventQueue::getInstance().close();
+
+    constexpr uint64_t wake = 1;
+    write(stopEventFd, &wake, sizeof(wake));
+
+    if (thread.joinable())
+        thread.join();
+}
+
+void NetworkReactor::attachUdp(std::shared_ptr<UDPClient> client) {
+    udpClient = std::move(client);
+    attachedUdpClient.store(udpClient.get(), std::memory_order_release);
+
+    addFd(udpClient->getSocketFd(), EPOLLIN);
+}
+
+bool NetworkReactor::isConnected() const {
+    return connected.load(std::memory_order_relaxed);
+}
+
+void NetworkReactor::run() {
+    auto &clockSync = ClockSync::getInstance();
+    auto &opponentManager = OpponentManager::getInstance();
+
+    epoll_event events[MAX_EVENTS];
+
+    while (running.load(std::memory_order_relaxed)) {
+        const int n = epoll_wait(epollFd, events, MAX_EVENTS, WAIT_TIMEOUT_MS);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            /* Nothing gets read anymore, the game handles it like a lost server */
+            LOG_ERROR("Network reactor can't wait for events: {}", strerror(errno));
+            onServerDisconnected();
+            return;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (!handleEvent(events[i].data.fd, events[i].events))
+                return;
+        }
+
+        const auto udp = attachedUdpClient.load(std::memory_order_acquire);
+        if (udp == nullptr)
+            continue;
+
+        /* Quiet socket, anything the ring couldn't take earlier gets another chance */
+        if (n == 0)
+            opponentManager.flushOverflow();
+
+        if (clockSync.isRequestDue(std::chrono::steady_clock::now()))
+            udp->sendTimeSyncRequest();
+    }
+}
+
+bool NetworkReactor::handleEvent(const int fd, const uint32_t events) {
+    if (fd == stopEventFd)
+        return false;
+
+    if (fd == tcpClient->getSocketFd()) {
+        /* Whatever arrived before the hangup is still handled */
+        if (events & EPOLLIN && !tcpClient->receivePending())
+            return onServerDisconnected();
+
+        if (events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR))
+            return onServerDisconnected();
+
+        return true;
+    }
+
+    if (fd == countdownTimerFd) {
+        uint64_t expirations;
+        read(countdownTimerFd, &expirations, sizeof(expirations));
+
+        tcpClient->onCountdownTick();
+        return true;
+    }
+
+    if (fd == STDIN_FILENO) {
+        /* A closed stdin would otherwise wake the loop on every wait */
+        if (events & (EPOLLHUP | EPOLLERR))
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+        else
+            tcpClient->handleUserInput();
+
+        return true;
+    }
+
+    if (const auto udp = attachedUdpClient.load(std::memory_order_acquire); udp && fd == udp->getSocketFd())
+        udp->receivePending();
+
+    return true;
+}
+
+bool NetworkReactor::onServerDisconnected() {
+    std::cout << "Disconnected from server\n";
+
+    bool gameReady;
+    {
+        std::lock_guard<std::mutex> lock(state->mtx);
+        gameReady = state->ready;
+    }
+
+    /* Nothing to shut down yet, main is still waiting for the lobby to end */
+    if (!gameReady)
+        exit(0);
+
+    connected.store(false, std::memory_order_relaxed);
+    return false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "tcp_client.hpp"
+#include "udp_client.hpp"
+
+/* The client's only network thread. One epoll loop reads the TCP and UDP sockets and stdin and drives the lobby
+ * countdown, the clock sync requests and the opponent overflow flush. Everything that changes the game world is
+ * handed to the main thread through GameEventQueue and the OpponentManager ring. */
+class NetworkReactor {
+    /* Upper bound on how late a due clock sync request or overflowed snapshot can be */
+    static constexpr int WAIT_TIMEOUT_MS = 20;
+    static constexpr int MAX_EVENTS = 8;
+
+    std::shared_ptr<TCPClient> tcpClient;
+    std::shared_ptr<ClientState> state;
+    /* Attached once the lobby is over, keeps the client alive while the reactor reads from it */
+    std::shared_ptr<UDPClient> udpClient;
+    std::atomic<UDPClient *> attachedUdpClient{nullptr};
+
+    int epollFd = -1;
+    int countdownTimerFd = -1;
+    int stopEventFd = -1;
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> connected{true};
+    std::thread thread;
+
+    void run();
+
+    void addFd(int fd, uint32_t events) const;
+
+    /* False once the reactor should stop */
+    bool handleEvent(int fd, uint32_t events);
+
+    bool onServerDisconnected();
+
+public:
+    NetworkReactor(std::shared_ptr<TCPClient> tcpClient, std::shared_ptr<ClientState> state);
+
+    ~NetworkReactor();
+
+    NetworkReactor(const NetworkReactor &) = delete;
+
+    NetworkReactor &operator=(const NetworkReactor &) = delete;
+
+    void start();
+
+    /* Wakes the loop and joins it, nothing is read after this returns */
+    void stop();
+
+    /* Main thread, once the UDP client exists. Its datagrams are read from the next wakeup on. */
+    void attachUdp(std::shared_ptr<UDPClient> client);
+
+    /* False after the server closed the TCP connection mid-race */
+    [[nodiscard]]
+    bool isConnected() const;
+};
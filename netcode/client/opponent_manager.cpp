@@ -1,11 +1,19 @@
 #include "opponent_manager.hpp"
 
+#include <algorithm>
+
+#include "clock_sync.hpp"
 #include "default_vehicle_model.hpp"
+#include "latency_tracer.hpp"
 #include "netcode/shared/starting_positions.hpp"
+#include "physics.hpp"
+#include "state_uploader.hpp"
 #include "vehicle_manager.hpp"
 #include "netcode/shared/client_inputs.hpp"
+#include "netcode/shared/logger.hpp"
 #include "netcode/shared/opponent_info.hpp"
 #include "netcode/shared/packets/udp/client/state_packet.hpp"
+#include "netcode/shared/vehicle_state.hpp"
 
 void OpponentManager::enqueueVehicleCreationForOpponent(uint16_t opponentId, const VehicleConfig &config) {
     if (!openglReady)
@@ -16,12 +24,15 @@ void OpponentManager::enqueueVehicleCreationForOpponent(uint16_t opponentId, con
 
 void OpponentManager::createOpponentVehicle(uint16_t opponentId, const VehicleConfig &config) {
     if (vehicleMap.contains(opponentId)) {
-        std::cerr << "Tried to create an opponent vehicle for a client with existing vehicle" << std::endl;
+        LOG_WARN("Tried to create an opponent vehicle for client {} with existing vehicle", opponentId);
         return;
     }
 
     auto veh = VehicleManager::getInstance().createVehicle(
         config, VehicleModelCache::getDefaultVehicleModel());
+    /* Interpolated opponents follow their snapshots, the local simulation must not push them around */
+    if (!rollbackEnabled)
+        veh->freeze();
 
     vehicleMap.insert({opponentId, veh});
 }
@@ -31,43 +42,241 @@ OpponentManager &OpponentManager::getInstance() {
     return instance;
 }
 
-void OpponentManager::updateOpponentState(const uint16_t clientId, const char *state) {
-    const auto vehicle = vehicleMap.find(clientId);
+void OpponentManager::enqueueUpdate(const OpponentUpdate &update) {
+    flushOverflow();
 
-    if (vehicle == vehicleMap.end()) {
+    /* Anything still waiting in overflow is older, pushing past it would reorder the opponent's updates */
+    if (overflowCount == 0 && updateRing.tryPush(update))
         return;
+
+    for (size_t i = 0; i < overflowCount; ++i) {
+        if (overflow[i].clientId == update.clientId) {
+            if (update.serverTimeUs >= overflow[i].serverTimeUs)
+                overflow[i] = update;
+            return;
+        }
     }
 
-    btTransform transform;
-    float velocityData[3];
-    btScalar steeringAngle;
-    ClientInputs inputs;
+    if (overflowCount < OVERFLOW_SLOTS)
+        overflow[overflowCount++] = update;
+}
 
-    btTransformFloatData transformData{};
+void OpponentManager::flushOverflow() {
+    size_t pushed = 0;
+    while (pushed < overflowCount && updateRing.tryPush(overflow[pushed]))
+        pushed++;
 
-    std::memcpy(&transformData, state, sizeof(transformData));
-    std::memcpy(&velocityData, state + sizeof(transformData), sizeof(velocityData));
-    std::memcpy(&steeringAngle, state + sizeof(transformData) + sizeof(velocityData), sizeof(steeringAngle));
-    std::memcpy(&inputs, state + STATE_PAYLOAD_SIZE - sizeof(inputs), sizeof(inputs));
+    if (pushed == 0)
+        return;
 
-    transform.deSerialize(transformData);
-    const auto velocity = btVector3(velocityData[0], velocityData[1], velocityData[2]);
+    std::move(overflow.begin() + pushed, overflow.begin() + overflowCount, overflow.begin());
+    overflowCount -= pushed;
+}
 
-    const auto btVehicle = vehicle->second->getBtVehicle();
+void OpponentManager::drainUpdates() {
+    auto &latencyTracer = LatencyTracer::getInstance();
 
-    auto *motionState = dynamic_cast<btDefaultMotionState *>(vehicle->second->
-        getBtChassis()->getMotionState());
+    OpponentUpdate update;
+    while (updateRing.tryPop(update)) {
+        auto &remote = remoteVehicles[update.clientId];
+        remote.snapshots.push({update.serverTimeUs, update.state});
+        interpolationDelay.onSnapshotArrived(update.serverTimeUs, update.arrivalUs);
+        latencyTracer.onStateReceived(update.trace, update.traceReceivedUs);
 
-    if (motionState) {
-        motionState->setWorldTransform(transform);
+        /* Only the newest state matters, it already contains everything that happened before it */
+        if (rollbackEnabled && update.serverTimeUs > remote.confirmed.serverTimeUs &&
+            (!remote.pending || update.serverTimeUs > remote.pending->serverTimeUs)) {
+            remote.pending = VehicleSnapshot{update.serverTimeUs, update.state};
+            remote.pendingInputs = {
+                .newestUs = update.serverTimeUs,
+                .periodUs = 1'000'000 / StateUploader::UPLOAD_RATE,
+                .samples = update.recentInputs
+            };
+        }
     }
 
-    btVehicle->getRigidBody()->setWorldTransform(transform);
-    btVehicle->getRigidBody()->setLinearVelocity(velocity);
-    btVehicle->setSteeringValue(steeringAngle, 0);
-    btVehicle->setSteeringValue(steeringAngle, 1);
+    if (rollbackEnabled)
+        reconcileOpponents();
+}
+
+void OpponentManager::reconcileOpponents() {
+    const auto &clockSync = ClockSync::getInstance();
+    const bool synchronized = clockSync.isSynchronized();
+    const auto serverNowUs = clockSync.serverTimeUs();
+
+    dueCorrections.clear();
+    for (const auto &[clientId, remote]: remoteVehicles) {
+        if (remote.pending && vehicleMap.contains(clientId))
+            dueCorrections.emplace_back(remote.pending->serverTimeUs, clientId);
+    }
+    std::ranges::sort(dueCorrections);
+
+    int budget = rollbackStepBudget;
+    for (const auto [timeUs, clientId]: dueCorrections) {
+        auto &remote = remoteVehicles[clientId];
+        auto &vehicle = *vehicleMap[clientId];
+        const auto snapshot = *remote.pending;
+
+        /* Without a clock there is no telling how old the state is, take it as it is */
+        if (!synchronized) {
+            hardCorrectOpponent(clientId, vehicle, remote, 0);
+            continue;
+        }
+
+        if (timeUs > serverNowUs) {
+            hardCorrectOpponent(clientId, vehicle, remote, serverNowUs);
+            continue;
+        }
+
+        if (!remote.history.predicted(timeUs, snapshot.state, remote.confirmed.serverTimeUs, remote.pendingInputs)) {
+            const int steps = RollbackWorld::countSteps(remote.history, timeUs);
 
-    inputsMap[clientId] = inputs;
+            /* Too far behind to ever fit, replaying it would stall every frame after */
+            if (steps > rollbackStepBudget || remote.history.size() == 0) {
+                hardCorrectOpponent(clientId, vehicle, remote, serverNowUs);
+                continue;
+            }
+
+            if (steps > budget)
+                continue;
+
+            if (const auto groundShape = Physics::getInstance().getGroundShape();
+                !rollbackWorld || rollbackWorld->getGroundShape() != groundShape)
+                rollbackWorld = std::make_unique<RollbackWorld>(groundShape);
+
+            const SimulatedState from = {
+                .transform = snapshot.state.transform,
+                .linearVelocity = snapshot.state.velocity,
+                .angularVelocity = DeadReckoning::angularVelocity(remote.confirmed, snapshot),
+                .steering = snapshot.state.steeringAngle
+            };
+
+            const auto before = captureState(vehicle);
+            budget -= rollbackWorld->resimulate(vehicle.getConfig(), from, timeUs, snapshot.state.inputs,
+                                                remote.history);
+
+            const auto &history = remote.history;
+            const auto &corrected = history.firstAfter(timeUs) < history.size()
+                                        ? history.at(history.size() - 1).state
+                                        : from;
+
+            restoreState(vehicle, corrected);
+            remote.smoother.addError(before.transform, corrected.transform);
+        }
+
+        remote.confirmed = snapshot;
+        remote.pending.reset();
+        inputsMap[clientId] = snapshot.state.inputs;
+        /* The step about to run is already driven by the confirmed inputs, steering is left as restored */
+        applyInputs(vehicle, snapshot.state.inputs, 0.0f);
+    }
+}
+
+void OpponentManager::hardCorrectOpponent(const uint16_t clientId, Vehicle &vehicle, RemoteVehicle &remote,
+                                          const uint64_t serverNowUs) {
+    const auto snapshot = *remote.pending;
+    const auto aheadUs = serverNowUs > snapshot.serverTimeUs ? serverNowUs - snapshot.serverTimeUs : 0;
+    const auto state = DeadReckoning::extrapolate(&remote.confirmed, snapshot, std::min(aheadUs, maxExtrapolationUs));
+
+    const auto before = captureState(vehicle);
+    restoreState(vehicle, {
+                     .transform = state.transform,
+                     .linearVelocity = state.velocity,
+                     .angularVelocity = DeadReckoning::angularVelocity(remote.confirmed, snapshot),
+                     .steering = state.steeringAngle
+                 });
+    remote.smoother.addError(before.transform, state.transform);
+
+    remote.history.clear();
+    remote.confirmed = snapshot;
+    remote.pending.reset();
+    inputsMap[clientId] = snapshot.state.inputs;
+    applyInputs(vehicle, snapshot.state.inputs, 0.0f);
+}
+
+void OpponentManager::recordOpponentFrames(const float dt) {
+    const auto &clockSync = ClockSync::getInstance();
+    const bool synchronized = clockSync.isSynchronized();
+    const auto serverNowUs = clockSync.serverTimeUs();
+
+    for (const auto &[clientId, vehicle]: vehicleMap) {
+        auto &remote = remoteVehicles[clientId];
+        const auto inputs = inputsMap.contains(clientId) ? inputsMap[clientId] : ClientInputs{0};
+        const auto state = captureState(*vehicle);
+
+        /* Frames stamped before the clock settled can't be matched against confirmed states */
+        if (synchronized)
+            remote.history.push({serverNowUs, inputs, state});
+        else
+            remote.history.clear();
+
+        /* Only the drawn pose is smoothed, the body keeps the simulated one */
+        remote.smoother.update(dt);
+        vehicle->setRenderTransform(remote.smoother.apply(vehicle->getRenderTransform()));
+    }
+}
+
+void OpponentManager::interpolateOpponents(const float dt) {
+    if (rollbackEnabled) {
+        recordOpponentFrames(dt);
+        return;
+    }
+
+    const auto &clockSync = ClockSync::getInstance();
+    const bool synchronized = clockSync.isSynchronized();
+    const auto serverNowUs = clockSync.serverTimeUs();
+
+    interpolationDelay.update(dt);
+    const auto delayUs = interpolationDelay.getDelayUs();
+
+    for (const auto &[clientId, vehicle]: vehicleMap) {
+        const auto remote = remoteVehicles.find(clientId);
+        if (remote == remoteVehicles.end())
+            continue;
+
+        auto &remoteVehicle = remote->second;
+        remoteVehicle.smoother.update(dt);
+
+        /* Without a clock estimate all we can do is trail the newest snapshot, smooth only on a perfect network */
+        const auto renderTimeUs = (synchronized ? serverNowUs : remoteVehicle.snapshots.newestTimeUs()) - delayUs;
+
+        VehicleState state;
+        const auto result = remoteVehicle.snapshots.sample(renderTimeUs, maxExtrapolationUs, state);
+        if (result == SnapshotBuffer::SampleResult::Empty)
+            continue;
+
+        /* Newer snapshots replaced the guess we were drawing, blend from the guess instead of jumping */
+        if (remoteVehicle.extrapolatedFromUs != 0 &&
+            remoteVehicle.extrapolatedFromUs != remoteVehicle.snapshots.newestTimeUs()) {
+            VehicleState guess;
+            if (remoteVehicle.snapshots.extrapolateFrom(remoteVehicle.extrapolatedFromUs, renderTimeUs,
+                                                        maxExtrapolationUs, guess))
+                remoteVehicle.smoother.addError(guess.transform, state.transform);
+        }
+
+        const bool extrapolated = result == SnapshotBuffer::SampleResult::Extrapolated ||
+                                  result == SnapshotBuffer::SampleResult::Held;
+        remoteVehicle.extrapolatedFromUs = extrapolated ? remoteVehicle.snapshots.newestTimeUs() : 0;
+
+        const auto transform = remoteVehicle.smoother.apply(state.transform);
+
+        const auto btVehicle = vehicle->getBtVehicle();
+        const auto body = btVehicle->getRigidBody();
+
+        /* Kinematic bodies are moved through their motion state, the body transform is set
+         * as well so the frame about to be drawn doesn't have to wait for the next step */
+        body->getMotionState()->setWorldTransform(transform);
+        body->setWorldTransform(transform);
+        body->setLinearVelocity(state.velocity);
+        vehicle->setRenderTransform(transform);
+
+        btVehicle->setSteeringValue(state.steeringAngle, 0);
+        btVehicle->setSteeringValue(state.steeringAngle, 1);
+        for (int i = 0; i < btVehicle->getNumWheels(); ++i)
+            btVehicle->updateWheelTransform(i, true);
+
+        inputsMap[clientId] = state.inputs;
+    }
 }
 
 void OpponentManager::addNewOpponent(const uint16_t &opponentId, const uint8_t gridPositionIndex,
@@ -93,15 +302,7 @@ void OpponentManager::applyLastInputs(const float dt) {
         if (inputBitmapIterator == inputsMap.end())
             continue;
 
-        const auto inputBitmap = inputBitmapIterator->second;
-
-        const auto forward = (inputBitmap & INPUT_THROTTLE) > 0;
-        const auto backward = (inputBitmap & INPUT_BRAKE) > 0;
-        const auto handbrake = (inputBitmap & INPUT_HANDBRAKE) > 0;
-        const auto left = (inputBitmap & INPUT_LEFT) > 0;
-        const auto right = (inputBitmap & INPUT_RIGHT) > 0;
-
-        vehicle->updateControls(forward, backward, handbrake, left, right, dt);
+        applyInputs(*vehicle, inputBitmapIterator->second, dt);
     }
 }
 
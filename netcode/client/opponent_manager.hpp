@@ -1,16 +1,72 @@
 #pragma once
+#include <array>
 #include <map>
 #include <memory>
+#include <optional>
 
+#include "dead_reckoning.hpp"
+#include "rollback.hpp"
+#include "snapshot_interpolation.hpp"
 #include "vehicle.hpp"
 #include "netcode/shared/client_inputs.hpp"
+#include "netcode/shared/latency_trace.hpp"
 #include "netcode/shared/opponent_info.hpp"
+#include "netcode/shared/utils/spsc_ring.hpp"
+
+/* One decoded opponent state on its way from the UDP thread to the main thread */
+struct OpponentUpdate {
+    uint16_t clientId;
+    uint64_t serverTimeUs;
+    /* Local monotonicTimeUs, for the jitter estimate */
+    uint64_t arrivalUs;
+    VehicleState state;
+    LatencyTrace trace;
+    uint32_t traceReceivedUs;
+    /* Newest first, see StatePacket::recentInputs */
+    std::array<InputSample, INPUT_REDUNDANCY> recentInputs;
+};
+
+/* Main thread view of one opponent's network state */
+struct RemoteVehicle {
+    SnapshotBuffer snapshots;
+    PoseSmoother smoother;
+    /* Newest snapshot the last frame was extrapolated from, 0 while interpolating */
+    uint64_t extrapolatedFromUs = 0;
+
+    /* Rollback mode. The newest state already simulated from and the newest one still waiting for budget. */
+    RollbackHistory history;
+    VehicleSnapshot confirmed{};
+    std::optional<VehicleSnapshot> pending;
+    ConfirmedInputs pendingInputs;
+};
 
 class OpponentManager {
+    /* Several seconds of updates for a full room, only a main thread stall long enough to matter fills it */
+    static constexpr size_t UPDATE_RING_CAPACITY = 512;
+    static constexpr size_t OVERFLOW_SLOTS = 32;
+
     std::vector<std::pair<uint16_t, VehicleConfig> > vehiclesToCreate;
     std::map<uint16_t, std::shared_ptr<Vehicle> > vehicleMap;
     std::map<uint16_t, ClientInputs> inputsMap;
 
+    /* The only state shared with the UDP thread */
+    SpscRing<OpponentUpdate, UPDATE_RING_CAPACITY> updateRing;
+
+    /* UDP thread only. Newest update per opponent that didn't fit into the ring, pushed before anything else. */
+    std::array<OpponentUpdate, OVERFLOW_SLOTS> overflow{};
+    size_t overflowCount = 0;
+
+    /* Main thread only */
+    std::map<uint16_t, RemoteVehicle> remoteVehicles;
+    InterpolationDelay interpolationDelay;
+    const uint64_t maxExtrapolationUs = DeadReckoning::maxExtrapolationFromEnv();
+
+    /* Rollback mode, opponents are simulated in the main world from their last confirmed inputs */
+    const bool rollbackEnabled = RollbackWorld::enabledFromEnv();
+    const int rollbackStepBudget = RollbackWorld::stepBudgetFromEnv();
+    std::unique_ptr<RollbackWorld> rollbackWorld;
+    std::vector<std::pair<uint64_t, uint16_t> > dueCorrections;
+
     bool openglReady = false;
 
     OpponentManager() = default;
@@ -19,6 +75,15 @@ class OpponentManager {
 
     void createOpponentVehicle(uint16_t opponentId, const VehicleConfig &config);
 
+    /* Rolls back opponents whose confirmed state differs from what was predicted, oldest correction first,
+     * until the step budget of the frame is spent. The rest wait for the next frame. */
+    void reconcileOpponents();
+
+    /* Dead reckons the confirmed state to now and drops the history, for corrections that can't be replayed */
+    void hardCorrectOpponent(uint16_t clientId, Vehicle &vehicle, RemoteVehicle &remote, uint64_t serverNowUs);
+
+    void recordOpponentFrames(float dt);
+
 public:
     static OpponentManager &getInstance();
 
@@ -30,11 +95,26 @@ public:
 
     OpponentManager &operator=(OpponentManager &&) = delete;
 
-    void updateOpponentState(uint16_t clientId, const char *state);
+    /* UDP thread. Never blocks and never allocates, when the ring is full only the newest
+     * update of each opponent is kept until there is room again. */
+    void enqueueUpdate(const OpponentUpdate &update);
+
+    /* UDP thread, retries pushing overflowed updates when no new ones arrive */
+    void flushOverflow();
+
+    /* Main thread, once per frame before the physics step. In rollback mode also corrects mispredicted opponents. */
+    void drainUpdates();
+
+    /* Moves every opponent to where it was the interpolation delay ago on the server's timeline, dead reckoned
+     * when its snapshots are late. In rollback mode records the frame the opponents were just simulated through
+     * instead. Call once per frame after the physics step and VehicleManager::updateRenderTransforms, the drawn
+     * poses set here replace the blended ones. */
+    void interpolateOpponents(float dt);
 
     void addNewOpponent(const uint16_t &opponentId, uint8_t gridPositionIndex, const PlayerVehicleColor &vehicleColor,
                         const std::string &nickname);
 
+    /* Physics pre tick callback, once per fixed step */
     void applyLastInputs(float dt);
 
     void setOpenGLReady();
@@ -0,0 +1,226 @@
+#include "rollback.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "netcode/shared/logger.hpp"
+
+SimulatedState captureState(const Vehicle &vehicle) {
+    const auto body = vehicle.getBtChassis();
+
+    return {
+        .transform = body->getCenterOfMassTransform(),
+        .linearVelocity = body->getLinearVelocity(),
+        .angularVelocity = body->getAngularVelocity(),
+        .steering = vehicle.getSteering()
+    };
+}
+
+void restoreState(Vehicle &vehicle, const SimulatedState &state) {
+    vehicle.restoreState(state.transform, state.linearVelocity, state.angularVelocity, state.steering);
+}
+
+void applyInputs(Vehicle &vehicle, const ClientInputs inputs, const float dt) {
+    const auto forward = (inputs & INPUT_THROTTLE) > 0;
+    const auto backward = (inputs & INPUT_BRAKE) > 0;
+    const auto handbrake = (inputs & INPUT_HANDBRAKE) > 0;
+    const auto left = (inputs & INPUT_LEFT) > 0;
+    const auto right = (inputs & INPUT_RIGHT) > 0;
+
+    vehicle.updateControls(forward, backward, handbrake, left, right, dt);
+}
+
+std::optional<ClientInputs> ConfirmedInputs::at(const uint64_t timeUs) const {
+    if (timeUs > newestUs || periodUs == 0)
+        return std::nullopt;
+
+    /* Samples are taken at the end of the ticks they were held through */
+    const auto ticksBefore = (newestUs - timeUs) / periodUs;
+    if (ticksBefore >= INPUT_REDUNDANCY)
+        return std::nullopt;
+
+    const auto frame = samples[0].frame - static_cast<uint32_t>(ticksBefore);
+    for (const auto &sample: samples) {
+        if (sample.frame == frame)
+            return sample.inputs;
+    }
+
+    return std::nullopt;
+}
+
+void RollbackHistory::push(const RollbackFrame &frame) {
+    if (count == CAPACITY) {
+        head = (head + 1) % CAPACITY;
+        count--;
+    }
+
+    at(count) = frame;
+    count++;
+}
+
+size_t RollbackHistory::size() const {
+    return count;
+}
+
+const RollbackFrame &RollbackHistory::at(const size_t index) const {
+    return frames[(head + index) % CAPACITY];
+}
+
+RollbackFrame &RollbackHistory::at(const size_t index) {
+    return frames[(head + index) % CAPACITY];
+}
+
+size_t RollbackHistory::firstAfter(const uint64_t timeUs) const {
+    /* Confirmed states are a round trip old, a few dozen frames at most, search from the back */
+    size_t i = count;
+    while (i > 0 && at(i - 1).serverTimeUs > timeUs)
+        i--;
+    return i;
+}
+
+bool RollbackHistory::predicted(const uint64_t timeUs, const VehicleState &confirmed, const uint64_t sinceUs,
+                                const ConfirmedInputs &inputs) const {
+    const auto first = firstAfter(timeUs);
+    if (first == 0)
+        return false;
+
+    for (size_t i = firstAfter(sinceUs); i < first; ++i) {
+        const auto held = inputs.at(at(i).serverTimeUs);
+        if (held && *held != at(i).inputs)
+            return false;
+    }
+
+    for (size_t i = first; i < count; ++i) {
+        if (at(i).inputs != confirmed.inputs)
+            return false;
+    }
+
+    /* The frame ending just before the confirmed state, moved forward to its time */
+    const auto &[frameTimeUs, inputs, state] = at(first - 1);
+    const auto sinceUs = static_cast<btScalar>(timeUs - frameTimeUs) * btScalar(1e-6);
+    const auto position = state.transform.getOrigin() + state.linearVelocity * sinceUs;
+
+    return position.distance(confirmed.transform.getOrigin()) <= POSITION_TOLERANCE &&
+           state.linearVelocity.distance(confirmed.velocity) <= VELOCITY_TOLERANCE &&
+           state.transform.getRotation().angleShortestPath(confirmed.transform.getRotation()) <= ROTATION_TOLERANCE;
+}
+
+void RollbackHistory::clear() {
+    head = 0;
+    count = 0;
+}
+
+RollbackWorld::RollbackWorld(btCollisionShape *groundShape) {
+    collisionConfig = std::make_unique<btDefaultCollisionConfiguration>();
+    dispatcher = std::make_unique<btCollisionDispatcher>(collisionConfig.get());
+    /* Two bodies, a sweep would be wasted on them */
+    broadphase = std::make_unique<btSimpleBroadphase>();
+    solver = std::make_unique<btSequentialImpulseConstraintSolver>();
+    world = std::make_unique<btDiscreteDynamicsWorld>(dispatcher.get(), broadphase.get(), solver.get(),
+                                                      collisionConfig.get());
+    world->setGravity(btVector3(0, -9.81f, 0));
+
+    /* The BVH is shared with the main world, it is never modified after loading */
+    groundMotion = std::make_unique<btDefaultMotionState>(btTransform::getIdentity());
+    const btRigidBody::btRigidBodyConstructionInfo groundCI(0.0f, groundMotion.get(), groundShape);
+    ground = std::make_unique<btRigidBody>(groundCI);
+    world->addRigidBody(ground.get());
+}
+
+RollbackWorld::~RollbackWorld() {
+    proxy.reset();
+    VehicleFactory::getInstance().releaseWorld(world.get());
+    world->removeRigidBody(ground.get());
+}
+
+const btCollisionShape *RollbackWorld::getGroundShape() const {
+    return ground->getCollisionShape();
+}
+
+int RollbackWorld::countSteps(const RollbackHistory &history, const uint64_t fromUs) {
+    int steps = 0;
+    auto previousUs = fromUs;
+
+    for (size_t i = history.firstAfter(fromUs); i < history.size(); ++i) {
+        steps += stepsFor(history.at(i).serverTimeUs - previousUs);
+        previousUs = history.at(i).serverTimeUs;
+    }
+
+    return steps;
+}
+
+int RollbackWorld::resimulate(const VehicleConfig &config, const SimulatedState &from, const uint64_t fromUs,
+                              const ClientInputs inputs, RollbackHistory &history) {
+    if (!proxy) {
+        proxy = std::make_unique<Vehicle>(config, nullptr, world.get());
+        proxy->addToWorld();
+    }
+
+    restoreState(*proxy, from);
+
+    int steps = 0;
+    auto previousUs = fromUs;
+
+    for (size_t i = history.firstAfter(fromUs); i < history.size(); ++i) {
+        auto &frame = history.at(i);
+
+        const int frameSteps = stepsFor(frame.serverTimeUs - previousUs);
+        if (frameSteps > 0) {
+            const auto step = static_cast<btScalar>(frame.serverTimeUs - previousUs) * btScalar(1e-6) / frameSteps;
+
+            for (int s = 0; s < frameSteps; ++s) {
+                applyInputs(*proxy, inputs, step);
+                /* Exactly one step of the given length, no interpolation */
+                world->stepSimulation(step, 0);
+            }
+        }
+
+        frame.inputs = inputs;
+        frame.state = captureState(*proxy);
+
+        steps += frameSteps;
+        previousUs = frame.serverTimeUs;
+    }
+
+    return steps;
+}
+
+bool RollbackWorld::enabledFromEnv() {
+    const char *value = std::getenv("NFSPUT_OPPONENT_SYNC");
+    if (!value || !*value || std::strcmp(value, "interpolation") == 0)
+        return false;
+
+    if (std::strcmp(value, "rollback") == 0)
+        return true;
+
+    LOG_WARN("Unknown NFSPUT_OPPONENT_SYNC {}, interpolating opponents", value);
+    return false;
+}
+
+int RollbackWorld::stepBudgetFromEnv() {
+    const char *value = std::getenv("NFSPUT_ROLLBACK_BUDGET");
+    if (!value || !*value)
+        return DEFAULT_STEP_BUDGET;
+
+    char *end;
+    const auto steps = std::strtol(value, &end, 10);
+    if (*end != '\0' || steps <= 0 || steps > 10'000) {
+        LOG_WARN("Ignoring invalid NFSPUT_ROLLBACK_BUDGET {}", value);
+        return DEFAULT_STEP_BUDGET;
+    }
+
+    return static_cast<int>(steps);
+}
+
+int RollbackWorld::stepsFor(const uint64_t spanUs) {
+    /* Frames closer than this are only clock slew, their state is the previous one */
+    constexpr uint64_t minSpanUs = 100;
+    /* Long gaps between recorded frames are split into steps no longer than the main world's fixed one */
+    const auto maxStepUs = static_cast<uint64_t>(Physics::getInstance().getFixedTimeStep() * 1e6);
+
+    if (spanUs < minSpanUs)
+        return 0;
+
+    return static_cast<int>((spanUs + maxStepUs - 1) / maxStepUs);
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#include "vehicle.hpp"
+#include "netcode/shared/client_inputs.hpp"
+#include "netcode/shared/vehicle_state.hpp"
+#include "netcode/shared/packets/udp/client/state_packet.hpp"
+
+/* Everything needed to put a simulated car back where it was */
+struct SimulatedState {
+    btTransform transform;
+    btVector3 linearVelocity;
+    btVector3 angularVelocity;
+    btScalar steering;
+};
+
+SimulatedState captureState(const Vehicle &vehicle);
+
+void restoreState(Vehicle &vehicle, const SimulatedState &state);
+
+/* Sets the controls a client's input bitmap asks for, the same way for the main world and the proxy */
+void applyInputs(Vehicle &vehicle, ClientInputs inputs, float dt);
+
+/* One local frame of a remote vehicle, state is where the physics step that ended at serverTimeUs left it
+ * and inputs are what drove it there */
+struct RollbackFrame {
+    uint64_t serverTimeUs;
+    ClientInputs inputs;
+    SimulatedState state;
+};
+
+/* The input samples a remote vehicle sent with a confirmed state, put on the server's timeline. The newest one is
+ * the confirmed state's own and is held up to newestUs, every older one a sender upload tick before it. */
+struct ConfirmedInputs {
+    uint64_t newestUs = 0;
+    uint64_t periodUs = 0;
+    /* Newest first */
+    std::array<InputSample, INPUT_REDUNDANCY> samples{};
+
+    /* What the sender held through the frame that ended at timeUs, nullopt when no sample covers it */
+    [[nodiscard]]
+    std::optional<ClientInputs> at(uint64_t timeUs) const;
+};
+
+/* The last few hundred milliseconds of a remote vehicle's frames, oldest first. Full history drops the oldest. */
+class RollbackHistory {
+public:
+    static constexpr size_t CAPACITY = 128;
+
+    /* Difference between a confirmed state and our prediction of it that is still not worth a rollback */
+    static constexpr btScalar POSITION_TOLERANCE = btScalar(0.05);
+    static constexpr btScalar VELOCITY_TOLERANCE = btScalar(0.25);
+    static constexpr btScalar ROTATION_TOLERANCE = btScalar(0.01);
+
+    void push(const RollbackFrame &frame);
+
+    [[nodiscard]]
+    size_t size() const;
+
+    [[nodiscard]]
+    const RollbackFrame &at(size_t index) const;
+
+    RollbackFrame &at(size_t index);
+
+    /* Index of the first frame that ended after timeUs, size() if there is none */
+    [[nodiscard]]
+    size_t firstAfter(uint64_t timeUs) const;
+
+    /* True if the frames around timeUs agree with the confirmed state, every frame since sinceUs was driven with
+     * what the sender actually held and every later frame with the confirmed inputs. A frame driven with the wrong
+     * inputs is an error still within tolerance that only grows, so it is corrected right away. */
+    [[nodiscard]]
+    bool predicted(uint64_t timeUs, const VehicleState &confirmed, uint64_t sinceUs,
+                   const ConfirmedInputs &inputs) const;
+
+    void clear();
+
+private:
+    std::array<RollbackFrame, CAPACITY> frames{};
+    /* Index of the oldest frame */
+    size_t head = 0;
+    size_t count = 0;
+};
+
+/* Isolated world holding only the track and one proxy car. Remote vehicles are re-simulated here so rolling
+ * one of them back doesn't disturb the rest of the main world, and nothing but the ground is raycast against. */
+class RollbackWorld {
+public:
+    static constexpr int DEFAULT_STEP_BUDGET = 96;
+
+    explicit RollbackWorld(btCollisionShape *groundShape);
+
+    ~RollbackWorld();
+
+    RollbackWorld(const RollbackWorld &) = delete;
+
+    RollbackWorld &operator=(const RollbackWorld &) = delete;
+
+    /* The track shape it was built on, a world built before a track swap has to be replaced */
+    [[nodiscard]]
+    const btCollisionShape *getGroundShape() const;
+
+    /* Steps resimulate() takes to bring a state from fromUs to the newest frame */
+    [[nodiscard]]
+    static int countSteps(const RollbackHistory &history, uint64_t fromUs);
+
+    /* Puts the proxy car at the confirmed state and drives it through every frame after fromUs with the
+     * confirmed inputs held, overwriting the states and inputs of those frames. Returns the steps taken. */
+    int resimulate(const VehicleConfig &config, const SimulatedState &from, uint64_t fromUs, ClientInputs inputs,
+                   RollbackHistory &history);
+
+    /* NFSPUT_OPPONENT_SYNC=rollback */
+    static bool enabledFromEnv();
+
+    /* NFSPUT_ROLLBACK_BUDGET, re-simulated steps allowed per frame for all opponents together */
+    static int stepBudgetFromEnv();
+
+private:
+    std::unique_ptr<btDefaultCollisionConfiguration> collisionConfig;
+    std::unique_ptr<btCollisionDispatcher> dispatcher;
+    std::unique_ptr<btBroadphaseInterface> broadphase;
+    std::unique_ptr<btSequentialImpulseConstraintSolver> solver;
+    std::unique_ptr<btDiscreteDynamicsWorld> world;
+
+    std::unique_ptr<btDefaultMotionState> groundMotion;
+    std::unique_ptr<btRigidBody> ground;
+
+    /* Created on first use from the config of the vehicle being rolled back */
+    std::unique_ptr<Vehicle> proxy;
+
+    static int stepsFor(uint64_t spanUs);
+};
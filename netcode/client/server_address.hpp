@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdlib>
+
+#define SERVER_IP "127.0.0.1"
+#define SERVER_PORT "1313"
+
+/* NFSPUT_SERVER_HOST and NFSPUT_SERVER_PORT override where the game connects, e.g. to go through nfsput_netem */
+inline const char *getServerHost() {
+    const char *host = std::getenv("NFSPUT_SERVER_HOST");
+    return host && *host ? host : SERVER_IP;
+}
+
+inline const char *getServerPort() {
+    const char *port = std::getenv("NFSPUT_SERVER_PORT");
+    return port && *port ? port : SERVER_PORT;
+}
@@ -0,0 +1,180 @@
+#include "snapshot_interpolation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "dead_reckoning.hpp"
+#include "netcode/shared/logger.hpp"
+
+bool SnapshotBuffer::push(const VehicleSnapshot &snapshot) {
+    const auto time = snapshot.serverTimeUs;
+    if (count == CAPACITY && time < at(0).serverTimeUs)
+        return false;
+
+    size_t position = count;
+    while (position > 0 && at(position - 1).serverTimeUs > time)
+        position--;
+
+    if (position > 0 && at(position - 1).serverTimeUs == time)
+        return false;
+
+    if (count == CAPACITY) {
+        head = (head + 1) % CAPACITY;
+        count--;
+        position--;
+    }
+
+    for (size_t i = count; i > position; --i)
+        at(i) = at(i - 1);
+
+    at(position) = snapshot;
+    count++;
+    return true;
+}
+
+SnapshotBuffer::SampleResult SnapshotBuffer::sample(const uint64_t renderTimeUs, const uint64_t maxExtrapolationUs,
+                                                    VehicleState &out) const {
+    if (count == 0)
+        return SampleResult::Empty;
+
+    if (renderTimeUs <= at(0).serverTimeUs) {
+        out = at(0).state;
+        return SampleResult::BeforeOldest;
+    }
+
+    if (renderTimeUs >= at(count - 1).serverTimeUs) {
+        const auto aheadUs = renderTimeUs - at(count - 1).serverTimeUs;
+        const auto *previous = count >= 2 ? &at(count - 2) : nullptr;
+
+        out = DeadReckoning::extrapolate(previous, at(count - 1), std::min(aheadUs, maxExtrapolationUs));
+        return aheadUs <= maxExtrapolationUs ? SampleResult::Extrapolated : SampleResult::Held;
+    }
+
+    /* The render time trails the newest snapshot by a few ticks, search from the back */
+    size_t i = count - 1;
+    while (at(i - 1).serverTimeUs > renderTimeUs)
+        i--;
+
+    out = interpolate(at(i - 1), at(i), renderTimeUs);
+    return SampleResult::Interpolated;
+}
+
+bool SnapshotBuffer::extrapolateFrom(const uint64_t baseTimeUs, const uint64_t renderTimeUs,
+                                     const uint64_t maxExtrapolationUs, VehicleState &out) const {
+    size_t i = count;
+    while (i > 0 && at(i - 1).serverTimeUs > baseTimeUs)
+        i--;
+
+    if (i == 0 || at(i - 1).serverTimeUs != baseTimeUs || renderTimeUs < baseTimeUs)
+        return false;
+
+    const auto *previous = i >= 2 ? &at(i - 2) : nullptr;
+    out = DeadReckoning::extrapolate(previous, at(i - 1), std::min(renderTimeUs - baseTimeUs, maxExtrapolationUs));
+    return true;
+}
+
+size_t SnapshotBuffer::size() const {
+    return count;
+}
+
+uint64_t SnapshotBuffer::newestTimeUs() const {
+    return count == 0 ? 0 : at(count - 1).serverTimeUs;
+}
+
+void SnapshotBuffer::clear() {
+    head = 0;
+    count = 0;
+}
+
+const VehicleSnapshot &SnapshotBuffer::at(const size_t index) const {
+    return snapshots[(head + index) % CAPACITY];
+}
+
+VehicleSnapshot &SnapshotBuffer::at(const size_t index) {
+    return snapshots[(head + index) % CAPACITY];
+}
+
+VehicleState SnapshotBuffer::interpolate(const VehicleSnapshot &from, const VehicleSnapshot &to,
+                                         const uint64_t renderTimeUs) {
+    const auto spanUs = static_cast<btScalar>(to.serverTimeUs - from.serverTimeUs);
+    const btScalar span = spanUs * btScalar(1e-6);
+    const btScalar u = static_cast<btScalar>(renderTimeUs - from.serverTimeUs) / spanUs;
+
+    const btScalar u2 = u * u;
+    const btScalar u3 = u2 * u;
+
+    /* Cubic Hermite basis and its derivative, velocities are scaled to the snapshot span */
+    const btScalar h00 = 2 * u3 - 3 * u2 + 1;
+    const btScalar h10 = u3 - 2 * u2 + u;
+    const btScalar h01 = -2 * u3 + 3 * u2;
+    const btScalar h11 = u3 - u2;
+
+    const btScalar d00 = 6 * u2 - 6 * u;
+    const btScalar d10 = 3 * u2 - 4 * u + 1;
+    const btScalar d01 = -6 * u2 + 6 * u;
+    const btScalar d11 = 3 * u2 - 2 * u;
+
+    const auto &p0 = from.state.transform.getOrigin();
+    const auto &p1 = to.state.transform.getOrigin();
+    const auto &v0 = from.state.velocity;
+    const auto &v1 = to.state.velocity;
+
+    VehicleState state;
+    state.transform.setOrigin(p0 * h00 + v0 * (h10 * span) + p1 * h01 + v1 * (h11 * span));
+    state.transform.setRotation(from.state.transform.getRotation().slerp(to.state.transform.getRotation(), u));
+    state.velocity = (p0 * d00 + p1 * d01) / span + v0 * d10 + v1 * d11;
+    state.steeringAngle = from.state.steeringAngle + (to.state.steeringAngle - from.state.steeringAngle) * u;
+    state.inputs = u < btScalar(0.5) ? from.state.inputs : to.state.inputs;
+
+    return state;
+}
+
+InterpolationDelay::InterpolationDelay() {
+    if (const char *value = std::getenv("NFSPUT_INTERPOLATION_DELAY_MS"); value && *value) {
+        char *end;
+        const auto ms = std::strtoul(value, &end, 10);
+
+        if (*end == '\0' && ms > 0 && ms * 1000 <= MAX_DELAY_US)
+            baseDelayUs = ms * 1000;
+        else
+            LOG_WARN("Ignoring invalid NFSPUT_INTERPOLATION_DELAY_MS {}", value);
+    }
+
+    currentDelayUs = static_cast<double>(baseDelayUs);
+}
+
+void InterpolationDelay::onSnapshotArrived(const uint64_t serverTimeUs, const uint64_t arrivalUs) {
+    /* States of one tick arrive in several datagrams, only the first one says something about the network */
+    if (serverTimeUs <= lastServerTimeUs)
+        return;
+
+    const auto transitUs = static_cast<int64_t>(arrivalUs - serverTimeUs);
+    if (lastServerTimeUs != 0) {
+        const auto deviation = static_cast<double>(std::abs(transitUs - lastTransitUs));
+        jitterUs += (deviation - jitterUs) / 16.0;
+    }
+
+    lastServerTimeUs = serverTimeUs;
+    lastTransitUs = transitUs;
+}
+
+void InterpolationDelay::update(const float dt) {
+    const double maxStep = MAX_RATE_CHANGE * dt * 1e6;
+    const auto target = static_cast<double>(getTargetDelayUs());
+
+    currentDelayUs += std::clamp(target - currentDelayUs, -maxStep, maxStep);
+}
+
+uint64_t InterpolationDelay::getDelayUs() const {
+    return std::llround(currentDelayUs);
+}
+
+uint64_t InterpolationDelay::getTargetDelayUs() const {
+    const auto target = static_cast<double>(baseDelayUs) + JITTER_MULTIPLIER * jitterUs;
+    return std::min(MAX_DELAY_US, static_cast<uint64_t>(target));
+}
+
+double InterpolationDelay::getJitterUs() const {
+    return jitterUs;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+#include "netcode/shared/vehicle_state.hpp"
+
+struct VehicleSnapshot {
+    /* Server tick the state was sent in, see OpponentStatesPacket */
+    uint64_t serverTimeUs;
+    VehicleState state;
+};
+
+/* The last second of one opponent's snapshots ordered by server time. Late packets are slotted in
+ * where they belong, duplicates and anything older than the whole window are dropped. */
+class SnapshotBuffer {
+public:
+    static constexpr size_t CAPACITY = 32;
+
+    enum class SampleResult {
+        Empty,
+        /* renderTimeUs fell between two snapshots */
+        Interpolated,
+        /* renderTimeUs is past the newest snapshot, dead reckoned from it */
+        Extrapolated,
+        /* renderTimeUs is further past the newest snapshot than extrapolation may reach, holding where it stopped */
+        Held,
+        /* renderTimeUs is before the oldest snapshot, holding it */
+        BeforeOldest
+    };
+
+    /* Returns false if the snapshot was a duplicate or too old to be of any use */
+    bool push(const VehicleSnapshot &snapshot);
+
+    /* Hermite spline through the positions and velocities of the surrounding snapshots, slerp between
+     * their orientations. The velocity of the result is the derivative of the spline. Past the newest
+     * snapshot the state is extrapolated for at most maxExtrapolationUs, see DeadReckoning. */
+    SampleResult sample(uint64_t renderTimeUs, uint64_t maxExtrapolationUs, VehicleState &out) const;
+
+    /* What sample() returned while baseTimeUs was the newest snapshot, used to measure the prediction error
+     * once newer snapshots have arrived. False if baseTimeUs is no longer in the buffer. */
+    bool extrapolateFrom(uint64_t baseTimeUs, uint64_t renderTimeUs, uint64_t maxExtrapolationUs,
+                         VehicleState &out) const;
+
+    [[nodiscard]]
+    size_t size() const;
+
+    [[nodiscard]]
+    uint64_t newestTimeUs() const;
+
+    void clear();
+
+private:
+    std::array<VehicleSnapshot, CAPACITY> snapshots{};
+    /* Index of the oldest snapshot */
+    size_t head = 0;
+    size_t count = 0;
+
+    [[nodiscard]]
+    const VehicleSnapshot &at(size_t index) const;
+
+    VehicleSnapshot &at(size_t index);
+
+    static VehicleState interpolate(const VehicleSnapshot &from, const VehicleSnapshot &to, uint64_t renderTimeUs);
+};
+
+/* How far behind the newest snapshot the opponents are rendered. A fixed base covers the snapshot interval
+ * and one lost tick, on top of it comes a multiple of the measured arrival jitter. Changes are eased in
+ * by running the render clock at most MAX_RATE_CHANGE faster or slower, so opponents never jump. */
+class InterpolationDelay {
+public:
+    /* Two ticks at 32 Hz plus some slack, enough for one lost snapshot on a quiet network */
+    static constexpr uint64_t DEFAULT_BASE_DELAY_US = 70'000;
+    static constexpr uint64_t MAX_DELAY_US = 250'000;
+    static constexpr double JITTER_MULTIPLIER = 3.0;
+    static constexpr double MAX_RATE_CHANGE = 0.1;
+
+    /* NFSPUT_INTERPOLATION_DELAY_MS overrides the base delay */
+    InterpolationDelay();
+
+    /* arrivalUs is the local monotonicTimeUs, jitter only looks at differences so the clocks don't need to agree */
+    void onSnapshotArrived(uint64_t serverTimeUs, uint64_t arrivalUs);
+
+    /* Eases the current delay towards the target, once per frame */
+    void update(float dt);
+
+    [[nodiscard]]
+    uint64_t getDelayUs() const;
+
+    [[nodiscard]]
+    uint64_t getTargetDelayUs() const;
+
+    [[nodiscard]]
+    double getJitterUs() const;
+
+private:
+    uint64_t baseDelayUs = DEFAULT_BASE_DELAY_US;
+    double currentDelayUs = 0;
+
+    /* RFC 3550 interarrival jitter over distinct server ticks */
+    uint64_t lastServerTimeUs = 0;
+    int64_t lastTransitUs = 0;
+    double jitterUs = 0;
+};
@@ -0,0 +1,80 @@
+#include "state_uploader.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <sys/prctl.h>
+
+#include "netcode/shared/logger.hpp"
+
+using namespace std::chrono;
+
+StateUploader::StateUploader(std::shared_ptr<UDPClient> udpClient) : udpClient(std::move(udpClient)) {
+}
+
+StateUploader::~StateUploader() {
+    stop();
+}
+
+void StateUploader::start() {
+    if (running.exchange(true))
+        return;
+
+    thread = std::thread(&StateUploader::run, this);
+}
+
+void StateUploader::stop() {
+    running.store(false, std::memory_order_relaxed);
+
+    if (thread.joinable())
+        thread.join();
+}
+
+void StateUploader::publish(const Vehicle &vehicle, const ClientInputs inputs, const uint32_t inputSampledUs) {
+    const auto btVehicle = vehicle.getBtVehicle();
+
+    auto &[state, sampledUs] = mailbox.writeSlot();
+    state = {
+        .transform = btVehicle->getChassisWorldTransform(),
+        .velocity = btVehicle->getRigidBody()->getLinearVelocity(),
+        .steeringAngle = btVehicle->getSteeringValue(0),
+        .inputs = inputs
+    };
+    sampledUs = inputSampledUs;
+
+    mailbox.publish();
+}
+
+void StateUploader::run() {
+    /* The default 50 us of timer slack would be most of the jitter left */
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    constexpr auto period = duration_cast<steady_clock::duration>(seconds(1)) / UPLOAD_RATE;
+
+    bool hasSample = false;
+    auto nextTick = steady_clock::now();
+
+    while (running.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_until(nextTick);
+
+        /* Nothing new means the main thread is stalled, the last sample is repeated so the tick isn't lost */
+        hasSample |= mailbox.fetch();
+
+        if (hasSample) {
+            const auto &[state, inputSampledUs] = mailbox.readSlot();
+
+            std::memmove(recentInputs + 1, recentInputs, (INPUT_REDUNDANCY - 1) * sizeof(InputSample));
+            recentInputs[0] = {.frame = frame++, .inputs = state.inputs};
+
+            udpClient->sendVehicleState(state, recentInputs, inputSampledUs);
+        }
+
+        /* Ticks stay on the grid of the first one. After a stall of this thread the missed ones are dropped,
+         * sending them in a burst would only repeat the same sample. */
+        nextTick += period;
+        if (const auto now = steady_clock::now(); now >= nextTick) {
+            const auto missed = (now - nextTick) / period + 1;
+            nextTick += period * missed;
+            LOG_WARN("State upload fell {} ticks behind", missed);
+        }
+    }
+}
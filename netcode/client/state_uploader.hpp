@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "udp_client.hpp"
+#include "vehicle.hpp"
+#include "netcode/shared/client_inputs.hpp"
+#include "netcode/shared/vehicle_state.hpp"
+#include "netcode/shared/packets/udp/client/state_packet.hpp"
+#include "netcode/shared/utils/triple_buffer.hpp"
+
+/* What the main thread last simulated and read from the keyboard */
+struct UploadSample {
+    VehicleState state;
+    /* See LatencyTrace::inputSampledUs */
+    uint32_t inputSampledUs;
+};
+
+/* Sends the player's state on its own thread at a fixed rate, so the upload cadence doesn't follow the frame
+ * time and survives rendering hitches. The main thread only publishes its newest sample into a mailbox. */
+class StateUploader {
+public:
+    /* Same as the server tick, one state per client per tick */
+    static constexpr int UPLOAD_RATE = 32;
+
+    explicit StateUploader(std::shared_ptr<UDPClient> udpClient);
+
+    ~StateUploader();
+
+    StateUploader(const StateUploader &) = delete;
+
+    StateUploader &operator=(const StateUploader &) = delete;
+
+    void start();
+
+    void stop();
+
+    /* Main thread, once per frame after the physics step. Never blocks. */
+    void publish(const Vehicle &vehicle, ClientInputs inputs, uint32_t inputSampledUs);
+
+private:
+    std::shared_ptr<UDPClient> udpClient;
+    TripleBuffer<UploadSample> mailbox;
+
+    std::atomic<bool> running{false};
+    std::thread thread;
+
+    /* Upload thread only, newest first, frame is the upload tick the inputs were sent on */
+    InputSample recentInputs[INPUT_REDUNDANCY]{};
+    uint32_t frame = 0;
+
+    void run();
+};
@@ -1,5 +1,6 @@
 #include "tcp_client.hpp"
 
+#include "clock_sync.hpp"
 #include "handlers/client_connected_handler.hpp"
 #include "handlers/client_disconnected_handler.hpp"
 #include "handlers/lobby_client_list_handler.hpp"
@@ -11,11 +12,11 @@
 #include <cstring>
 #include <iostream>
 #include <stdexcept>
-#include <thread>
 #include <atomic>
 #include <regex>
 
 #include "handlers/laps_update_handler.hpp"
+#include "netcode/shared/logger.hpp"
 #include "handlers/name_accepted_handler.hpp"
 #include "handlers/name_taken_handler.hpp"
 #include "handlers/opponents_info_handler.hpp"
@@ -40,7 +41,6 @@ TCPClient::TCPClient(std::shared_ptr<ClientState> state) {
 
 TCPClient::~TCPClient() {
     if (socketFd >= 0) close(socketFd);
-    if (epollFd >= 0) close(epollFd);
 }
 void TCPClient::refreshScreen() const {
     if (!inLobby.load())
@@ -96,38 +96,22 @@ void TCPClient::connect(const char* host, const char* port) {
 
     freeaddrinfo(res);
 
-    epollFd = epoll_create1(0);
-    if (epollFd < 0)
-        throw std::runtime_error(strerror(errno));
-
-    epoll_event ev{};
-    ev.events = EPOLLIN | EPOLLRDHUP;
-    ev.data.fd = socketFd;
-    epoll_ctl(epollFd, EPOLL_CTL_ADD, socketFd, &ev);
-
-    ev.events = EPOLLIN;
-    ev.data.fd = STDIN_FILENO;
-    epoll_ctl(epollFd, EPOLL_CTL_ADD, STDIN_FILENO, &ev);
-
     std::cout << "Connected to server\n";
 
-    // Start countdown display thread
     localTimeLeft = 0;
-    countdownThread = std::thread([this]() {
-    while (true) {
-        int time = localTimeLeft.load();
-        if (time >= 0) {
-            refreshScreen();
-            localTimeLeft = time - 1;
+}
 
-        }
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
-});
+int TCPClient::getSocketFd() const {
+    return socketFd;
+}
 
-    countdownThread.detach();
+void TCPClient::onCountdownTick() const {
+    const int time = localTimeLeft.load();
+    if (time < 0)
+        return;
 
-    loop();
+    refreshScreen();
+    localTimeLeft = time - 1;
 }
 
 void TCPClient::send(const char *data, const size_t size) const {
@@ -155,20 +139,35 @@ PlayerVehicleColor TCPClient::getColor() const {
     return vehicleColor;
 }
 
-void TCPClient::setRaceStartTime(const std::chrono::time_point<std::chrono::steady_clock> time) {
+void TCPClient::setRaceStartTime(const uint64_t serverTimeUs,
+                                 const std::chrono::time_point<std::chrono::steady_clock> fallbackTime) {
+    raceStartServerUs = serverTimeUs;
+    raceStartTime = fallbackTime;
     countdownUntilStart = true;
-    raceStartTime = time;
+}
+
+std::chrono::time_point<std::chrono::steady_clock> TCPClient::getRaceStartTime() const {
+    /* Converted on every call so the start keeps following the clock estimate as it improves */
+    const auto &clockSync = ClockSync::getInstance();
+    if (clockSync.isSynchronized())
+        return clockSync.toLocalTime(raceStartServerUs);
+
+    return raceStartTime;
 }
 
 int TCPClient::getTimeUntilRaceStart() const {
     const auto now = std::chrono::steady_clock::now();
-    const auto diff = raceStartTime - now;
+    const auto diff = getRaceStartTime() - now;
 
-    const auto secondsRemaining = std::chrono::duration_cast<std::chrono::seconds>(diff).count();
+    const auto secondsRemaining = std::chrono::ceil<std::chrono::seconds>(diff).count();
 
     return std::max(0, static_cast<int>(secondsRemaining));
 }
 
+bool TCPClient::hasRaceStarted() const {
+    return countdownUntilStart && std::chrono::steady_clock::now() >= getRaceStartTime();
+}
+
 bool TCPClient::isRaceStartCountdownActive() const {
     return countdownUntilStart;
 }
@@ -188,59 +187,45 @@ void TCPClient::sendLapCount(const uint8_t lapCount) const {
     send(TCPPacket::serialize(packet), sizeof(packet));
 }
 
-[[noreturn]]
-void TCPClient::loop(){
-    epoll_event events[2];
+bool TCPClient::receivePending() {
+    char buf[4096];
 
     while (true) {
-        int n = epoll_wait(epollFd, events, 2, -1);
-        if (n < 0)
-            throw std::runtime_error(strerror(errno));
-
-        for (int i = 0; i < n; ++i) {
-            if (events[i].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
-                std::cout << "Disconnected from server\n";
-                exit(0);
-            }
-
-            if (events[i].data.fd == socketFd) {
-                receivePacket();
-            }
-            else if (events[i].data.fd == STDIN_FILENO) {
-                handleUserInput();
-            }
+        const ssize_t bytesRead = recv(socketFd, buf, sizeof(buf), 0);
+        if (bytesRead > 0) {
+            receiveBuffer.insert(receiveBuffer.end(), buf, buf + bytesRead);
+            continue;
         }
-    }
-}
 
-void TCPClient::receivePacket(){
-    char headerBuf[sizeof(TCPPacketHeader)];
-    const ssize_t headerBytesRead = recv(socketFd, headerBuf, sizeof(headerBuf), MSG_WAITALL);
+        if (bytesRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return false;
+        break;
+    }
 
-    if (headerBytesRead <= 0)
-        throw std::runtime_error("Server closed connection");
+    /* Packets are framed by their header, a read may end in the middle of one */
+    size_t offset = 0;
+    while (receiveBuffer.size() - offset >= sizeof(TCPPacketHeader)) {
+        TCPPacketHeader header{};
+        std::memcpy(&header, receiveBuffer.data() + offset, sizeof(header));
 
-    auto header = TCPPacketHeader();
-    std::memcpy(&header, headerBuf, sizeof(TCPPacketHeader));
+        if (header.payloadSize > MAX_TCP_PAYLOAD_SIZE)
+            throw std::runtime_error("Packet too large!");
 
-    if (header.payloadSize > MAX_TCP_PAYLOAD_SIZE) {
-        throw std::runtime_error("Packet too large!");
-    }
+        const size_t packetSize = sizeof(header) + header.payloadSize;
+        if (receiveBuffer.size() - offset < packetSize)
+            break;
 
-    const auto payloadBuf = std::make_unique<char[]>(header.payloadSize);
+        auto payload = std::make_unique<char[]>(header.payloadSize);
+        std::memcpy(payload.get(), receiveBuffer.data() + offset + sizeof(header), header.payloadSize);
 
-    if (header.payloadSize > 0) {
-        const ssize_t payloadBytesRead = recv(socketFd, payloadBuf.get(), header.payloadSize, MSG_WAITALL);
-
-        if (payloadBytesRead <= 0)
-            throw std::runtime_error("Server closed connection");
+        handlePacket(header.type, payload, header.payloadSize);
+        offset += packetSize;
     }
 
-    handlePacket(header.type, std::move(payloadBuf), header.payloadSize);
-    return;
+    receiveBuffer.erase(receiveBuffer.begin(), receiveBuffer.begin() + static_cast<long>(offset));
+    return true;
 }
 
-
 void TCPClient::handleUserInput() const {
     char buf[32];
     const ssize_t bytes = read(STDIN_FILENO, buf, sizeof(buf));
@@ -299,15 +284,15 @@ void TCPClient::handlePacket(const TCPPacketType type, const PacketBuffer &paylo
                 OpponentsInfoHandler::handle(payload, size);
                 break;
             case TCPPacketType::RaceStartCountdown:
-                RaceStartCountdownHandler::handle(payload, size, this);
+                RaceStartCountdownHandler::handle(payload, size);
                 break;
             case TCPPacketType::LapsUpdate:
                 LapsUpdateHandler::handle(payload, size);
                 break;
             default:
-                std::cerr << "Received packet with unknown type: " << static_cast<uint8_t>(type) << std::endl;
+                LOG_WARN("Received packet with unknown type: {}", static_cast<uint8_t>(type));
         }
     } catch (DeserializationError &e) {
-        std::cerr << "Error while deserializing packet: " << e.what() << std::endl;
+        LOG_WARN("Error while deserializing packet: {}", e.what());
     }
 }
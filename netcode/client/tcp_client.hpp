@@ -2,8 +2,6 @@
 
 #include <string>
 #include <vector>
-#include <sys/epoll.h>
-#include <thread>
 #include <atomic>
 #include <condition_variable>
 
@@ -27,18 +25,37 @@ public:
 
     void displayLobby() const;
 
+    /* Only connects, reading is left to the NetworkReactor */
     void connect(const char* host, const char* port);
 
+    [[nodiscard]]
+    int getSocketFd() const;
+
+    /* Reactor thread. Reads everything available and handles every complete packet, false once the server
+     * has closed the connection. */
+    bool receivePending();
+
+    /* Reactor thread, when stdin has a nickname for us */
+    void handleUserInput() const;
+
+    /* Reactor thread, once a second while in the lobby */
+    void onCountdownTick() const;
+
     void send(const char *data, size_t size) const;
 
     void send(const PacketBuffer &buf, size_t size) const;
 
     void setGameReady();
 
-    void setRaceStartTime(std::chrono::time_point<std::chrono::steady_clock> time);
+    /* fallbackTime is only used until ClockSync has synchronized */
+    void setRaceStartTime(uint64_t serverTimeUs, std::chrono::time_point<std::chrono::steady_clock> fallbackTime);
+
+    std::chrono::time_point<std::chrono::steady_clock> getRaceStartTime() const;
 
     int getTimeUntilRaceStart() const;
 
+    bool hasRaceStarted() const;
+
     bool isRaceStartCountdownActive() const;
 
     uint8_t getGridPosition() const;
@@ -60,24 +77,19 @@ public:
 
 private:
     int socketFd{-1};
-    int epollFd{-1};
 
-    mutable std::thread countdownThread;         // background countdown thread
+    /* Received bytes not yet making up a whole packet */
+    std::vector<char> receiveBuffer;
+
     mutable std::string lastLobbyMessage; // latest lobby + countdown from server
 
     uint8_t gridPosition;
     PlayerVehicleColor vehicleColor;
 
+    uint64_t raceStartServerUs{};
     std::chrono::time_point<std::chrono::steady_clock> raceStartTime;
     bool countdownUntilStart{false};
 
-    [[noreturn]]
-    void loop();
-
-    void receivePacket();
-
-    void handleUserInput() const;
-
     void handlePacket(TCPPacketType type, const PacketBuffer &payload, ssize_t size);
 
     std::shared_ptr<ClientState> state;
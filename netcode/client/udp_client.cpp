@@ -2,13 +2,16 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <format>
-#include <iostream>
 #include <netdb.h>
 
 #include "../shared/packets/udp/client/state_packet.hpp"
+#include "clock_sync.hpp"
 #include "handlers/opponent_states_handler.hpp"
+#include "handlers/time_sync_response_handler.hpp"
 #include "netcode/shared/client_inputs.hpp"
+#include "netcode/shared/logger.hpp"
 #include "netcode/shared/packets/udp/client/ping_packet.hpp"
+#include "netcode/shared/vehicle_state.hpp"
 
 UDPClient::UDPClient() {
     addrinfo hints{};
@@ -18,7 +21,7 @@ UDPClient::UDPClient() {
     hints.ai_socktype = SOCK_DGRAM;
     hints.ai_protocol = IPPROTO_UDP;
 
-    const int status = getaddrinfo(SERVER_IP, SERVER_PORT, &hints, &result);
+    const int status = getaddrinfo(getServerHost(), getServerPort(), &hints, &result);
     if (status != 0)
         throw std::runtime_error(std::format("getaddrinfo failed: {}", gai_strerror(status)));
 
@@ -30,7 +33,7 @@ UDPClient::UDPClient() {
             continue;
 
         if (connect(socketFd, result->ai_addr, result->ai_addrlen) == 0) {
-            std::cout << "Connected to the server!" << std::endl;
+            LOG_INFO("Connected to the server!");
             connectedSuccessfully = true;
             break;
         }
@@ -40,8 +43,15 @@ UDPClient::UDPClient() {
 
     if (!connectedSuccessfully) {
         close();
-        throw std::runtime_error(std::format("Failed to connect to the server with IP {} and port {}.", SERVER_IP,
-                                             SERVER_PORT));
+        throw std::runtime_error(std::format("Failed to connect to the server with IP {} and port {}.",
+                                             getServerHost(), getServerPort()));
+    }
+
+    for (int i = 0; i < RECEIVE_BATCH; i++) {
+        receiveBuffers[i] = std::make_unique<char[]>(MAX_MESSAGE_SIZE);
+        receiveVectors[i] = {.iov_base = receiveBuffers[i].get(), .iov_len = MAX_MESSAGE_SIZE};
+        receiveHeaders[i].msg_hdr.msg_iov = &receiveVectors[i];
+        receiveHeaders[i].msg_hdr.msg_iovlen = 1;
     }
 }
 
@@ -58,42 +68,30 @@ void UDPClient::send(const PacketBuffer &data, const ssize_t size) const {
     write(socketFd, data.get(), size);
 }
 
-void UDPClient::sendVehicleState(const std::shared_ptr<Vehicle> &vehicle, ClientInputs inputs) {
-    const auto btVehicle = vehicle->getBtVehicle();
-
-    const auto transform = btVehicle->getChassisWorldTransform();
-    const auto velocity = btVehicle->getRigidBody()->getLinearVelocity();
-    const auto steeringAngle = btVehicle->getSteeringValue(0);
-
-    btTransformFloatData transformData{};
-    transform.serialize(transformData);
-
-    float velocityData[3];
-    velocityData[0] = velocity.getX();
-    velocityData[1] = velocity.getY();
-    velocityData[2] = velocity.getZ();
+void UDPClient::sendVehicleState(const VehicleState &vehicleState, const InputSample *recentInputs,
+                                 const uint32_t inputSampledUs) {
+    StatePacket packet;
+    packet.header.id = lastPacketId;
+    packVehicleState(vehicleState, packet.payload);
+    std::memcpy(packet.recentInputs, recentInputs, sizeof(packet.recentInputs));
 
-    constexpr auto transformSize = sizeof(btTransformFloatData);
-    constexpr auto velocitySize = sizeof(velocityData);
-    constexpr auto steeringAngleSize = sizeof(btScalar);
-
-    StateBuffer buf;
-
-    std::memcpy(buf, &transformData, transformSize);
-    std::memcpy(buf + transformSize, &velocityData, velocitySize);
-    std::memcpy(buf + transformSize + velocitySize, &steeringAngle, steeringAngleSize);
-    std::memcpy(buf + sizeof(buf) - sizeof(inputs), &inputs, sizeof(inputs));
-
-    const auto packet = UDPPacket::create<StatePacket>(lastPacketId, buf, STATE_PAYLOAD_SIZE);
+    packet.trace.inputSampledUs = inputSampledUs;
+    packet.trace.clientSentUs = traceTimestampUs();
+    packet.checksum = UDPPacket::calculatePacketChecksum(packet);
 
     send(UDPPacket::serialize(packet), sizeof(packet));
     lastPacketId++;
 }
 
+void UDPClient::sendTimeSyncRequest() const {
+    const auto packet = ClockSync::getInstance().createRequest();
+    send(UDPPacket::serialize(packet), sizeof(packet));
+}
+
 void UDPClient::handlePacket(const PacketBuffer &buf, const ssize_t size) const {
     const bool isValid = UDPPacket::validate(buf, size);
     if (!isValid) {
-        std::cerr << "Received a packet with invalid checksum." << std::endl;
+        LOG_WARN("Received a packet with invalid checksum.");
         return;
     }
 
@@ -106,32 +104,34 @@ void UDPClient::handlePacket(const PacketBuffer &buf, const ssize_t size) const
                 OpponentStatesHandler::handle(buf, size);
                 break;
 
+            case UDPPacketType::TimeSyncResponse:
+                TimeSyncResponseHandler::handle(buf, size);
+                break;
+
             default:
-                std::cerr << "Received packet with unknown type!" << std::endl;
+                LOG_WARN("Received packet with unknown type: {}", static_cast<uint8_t>(type));
         }
     } catch (DeserializationError &e) {
-        std::cerr << "Error while deserializing packet: " << e.what() << std::endl;
+        LOG_WARN("Error while deserializing packet: {}", e.what());
     }
 }
 
-void UDPClient::listen() {
-    waitForMessages = true;
+void UDPClient::receivePending() {
+    while (true) {
+        const int received = recvmmsg(socketFd, receiveHeaders, RECEIVE_BATCH, MSG_DONTWAIT, nullptr);
 
-    while (waitForMessages) {
-        auto buf = std::make_unique<char []>(MAX_MESSAGE_SIZE);
-        const ssize_t bytesRead = ::read(socketFd, buf.get(), MAX_MESSAGE_SIZE);
-
-        if (bytesRead < 0) {
-            std::cerr << "Error while reading data from UDP connection: " << strerror(errno) << std::endl;
-            continue;
+        if (received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG_WARN("Error while reading data from UDP connection: {}", strerror(errno));
+            return;
         }
 
-        handlePacket(buf, bytesRead);
-    }
-}
+        for (int i = 0; i < received; i++)
+            handlePacket(receiveBuffers[i], receiveHeaders[i].msg_len);
 
-void UDPClient::stopListening() {
-    waitForMessages = false;
+        if (received < RECEIVE_BATCH)
+            return;
+    }
 }
 
 void UDPClient::close() {
@@ -139,6 +139,10 @@ void UDPClient::close() {
     socketFd = -1;
 }
 
+int UDPClient::getSocketFd() const {
+    return socketFd;
+}
+
 uint16_t UDPClient::getPort() const {
     sockaddr_in addr{};
     socklen_t size = sizeof(addr);
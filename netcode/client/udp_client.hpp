@@ -1,18 +1,25 @@
 #pragma once
+#include <sys/socket.h>
 
-#define SERVER_IP "127.0.0.1"
-#define SERVER_PORT "1313"
+#include "server_address.hpp"
 #include "vehicle.hpp"
 #include "../shared/packets/udp/udp_packet.hpp"
 #include "LinearMath/btTransform.h"
 #include "netcode/shared/client_inputs.hpp"
+#include "netcode/shared/vehicle_state.hpp"
 
 class UDPClient {
-    static constexpr int MAX_MESSAGE_SIZE = 512;
+    static constexpr int MAX_MESSAGE_SIZE = 1024;
+    /* Datagrams taken from the socket per recvmmsg call */
+    static constexpr int RECEIVE_BATCH = 16;
 
     int socketFd = -1;
     long lastPacketId = 0;
-    volatile bool waitForMessages = false;
+
+    /* Allocated once, recvmmsg fills them in place on every call */
+    PacketBuffer receiveBuffers[RECEIVE_BATCH];
+    iovec receiveVectors[RECEIVE_BATCH]{};
+    mmsghdr receiveHeaders[RECEIVE_BATCH]{};
 
 public:
     explicit UDPClient();
@@ -23,16 +30,22 @@ public:
 
     void send(const PacketBuffer &data, ssize_t size) const;
 
-    void sendVehicleState(const std::shared_ptr<Vehicle> &vehicle, ClientInputs inputs);
+    /* recentInputs holds INPUT_REDUNDANCY samples, newest first. inputSampledUs is when the newest ones were read
+     * from the window system, see LatencyTrace. Only ever called from the StateUploader thread. */
+    void sendVehicleState(const VehicleState &vehicleState, const InputSample *recentInputs, uint32_t inputSampledUs);
 
-    void handlePacket(const PacketBuffer &buf, ssize_t size) const;
+    void sendTimeSyncRequest() const;
 
-    void listen();
+    void handlePacket(const PacketBuffer &buf, ssize_t size) const;
 
-    void stopListening();
+    /* Reactor thread. Handles every datagram waiting on the socket. */
+    void receivePending();
 
     void close();
 
+    [[nodiscard]]
+    int getSocketFd() const;
+
     [[nodiscard]]
     uint16_t getPort() const;
 };
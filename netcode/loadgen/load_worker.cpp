@@ -0,0 +1,84 @@
+#include "load_worker.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+using namespace std::chrono;
+
+namespace {
+    /* The epoll data holds the client slot, the lowest bit tells the UDP socket from the TCP one */
+    constexpr uint64_t UDP_FLAG = 1;
+
+    /* Wakes up at least this often to send due states */
+    constexpr int POLL_TIMEOUT_MS = 1;
+}
+
+LoadWorker::LoadWorker(std::vector<std::unique_ptr<SimulatedClient> > clients) : clients(std::move(clients)) {
+    epollFd = epoll_create1(0);
+    if (epollFd < 0)
+        throw std::runtime_error(std::string("epoll_create1 failed: ") + strerror(errno));
+
+    for (uint64_t slot = 0; slot < this->clients.size(); ++slot) {
+        const auto &client = this->clients[slot];
+
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u64 = slot << 1;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, client->getTcpFd(), &ev);
+
+        ev.events = EPOLLIN;
+        ev.data.u64 = slot << 1 | UDP_FLAG;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, client->getUdpFd(), &ev);
+    }
+}
+
+LoadWorker::~LoadWorker() {
+    if (epollFd >= 0)
+        close(epollFd);
+}
+
+void LoadWorker::run() {
+    epoll_event events[256];
+
+    while (running.load(std::memory_order_relaxed)) {
+        const int n = epoll_wait(epollFd, events, 256, POLL_TIMEOUT_MS);
+        if (n < 0 && errno != EINTR)
+            throw std::runtime_error(std::string("epoll_wait failed: ") + strerror(errno));
+
+        for (int i = 0; i < n; ++i)
+            handleEvent(events[i].data.u64, events[i].events);
+
+        const auto now = steady_clock::now();
+        for (const auto &client: clients)
+            client->tick(now);
+    }
+}
+
+void LoadWorker::stop() {
+    running.store(false, std::memory_order_relaxed);
+}
+
+const std::vector<std::unique_ptr<SimulatedClient> > &LoadWorker::getClients() const {
+    return clients;
+}
+
+void LoadWorker::handleEvent(const uint64_t data, const uint32_t events) {
+    auto &client = *clients[data >> 1];
+
+    if (data & UDP_FLAG) {
+        client.onUdpReadable();
+        return;
+    }
+
+    if (events & EPOLLIN)
+        client.onTcpReadable();
+
+    if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        client.onDisconnected();
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, client.getTcpFd(), nullptr);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, client.getUdpFd(), nullptr);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "simulated_client.hpp"
+
+/* Drives a share of the simulated clients from one thread with a single epoll set */
+class LoadWorker {
+public:
+    explicit LoadWorker(std::vector<std::unique_ptr<SimulatedClient> > clients);
+
+    ~LoadWorker();
+
+    LoadWorker(const LoadWorker &) = delete;
+
+    LoadWorker &operator=(const LoadWorker &) = delete;
+
+    /* Runs until stop() is called */
+    void run();
+
+    void stop();
+
+    [[nodiscard]]
+    const std::vector<std::unique_ptr<SimulatedClient> > &getClients() const;
+
+private:
+    std::vector<std::unique_ptr<SimulatedClient> > clients;
+    int epollFd;
+    std::atomic<bool> running{true};
+
+    void handleEvent(uint64_t data, uint32_t events);
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+constexpr const char *LOADGEN_USAGE =
+        "Usage: %s [--host 127.0.0.1] [--port 1313] [--clients N] [--threads N] [--duration SECONDS]"
+        " [--rate HZ] [--speed M/S] [--paths paths.json] [--csv FILE]\n";
+
+struct LoadgenConfig {
+    std::string host = "127.0.0.1";
+    std::string port = "1313";
+
+    size_t clientCount = 64;
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+    int durationSeconds = 60;
+
+    /* Same rate the game client sends its state with */
+    int stateRate = 32;
+
+    /* How fast the simulated cars move along their paths */
+    float speed = 30.0f;
+
+    std::string pathsFile = std::string(SOURCE_PATH) + "/paths.json";
+
+    /* Per client stats are written here when set */
+    std::string csvFile;
+
+    /* Throws std::invalid_argument on malformed arguments */
+    static LoadgenConfig fromArgs(const int argc, char *argv[]) {
+        LoadgenConfig config;
+
+        for (int i = 1; i < argc; ++i) {
+            const auto nextValue = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::invalid_argument(std::string("Missing value for ") + argv[i]);
+                return argv[++i];
+            };
+
+            if (std::strcmp(argv[i], "--host") == 0)
+                config.host = nextValue();
+            else if (std::strcmp(argv[i], "--port") == 0)
+                config.port = nextValue();
+            else if (std::strcmp(argv[i], "--clients") == 0)
+                config.clientCount = std::max(1ul, std::stoul(nextValue()));
+            else if (std::strcmp(argv[i], "--threads") == 0)
+                config.threadCount = std::max(1ul, std::stoul(nextValue()));
+            else if (std::strcmp(argv[i], "--duration") == 0)
+                config.durationSeconds = std::stoi(nextValue());
+            else if (std::strcmp(argv[i], "--rate") == 0)
+                config.stateRate = std::max(1, std::stoi(nextValue()));
+            else if (std::strcmp(argv[i], "--speed") == 0)
+                config.speed = std::stof(nextValue());
+            else if (std::strcmp(argv[i], "--paths") == 0)
+                config.pathsFile = nextValue();
+            else if (std::strcmp(argv[i], "--csv") == 0)
+                config.csvFile = nextValue();
+            else
+                throw std::invalid_argument(std::string("Unknown option ") + argv[i]);
+        }
+
+        config.threadCount = std::min(config.threadCount, config.clientCount);
+        return config;
+    }
+};
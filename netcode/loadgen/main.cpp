@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "load_worker.hpp"
+#include "loadgen_config.hpp"
+#include "simulated_client.hpp"
+#include "trajectory.hpp"
+
+using namespace std::chrono;
+
+namespace {
+    constexpr auto REPORT_INTERVAL = seconds(5);
+    constexpr size_t WORST_CLIENTS_SHOWN = 5;
+
+    const char *phaseName(const SimulatedClientPhase phase) {
+        switch (phase) {
+            case SimulatedClientPhase::Connecting: return "connecting";
+            case SimulatedClientPhase::WaitingForNick: return "nick";
+            case SimulatedClientPhase::InLobby: return "lobby";
+            case SimulatedClientPhase::Loading: return "loading";
+            case SimulatedClientPhase::Countdown: return "countdown";
+            case SimulatedClientPhase::Racing: return "racing";
+            case SimulatedClientPhase::Disconnected: return "disconnected";
+        }
+        return "?";
+    }
+
+    struct ClientReport {
+        uint32_t index;
+        SimulatedClientPhase phase;
+        uint64_t statesSent;
+        uint64_t snapshotsReceived;
+        double snapshotRate;
+        uint64_t statesReceived;
+        uint64_t statesMissed;
+        double lossRatio;
+        double latencyAverageMs;
+        double latencyMaxMs;
+    };
+
+    ClientReport reportClient(const SimulatedClient &client) {
+        const auto &stats = client.getStats();
+
+        ClientReport report{};
+        report.index = client.getIndex();
+        report.phase = client.getPhase();
+        report.statesSent = stats.statesSent.load();
+        report.snapshotsReceived = stats.snapshotsReceived.load();
+        report.statesReceived = stats.statesReceived.load();
+        report.statesMissed = stats.statesMissed.load();
+
+        const auto activeSeconds = static_cast<double>(stats.lastSnapshotNs.load() - stats.firstSnapshotNs.load()) / 1e9;
+        if (activeSeconds > 0)
+            report.snapshotRate = static_cast<double>(report.snapshotsReceived - 1) / activeSeconds;
+
+        if (const auto expected = report.statesReceived + report.statesMissed; expected > 0)
+            report.lossRatio = static_cast<double>(report.statesMissed) / static_cast<double>(expected);
+
+        if (const auto samples = stats.latencySamples.load(); samples > 0)
+            report.latencyAverageMs = static_cast<double>(stats.latencySumMicroseconds.load()) / samples / 1000.0;
+        report.latencyMaxMs = static_cast<double>(stats.latencyMaxMicroseconds.load()) / 1000.0;
+
+        return report;
+    }
+
+    std::vector<ClientReport> collectReports(const std::vector<std::unique_ptr<LoadWorker> > &workers) {
+        std::vector<ClientReport> reports;
+        for (const auto &worker: workers) {
+            for (const auto &client: worker->getClients())
+                reports.push_back(reportClient(*client));
+        }
+
+        std::ranges::sort(reports, {}, &ClientReport::index);
+        return reports;
+    }
+
+    void printSummary(const std::vector<ClientReport> &reports, const Histogram &latency, const double elapsedSeconds) {
+        size_t racing = 0, disconnected = 0;
+        uint64_t statesSent = 0, snapshots = 0, received = 0, missed = 0;
+
+        for (const auto &report: reports) {
+            racing += report.phase == SimulatedClientPhase::Racing;
+            disconnected += report.phase == SimulatedClientPhase::Disconnected;
+            statesSent += report.statesSent;
+            snapshots += report.snapshotsReceived;
+            received += report.statesReceived;
+            missed += report.statesMissed;
+        }
+
+        const auto snapshot = latency.snapshot();
+        const double loss = received + missed > 0 ? 100.0 * missed / static_cast<double>(received + missed) : 0.0;
+
+        printf("[%6.1fs] clients %zu racing %zu disconnected %zu | sent %" PRIu64 " states, received %" PRIu64
+               " snapshots %" PRIu64 " states | missed %.2f%% | latency p50 %.1fms p99 %.1fms p99.9 %.1fms\n",
+               elapsedSeconds, reports.size(), racing, disconnected, statesSent, snapshots, received, loss,
+               snapshot.quantile(0.5) / 1000.0, snapshot.quantile(0.99) / 1000.0, snapshot.quantile(0.999) / 1000.0);
+        fflush(stdout);
+    }
+
+    void printWorstClients(std::vector<ClientReport> reports) {
+        std::ranges::sort(reports, [](const ClientReport &a, const ClientReport &b) {
+            if (a.lossRatio != b.lossRatio)
+                return a.lossRatio > b.lossRatio;
+            return a.latencyAverageMs > b.latencyAverageMs;
+        });
+
+        printf("\nWorst clients by loss, then latency:\n");
+        printf("%8s %13s %10s %12s %10s %10s %8s %10s %10s\n", "client", "phase", "sent", "snapshots/s", "received",
+               "missed", "loss%", "avg ms", "max ms");
+
+        for (size_t i = 0; i < std::min(WORST_CLIENTS_SHOWN, reports.size()); ++i) {
+            const auto &r = reports[i];
+            printf("%8" PRIu32 " %13s %10" PRIu64 " %12.1f %10" PRIu64 " %10" PRIu64 " %8.2f %10.2f %10.2f\n",
+                   r.index, phaseName(r.phase), r.statesSent, r.snapshotRate, r.statesReceived, r.statesMissed,
+                   100.0 * r.lossRatio, r.latencyAverageMs, r.latencyMaxMs);
+        }
+    }
+
+    void writeCsv(const std::string &filename, const std::vector<ClientReport> &reports) {
+        FILE *file = fopen(filename.c_str(), "w");
+        if (!file) {
+            fprintf(stderr, "Failed to open %s for writing\n", filename.c_str());
+            return;
+        }
+
+        fprintf(file, "client,phase,states_sent,snapshots_received,snapshots_per_second,states_received,"
+                "states_missed,loss_ratio,latency_avg_ms,latency_max_ms\n");
+        for (const auto &r: reports) {
+            fprintf(file, "%" PRIu32 ",%s,%" PRIu64 ",%" PRIu64 ",%.2f,%" PRIu64 ",%" PRIu64 ",%.5f,%.3f,%.3f\n",
+                    r.index, phaseName(r.phase), r.statesSent, r.snapshotsReceived, r.snapshotRate, r.statesReceived,
+                    r.statesMissed, r.lossRatio, r.latencyAverageMs, r.latencyMaxMs);
+        }
+
+        fclose(file);
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    LoadgenConfig config;
+    std::vector<Trajectory> trajectories;
+
+    try {
+        config = LoadgenConfig::fromArgs(argc, argv);
+        trajectories = Trajectory::loadFromFile(config.pathsFile);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, LOADGEN_USAGE, argv[0]);
+        return 1;
+    }
+
+    SendTimeTable sendTimes(config.clientCount);
+    Histogram latency;
+
+    /* Clients are dealt out round robin so every worker gets a similar mix of rooms */
+    std::vector<std::vector<std::unique_ptr<SimulatedClient> > > shares(config.threadCount);
+    for (uint32_t i = 0; i < config.clientCount; ++i) {
+        auto client = std::make_unique<SimulatedClient>(i, trajectories[i % trajectories.size()], config, sendTimes,
+                                                        latency);
+        try {
+            client->connect(config.host.c_str(), config.port.c_str());
+        } catch (const std::exception &e) {
+            fprintf(stderr, "Simulated client %u failed to connect: %s\n", i, e.what());
+            return 1;
+        }
+
+        shares[i % config.threadCount].push_back(std::move(client));
+    }
+
+    std::vector<std::unique_ptr<LoadWorker> > workers;
+    std::vector<std::thread> threads;
+    for (auto &share: shares) {
+        workers.push_back(std::make_unique<LoadWorker>(std::move(share)));
+        threads.emplace_back([worker = workers.back().get()] {
+            worker->run();
+        });
+    }
+
+    printf("Running %zu simulated clients on %zu threads against %s:%s for %ds\n", config.clientCount,
+           config.threadCount, config.host.c_str(), config.port.c_str(), config.durationSeconds);
+
+    const auto start = steady_clock::now();
+    const auto end = start + seconds(config.durationSeconds);
+
+    while (steady_clock::now() < end) {
+        std::this_thread::sleep_until(std::min(end, steady_clock::now() + REPORT_INTERVAL));
+        printSummary(collectReports(workers), latency, duration<double>(steady_clock::now() - start).count());
+    }
+
+    for (const auto &worker: workers)
+        worker->stop();
+    for (auto &thread: threads)
+        thread.join();
+
+    const auto reports = collectReports(workers);
+    printWorstClients(reports);
+
+    if (!config.csvFile.empty())
+        writeCsv(config.csvFile, reports);
+
+    return 0;
+}
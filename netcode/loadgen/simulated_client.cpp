@@ -0,0 +1,376 @@
+#include "simulated_client.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <netinet/tcp.h>
+
+#include "../shared/client_inputs.hpp"
+#include "../shared/client_state.hpp"
+#include "../shared/packets/tcp/tcp_packet.hpp"
+#include "../shared/packets/tcp/client/client_game_loaded_packet.hpp"
+#include "../shared/packets/tcp/client/lap_count_packet.hpp"
+#include "../shared/packets/tcp/client/name_packet.hpp"
+#include "../shared/packets/tcp/client/udp_info_packet.hpp"
+#include "../shared/packets/tcp/server/race_start_countdown_packet.hpp"
+#include "../shared/packets/udp/udp_packet.hpp"
+#include "../shared/packets/udp/client/ping_packet.hpp"
+#include "../shared/packets/udp/client/state_packet.hpp"
+#include "../shared/packets/udp/server/opponent_states_packet.hpp"
+#include "../shared/vehicle_state.hpp"
+
+using namespace std::chrono;
+
+namespace {
+    constexpr size_t MAX_DATAGRAM_SIZE = 1024;
+
+    /* btTransformFloatData pads every basis row and the origin to four floats. The game ignores the fourth one,
+     * so we use them to stamp who sent a state and its sequence number for the latency measurement. */
+    constexpr size_t SENDER_INDEX_OFFSET = offsetof(btTransformFloatData, m_basis) + 3 * sizeof(float);
+    constexpr size_t SEQUENCE_OFFSET = offsetof(btTransformFloatData, m_origin) + 3 * sizeof(float);
+
+    /* Cars start a few meters apart instead of on top of each other */
+    constexpr float GRID_SPACING = 4.0f;
+    constexpr uint32_t GRID_SLOTS = 8;
+
+    int64_t toNs(const steady_clock::time_point time) {
+        return duration_cast<nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    void makeNonBlocking(const int fd) {
+        const int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    int connectSocket(const char *host, const char *port, const int socketType) {
+        addrinfo hints{}, *res;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = socketType;
+
+        if (const int rv = getaddrinfo(host, port, &hints, &res))
+            throw std::runtime_error(std::string("getaddrinfo failed: ") + gai_strerror(rv));
+
+        const int fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if (fd < 0) {
+            freeaddrinfo(res);
+            throw std::runtime_error(std::string("socket failed: ") + strerror(errno));
+        }
+
+        if (::connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+            const int error = errno;
+            freeaddrinfo(res);
+            close(fd);
+            throw std::runtime_error(std::string("connect failed: ") + strerror(error));
+        }
+
+        freeaddrinfo(res);
+        makeNonBlocking(fd);
+        return fd;
+    }
+}
+
+SendTimeTable::SendTimeTable(const size_t clientCount)
+    : clientCount(clientCount), times(std::make_unique<std::atomic<int64_t>[]>(clientCount * HISTORY)) {
+}
+
+void SendTimeTable::record(const uint32_t clientIndex, const uint32_t sequence, const int64_t timeNs) {
+    times[clientIndex * HISTORY + sequence % HISTORY].store(timeNs, std::memory_order_relaxed);
+}
+
+int64_t SendTimeTable::lookup(const uint32_t clientIndex, const uint32_t sequence) const {
+    if (clientIndex >= clientCount)
+        return 0;
+
+    return times[clientIndex * HISTORY + sequence % HISTORY].load(std::memory_order_relaxed);
+}
+
+SimulatedClient::SimulatedClient(const uint32_t index, const Trajectory &trajectory, const LoadgenConfig &config,
+                                 SendTimeTable &sendTimes, Histogram &latency)
+    : index(index), trajectory(trajectory), config(config), sendTimes(sendTimes), latency(latency) {
+}
+
+SimulatedClient::~SimulatedClient() {
+    if (tcpSocketFd >= 0)
+        close(tcpSocketFd);
+    if (udpSocketFd >= 0)
+        close(udpSocketFd);
+}
+
+void SimulatedClient::connect(const char *host, const char *port) {
+    tcpSocketFd = connectSocket(host, port, SOCK_STREAM);
+    udpSocketFd = connectSocket(host, port, SOCK_DGRAM);
+
+    constexpr int one = 1;
+    setsockopt(tcpSocketFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    phase = SimulatedClientPhase::WaitingForNick;
+}
+
+void SimulatedClient::onTcpReadable() {
+    char buf[4096];
+
+    while (true) {
+        const ssize_t bytesRead = recv(tcpSocketFd, buf, sizeof(buf), 0);
+        if (bytesRead > 0) {
+            tcpBuffer.insert(tcpBuffer.end(), buf, buf + bytesRead);
+            continue;
+        }
+
+        if (bytesRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            onDisconnected();
+            return;
+        }
+        break;
+    }
+
+    /* Packets are framed by their header, a read may end in the middle of one */
+    size_t offset = 0;
+    while (tcpBuffer.size() - offset >= sizeof(TCPPacketHeader)) {
+        TCPPacketHeader header{};
+        std::memcpy(&header, tcpBuffer.data() + offset, sizeof(header));
+
+        if (header.payloadSize > MAX_TCP_PAYLOAD_SIZE) {
+            onDisconnected();
+            return;
+        }
+
+        const size_t packetSize = sizeof(header) + header.payloadSize;
+        if (tcpBuffer.size() - offset < packetSize)
+            break;
+
+        handleTcpPacket(header.type, tcpBuffer.data() + offset + sizeof(header), header.payloadSize);
+        offset += packetSize;
+    }
+
+    tcpBuffer.erase(tcpBuffer.begin(), tcpBuffer.begin() + static_cast<long>(offset));
+}
+
+void SimulatedClient::onUdpReadable() {
+    const auto buf = std::make_unique<char[]>(MAX_DATAGRAM_SIZE);
+
+    while (true) {
+        const ssize_t bytesRead = ::recv(udpSocketFd, buf.get(), MAX_DATAGRAM_SIZE, 0);
+        if (bytesRead <= 0)
+            return;
+
+        if (!UDPPacket::validate(buf, bytesRead))
+            continue;
+
+        UDPPacketHeader header{};
+        std::memcpy(&header, buf.get(), sizeof(header));
+        if (header.type != UDPPacketType::OpponentStates)
+            continue;
+
+        const auto nowNs = toNs(steady_clock::now());
+        stats.snapshotsReceived.fetch_add(1, std::memory_order_relaxed);
+        if (stats.firstSnapshotNs.load(std::memory_order_relaxed) == 0)
+            stats.firstSnapshotNs.store(nowNs, std::memory_order_relaxed);
+        stats.lastSnapshotNs.store(nowNs, std::memory_order_relaxed);
+
+        uint8_t statesCount;
+        std::memcpy(&statesCount, buf.get() + sizeof(header), sizeof(statesCount));
+
+        /* Snapshot server time isn't used, latency is measured with the stamps in the state padding */
+        size_t offset = sizeof(header) + sizeof(statesCount) + sizeof(OpponentStatesPacket::serverTimeUs);
+        for (uint8_t i = 0; i < statesCount && offset + sizeof(ClientState) <= static_cast<size_t>(bytesRead); ++i) {
+            recordOpponentState(buf.get() + offset + offsetof(ClientState, state), nowNs);
+            offset += sizeof(ClientState);
+        }
+    }
+}
+
+void SimulatedClient::onDisconnected() {
+    phase = SimulatedClientPhase::Disconnected;
+}
+
+void SimulatedClient::tick(const steady_clock::time_point now) {
+    const auto currentPhase = phase.load();
+    if (currentPhase != SimulatedClientPhase::Loading && currentPhase != SimulatedClientPhase::Countdown &&
+        currentPhase != SimulatedClientPhase::Racing)
+        return;
+
+    if (currentPhase == SimulatedClientPhase::Countdown && now >= raceStartTime)
+        phase = SimulatedClientPhase::Racing;
+
+    if (now < nextStateTime)
+        return;
+
+    sendState(now);
+
+    /* Keep the cadence, but don't try to catch up after a stall */
+    nextStateTime += nanoseconds(1'000'000'000 / config.stateRate);
+    if (nextStateTime < now)
+        nextStateTime = now;
+}
+
+int SimulatedClient::getTcpFd() const {
+    return tcpSocketFd;
+}
+
+int SimulatedClient::getUdpFd() const {
+    return udpSocketFd;
+}
+
+uint32_t SimulatedClient::getIndex() const {
+    return index;
+}
+
+SimulatedClientPhase SimulatedClient::getPhase() const {
+    return phase.load(std::memory_order_relaxed);
+}
+
+const SimulatedClientStats &SimulatedClient::getStats() const {
+    return stats;
+}
+
+void SimulatedClient::handleTcpPacket(const TCPPacketType type, const char *payload, const size_t size) {
+    switch (type) {
+        case TCPPacketType::ProvideName:
+        case TCPPacketType::NameTaken:
+            sendName();
+            break;
+
+        case TCPPacketType::NameAccepted: {
+            phase = SimulatedClientPhase::InLobby;
+            sendUdpInfo();
+
+            /* Same as the game, lets the server's datagrams through NATs and firewalls */
+            const auto ping = UDPPacket::create<PingPacket>(0, nullptr, 0);
+            ::send(udpSocketFd, UDPPacket::serialize(ping).get(), sizeof(ping), 0);
+            break;
+        }
+
+        case TCPPacketType::StartGame: {
+            phase = SimulatedClientPhase::Loading;
+            nextStateTime = steady_clock::now();
+
+            const ClientGameLoadedPacket packet;
+            sendTcp(TCPPacket::serialize(packet).get(), sizeof(packet));
+            break;
+        }
+
+        case TCPPacketType::RaceStartCountdown:
+            if (size == RACE_START_COUNTDOWN_PAYLOAD_SIZE) {
+                raceStartTime = steady_clock::now() + seconds(static_cast<uint8_t>(payload[0]));
+                phase = SimulatedClientPhase::Countdown;
+            }
+            break;
+
+        default:
+            /* Lobby and opponent bookkeeping, nothing to simulate */
+            break;
+    }
+}
+
+void SimulatedClient::sendName() {
+    auto nick = "bot" + std::to_string(index);
+    if (nameAttempts++ > 0)
+        nick += "_" + std::to_string(nameAttempts);
+
+    const auto [packet, packetSize] = TCPPacket::create<NamePacket>(nick.c_str(), nick.size());
+    sendTcp(TCPPacket::serialize(packet).get(), packetSize);
+}
+
+void SimulatedClient::sendUdpInfo() const {
+    sockaddr_in addr{};
+    socklen_t addrSize = sizeof(addr);
+    getsockname(udpSocketFd, reinterpret_cast<sockaddr *>(&addr), &addrSize);
+
+    UdpInfoPacket packet;
+    packet.port = ntohs(addr.sin_port);
+    sendTcp(TCPPacket::serialize(packet).get(), sizeof(packet));
+}
+
+void SimulatedClient::sendState(const steady_clock::time_point now) {
+    const bool racing = phase.load() == SimulatedClientPhase::Racing;
+    const float driven = racing ? config.speed * duration<float>(now - raceStartTime).count() : 0.0f;
+    const float gridOffset = static_cast<float>(index % GRID_SLOTS) * GRID_SPACING;
+
+    const auto sample = trajectory.sample(driven - gridOffset, racing ? config.speed : 0.0f);
+
+    const VehicleState vehicleState{
+        .transform = sample.transform,
+        .velocity = sample.velocity,
+        .steeringAngle = 0.0f,
+        .inputs = buildInputBitmap(false, false, false, racing, false)
+    };
+
+    const uint32_t sequence = nextStatePacketId++;
+
+    StatePacket packet;
+    packet.header.id = sequence;
+    packVehicleState(vehicleState, packet.payload);
+    std::memcpy(packet.payload + SENDER_INDEX_OFFSET, &index, sizeof(index));
+    std::memcpy(packet.payload + SEQUENCE_OFFSET, &sequence, sizeof(sequence));
+
+    std::memmove(recentInputs + 1, recentInputs, (INPUT_REDUNDANCY - 1) * sizeof(InputSample));
+    recentInputs[0] = {.frame = sequence, .inputs = vehicleState.inputs};
+    std::memcpy(packet.recentInputs, recentInputs, sizeof(packet.recentInputs));
+
+    packet.checksum = UDPPacket::calculatePacketChecksum(packet);
+
+    sendTimes.record(index, sequence, toNs(now));
+    if (::send(udpSocketFd, UDPPacket::serialize(packet).get(), sizeof(packet), 0) > 0)
+        stats.statesSent.fetch_add(1, std::memory_order_relaxed);
+
+    if (racing && sample.laps > lapsSent) {
+        lapsSent = sample.laps;
+
+        LapCountPacket lapPacket;
+        lapPacket.lapCount = static_cast<uint8_t>(lapsSent);
+        sendTcp(TCPPacket::serialize(lapPacket).get(), sizeof(lapPacket));
+    }
+}
+
+void SimulatedClient::sendTcp(const char *data, const size_t size) const {
+    size_t sent = 0;
+
+    while (sent < size) {
+        const ssize_t n = ::send(tcpSocketFd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+
+        /* Control packets are tiny and rare, spinning on a full buffer is fine here */
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+
+        return;
+    }
+}
+
+void SimulatedClient::recordOpponentState(const char *state, const int64_t nowNs) {
+    uint32_t sender, sequence;
+    std::memcpy(&sender, state + SENDER_INDEX_OFFSET, sizeof(sender));
+    std::memcpy(&sequence, state + SEQUENCE_OFFSET, sizeof(sequence));
+
+    /* Datagrams may arrive out of order, an older state than one we already have is just ignored */
+    const auto [it, firstFromSender] = lastSequenceBySender.try_emplace(sender, sequence);
+    if (!firstFromSender) {
+        if (sequence <= it->second)
+            return;
+
+        stats.statesMissed.fetch_add(sequence - it->second - 1, std::memory_order_relaxed);
+        it->second = sequence;
+    }
+
+    stats.statesReceived.fetch_add(1, std::memory_order_relaxed);
+
+    const auto sentNs = sendTimes.lookup(sender, sequence);
+    if (sentNs == 0 || sentNs > nowNs)
+        return;
+
+    const auto latencyUs = static_cast<uint64_t>((nowNs - sentNs) / 1000);
+    latency.observe(latencyUs);
+
+    stats.latencySamples.fetch_add(1, std::memory_order_relaxed);
+    stats.latencySumMicroseconds.fetch_add(latencyUs, std::memory_order_relaxed);
+    if (latencyUs > stats.latencyMaxMicroseconds.load(std::memory_order_relaxed))
+        stats.latencyMaxMicroseconds.store(latencyUs, std::memory_order_relaxed);
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "loadgen_config.hpp"
+#include "trajectory.hpp"
+#include "../shared/histogram.hpp"
+#include "../shared/packets/udp/client/state_packet.hpp"
+#include "../shared/packets/tcp/tcp_packet_type.hpp"
+
+/* When every simulated client sent its recent states, so whoever receives them can compute the latency.
+ * Written by the sender's worker and read by the receivers', hence atomics. */
+class SendTimeTable {
+public:
+    static constexpr uint32_t HISTORY = 256;
+
+    explicit SendTimeTable(size_t clientCount);
+
+    void record(uint32_t clientIndex, uint32_t sequence, int64_t timeNs);
+
+    /* Returns 0 if the sequence is unknown */
+    [[nodiscard]]
+    int64_t lookup(uint32_t clientIndex, uint32_t sequence) const;
+
+private:
+    size_t clientCount;
+    std::unique_ptr<std::atomic<int64_t>[]> times;
+};
+
+enum class SimulatedClientPhase {
+    Connecting,
+    WaitingForNick,
+    InLobby,
+    Loading,
+    Countdown,
+    Racing,
+    Disconnected
+};
+
+/* Read by the reporting thread while the worker updates them */
+struct SimulatedClientStats {
+    std::atomic<uint64_t> statesSent{0};
+    std::atomic<uint64_t> snapshotsReceived{0};
+    std::atomic<uint64_t> statesReceived{0};
+    /* Gaps in the sequence of another client's states, states overwritten before a server tick count here too */
+    std::atomic<uint64_t> statesMissed{0};
+
+    std::atomic<uint64_t> latencySamples{0};
+    std::atomic<uint64_t> latencySumMicroseconds{0};
+    std::atomic<uint64_t> latencyMaxMicroseconds{0};
+
+    std::atomic<int64_t> firstSnapshotNs{0};
+    std::atomic<int64_t> lastSnapshotNs{0};
+};
+
+/* A headless player speaking the same TCP and UDP protocol as the game client */
+class SimulatedClient {
+public:
+    SimulatedClient(uint32_t index, const Trajectory &trajectory, const LoadgenConfig &config,
+                    SendTimeTable &sendTimes, Histogram &latency);
+
+    ~SimulatedClient();
+
+    SimulatedClient(const SimulatedClient &) = delete;
+
+    SimulatedClient &operator=(const SimulatedClient &) = delete;
+
+    /* Throws std::runtime_error if either socket can't be set up */
+    void connect(const char *host, const char *port);
+
+    void onTcpReadable();
+
+    void onUdpReadable();
+
+    void onDisconnected();
+
+    /* Sends a state packet if one is due */
+    void tick(std::chrono::steady_clock::time_point now);
+
+    [[nodiscard]]
+    int getTcpFd() const;
+
+    [[nodiscard]]
+    int getUdpFd() const;
+
+    [[nodiscard]]
+    uint32_t getIndex() const;
+
+    [[nodiscard]]
+    SimulatedClientPhase getPhase() const;
+
+    [[nodiscard]]
+    const SimulatedClientStats &getStats() const;
+
+private:
+    const uint32_t index;
+    const Trajectory &trajectory;
+    const LoadgenConfig &config;
+    SendTimeTable &sendTimes;
+    Histogram &latency;
+
+    int tcpSocketFd = -1;
+    int udpSocketFd = -1;
+
+    std::atomic<SimulatedClientPhase> phase{SimulatedClientPhase::Connecting};
+    SimulatedClientStats stats;
+
+    int nameAttempts = 0;
+
+    std::vector<char> tcpBuffer;
+
+    std::chrono::steady_clock::time_point raceStartTime;
+    std::chrono::steady_clock::time_point nextStateTime;
+    uint32_t nextStatePacketId = 0;
+    /* Repeated in every state packet like the game does, newest first */
+    InputSample recentInputs[INPUT_REDUNDANCY]{};
+    int lapsSent = 0;
+
+    /* Latest state sequence seen from every opponent */
+    std::unordered_map<uint32_t, uint32_t> lastSequenceBySender;
+
+    void handleTcpPacket(TCPPacketType type, const char *payload, size_t size);
+
+    void sendName();
+
+    void sendUdpInfo() const;
+
+    void sendState(std::chrono::steady_clock::time_point now);
+
+    void sendTcp(const char *data, size_t size) const;
+
+    void recordOpponentState(const char *state, int64_t nowNs);
+};
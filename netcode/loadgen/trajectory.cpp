@@ -0,0 +1,77 @@
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#include "nlohmann/json.hpp"
+
+Trajectory::Trajectory(std::vector<btVector3> waypoints) : waypoints(std::move(waypoints)) {
+    cumulativeLength.reserve(this->waypoints.size() + 1);
+    cumulativeLength.push_back(0.0f);
+
+    for (size_t i = 0; i < this->waypoints.size(); ++i) {
+        const auto &from = this->waypoints[i];
+        const auto &to = this->waypoints[(i + 1) % this->waypoints.size()];
+        cumulativeLength.push_back(cumulativeLength.back() + from.distance(to));
+    }
+}
+
+std::vector<Trajectory> Trajectory::loadFromFile(const std::string &filename) {
+    std::ifstream file(filename);
+    if (!file)
+        throw std::runtime_error("Failed to open paths file: " + filename);
+
+    const auto json = nlohmann::json::parse(file, nullptr, false);
+    if (json.is_discarded() || !json.contains("paths") || !json["paths"].is_array())
+        throw std::runtime_error("Invalid or missing 'paths' array in " + filename);
+
+    std::vector<Trajectory> trajectories;
+    for (const auto &path: json["paths"]) {
+        std::vector<btVector3> waypoints;
+
+        for (const auto &point: path) {
+            if (point.is_array() && point.size() == 3)
+                waypoints.emplace_back(point[0].get<float>(), point[1].get<float>(), point[2].get<float>());
+        }
+
+        if (waypoints.size() >= 2)
+            trajectories.emplace_back(std::move(waypoints));
+    }
+
+    if (trajectories.empty())
+        throw std::runtime_error("No usable paths in " + filename);
+
+    return trajectories;
+}
+
+Trajectory::Sample Trajectory::sample(const float distance, const float speed) const {
+    const float length = getLength();
+    /* Negative distances are behind the start line on the previous lap */
+    const int laps = static_cast<int>(std::floor(distance / length));
+    const float along = std::clamp(distance - static_cast<float>(laps) * length, 0.0f, length);
+
+    const auto segment = std::upper_bound(cumulativeLength.begin(), cumulativeLength.end(), along) -
+                         cumulativeLength.begin() - 1;
+    const auto index = static_cast<size_t>(std::clamp<long>(segment, 0, static_cast<long>(waypoints.size()) - 1));
+
+    const auto &from = waypoints[index];
+    const auto &to = waypoints[(index + 1) % waypoints.size()];
+    const float segmentLength = cumulativeLength[index + 1] - cumulativeLength[index];
+    const float t = segmentLength > 0 ? (along - cumulativeLength[index]) / segmentLength : 0.0f;
+
+    const btVector3 direction = segmentLength > 0 ? (to - from) / segmentLength : btVector3(0, 0, 1);
+    const btScalar yaw = std::atan2(direction.x(), direction.z());
+
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin(from.lerp(to, t));
+    transform.setRotation(btQuaternion(btVector3(0, 1, 0), yaw));
+
+    return {transform, direction * speed, laps};
+}
+
+float Trajectory::getLength() const {
+    return cumulativeLength.back();
+}
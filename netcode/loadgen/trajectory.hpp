@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "LinearMath/btTransform.h"
+
+/* A looped path from paths.json that simulated cars drive along at constant speed */
+class Trajectory {
+public:
+    struct Sample {
+        btTransform transform;
+        btVector3 velocity;
+        /* How many times the car went around the whole path */
+        int laps;
+    };
+
+    explicit Trajectory(std::vector<btVector3> waypoints);
+
+    /* Throws std::runtime_error if the file is missing or has no usable path */
+    static std::vector<Trajectory> loadFromFile(const std::string &filename);
+
+    /* Position and velocity after driving the given distance from the start of the path, may be negative */
+    [[nodiscard]]
+    Sample sample(float distance, float speed) const;
+
+    [[nodiscard]]
+    float getLength() const;
+
+private:
+    std::vector<btVector3> waypoints;
+
+    /* cumulativeLength[i] is the distance from waypoint 0 to waypoint i, the last entry closes the loop */
+    std::vector<float> cumulativeLength;
+};
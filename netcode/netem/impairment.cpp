@@ -0,0 +1,242 @@
+#include "impairment.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include "nlohmann/json.hpp"
+
+using namespace std::chrono;
+
+namespace {
+    struct Preset {
+        const char *name;
+        std::vector<ImpairmentSchedule::Stage> stages;
+        bool loop;
+    };
+
+    const std::vector<Preset> &presets() {
+        static const std::vector<Preset> list = {
+            {"perfect", {{"perfect", {}, {}}}, false},
+            {"lan", {{"lan", {}, {.latencyMs = 1, .jitterMs = 0.2}}}, false},
+            {"wifi", {{"wifi", {}, {.latencyMs = 15, .jitterMs = 5, .lossPercent = 0.5, .reorderPercent = 0.1}}}, false},
+            {
+                "4g", {
+                    {
+                        "4g", {}, {
+                            .latencyMs = 45, .jitterMs = 12, .lossPercent = 1, .duplicatePercent = 0.1,
+                            .reorderPercent = 0.5, .bandwidthKbps = 8000
+                        }
+                    }
+                },
+                false
+            },
+            {
+                "congested", {
+                    {
+                        "congested", {}, {
+                            .latencyMs = 120, .jitterMs = 40, .lossPercent = 3, .duplicatePercent = 1,
+                            .reorderPercent = 2, .bandwidthKbps = 512
+                        }
+                    }
+                },
+                false
+            },
+            {
+                "flaky", {
+                    {"calm", seconds(20), {.latencyMs = 15, .jitterMs = 5, .lossPercent = 0.5}},
+                    {"spike", seconds(5), {.latencyMs = 250, .jitterMs = 80, .lossPercent = 20, .reorderPercent = 5}},
+                    {"recovery", seconds(10), {.latencyMs = 40, .jitterMs = 15, .lossPercent = 2}}
+                },
+                true
+            }
+        };
+
+        return list;
+    }
+
+    ImpairmentProfile parseProfile(const nlohmann::json &json) {
+        ImpairmentProfile profile;
+        profile.latencyMs = json.value("latencyMs", 0.0);
+        profile.jitterMs = json.value("jitterMs", 0.0);
+        profile.lossPercent = json.value("lossPercent", 0.0);
+        profile.duplicatePercent = json.value("duplicatePercent", 0.0);
+        profile.reorderPercent = json.value("reorderPercent", 0.0);
+        profile.bandwidthKbps = json.value("bandwidthKbps", 0.0);
+        return profile;
+    }
+}
+
+void ImpairmentOverrides::applyTo(ImpairmentProfile &profile) const {
+    if (latencyMs) profile.latencyMs = *latencyMs;
+    if (jitterMs) profile.jitterMs = *jitterMs;
+    if (lossPercent) profile.lossPercent = *lossPercent;
+    if (duplicatePercent) profile.duplicatePercent = *duplicatePercent;
+    if (reorderPercent) profile.reorderPercent = *reorderPercent;
+    if (bandwidthKbps) profile.bandwidthKbps = *bandwidthKbps;
+}
+
+ImpairmentSchedule ImpairmentSchedule::load(const std::string &nameOrFile) {
+    ImpairmentSchedule schedule;
+
+    for (const auto &[name, stages, loop]: presets()) {
+        if (nameOrFile == name) {
+            schedule.stages = stages;
+            schedule.loop = loop;
+            return schedule;
+        }
+    }
+
+    std::ifstream file(nameOrFile);
+    if (!file)
+        throw std::runtime_error("No preset or profile file named " + nameOrFile);
+
+    const auto json = nlohmann::json::parse(file, nullptr, false);
+    if (json.is_discarded() || !json.contains("stages") || !json["stages"].is_array() || json["stages"].empty())
+        throw std::runtime_error("Invalid or missing 'stages' array in " + nameOrFile);
+
+    for (const auto &stageJson: json["stages"]) {
+        Stage stage;
+        stage.name = stageJson.value("name", "stage " + std::to_string(schedule.stages.size()));
+        stage.duration = milliseconds(static_cast<int64_t>(stageJson.value("durationSeconds", 0.0) * 1000));
+        stage.profile = parseProfile(stageJson);
+        schedule.stages.push_back(stage);
+    }
+
+    schedule.loop = json.value("loop", false);
+    if (json.contains("seed"))
+        schedule.seed = json["seed"].get<uint64_t>();
+
+    return schedule;
+}
+
+void ImpairmentSchedule::applyOverrides(const ImpairmentOverrides &overrides) {
+    for (auto &stage: stages)
+        overrides.applyTo(stage.profile);
+}
+
+size_t ImpairmentSchedule::stageAt(steady_clock::duration elapsed) const {
+    steady_clock::duration cycle{0};
+    for (const auto &stage: stages) {
+        if (stage.duration.count() == 0)
+            break;
+        cycle += stage.duration;
+    }
+
+    const bool everyStageEnds = std::ranges::all_of(stages, [](const Stage &stage) {
+        return stage.duration.count() > 0;
+    });
+    if (loop && everyStageEnds && cycle.count() > 0)
+        elapsed %= cycle;
+
+    for (size_t i = 0; i < stages.size(); ++i) {
+        if (stages[i].duration.count() == 0 || elapsed < stages[i].duration)
+            return i;
+        elapsed -= stages[i].duration;
+    }
+
+    /* A schedule that doesn't loop stays on its last stage */
+    return stages.size() - 1;
+}
+
+const ImpairmentSchedule::Stage &ImpairmentSchedule::getStage(const size_t index) const {
+    return stages[index];
+}
+
+std::optional<uint64_t> ImpairmentSchedule::getSeed() const {
+    return seed;
+}
+
+ImpairedLink::ImpairedLink(const uint64_t seed, const uint64_t linkIndex, LinkStats &stats) : stats(stats) {
+    std::seed_seq sequence{
+        static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+        static_cast<uint32_t>(linkIndex), static_cast<uint32_t>(linkIndex >> 32)
+    };
+    random.seed(sequence);
+}
+
+std::vector<ImpairedLink::Clock::time_point> ImpairedLink::scheduleDatagram(const size_t size, const Clock::time_point now,
+                                                                            const ImpairmentProfile &profile) {
+    stats.packets++;
+    stats.bytes += size;
+
+    if (chance(profile.lossPercent)) {
+        stats.lost++;
+        return {};
+    }
+
+    const auto sent = transmit(size, now, profile, true);
+    if (!sent) {
+        stats.queueDropped++;
+        return {};
+    }
+
+    std::vector<Clock::time_point> deliveries;
+
+    if (chance(profile.reorderPercent)) {
+        stats.reordered++;
+        deliveries.push_back(*sent);
+    } else {
+        deliveries.push_back(*sent + propagationDelay(profile));
+    }
+
+    if (chance(profile.duplicatePercent)) {
+        stats.duplicated++;
+        deliveries.push_back(*sent + propagationDelay(profile));
+    }
+
+    return deliveries;
+}
+
+ImpairedLink::Clock::time_point ImpairedLink::scheduleStream(const size_t size, const Clock::time_point now,
+                                                             const ImpairmentProfile &profile) {
+    stats.packets++;
+    stats.bytes += size;
+
+    auto delivery = *transmit(size, now, profile, false) + propagationDelay(profile);
+
+    if (chance(profile.lossPercent)) {
+        stats.lost++;
+        delivery += RETRANSMIT_DELAY + duration_cast<Clock::duration>(duration<double, std::milli>(profile.latencyMs));
+    }
+
+    /* Head of line blocking, nothing behind a stalled chunk gets through first */
+    delivery = std::max(delivery, lastStreamDelivery);
+    lastStreamDelivery = delivery;
+
+    return delivery;
+}
+
+ImpairedLink::Clock::time_point ImpairedLink::streamEnd(const Clock::time_point now) const {
+    return std::max(now, lastStreamDelivery);
+}
+
+bool ImpairedLink::chance(const double percent) {
+    if (percent <= 0)
+        return false;
+    return std::uniform_real_distribution(0.0, 100.0)(random) < percent;
+}
+
+ImpairedLink::Clock::duration ImpairedLink::propagationDelay(const ImpairmentProfile &profile) {
+    double delayMs = profile.latencyMs;
+    if (profile.jitterMs > 0)
+        delayMs += std::normal_distribution(0.0, profile.jitterMs)(random);
+
+    return duration_cast<Clock::duration>(duration<double, std::milli>(std::max(0.0, delayMs)));
+}
+
+std::optional<ImpairedLink::Clock::time_point> ImpairedLink::transmit(const size_t size, const Clock::time_point now,
+                                                                      const ImpairmentProfile &profile,
+                                                                      const bool mayDrop) {
+    if (profile.bandwidthKbps <= 0)
+        return now;
+
+    const auto start = std::max(now, busyUntil);
+    if (mayDrop && start - now > MAX_QUEUE_DELAY)
+        return std::nullopt;
+
+    const double seconds = static_cast<double>(size) * 8.0 / (profile.bandwidthKbps * 1000.0);
+    busyUntil = start + duration_cast<Clock::duration>(duration<double>(seconds));
+
+    return busyUntil;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+/* How bad the network is for a while. Applied the same way to both directions. */
+struct ImpairmentProfile {
+    double latencyMs = 0;
+    /* Standard deviation of the extra delay added on top of the latency */
+    double jitterMs = 0;
+    double lossPercent = 0;
+    double duplicatePercent = 0;
+    /* A reordered datagram skips the latency and overtakes the ones already in flight */
+    double reorderPercent = 0;
+    /* 0 means unlimited */
+    double bandwidthKbps = 0;
+};
+
+/* Single fields set on the command line, they win over every stage of the profile */
+struct ImpairmentOverrides {
+    std::optional<double> latencyMs;
+    std::optional<double> jitterMs;
+    std::optional<double> lossPercent;
+    std::optional<double> duplicatePercent;
+    std::optional<double> reorderPercent;
+    std::optional<double> bandwidthKbps;
+
+    void applyTo(ImpairmentProfile &profile) const;
+};
+
+/* A scripted sequence of profiles, e.g. a clean minute followed by ten seconds of heavy loss */
+class ImpairmentSchedule {
+public:
+    struct Stage {
+        std::string name;
+        /* Zero means the stage lasts forever */
+        std::chrono::milliseconds duration{0};
+        ImpairmentProfile profile;
+    };
+
+    /* Built in presets by name, or a JSON file with a "stages" array.
+     * Throws std::runtime_error if neither matches. */
+    static ImpairmentSchedule load(const std::string &nameOrFile);
+
+    void applyOverrides(const ImpairmentOverrides &overrides);
+
+    /* Index of the stage active after the given time since the proxy started */
+    [[nodiscard]]
+    size_t stageAt(std::chrono::steady_clock::duration elapsed) const;
+
+    [[nodiscard]]
+    const Stage &getStage(size_t index) const;
+
+    [[nodiscard]]
+    std::optional<uint64_t> getSeed() const;
+
+private:
+    std::vector<Stage> stages;
+    /* Start over from the first stage after the last one ends */
+    bool loop = false;
+    std::optional<uint64_t> seed;
+};
+
+struct LinkStats {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t lost = 0;
+    /* Tail drops because the bandwidth cap built up too long a queue */
+    uint64_t queueDropped = 0;
+    uint64_t duplicated = 0;
+    uint64_t reordered = 0;
+};
+
+/* One direction of one flow. Decides when, and how many times, every datagram or stream chunk is delivered. */
+class ImpairedLink {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /* Datagrams that would wait longer than this behind the bandwidth cap are dropped */
+    static constexpr auto MAX_QUEUE_DELAY = std::chrono::milliseconds(250);
+
+    /* What a lost segment costs a TCP stream, roughly the minimum retransmission timeout */
+    static constexpr auto RETRANSMIT_DELAY = std::chrono::milliseconds(200);
+
+    /* Every link draws from its own generator so one flow's traffic never changes another's outcome */
+    ImpairedLink(uint64_t seed, uint64_t linkIndex, LinkStats &stats);
+
+    /* Delivery times for a datagram, empty if it is lost. More than one if it is duplicated. */
+    std::vector<Clock::time_point> scheduleDatagram(size_t size, Clock::time_point now,
+                                                    const ImpairmentProfile &profile);
+
+    /* Stream data is never lost, duplicated or reordered. Loss shows up as a retransmission stall instead. */
+    Clock::time_point scheduleStream(size_t size, Clock::time_point now, const ImpairmentProfile &profile);
+
+    /* When a stream closed now would be seen closed, after everything already sent on it */
+    [[nodiscard]]
+    Clock::time_point streamEnd(Clock::time_point now) const;
+
+private:
+    std::mt19937_64 random;
+    LinkStats &stats;
+
+    /* When the bandwidth capped link finishes sending what's already queued */
+    Clock::time_point busyUntil{};
+    /* Stream chunks never overtake each other */
+    Clock::time_point lastStreamDelivery{};
+
+    bool chance(double percent);
+
+    Clock::duration propagationDelay(const ImpairmentProfile &profile);
+
+    /* When the last bit leaves the sender, nullopt if the queue is too long and the caller may drop */
+    std::optional<Clock::time_point> transmit(size_t size, Clock::time_point now, const ImpairmentProfile &profile,
+                                              bool mayDrop);
+};
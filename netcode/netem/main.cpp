@@ -0,0 +1,34 @@
+#include <cstdio>
+#include <exception>
+#include <random>
+
+#include "impairment.hpp"
+#include "netem_config.hpp"
+#include "relay.hpp"
+
+int main(const int argc, char *argv[]) {
+    NetemConfig config;
+    ImpairmentSchedule schedule;
+
+    try {
+        config = NetemConfig::fromArgs(argc, argv);
+        schedule = ImpairmentSchedule::load(config.profile);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, NETEM_USAGE, argv[0]);
+        return 1;
+    }
+
+    schedule.applyOverrides(config.overrides);
+
+    /* Without a seed the run is still reproducible afterwards, the one picked is printed on startup */
+    const uint64_t seed = config.seed.value_or(schedule.getSeed().value_or(std::random_device{}()));
+
+    try {
+        Relay relay(config, std::move(schedule), seed);
+        relay.run();
+    } catch (const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
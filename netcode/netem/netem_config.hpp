@@ -0,0 +1,74 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include "impairment.hpp"
+
+constexpr const char *NETEM_USAGE =
+        "Usage: %s [--listen 1314] [--server-host 127.0.0.1] [--server-port 1313] [--profile NAME|FILE] [--seed N]"
+        " [--latency MS] [--jitter MS] [--loss %%] [--duplicate %%] [--reorder %%] [--bandwidth KBPS]"
+        " [--report SECONDS]\n"
+        "Presets: perfect, lan, wifi, 4g, congested, flaky. Point the game at the proxy with"
+        " NFSPUT_SERVER_PORT=<listen port>.\n";
+
+struct NetemConfig {
+    /* TCP and UDP are both relayed on this port, like the server uses one port for both */
+    std::string listenPort = "1314";
+
+    std::string serverHost = "127.0.0.1";
+    std::string serverPort = "1313";
+
+    std::string profile = "perfect";
+    ImpairmentOverrides overrides;
+
+    /* Same seed and same traffic give the same drops and delays, a seed in the profile file is used otherwise */
+    std::optional<uint64_t> seed;
+
+    int reportSeconds = 5;
+
+    /* Throws std::invalid_argument on malformed arguments */
+    static NetemConfig fromArgs(const int argc, char *argv[]) {
+        NetemConfig config;
+
+        for (int i = 1; i < argc; ++i) {
+            const auto nextValue = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::invalid_argument(std::string("Missing value for ") + argv[i]);
+                return argv[++i];
+            };
+
+            if (std::strcmp(argv[i], "--listen") == 0)
+                config.listenPort = nextValue();
+            else if (std::strcmp(argv[i], "--server-host") == 0)
+                config.serverHost = nextValue();
+            else if (std::strcmp(argv[i], "--server-port") == 0)
+                config.serverPort = nextValue();
+            else if (std::strcmp(argv[i], "--profile") == 0)
+                config.profile = nextValue();
+            else if (std::strcmp(argv[i], "--seed") == 0)
+                config.seed = std::stoull(nextValue());
+            else if (std::strcmp(argv[i], "--latency") == 0)
+                config.overrides.latencyMs = std::stod(nextValue());
+            else if (std::strcmp(argv[i], "--jitter") == 0)
+                config.overrides.jitterMs = std::stod(nextValue());
+            else if (std::strcmp(argv[i], "--loss") == 0)
+                config.overrides.lossPercent = std::stod(nextValue());
+            else if (std::strcmp(argv[i], "--duplicate") == 0)
+                config.overrides.duplicatePercent = std::stod(nextValue());
+            else if (std::strcmp(argv[i], "--reorder") == 0)
+                config.overrides.reorderPercent = std::stod(nextValue());
+            else if (std::strcmp(argv[i], "--bandwidth") == 0)
+                config.overrides.bandwidthKbps = std::stod(nextValue());
+            else if (std::strcmp(argv[i], "--report") == 0)
+                config.reportSeconds = std::max(1, std::stoi(nextValue()));
+            else
+                throw std::invalid_argument(std::string("Unknown option ") + argv[i]);
+        }
+
+        return config;
+    }
+};
@@ -0,0 +1,601 @@
+#include "relay.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "../shared/packets/tcp/tcp_packet_header.hpp"
+#include "../shared/packets/tcp/client/udp_info_packet.hpp"
+
+using namespace std::chrono;
+
+namespace {
+    constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+    constexpr int MAX_EVENTS = 64;
+
+    /* A UDP flow nobody used for this long belongs to a client that went away */
+    constexpr auto FLOW_IDLE_TIMEOUT = seconds(120);
+
+    constexpr uint32_t STREAM_EVENTS = EPOLLIN | EPOLLRDHUP;
+
+    std::runtime_error socketError(const std::string &what) {
+        return std::runtime_error(what + ": " + strerror(errno));
+    }
+
+    uint64_t addressKey(const sockaddr_in &addr) {
+        return static_cast<uint64_t>(addr.sin_addr.s_addr) << 16 | addr.sin_port;
+    }
+
+    uint64_t epollData(const uint32_t id, const uint8_t endpoint) {
+        return static_cast<uint64_t>(id) << 8 | endpoint;
+    }
+
+    void printStats(const char *name, const LinkStats &stats) {
+        printf("  %-8s %9lu pkts %10.1f KB | lost %6lu | queue dropped %6lu | duplicated %5lu | reordered %5lu\n",
+               name, stats.packets, static_cast<double>(stats.bytes) / 1024.0, stats.lost, stats.queueDropped,
+               stats.duplicated, stats.reordered);
+    }
+}
+
+Relay::Relay(const NetemConfig &config, ImpairmentSchedule schedule, const uint64_t seed)
+    : config(config), schedule(std::move(schedule)), seed(seed) {
+    epollFd = epoll_create1(0);
+    if (epollFd < 0)
+        throw socketError("epoll_create1 failed");
+
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timerFd < 0)
+        throw socketError("timerfd_create failed");
+
+    watch(timerFd, Endpoint::Timer, 0, EPOLLIN);
+
+    listen();
+}
+
+Relay::~Relay() {
+    for (const auto &session: sessions | std::views::values) {
+        close(session->clientFd);
+        close(session->serverFd);
+    }
+    for (const auto &flow: flows | std::views::values)
+        close(flow->upstreamFd);
+
+    for (const int fd: {tcpListenFd, udpListenFd, timerFd, epollFd}) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+void Relay::listen() {
+    addrinfo hints{}, *result;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    int status = getaddrinfo(config.serverHost.c_str(), config.serverPort.c_str(), &hints, &result);
+    if (status != 0)
+        throw std::runtime_error(std::string("Failed to resolve the server: ") + gai_strerror(status));
+
+    std::memcpy(&serverAddr, result->ai_addr, result->ai_addrlen);
+    serverAddrLen = result->ai_addrlen;
+    freeaddrinfo(result);
+
+    hints.ai_flags = AI_PASSIVE;
+    status = getaddrinfo(nullptr, config.listenPort.c_str(), &hints, &result);
+    if (status != 0)
+        throw std::runtime_error(std::string("Invalid listen port: ") + gai_strerror(status));
+
+    tcpListenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    udpListenFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (tcpListenFd < 0 || udpListenFd < 0)
+        throw socketError("Failed to create the listening sockets");
+
+    constexpr int yes = 1;
+    setsockopt(tcpListenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    if (bind(tcpListenFd, result->ai_addr, result->ai_addrlen) < 0 ||
+        bind(udpListenFd, result->ai_addr, result->ai_addrlen) < 0) {
+        freeaddrinfo(result);
+        throw socketError("Failed to bind port " + config.listenPort);
+    }
+    freeaddrinfo(result);
+
+    if (::listen(tcpListenFd, SOMAXCONN) < 0)
+        throw socketError("listen failed");
+
+    watch(tcpListenFd, Endpoint::TcpListener, 0, EPOLLIN);
+    watch(udpListenFd, Endpoint::UdpListener, 0, EPOLLIN);
+}
+
+void Relay::run() {
+    startTime = Clock::now();
+    auto nextReport = startTime + seconds(config.reportSeconds);
+
+    const auto &firstStage = schedule.getStage(0);
+    printf("Relaying port %s to %s:%s with seed %" PRIu64 ", stage \"%s\"\n", config.listenPort.c_str(),
+           config.serverHost.c_str(), config.serverPort.c_str(), seed, firstStage.name.c_str());
+    fflush(stdout);
+
+    epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        const auto untilReport = duration_cast<milliseconds>(nextReport - Clock::now()).count();
+        const int n = epoll_wait(epollFd, events, MAX_EVENTS, static_cast<int>(std::max<int64_t>(0, untilReport)));
+        if (n < 0 && errno != EINTR)
+            throw socketError("epoll_wait failed");
+
+        for (int i = 0; i < n; ++i) {
+            try {
+                handleEvent(events[i].data.u64, events[i].events);
+            } catch (const std::runtime_error &e) {
+                fprintf(stderr, "%s\n", e.what());
+            }
+        }
+
+        const auto now = Clock::now();
+        deliverDue(now);
+        armTimer();
+
+        if (now >= nextReport) {
+            printReport(now);
+            expireIdleFlows(now);
+            nextReport += seconds(config.reportSeconds);
+        }
+    }
+}
+
+void Relay::watch(const int fd, const Endpoint endpoint, const uint32_t id, const uint32_t events) const {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.u64 = epollData(id, static_cast<uint8_t>(endpoint));
+
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        throw socketError("epoll_ctl failed");
+}
+
+void Relay::updateWatch(const int fd, const Endpoint endpoint, const uint32_t id, const uint32_t events) const {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.u64 = epollData(id, static_cast<uint8_t>(endpoint));
+
+    /* A side that stopped reading was taken out of the set, it comes back for EPOLLOUT only */
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0 && errno == ENOENT)
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void Relay::handleEvent(const uint64_t data, const uint32_t events) {
+    const auto endpoint = static_cast<Endpoint>(data & 0xFF);
+    const auto id = static_cast<uint32_t>(data >> 8);
+
+    switch (endpoint) {
+        case Endpoint::TcpListener:
+            acceptClients();
+            return;
+
+        case Endpoint::UdpListener:
+            readUdpListener();
+            return;
+
+        case Endpoint::Timer: {
+            uint64_t expirations;
+            [[maybe_unused]] const auto bytes = read(timerFd, &expirations, sizeof(expirations));
+            return;
+        }
+
+        case Endpoint::UdpUpstream:
+            if (const auto flow = flows.find(id); flow != flows.end())
+                readUdpUpstream(*flow->second);
+            return;
+
+        case Endpoint::Client:
+        case Endpoint::Server: {
+            const auto session = sessions.find(id);
+            if (session == sessions.end())
+                return;
+
+            if (endpoint == Endpoint::Server && session->second->serverConnecting) {
+                finishConnect(*session->second);
+                return;
+            }
+
+            if (events & EPOLLOUT)
+                flushStream(*session->second, endpoint);
+
+            if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                return;
+
+            if (endpoint == Endpoint::Client && session->second->clientReading)
+                readClient(*session->second);
+            else if (endpoint == Endpoint::Server && session->second->serverReading)
+                readServer(*session->second);
+        }
+    }
+}
+
+void Relay::acceptClients() {
+    while (true) {
+        sockaddr_in clientAddr{};
+        socklen_t addrLen = sizeof(clientAddr);
+
+        const int clientFd = accept4(tcpListenFd, reinterpret_cast<sockaddr *>(&clientAddr), &addrLen,
+                                     SOCK_NONBLOCK);
+        if (clientFd < 0)
+            return;
+
+        /* The connect completes on EPOLLOUT, a slow server must not hold up the other sessions */
+        const int serverFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        const bool connected = serverFd >= 0 &&
+                               connect(serverFd, reinterpret_cast<sockaddr *>(&serverAddr), serverAddrLen) == 0;
+        if (!connected && (serverFd < 0 || errno != EINPROGRESS)) {
+            fprintf(stderr, "Failed to connect to the server: %s\n", strerror(errno));
+            close(clientFd);
+            if (serverFd >= 0)
+                close(serverFd);
+            continue;
+        }
+
+        constexpr int yes = 1;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        setsockopt(serverFd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        const auto id = nextSessionId++;
+        auto session = std::unique_ptr<Session>(new Session{
+            .id = id,
+            .clientAddr = clientAddr,
+            .clientFd = clientFd,
+            .serverFd = serverFd,
+            .upLink = ImpairedLink(seed, nextLinkIndex++, tcpUpStats),
+            .downLink = ImpairedLink(seed, nextLinkIndex++, tcpDownStats)
+        });
+        session->serverConnecting = !connected;
+
+        watch(clientFd, Endpoint::Client, id, STREAM_EVENTS);
+        watch(serverFd, Endpoint::Server, id, connected ? STREAM_EVENTS : STREAM_EVENTS | EPOLLOUT);
+        sessions.emplace(id, std::move(session));
+    }
+}
+
+void Relay::finishConnect(Session &session) {
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+    if (getsockopt(session.serverFd, SOL_SOCKET, SO_ERROR, &error, &errorLen) < 0)
+        error = errno;
+
+    if (error != 0) {
+        fprintf(stderr, "Failed to connect to the server: %s\n", strerror(error));
+        closeSession(session.id);
+        return;
+    }
+
+    session.serverConnecting = false;
+    if (session.serverOut.empty())
+        updateWatch(session.serverFd, Endpoint::Server, session.id, STREAM_EVENTS);
+    else
+        flushStream(session, Endpoint::Server);
+}
+
+void Relay::readClient(Session &session) {
+    char buf[READ_BUFFER_SIZE];
+    const auto now = Clock::now();
+    bool closed = false;
+
+    while (true) {
+        const ssize_t n = recv(session.clientFd, buf, sizeof(buf), 0);
+
+        if (n > 0) {
+            session.pendingUp.insert(session.pendingUp.end(), buf, buf + n);
+            continue;
+        }
+
+        closed = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+
+    auto packets = takeCompletePackets(session);
+    if (!packets.empty()) {
+        const auto due = session.upLink.scheduleStream(packets.size(), now, currentProfile(now));
+        enqueueDelivery(Endpoint::Server, session.id, due, std::move(packets));
+    }
+
+    if (closed) {
+        /* The close travels behind the data still in flight */
+        session.clientReading = false;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, session.clientFd, nullptr);
+        enqueueDelivery(Endpoint::Server, session.id, session.upLink.streamEnd(now), {}, true);
+    }
+}
+
+void Relay::readServer(Session &session) {
+    char buf[READ_BUFFER_SIZE];
+    const auto now = Clock::now();
+
+    while (true) {
+        const ssize_t n = recv(session.serverFd, buf, sizeof(buf), 0);
+
+        if (n > 0) {
+            const auto due = session.downLink.scheduleStream(n, now, currentProfile(now));
+            enqueueDelivery(Endpoint::Client, session.id, due, std::vector(buf, buf + n));
+            continue;
+        }
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        session.serverReading = false;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, session.serverFd, nullptr);
+        enqueueDelivery(Endpoint::Client, session.id, session.downLink.streamEnd(now), {}, true);
+        return;
+    }
+}
+
+std::vector<char> Relay::takeCompletePackets(Session &session) {
+    auto &pending = session.pendingUp;
+    size_t offset = 0;
+
+    while (pending.size() - offset >= sizeof(TCPPacketHeader)) {
+        TCPPacketHeader header{};
+        std::memcpy(&header, pending.data() + offset, sizeof(header));
+
+        const size_t packetSize = sizeof(header) + header.payloadSize;
+        if (pending.size() - offset < packetSize)
+            break;
+
+        /* The server pairs the UDP port in UdpInfo with the TCP peer address, which is us now */
+        if (header.type == TCPPacketType::UdpInfo && header.payloadSize == UDP_INFO_PAYLOAD_SIZE) {
+            char *portAddress = pending.data() + offset + sizeof(header);
+            uint16_t clientPort;
+            std::memcpy(&clientPort, portAddress, sizeof(clientPort));
+
+            sockaddr_in clientUdpAddr = session.clientAddr;
+            clientUdpAddr.sin_port = htons(clientPort);
+
+            const auto &flow = getOrCreateFlow(clientUdpAddr);
+            std::memcpy(portAddress, &flow.localPort, sizeof(flow.localPort));
+        }
+
+        offset += packetSize;
+    }
+
+    std::vector packets(pending.begin(), pending.begin() + static_cast<ssize_t>(offset));
+    pending.erase(pending.begin(), pending.begin() + static_cast<ssize_t>(offset));
+    return packets;
+}
+
+void Relay::readUdpListener() {
+    char buf[READ_BUFFER_SIZE];
+
+    while (true) {
+        sockaddr_in clientAddr{};
+        socklen_t addrLen = sizeof(clientAddr);
+
+        const ssize_t n = recvfrom(udpListenFd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr *>(&clientAddr),
+                                   &addrLen);
+        if (n < 0)
+            return;
+
+        const auto now = Clock::now();
+        auto &flow = getOrCreateFlow(clientAddr);
+        flow.lastActive = now;
+
+        for (const auto due: flow.upLink.scheduleDatagram(n, now, currentProfile(now)))
+            enqueueDelivery(Endpoint::UdpUpstream, flow.id, due, std::vector(buf, buf + n));
+    }
+}
+
+void Relay::readUdpUpstream(UdpFlow &flow) {
+    char buf[READ_BUFFER_SIZE];
+
+    while (true) {
+        const ssize_t n = recv(flow.upstreamFd, buf, sizeof(buf), 0);
+        if (n < 0)
+            return;
+
+        const auto now = Clock::now();
+        flow.lastActive = now;
+
+        for (const auto due: flow.downLink.scheduleDatagram(n, now, currentProfile(now)))
+            enqueueDelivery(Endpoint::UdpListener, flow.id, due, std::vector(buf, buf + n));
+    }
+}
+
+Relay::UdpFlow &Relay::getOrCreateFlow(const sockaddr_in &clientAddr) {
+    const auto key = addressKey(clientAddr);
+    if (const auto existing = flowIdByAddress.find(key); existing != flowIdByAddress.end())
+        return *flows.at(existing->second);
+
+    const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&serverAddr), serverAddrLen) < 0)
+        throw socketError("Failed to open a UDP socket towards the server");
+
+    sockaddr_in localAddr{};
+    socklen_t addrLen = sizeof(localAddr);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&localAddr), &addrLen);
+
+    const auto id = nextFlowId++;
+    auto flow = std::unique_ptr<UdpFlow>(new UdpFlow{
+        .id = id,
+        .clientAddr = clientAddr,
+        .upstreamFd = fd,
+        .localPort = ntohs(localAddr.sin_port),
+        .upLink = ImpairedLink(seed, nextLinkIndex++, udpUpStats),
+        .downLink = ImpairedLink(seed, nextLinkIndex++, udpDownStats),
+        .lastActive = Clock::now()
+    });
+
+    watch(fd, Endpoint::UdpUpstream, id, EPOLLIN);
+    flowIdByAddress.emplace(key, id);
+
+    return *flows.emplace(id, std::move(flow)).first->second;
+}
+
+void Relay::enqueueDelivery(const Endpoint target, const uint32_t id, const Clock::time_point due,
+                            std::vector<char> data, const bool close) {
+    deliveries.push({due, nextDeliverySequence++, target, id, std::move(data), close});
+}
+
+void Relay::deliverDue(const Clock::time_point now) {
+    while (!deliveries.empty() && deliveries.top().due <= now) {
+        /* Moving out of the top is fine, the element is popped right after */
+        auto delivery = std::move(const_cast<Delivery &>(deliveries.top()));
+        deliveries.pop();
+        deliver(delivery);
+    }
+}
+
+void Relay::deliver(Delivery &delivery) {
+    switch (delivery.target) {
+        case Endpoint::UdpUpstream:
+            if (const auto flow = flows.find(delivery.id); flow != flows.end())
+                send(flow->second->upstreamFd, delivery.data.data(), delivery.data.size(), 0);
+            return;
+
+        case Endpoint::UdpListener:
+            if (const auto flow = flows.find(delivery.id); flow != flows.end()) {
+                const auto &clientAddr = flow->second->clientAddr;
+                sendto(udpListenFd, delivery.data.data(), delivery.data.size(), 0,
+                       reinterpret_cast<const sockaddr *>(&clientAddr), sizeof(clientAddr));
+            }
+            return;
+
+        case Endpoint::Client:
+        case Endpoint::Server: {
+            const auto session = sessions.find(delivery.id);
+            if (session == sessions.end())
+                return;
+
+            if (delivery.close) {
+                flushStream(*session->second, delivery.target);
+                closeSession(delivery.id);
+                return;
+            }
+
+            writeStream(*session->second, delivery.target, delivery.data.data(), delivery.data.size());
+            return;
+        }
+
+        default:
+            return;
+    }
+}
+
+void Relay::writeStream(Session &session, const Endpoint side, const char *data, const size_t size) {
+    auto &out = side == Endpoint::Client ? session.clientOut : session.serverOut;
+    const int fd = side == Endpoint::Client ? session.clientFd : session.serverFd;
+
+    /* Until the server accepts the connection everything for it waits in out */
+    const bool connecting = side == Endpoint::Server && session.serverConnecting;
+
+    size_t sent = 0;
+    if (out.empty() && !connecting) {
+        const ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n > 0)
+            sent = n;
+    }
+
+    if (sent == size)
+        return;
+
+    const bool wasEmpty = out.empty();
+    out.insert(out.end(), data + sent, data + size);
+
+    if (wasEmpty && !connecting) {
+        const bool reading = side == Endpoint::Client ? session.clientReading : session.serverReading;
+        updateWatch(fd, side, session.id, (reading ? STREAM_EVENTS : 0) | EPOLLOUT);
+    }
+}
+
+void Relay::flushStream(Session &session, const Endpoint side) {
+    auto &out = side == Endpoint::Client ? session.clientOut : session.serverOut;
+    const int fd = side == Endpoint::Client ? session.clientFd : session.serverFd;
+
+    if (out.empty())
+        return;
+
+    const ssize_t n = send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+    if (n > 0)
+        out.erase(out.begin(), out.begin() + n);
+
+    if (out.empty()) {
+        const bool reading = side == Endpoint::Client ? session.clientReading : session.serverReading;
+        updateWatch(fd, side, session.id, reading ? STREAM_EVENTS : 0);
+    }
+}
+
+void Relay::closeSession(const uint32_t id) {
+    const auto session = sessions.find(id);
+    if (session == sessions.end())
+        return;
+
+    /* Closing removes the descriptors from the epoll set as well */
+    close(session->second->clientFd);
+    close(session->second->serverFd);
+    sessions.erase(session);
+}
+
+void Relay::expireIdleFlows(const Clock::time_point now) {
+    for (auto it = flows.begin(); it != flows.end();) {
+        if (now - it->second->lastActive < FLOW_IDLE_TIMEOUT) {
+            ++it;
+            continue;
+        }
+
+        close(it->second->upstreamFd);
+        flowIdByAddress.erase(addressKey(it->second->clientAddr));
+        it = flows.erase(it);
+    }
+}
+
+void Relay::armTimer() {
+    itimerspec spec{};
+
+    if (!deliveries.empty()) {
+        const auto due = duration_cast<nanoseconds>(deliveries.top().due.time_since_epoch()).count();
+        /* A zero it_value would disarm the timer */
+        spec.it_value.tv_sec = due / 1'000'000'000;
+        spec.it_value.tv_nsec = std::max<int64_t>(1, due % 1'000'000'000);
+    }
+
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+const ImpairmentProfile &Relay::currentProfile(const Clock::time_point now) {
+    const auto stage = schedule.stageAt(now - startTime);
+
+    if (stage != currentStage) {
+        currentStage = stage;
+        printf("[%6.1fs] Switched to stage \"%s\"\n", duration<double>(now - startTime).count(),
+               schedule.getStage(stage).name.c_str());
+        fflush(stdout);
+    }
+
+    return schedule.getStage(stage).profile;
+}
+
+void Relay::printReport(const Clock::time_point now) const {
+    const auto &stage = schedule.getStage(schedule.stageAt(now - startTime));
+    const auto &profile = stage.profile;
+
+    printf("[%6.1fs] stage \"%s\": latency %.0fms jitter %.0fms loss %.1f%% dup %.1f%% reorder %.1f%% "
+           "bandwidth %s | %zu sessions, %zu UDP flows, %zu deliveries queued\n",
+           duration<double>(now - startTime).count(), stage.name.c_str(), profile.latencyMs, profile.jitterMs,
+           profile.lossPercent, profile.duplicatePercent, profile.reorderPercent,
+           profile.bandwidthKbps > 0 ? (std::to_string(static_cast<int>(profile.bandwidthKbps)) + "kbps").c_str()
+                                     : "unlimited",
+           sessions.size(), flows.size(), deliveries.size());
+
+    printStats("tcp up", tcpUpStats);
+    printStats("tcp down", tcpDownStats);
+    printStats("udp up", udpUpStats);
+    printStats("udp down", udpDownStats);
+    fflush(stdout);
+}
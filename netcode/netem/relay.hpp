@@ -0,0 +1,174 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <netinet/in.h>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "impairment.hpp"
+#include "netem_config.hpp"
+
+/* Single threaded TCP and UDP relay between game clients and the server that delays, drops, duplicates and
+ * reorders traffic according to an ImpairmentSchedule */
+class Relay {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /* Throws std::runtime_error if the listening sockets can't be set up */
+    Relay(const NetemConfig &config, ImpairmentSchedule schedule, uint64_t seed);
+
+    ~Relay();
+
+    Relay(const Relay &) = delete;
+
+    Relay &operator=(const Relay &) = delete;
+
+    [[noreturn]] void run();
+
+private:
+    /* What an epoll event or a delivery refers to, stored in the lowest byte next to the session or flow id */
+    enum class Endpoint : uint8_t {
+        TcpListener,
+        UdpListener,
+        Timer,
+        /* TCP connection with the game client */
+        Client,
+        /* TCP connection with the server */
+        Server,
+        /* UDP socket talking to the server on behalf of one client */
+        UdpUpstream
+    };
+
+    struct Session {
+        uint32_t id;
+        sockaddr_in clientAddr;
+
+        int clientFd;
+        int serverFd;
+
+        ImpairedLink upLink;
+        ImpairedLink downLink;
+
+        /* Client bytes waiting for the rest of their TCP packet, so UdpInfo can be rewritten whole */
+        std::vector<char> pendingUp{};
+
+        /* Delivered but not yet accepted by the socket */
+        std::vector<char> clientOut{};
+        std::vector<char> serverOut{};
+
+        bool clientReading = true;
+        bool serverReading = true;
+        /* The non-blocking connect to the server hasn't completed yet */
+        bool serverConnecting = false;
+    };
+
+    struct UdpFlow {
+        uint32_t id;
+        sockaddr_in clientAddr;
+
+        int upstreamFd;
+        /* The port the server sees, reported to it in place of the client's own */
+        uint16_t localPort;
+
+        ImpairedLink upLink;
+        ImpairedLink downLink;
+
+        Clock::time_point lastActive;
+    };
+
+    struct Delivery {
+        Clock::time_point due;
+        /* Keeps deliveries due at the same time in the order they were scheduled */
+        uint64_t sequence;
+
+        Endpoint target;
+        uint32_t id;
+        std::vector<char> data;
+
+        /* Closes the session once everything before it went through */
+        bool close = false;
+
+        bool operator>(const Delivery &other) const {
+            return due != other.due ? due > other.due : sequence > other.sequence;
+        }
+    };
+
+    const NetemConfig &config;
+    ImpairmentSchedule schedule;
+    const uint64_t seed;
+    uint64_t nextLinkIndex = 0;
+
+    Clock::time_point startTime;
+    size_t currentStage = 0;
+
+    int epollFd = -1;
+    int timerFd = -1;
+    int tcpListenFd = -1;
+    int udpListenFd = -1;
+
+    sockaddr_storage serverAddr{};
+    socklen_t serverAddrLen = 0;
+
+    uint32_t nextSessionId = 0;
+    uint32_t nextFlowId = 0;
+
+    std::unordered_map<uint32_t, std::unique_ptr<Session> > sessions;
+    std::unordered_map<uint32_t, std::unique_ptr<UdpFlow> > flows;
+    std::unordered_map<uint64_t, uint32_t> flowIdByAddress;
+
+    std::priority_queue<Delivery, std::vector<Delivery>, std::greater<> > deliveries;
+    uint64_t nextDeliverySequence = 0;
+
+    LinkStats tcpUpStats, tcpDownStats, udpUpStats, udpDownStats;
+
+    void listen();
+
+    void watch(int fd, Endpoint endpoint, uint32_t id, uint32_t events) const;
+
+    void updateWatch(int fd, Endpoint endpoint, uint32_t id, uint32_t events) const;
+
+    void handleEvent(uint64_t data, uint32_t events);
+
+    void acceptClients();
+
+    /* Checks the outcome of the connect to the server once its socket turns writable */
+    void finishConnect(Session &session);
+
+    void readClient(Session &session);
+
+    void readServer(Session &session);
+
+    void readUdpListener();
+
+    void readUdpUpstream(UdpFlow &flow);
+
+    /* Cuts complete TCP packets off pendingUp, pointing UdpInfo at the flow the proxy uses for that client */
+    std::vector<char> takeCompletePackets(Session &session);
+
+    UdpFlow &getOrCreateFlow(const sockaddr_in &clientAddr);
+
+    void enqueueDelivery(Endpoint target, uint32_t id, Clock::time_point due, std::vector<char> data,
+                         bool close = false);
+
+    void deliverDue(Clock::time_point now);
+
+    void deliver(Delivery &delivery);
+
+    /* Sends what the socket accepts and keeps the rest in out for EPOLLOUT */
+    void writeStream(Session &session, Endpoint side, const char *data, size_t size);
+
+    void flushStream(Session &session, Endpoint side);
+
+    void closeSession(uint32_t id);
+
+    void expireIdleFlows(Clock::time_point now);
+
+    void armTimer();
+
+    [[nodiscard]]
+    const ImpairmentProfile &currentProfile(Clock::time_point now);
+
+    void printReport(Clock::time_point now) const;
+};
@@ -16,7 +16,7 @@ public:
 
     virtual void listen(const char *port) = 0;
 
-    virtual void send(ClientHandle client, const std::unique_ptr<char[]> &data, ssize_t size) const = 0;
+    virtual void send(const ClientHandle &client, const std::unique_ptr<char[]> &data, ssize_t size) const = 0;
 
     virtual void sendToAll(const std::unique_ptr<char[]> &data, ssize_t size) const = 0;
 
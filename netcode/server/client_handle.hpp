@@ -1,9 +1,27 @@
 #pragma once
 
+#include "client_outbox.hpp"
 #include "../shared/opponent_info.hpp"
 
+#include <atomic>
 #include <netinet/in.h>
 #include <string>
+
+constexpr uint32_t NO_ROOM = UINT32_MAX;
+
+/* IPv4 address and port in one word, so it can be swapped atomically and used as a lookup key */
+inline uint64_t packAddress(const sockaddr_in &addr) {
+    return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | ntohs(addr.sin_port);
+}
+
+inline sockaddr_in unpackAddress(const uint64_t packed) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = static_cast<in_addr_t>(packed >> 16);
+    addr.sin_port = htons(static_cast<uint16_t>(packed & 0xFFFF));
+    return addr;
+}
+
 enum class ClientStateLobby {
     WaitingForNick,
     InLobby,
@@ -12,18 +30,44 @@ enum class ClientStateLobby {
 
 struct ClientHandle {
     int tcpSocketFd;
-    mutable sockaddr_in udpAddr;
     uint16_t id;
 
-    bool connected;
+    /* Changed by the TCP thread when the client reports its UDP port, read by every thread that sends to it */
+    std::atomic<uint64_t> udpAddress = 0;
+
+    /* Cleared by the TCP thread when it closes the socket, checked before every send */
+    std::atomic<bool> connected = false;
     int lastReceivedPacketId;
     std::string nick;
-    ClientStateLobby state = ClientStateLobby::WaitingForNick;
+    /* Changed by the TCP thread and the room's worker, read by every thread */
+    std::atomic<ClientStateLobby> state = ClientStateLobby::WaitingForNick;
 
+    /* Only touched with the room's state.mtx held once the client joined a room */
     PlayerVehicleColor vehicleColor;
-
     uint8_t gridPosition;
     bool gameLoaded;
 
-    uint8_t laps;
+    /* Reported over TCP, read by the room's worker to tell when the race is over */
+    std::atomic<uint8_t> laps = 0;
+
+    /* Set by the TCP thread, the UDP thread looks the room up by it */
+    std::atomic<uint32_t> roomId = NO_ROOM;
+
+    /* State packet ids are sequential per client, the gaps between them give us the loss rate. Written by the UDP
+     * thread, read on metrics scrapes. */
+    std::atomic<uint64_t> statePacketsReceived = 0;
+    std::atomic<uint32_t> firstStatePacketId = 0;
+    std::atomic<uint32_t> highestStatePacketId = 0;
+
+    /* TCP sends from any thread end up here, the TCP thread writes them out */
+    mutable ClientOutbox outbox;
+
+    [[nodiscard]]
+    sockaddr_in getUdpAddr() const {
+        return unpackAddress(udpAddress);
+    }
+
+    void setUdpAddr(const sockaddr_in &addr) {
+        udpAddress = packAddress(addr);
+    }
 };
@@ -1,41 +1,58 @@
 #pragma once
+#include <cstring>
+#include <memory>
 #include <unordered_map>
+#include <mutex>
 #include <netdb.h>
+#include <stdexcept>
+#include <linux/sockios.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 
 #include "client_handle.hpp"
+#include "metrics.hpp"
+#include "../shared/logger.hpp"
 
 #include <ranges>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
 class ClientManager {
 public:
-    int numberOfConnectedClients = 0;
-    ClientHandle *getClient(const uint16_t id) {
+    ClientManager() {
+        tcpEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (tcpEventFd < 0)
+            throw std::runtime_error(std::string("Failed to create the TCP eventfd: ") + strerror(errno));
+    }
+
+    ~ClientManager() {
+        close(tcpEventFd);
+    }
+
+    ClientManager(const ClientManager &) = delete;
+
+    ClientManager &operator=(const ClientManager &) = delete;
+
+    std::shared_ptr<ClientHandle> getClient(const uint16_t id) {
+        std::lock_guard lock(mtx);
         const auto client = clients.find(id);
         if (client == clients.end()) return nullptr;
 
-        return &client->second;
-    }
-    void resetAll() {
-        for (auto& [id, client] : clients) {
-            if (client.connected) {
-                close(client.tcpSocketFd);
-            }
-        }
-        clients.clear();
-        numberOfConnectedClients=0;
+        return client->second;
     }
-
     bool nameTaken(const std::string & nickname, const uint16_t client_id) {
-        for (auto &val: getAllClients() | std::views::values) {
-            if (val.nick == nickname && val.id != client_id)
+        std::lock_guard lock(mtx);
+        for (const auto &val: clients | std::views::values) {
+            if (val->nick == nickname && val->id != client_id)
                 return true;
         }
         return false;
     }
 
-    ClientHandle *getClient(const sockaddr_in &address) {
+    std::shared_ptr<ClientHandle> getClient(const sockaddr_in &address) {
+        std::lock_guard lock(mtx);
         const auto clientAddress = clientIdsByAddress.find(packAddress(address));
         if (clientAddress == clientIdsByAddress.end()) {
             return nullptr;
@@ -46,98 +63,170 @@ public:
             return nullptr;
         }
 
-        return &client->second;
+        return client->second;
     }
 
-    std::vector<std::string> getNicksInLobby() {
-        std::vector<std::string> nicks;
-        for (const auto &[id, c] : getAllClients()) {
-            if (c.state == ClientStateLobby::InLobby)
-                nicks.push_back(c.nick);
-        }
-        return nicks;
-    }
-
-    ClientHandle* getClientByFd(int fd) {
+    std::shared_ptr<ClientHandle> getClientByFd(int fd) {
+        std::lock_guard lock(mtx);
         for (auto &[id, client] : clients) {
-            if (client.tcpSocketFd == fd)
-                return &client;
+            if (client->tcpSocketFd == fd)
+                return client;
         }
         return nullptr;
     }
 
     void updateClientUdpAddr(ClientHandle &client, const sockaddr_in udpAddr) {
-        clientIdsByAddress.erase(packAddress(client.udpAddr));
-        client.udpAddr = udpAddr;
-        clientIdsByAddress.emplace(packAddress(client.udpAddr), client.id);
+        std::lock_guard lock(mtx);
+        clientIdsByAddress.erase(client.udpAddress);
+        client.setUdpAddr(udpAddr);
+        clientIdsByAddress.emplace(client.udpAddress, client.id);
     }
 
+    /* TCP thread only, it owns the sockets. Threads still holding the handle keep it alive but it is not connected
+     * anymore. */
     void removeClient(int fd) {
+        std::lock_guard lock(mtx);
         for (auto it = clients.begin(); it != clients.end(); ++it) {
-            if (it->second.tcpSocketFd == fd) {
-                clientIdsByAddress.erase(packAddress(it->second.udpAddr));
+            if (it->second->tcpSocketFd == fd) {
+                clientIdsByAddress.erase(it->second->udpAddress);
 
-                close(it->second.tcpSocketFd);
+                it->second->connected = false;
+                close(it->second->tcpSocketFd);
 
                 clients.erase(it);
-                numberOfConnectedClients--;
                 break;
             }
         }
     }
-    void setNickName(const int fd, const std::string &nickname) {
-        ClientHandle* client = getClientByFd(fd);
-        if (!client) return;
-        client->nick = nickname;
+
+    /* Any thread, the TCP thread removes the client once it wakes up on getTcpEventFd */
+    void requestDisconnect(const uint16_t id) {
+        {
+            std::lock_guard lock(mtx);
+            disconnectRequests.push_back(id);
+        }
+
+        wakeTcpThread();
+    }
+
+    /* Any thread, the TCP thread writes out the client's outbox once it wakes up on getTcpEventFd */
+    void requestFlush(const uint16_t id) {
+        {
+            std::lock_guard lock(mtx);
+            flushRequests.push_back(id);
+        }
+
+        wakeTcpThread();
+    }
+
+    /* TCP thread only, clears the eventfd before handing out what was requested so far */
+    std::pair<std::vector<uint16_t>, std::vector<uint16_t> > takeTcpRequests() {
+        uint64_t count;
+        [[maybe_unused]] const auto bytes = read(tcpEventFd, &count, sizeof(count));
+
+        std::lock_guard lock(mtx);
+        return {std::exchange(disconnectRequests, {}), std::exchange(flushRequests, {})};
     }
 
-    int getNumberOfConnectedClients() const {
-        return numberOfConnectedClients;
+    [[nodiscard]]
+    int getTcpEventFd() const {
+        return tcpEventFd;
     }
 
-    std::unordered_map<uint16_t, ClientHandle> &getAllClients() { return clients; }
+    /* Snapshot of the clients, safe to use while other threads add and remove them */
+    std::vector<std::shared_ptr<ClientHandle> > getAllClients() const {
+        std::lock_guard lock(mtx);
+        std::vector<std::shared_ptr<ClientHandle> > result;
+        result.reserve(clients.size());
+        for (const auto &client: clients | std::views::values)
+            result.push_back(client);
+        return result;
+    }
 
     void ToLobby(const std::string &nickname, ClientHandle & client) {
+        std::lock_guard lock(mtx);
         client.nick = nickname;
         client.state = ClientStateLobby::InLobby;
-        numberOfConnectedClients++;
     }
 
-    ClientHandle *newClient(sockaddr_in addr, int fd) {
-        auto client = ClientHandle();
-        client.udpAddr = addr;
-        client.id = lastClientId;
+    /* Per client RTT and send queue come straight from the kernel's view of the TCP connection */
+    void writeMetrics(MetricsWriter &writer) const {
+        std::lock_guard lock(mtx);
+
+        writer.family("nfsput_client_rtt_microseconds", "Smoothed TCP round trip time per client", "gauge");
+        for (const auto &client: clients | std::views::values) {
+            tcp_info info{};
+            socklen_t infoSize = sizeof(info);
+            if (getsockopt(client->tcpSocketFd, IPPROTO_TCP, TCP_INFO, &info, &infoSize) == 0)
+                writer.sample("nfsput_client_rtt_microseconds", clientLabels(*client), static_cast<uint64_t>(info.tcpi_rtt));
+        }
+
+        writer.family("nfsput_client_tcp_send_queue_bytes", "Bytes not yet acknowledged by the client", "gauge");
+        for (const auto &client: clients | std::views::values) {
+            int queued = 0;
+            if (ioctl(client->tcpSocketFd, SIOCOUTQ, &queued) == 0)
+                writer.sample("nfsput_client_tcp_send_queue_bytes", clientLabels(*client), static_cast<uint64_t>(queued));
+        }
+
+        writer.family("nfsput_client_udp_loss_ratio", "Share of state packets that never arrived per client", "gauge");
+        for (const auto &client: clients | std::views::values) {
+            if (client->statePacketsReceived == 0)
+                continue;
+
+            const auto expected = static_cast<double>(client->highestStatePacketId - client->firstStatePacketId) + 1;
+            const auto loss = std::max(0.0, 1.0 - static_cast<double>(client->statePacketsReceived) / expected);
+            writer.sample("nfsput_client_udp_loss_ratio", clientLabels(*client), loss);
+        }
+    }
 
-        client.tcpSocketFd = fd;
+    std::shared_ptr<ClientHandle> newClient(sockaddr_in addr, int fd) {
+        std::lock_guard lock(mtx);
+        auto client = std::make_shared<ClientHandle>();
+        client->setUdpAddr(addr);
+        client->id = lastClientId;
 
-        client.connected = true;
+        client->tcpSocketFd = fd;
 
-        client.connected = true;
+        client->connected = true;
+        client->outbox.setOnPending([this, id = lastClientId] {
+            requestFlush(id);
+        });
 
-        client.gridPosition = lastClientId;
+        client->gridPosition = lastClientId;
 
         clients.emplace(lastClientId, client);
-        clientIdsByAddress.emplace(packAddress(client.udpAddr), lastClientId);
+        clientIdsByAddress.emplace(client->udpAddress, lastClientId);
 
         lastClientId++;
 
         char host[NI_MAXHOST], port[NI_MAXSERV];
         getnameinfo(reinterpret_cast<sockaddr *>(&addr), sizeof(addr), host, NI_MAXHOST, port, NI_MAXSERV, 0);
-        printf("new connection from: %s:%s\n", host, port);
+        LOG_INFO("New connection from: {}:{}", host, port);
 
-        return &clients[lastClientId - 1];
+        return client;
     };
 
 private:
-    static uint64_t packAddress(const sockaddr_in &addr) {
-        return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) |
-               ntohs(addr.sin_port);
+    void wakeTcpThread() const {
+        constexpr uint64_t one = 1;
+        [[maybe_unused]] const auto written = write(tcpEventFd, &one, sizeof(one));
     }
 
-    // TODO: Maybe ClientHandle should be stored as a shared_ptr
-    // so that we can avoid complications when client is removed while doing something on their object
-    std::unordered_map<uint16_t, ClientHandle> clients;
+    static MetricLabels clientLabels(const ClientHandle &client) {
+        return {{"client", std::to_string(client.id)}};
+    }
+
+    /* Rooms are ticked on worker threads while the TCP and UDP threads add, look up and remove clients.
+     * Handles are shared so a thread still working on a removed client doesn't lose it underneath */
+    mutable std::mutex mtx;
+
+    std::unordered_map<uint16_t, std::shared_ptr<ClientHandle> > clients;
     std::unordered_map<uint64_t, uint16_t> clientIdsByAddress;
     uint16_t lastClientId = 0;
 
+    /* Work other threads hand to the TCP thread, it owns the sockets */
+    std::vector<uint16_t> disconnectRequests;
+    std::vector<uint16_t> flushRequests;
+    int tcpEventFd = -1;
+
 };
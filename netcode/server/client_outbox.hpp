@@ -0,0 +1,92 @@
+#pragma once
+#include <cerrno>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+/* Bytes waiting to go out on a client's TCP socket. Any thread appends, only the TCP thread writes them to the
+ * socket, so a slow client never stalls the room worker that sent to it. */
+class ClientOutbox {
+public:
+    /* A client this far behind isn't reading anymore, it gets disconnected */
+    static constexpr size_t MAX_BYTES = 64 * 1024;
+
+    enum class FlushResult {
+        Done,
+        /* The socket is full, flush again once it's writable */
+        Pending,
+        /* Hard error on the socket or the client fell MAX_BYTES behind */
+        Failed
+    };
+
+    /* Called outside the lock whenever the TCP thread has something new to do with this outbox */
+    void setOnPending(std::function<void()> callback) {
+        onPending = std::move(callback);
+    }
+
+    /* Returns false once the client fell MAX_BYTES behind, nothing more is queued after that */
+    bool append(const char *data, const size_t size) {
+        bool notify;
+        bool queued;
+        {
+            std::lock_guard lock(mtx);
+            if (overflowed)
+                return false;
+
+            if (bytes.size() + size > MAX_BYTES) {
+                overflowed = true;
+                notify = true;
+                queued = false;
+            } else {
+                notify = bytes.empty();
+                bytes.insert(bytes.end(), data, data + size);
+                queued = true;
+            }
+        }
+
+        if (notify && onPending)
+            onPending();
+
+        return queued;
+    }
+
+    /* TCP thread only */
+    FlushResult flush(const int fd) {
+        std::lock_guard lock(mtx);
+        if (overflowed)
+            return FlushResult::Failed;
+
+        size_t sent = 0;
+        while (sent < bytes.size()) {
+            const ssize_t written = ::send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (written >= 0) {
+                sent += written;
+                continue;
+            }
+
+            if (errno == EINTR)
+                continue;
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return FlushResult::Failed;
+
+            bytes.erase(bytes.begin(), bytes.begin() + static_cast<std::ptrdiff_t>(sent));
+            return FlushResult::Pending;
+        }
+
+        bytes.clear();
+        return FlushResult::Done;
+    }
+
+    /* TCP thread only, whether the socket is registered for EPOLLOUT because of this outbox */
+    bool waitingForWritable = false;
+
+private:
+    std::mutex mtx;
+    std::vector<char> bytes;
+    bool overflowed = false;
+    std::function<void()> onPending;
+};
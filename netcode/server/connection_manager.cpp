@@ -29,13 +29,11 @@ void ConnectionManager::accept() {
         throw std::runtime_error(std::string("accept failed! ") + strerror(errno));
     }
 
-    ClientHandle client{};
+    auto &client = clients[lastClientId];
     client.tcpSocketFd = clientFd;
-    client.udpAddr = clientAddr;
+    client.setUdpAddr(clientAddr);
     client.id = lastClientId;
 
-    clients[client.id] = client;
-
     lastClientId++;
 
     char host[NI_MAXHOST], port[NI_MAXSERV];
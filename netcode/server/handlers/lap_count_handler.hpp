@@ -9,6 +9,7 @@ public:
         const uint8_t laps = static_cast<uint8_t>(*payload.get());
         client.laps = laps;
 
-        server->broadcastLapsUpdate(client);
+        if (const auto room = server->matchManager->getRoom(client.roomId))
+            room->broadcastLapsUpdate(client);
     }
 };
@@ -1,9 +1,9 @@
 #pragma once
-#include <iostream>
 #include <ranges>
 
 #include "../client_handle.hpp"
 #include "../tcp_server.hpp"
+#include "../../shared/logger.hpp"
 #include "../../shared/packets/tcp/client/name_packet.hpp"
 #include "../../shared/packets/tcp/server/name_accepted_packet.hpp"
 #include "../../shared/packets/tcp/server/name_taken_packet.hpp"
@@ -26,13 +26,16 @@ public:
             return;
         }
 
-        sendNameAcceptedPacket(nickname,client,server);
+        server->clientManager->ToLobby(nickname, client);
+        const auto room = server->matchManager->assignToLobby(client);
+
+        sendNameAcceptedPacket(client);
 
-        std::cout << "\nClient fd=" << client.tcpSocketFd << " set nick: " << nickname << "\n";
+        LOG_INFO("Client fd={} set nick: {}, joined room {}", client.tcpSocketFd, nickname, room->getId());
 
-        sendClientConnectedPacket(client, server);
-        sendTimeUntilStartPacket(server);
-        sendClientList(client,server);
+        sendClientConnectedPacket(client, *room);
+        sendTimeUntilStartPacket(*room);
+        sendClientList(client, *room);
     }
 
     static void sendNameTaken(const ClientHandle & client) {
@@ -40,43 +43,34 @@ public:
         TCPServer::send(client, TCPPacket::serialize(response), sizeof(response));
     }
 
-    static void sendNameAcceptedPacket(const std::string &nickname, ClientHandle &client, TCPServer *server) {
-        server->clientManager->ToLobby(nickname, client);
-        if (server->clientManager->getNumberOfConnectedClients() == 1) {
-            std::lock_guard lock(server->state->mtx);
-            if (server->state->phase == MatchPhase::Lobby) {
-                server->resetLobbyStartTime();
-                server->countdownToLobbyEnd();
-            }
-        }
-
+    static void sendNameAcceptedPacket(const ClientHandle &client) {
         constexpr auto response = NameAcceptedPacket();
         TCPServer::send(client, TCPPacket::serialize(response), sizeof(response));
     }
 
-    static void sendClientConnectedPacket(const ClientHandle &client, const TCPServer *server) {
+    static void sendClientConnectedPacket(const ClientHandle &client, Room &room) {
         const auto [clientConnectedPacket, clientConnectedPacketSize] = TCPPacket::create<ClientConnectedPacket>(
        client.nick.c_str(), client.nick.size());
 
         const auto buf = TCPPacket::serialize(clientConnectedPacket, clientConnectedPacketSize);
 
-        server->sendToAllInLobbyExcept(buf,
-                                       clientConnectedPacketSize,
-                                       client);
+        room.sendToAllInLobbyExcept(buf,
+                                    clientConnectedPacketSize,
+                                    client);
     }
 
-    static void sendTimeUntilStartPacket(const TCPServer *server) {
+    static void sendTimeUntilStartPacket(Room &room) {
         TimeUntilStartPacket countdown{};
-        countdown.seconds = server->timeUntilStart();
+        countdown.seconds = room.timeUntilStart();
         auto countdownBuf = TCPPacket::serialize(countdown);
 
-        server->sendToAllInLobby(countdownBuf, sizeof(countdown));
+        room.sendToAllInLobby(countdownBuf, sizeof(countdown));
     }
 
-    static void sendClientList(const ClientHandle &client, const TCPServer *server) {
-        std::vector<std::string> nicks = server->clientManager->getNicksInLobby();
+    static void sendClientList(const ClientHandle &client, Room &room) {
+        std::vector<std::string> nicks = room.getNicksInLobby();
 
-        if (server->clientManager->getNumberOfConnectedClients()!=1) {
+        if (nicks.size() != 1) {
             LobbyClientListPacket lobbyList(nicks, client.nick);
 
             size_t totalSize = sizeof(TCPPacketHeader) + lobbyList.header.payloadSize;
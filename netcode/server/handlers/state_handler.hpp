@@ -1,21 +1,62 @@
 #pragma once
+#include <algorithm>
 
 #include "../../shared/packets/udp/client/state_packet.hpp"
 #include "../../server/udp_server.hpp"
 #include "../../shared/client_state.hpp"
-#include "../../server/loop.hpp"
+#include "../../server/match_manager.hpp"
+#include "../../server/metrics.hpp"
 
 class StateHandler {
 public:
-    static void handle(const StatePacket &packet, ClientHandle &client) {
+    static void handle(const StatePacket &packet, ClientHandle &client, MatchManager &matchManager) {
+        if (client.statePacketsReceived == 0)
+            client.firstStatePacketId = packet.header.id;
+        else if (packet.header.id > client.highestStatePacketId + 1)
+            countLostPackets(packet, packet.header.id - client.highestStatePacketId - 1);
+        client.statePacketsReceived++;
+        client.highestStatePacketId = std::max(client.highestStatePacketId.load(), packet.header.id);
+
         if (packet.header.id < client.lastReceivedPacketId)
             return;
 
-        ClientState state{client.id};
+        const auto room = matchManager.getRoom(client.roomId);
+        if (!room)
+            return;
+
+        ClientState state{};
+        state.clientId = client.id;
         std::memcpy(state.state, packet.payload, STATE_PAYLOAD_SIZE);
+        state.trace = packet.trace;
+        state.trace.serverReceivedUs = traceTimestampUs();
+        std::memcpy(state.recentInputs, packet.recentInputs, sizeof(state.recentInputs));
 
-        Loop::enqueueStateUpdate(state);
+        room->enqueueStateUpdate(state);
 
         client.lastReceivedPacketId++;
     }
+
+private:
+    /* Every state packet carries the whole state, a later one makes up for the lost ones. The inputs of lost
+     * packets are only gone once more of them in a row were lost than the packet repeats. */
+    static void countLostPackets(const StatePacket &packet, const uint32_t missingPackets) {
+        static auto &lost = Metrics::getInstance().counter(
+            "nfsput_state_packets_lost_total", "State packets skipped over by a later one from the same client");
+        static auto &inputsRecovered = Metrics::getInstance().counter(
+            "nfsput_state_inputs_recovered_total", "Input samples of lost state packets repeated in a later one");
+        static auto &inputsLost = Metrics::getInstance().counter(
+            "nfsput_state_inputs_lost_total", "Input samples lost with more state packets in a row than are repeated");
+
+        /* The missing packets carried the frames right before the newest one here */
+        const auto newestFrame = packet.recentInputs[0].frame;
+        uint32_t recovered = 0;
+        for (const auto &[frame, inputs]: packet.recentInputs) {
+            if (frame < newestFrame && newestFrame - frame <= missingPackets)
+                recovered++;
+        }
+
+        lost.inc(missingPackets);
+        inputsRecovered.inc(recovered);
+        inputsLost.inc(missingPackets - std::min(recovered, missingPackets));
+    }
 };
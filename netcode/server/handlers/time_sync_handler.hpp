@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../../shared/packets/udp/client/time_sync_request_packet.hpp"
+#include "../../shared/packets/udp/server/time_sync_response_packet.hpp"
+#include "../../shared/server_time.hpp"
+#include "../../server/udp_server.hpp"
+
+class TimeSyncHandler {
+public:
+    /* receivedUs should be taken as close to the recvfrom as possible, the client treats
+     * everything between it and the send as server processing time instead of network delay */
+    static void handle(const TimeSyncRequestPacket &packet, const ClientHandle &client, const UDPServer &server,
+                       const uint64_t receivedUs) {
+        TimeSyncResponsePacket response;
+        response.header.id = packet.header.id;
+        response.clientSentUs = packet.clientSentUs;
+        response.serverReceivedUs = receivedUs;
+        response.serverSentUs = monotonicTimeUs();
+        response.checksum = UDPPacket::calculatePacketChecksum(response);
+
+        server.send(client, UDPPacket::serialize(response), sizeof(response));
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include "../client_handle.hpp"
 #include "../tcp_server.hpp"
+#include "../../shared/logger.hpp"
 
 class UdpInfoHandler {
 public:
@@ -13,11 +14,11 @@ public:
         socklen_t addrLen = sizeof(udpAddr);
 
         if (getpeername(client.tcpSocketFd, reinterpret_cast<sockaddr *>(&udpAddr), &addrLen) == -1) {
-            perror("getpeername failed when trying to construct UDP address");
+            LOG_WARN("getpeername failed when trying to construct UDP address: {}", strerror(errno));
             return;
         }
 
-        std::cout << "Received port: " << port << std::endl;
+        LOG_DEBUG("Client {} reported UDP port {}", client.id, port);
         udpAddr.sin_port = htons(port);
 
         clientManager->updateClientUdpAddr(client, udpAddr);
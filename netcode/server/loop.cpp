@@ -1,64 +1,46 @@
 #include "loop.hpp"
 
-#include <chrono>
-#include <iostream>
-#include <thread>
-#include <format>
 #include <ranges>
 
-using namespace std::chrono;
-
-std::shared_ptr<UDPServer> Loop::server;
-std::unordered_map<uint16_t, ClientState> Loop::latestClientStates{};
+Loop::Loop(std::shared_ptr<BSDServer> udpServer) : server(std::move(udpServer)) {
+}
 
 void Loop::reset() {
+    std::lock_guard lock(statesMtx);
     latestClientStates.clear();
+    tickNumber = 0;
 }
-void Loop::run(const std::shared_ptr<UDPServer> &udpServer,const std::shared_ptr<ServerState>& state) {
-    server = udpServer;
-
-    const auto tickDuration = milliseconds(1000 / TICK_RATE);
-    int tickCounter = 0;
-    auto nextTick = steady_clock::now();
-
-    while (true) {
-        //state->endMatch();
-        {
-            std::lock_guard lock(state->mtx);
-            if (state->phase == MatchPhase::Finished)
-                break;
-        }
-        nextTick = nextTick + tickDuration;
 
-        if (!latestClientStates.empty()) {
-            sendLatestStates();
-        }
+void Loop::tick(const std::vector<const ClientHandle *> &recipients) {
+    tickNumber++;
+    tickTimeUs = monotonicTimeUs();
 
-        if (tickCounter % 100 == 0) {
-            std::cout << std::format("Finished tick {}, time until next tick is {}", tickCounter,
-                                     nextTick - steady_clock::now())
-                    << std::endl;
-        }
+    {
+        std::lock_guard lock(statesMtx);
+        if (latestClientStates.empty())
+            return;
 
-        tickCounter++;
-        std::this_thread::sleep_until(nextTick);
+        std::swap(latestClientStates, tickStates);
     }
+
+    sendLatestStates(recipients);
+    tickStates.clear();
 }
 
 void Loop::enqueueStateUpdate(const ClientState &state) {
+    std::lock_guard lock(statesMtx);
     latestClientStates.insert_or_assign(state.clientId, state);
 }
 
-/* TODO: Make this thread safe (statesToUpdate can be updated while this function is executing) */
-void Loop::sendLatestStates() {
+void Loop::sendLatestStates(const std::vector<const ClientHandle *> &recipients) {
     constexpr int STATES_PER_PACKET = 5;
 
-    for (const auto client: server->getAllClients() | std::views::values) {
+    for (const auto client: recipients) {
         std::vector<OpponentStatesPacket> packets;
 
-        auto opponentStates = latestClientStates
+        auto opponentStates = tickStates
                               | std::views::filter([client](const auto &pair) {
-                                  return pair.first != client.id;
+                                  return pair.first != client->id;
                               }) | std::views::values;
 
         std::vector<ClientState> batch{};
@@ -76,24 +58,24 @@ void Loop::sendLatestStates() {
 
         for (const auto &packet: packets) {
             auto buf = serializeOpponentState(packet);
-            server->send(client, buf, static_cast<ssize_t>(getOpponentStatePacketSize(packet)));
+            server->send(*client, buf, static_cast<ssize_t>(getOpponentStatePacketSize(packet)));
         }
     }
-
-    latestClientStates.clear();
 }
 
-OpponentStatesPacket Loop::packStatesBatch(const std::vector<ClientState> &batch) {
+OpponentStatesPacket Loop::packStatesBatch(const std::vector<ClientState> &batch) const {
     OpponentStatesPacket packet;
 
-    packet.header = {
-        .type = UDPPacketType::OpponentStates,
-        .id = 0,
-    };
+    packet.header.id = tickNumber;
 
     packet.statesCount = batch.size();
+    packet.serverTimeUs = tickTimeUs;
     packet.states = batch;
 
+    const auto sentUs = traceTimestampUs();
+    for (auto &state: packet.states)
+        state.trace.serverSentUs = sentUs;
+
     const auto serialized = serializeOpponentState(packet);
 
     const auto packetSize = OPPONENT_STATES_PACKET_SIZE_WITHOUT_DATA + sizeof(ClientState) * packet.statesCount;
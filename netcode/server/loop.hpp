@@ -1,27 +1,38 @@
 #pragma once
-#include "udp_server.hpp"
+#include "bsd_server.hpp"
 #include "../shared/packets/udp/udp_packet.hpp"
+#include <mutex>
 #include <vector>
-#include "server_state.hpp"
 #include "../shared/packets/udp/server/opponent_states_packet.hpp"
+#include "../shared/server_time.hpp"
 
+/* Snapshot loop of a single room. Ticked by a MatchManager worker. */
 class Loop {
-    static constexpr int TICK_RATE = 32;
+    /* UDPServer in the real server, anything that records datagrams in benchmarks */
+    std::shared_ptr<BSDServer> server;
+
+    std::mutex statesMtx;
+    std::unordered_map<uint16_t, ClientState> latestClientStates;
+
+    /* Swapped with latestClientStates every tick so the UDP thread is never blocked on sending */
+    std::unordered_map<uint16_t, ClientState> tickStates;
 
-    static std::shared_ptr<UDPServer> server;
+    /* Ticks since the race started and when the current one began, stamped on every snapshot */
+    uint32_t tickNumber = 0;
+    uint64_t tickTimeUs = 0;
 
-    static std::unordered_map<uint16_t, ClientState> latestClientStates;
+    void sendLatestStates(const std::vector<const ClientHandle *> &recipients);
 
-    static void sendMessageToAll();
+    OpponentStatesPacket packStatesBatch(const std::vector<ClientState> &batch) const;
 
-    static void sendLatestStates();
+public:
+    static constexpr int TICK_RATE = 32;
 
+    explicit Loop(std::shared_ptr<BSDServer> udpServer);
 
+    void tick(const std::vector<const ClientHandle *> &recipients);
 
-    static OpponentStatesPacket packStatesBatch(const std::vector<ClientState> &batch);
+    void reset();
 
-public:
-    static void run(const std::shared_ptr<UDPServer> &udpServer,const std::shared_ptr<ServerState>& state);
-    static void reset();
-    static void enqueueStateUpdate(const ClientState &state);
+    void enqueueStateUpdate(const ClientState &state);
 };
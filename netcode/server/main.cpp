@@ -2,66 +2,66 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <cstring>
+#include <string>
 #include <thread>
-#include <condition_variable>
 
-#include "loop.hpp"
+#include "match_manager.hpp"
+#include "metrics.hpp"
+#include "metrics_server.hpp"
+#include "server_config.hpp"
 #include "tcp_server.hpp"
 #include "udp_server.hpp"
 
 
 int main(const int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <port>", argv[0]);
+    ServerConfig config;
+    try {
+        config = ServerConfig::fromArgs(argc, argv);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, SERVER_USAGE, argv[0]);
         return 1;
     }
 
     const auto clientManager = std::make_shared<ClientManager>();
     const auto udpServer = std::make_shared<UDPServer>(clientManager);
 
-    auto state = std::make_shared<ServerState>();
-    const auto tcpServer = std::make_shared<TCPServer>(clientManager, state);
+    if (config.busyPollMicroseconds > 0)
+        udpServer->setBusyPoll(config.busyPollMicroseconds);
 
-    std::thread udpServerThread([&] {
-        udpServer->listen(argv[1]);
-    });
+    const auto matchManager = std::make_shared<MatchManager>(clientManager, udpServer, config);
+    udpServer->setMatchManager(matchManager);
 
-    udpServerThread.detach();
+    const auto tcpServer = std::make_shared<TCPServer>(clientManager, matchManager);
 
-    std::thread tcpServerThread([&] {
-        tcpServer->listen(argv[1]);
+    Metrics::getInstance().addCollector([clientManager](MetricsWriter &writer) {
+        clientManager->writeMetrics(writer);
+    });
+    Metrics::getInstance().addCollector([matchManager](MetricsWriter &writer) {
+        matchManager->writeMetrics(writer);
     });
-    tcpServerThread.detach();
-
-    while (true) {
-
-        {
-            std::unique_lock lock(state->mtx);
-            state->cv.wait(lock, [&] {
-                return state->phase == MatchPhase::Running;
-            });
-        }
 
-        std::thread gameThread([&] {
-            Loop::run(udpServer, state);
+    if (config.metricsPort != "0") {
+        std::thread metricsServerThread([&] {
+            MetricsServer metricsServer;
+            metricsServer.listen(config.metricsPort.c_str());
         });
+        metricsServerThread.detach();
+    }
 
-        gameThread.join();
-
-        //tcpServer->notifyMatchEnded();
+    std::thread udpServerThread([&] {
+        udpServer->listen(config.port.c_str());
+    });
 
-        tcpServer->resetLobbyStartTime();
-        Loop::reset();
-        tcpServer->resetLobby();
-        clientManager->resetAll();
+    udpServerThread.detach();
 
-        {
-            std::lock_guard lock(state->mtx);
-            state->phase = MatchPhase::Lobby;
-        }
+    std::thread tcpServerThread([&] {
+        tcpServer->listen(config.port.c_str());
+    });
+    tcpServerThread.detach();
 
-        std::cout << "Server reset. Waiting for new clients...\n";
-    }
+    /* Rooms are created on demand as players join, every one of them is ticked by the worker pool */
+    matchManager->run();
 
     return 0;
 }
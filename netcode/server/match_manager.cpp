@@ -0,0 +1,165 @@
+#include "match_manager.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ranges>
+
+#include "metrics.hpp"
+#include "../shared/logger.hpp"
+
+using namespace std::chrono;
+
+MatchManager::MatchManager(std::shared_ptr<ClientManager> clientManager, std::shared_ptr<UDPServer> udpServer,
+                           const ServerConfig &config)
+    : clientManager(std::move(clientManager)), udpServer(std::move(udpServer)) {
+    for (size_t i = 0; i < std::max<size_t>(config.workerCount, 1); ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->tickConfig = config.tickConfigForWorker(i);
+        workers.push_back(std::move(worker));
+    }
+}
+
+std::shared_ptr<Room> MatchManager::assignToLobby(ClientHandle &client) {
+    std::lock_guard lock(roomsMtx);
+
+    /* Prefer the fullest lobby so that races fill up and start with as many players as possible */
+    std::vector<std::pair<size_t, std::shared_ptr<Room> > > lobbies;
+    for (const auto &room: rooms | std::views::values) {
+        if (room->getPhase() != MatchPhase::Lobby) continue;
+
+        const auto clientCount = room->getClientCount();
+        if (clientCount < Room::MAX_PLAYERS)
+            lobbies.emplace_back(clientCount, room);
+    }
+
+    std::ranges::sort(lobbies, [](const auto &a, const auto &b) {
+        if (a.first != b.first) return a.first > b.first;
+        return a.second->getId() < b.second->getId();
+    });
+
+    /* The lobby could have started the race in the meantime, in that case try the next one */
+    for (const auto &room: lobbies | std::views::values) {
+        if (room->addClient(client))
+            return room;
+    }
+
+    const auto room = createRoom();
+    room->addClient(client);
+    return room;
+}
+
+std::shared_ptr<Room> MatchManager::getRoom(const uint32_t roomId) {
+    std::lock_guard lock(roomsMtx);
+
+    const auto room = rooms.find(roomId);
+    if (room == rooms.end()) return nullptr;
+
+    return room->second;
+}
+
+void MatchManager::removeClient(const ClientHandle &client) {
+    if (const auto room = getRoom(client.roomId))
+        room->removeClient(client);
+}
+
+void MatchManager::run() {
+    for (size_t i = 0; i < workers.size(); ++i) {
+        auto &worker = *workers[i];
+        worker.thread = std::thread([i, &worker] {
+            workerLoop(i, worker);
+        });
+    }
+
+    LOG_INFO("Match manager running with {} workers", workers.size());
+
+    for (const auto &worker: workers)
+        worker->thread.join();
+}
+
+void MatchManager::writeMetrics(MetricsWriter &writer) {
+    constexpr std::array phaseNames = {"lobby", "running", "finished"};
+    std::array<uint64_t, phaseNames.size()> roomsByPhase{};
+
+    std::lock_guard lock(roomsMtx);
+
+    writer.family("nfsput_room_players", "Players in each room", "gauge");
+    for (const auto &room: rooms | std::views::values) {
+        const auto phase = static_cast<size_t>(room->getPhase());
+        roomsByPhase[phase]++;
+
+        writer.sample("nfsput_room_players", {{"room", std::to_string(room->getId())}, {"phase", phaseNames[phase]}},
+                      static_cast<uint64_t>(room->getClientCount()));
+    }
+
+    writer.family("nfsput_rooms", "Rooms by match phase", "gauge");
+    for (size_t i = 0; i < phaseNames.size(); ++i)
+        writer.sample("nfsput_rooms", {{"phase", phaseNames[i]}}, roomsByPhase[i]);
+}
+
+/* Expects roomsMtx to be held by the caller */
+std::shared_ptr<Room> MatchManager::createRoom() {
+    const auto roomId = lastRoomId++;
+    auto room = std::make_shared<Room>(roomId, clientManager, udpServer);
+    rooms.emplace(roomId, room);
+
+    auto &worker = *workers[roomId % workers.size()];
+    {
+        std::lock_guard lock(worker.mtx);
+        worker.rooms.push_back(room);
+    }
+
+    LOG_INFO("Created room {}", roomId);
+    return room;
+}
+
+[[noreturn]]
+void MatchManager::workerLoop(const size_t workerIndex, Worker &worker) {
+    const auto tickDuration = milliseconds(1000 / Loop::TICK_RATE);
+    int tickCounter = 0;
+
+    TickScheduler scheduler(tickDuration, worker.tickConfig);
+    scheduler.applyThreadSettings();
+
+    auto &metrics = Metrics::getInstance();
+    const MetricLabels labels{{"worker", std::to_string(workerIndex)}};
+    auto &tickTime = metrics.histogram("nfsput_tick_duration_microseconds", "Time spent ticking all rooms of a worker",
+                                       labels);
+    auto &tickLateness = metrics.histogram("nfsput_tick_lateness_microseconds",
+                                           "How late a worker woke up for its tick", labels);
+    auto &ticksSkipped = metrics.counter("nfsput_ticks_skipped_total", "Ticks skipped because a worker fell behind",
+                                         labels);
+    uint64_t skippedBefore = 0;
+
+    while (true) {
+        const auto tickStart = steady_clock::now();
+
+        size_t roomCount;
+        {
+            std::lock_guard lock(worker.mtx);
+            for (const auto &room: worker.rooms)
+                room->tick();
+
+            roomCount = worker.rooms.size();
+        }
+
+        tickTime.observe(duration_cast<microseconds>(steady_clock::now() - tickStart).count());
+
+        if (tickCounter % 100 == 0) {
+            const auto lateness = scheduler.getLatenessPercentiles();
+            const auto untilNextTick = duration_cast<microseconds>(scheduler.getNextTick() - steady_clock::now());
+            LOG_INFO("Worker {} finished tick {} over {} rooms, time until next tick is {}us, "
+                     "lateness p50 {}us p99 {}us p99.9 {}us max {}us, skipped {} ticks",
+                     workerIndex, tickCounter, roomCount, untilNextTick.count(),
+                     lateness.p50.count(), lateness.p99.count(), lateness.p999.count(), lateness.max.count(),
+                     scheduler.getSkippedTicks());
+        }
+
+        tickCounter++;
+        const auto lateness = scheduler.waitForNextTick();
+        tickLateness.observe(std::max<int64_t>(0, duration_cast<microseconds>(lateness).count()));
+
+        ticksSkipped.inc(scheduler.getSkippedTicks() - skippedBefore);
+        skippedBefore = scheduler.getSkippedTicks();
+    }
+}
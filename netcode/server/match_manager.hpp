@@ -0,0 +1,55 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "client_manager.hpp"
+#include "metrics.hpp"
+#include "room.hpp"
+#include "server_config.hpp"
+#include "udp_server.hpp"
+
+/* Hosts many independent rooms in one process.
+ * Players are put into lobbies automatically and rooms are ticked by a fixed pool of workers. */
+class MatchManager {
+public:
+    MatchManager(std::shared_ptr<ClientManager> clientManager, std::shared_ptr<UDPServer> udpServer,
+                 const ServerConfig &config);
+
+    /* Puts the client into the fullest lobby that still has a free slot, creating a new room if there is none */
+    std::shared_ptr<Room> assignToLobby(ClientHandle &client);
+
+    [[nodiscard]]
+    std::shared_ptr<Room> getRoom(uint32_t roomId);
+
+    void removeClient(const ClientHandle &client);
+
+    /* Players per room and room counts by phase, sampled on every metrics scrape */
+    void writeMetrics(MetricsWriter &writer);
+
+    /* Starts the worker pool and blocks forever */
+    void run();
+
+private:
+    struct Worker {
+        TickSchedulerConfig tickConfig;
+        std::mutex mtx;
+        std::vector<std::shared_ptr<Room> > rooms;
+        std::thread thread;
+    };
+
+    std::shared_ptr<ClientManager> clientManager;
+    std::shared_ptr<UDPServer> udpServer;
+
+    std::mutex roomsMtx;
+    std::unordered_map<uint32_t, std::shared_ptr<Room> > rooms;
+    uint32_t lastRoomId = 0;
+
+    std::vector<std::unique_ptr<Worker> > workers;
+
+    std::shared_ptr<Room> createRoom();
+
+    [[noreturn]] static void workerLoop(size_t workerIndex, Worker &worker);
+};
@@ -0,0 +1,236 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <ranges>
+#include <stdexcept>
+
+namespace {
+    std::string labelsKey(const MetricLabels &labels) {
+        std::string key;
+        for (const auto &[name, value]: labels) {
+            key += name;
+            key += '\0';
+            key += value;
+            key += '\0';
+        }
+        return key;
+    }
+}
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const auto &shard: shards)
+        total += shard.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+void MetricsWriter::family(const std::string_view name, const std::string_view help, const std::string_view type) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void MetricsWriter::sample(const std::string_view name, const MetricLabels &labels, const double value) {
+    out += name;
+    appendLabels(labels);
+
+    char buf[32];
+    const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out += ' ';
+    out.append(buf, result.ptr);
+    out += '\n';
+}
+
+void MetricsWriter::sample(const std::string_view name, const MetricLabels &labels, const uint64_t value) {
+    out += name;
+    appendLabels(labels);
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+void MetricsWriter::appendLabels(const MetricLabels &labels) {
+    if (labels.empty())
+        return;
+
+    out += '{';
+    for (size_t i = 0; i < labels.size(); ++i) {
+        if (i > 0)
+            out += ',';
+
+        out += labels[i].first;
+        out += "=\"";
+        for (const char c: labels[i].second) {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            if (c == '\n')
+                out += "\\n";
+            else
+                out += c;
+        }
+        out += '"';
+    }
+    out += '}';
+}
+
+PacketMetrics::PacketMetrics(const std::string &transport, const std::vector<std::string> &typeNames)
+    : checksumFailures(Metrics::getInstance().counter(
+          "nfsput_checksum_failures_total", "Packets dropped because of a bad checksum", {{"transport", transport}})),
+      deserializationErrors(Metrics::getInstance().counter(
+          "nfsput_deserialization_errors_total", "Packets that failed to deserialize", {{"transport", transport}})) {
+    auto &metrics = Metrics::getInstance();
+
+    /* The last slot collects packet types we don't know about */
+    auto names = typeNames;
+    names.emplace_back("unknown");
+
+    for (const auto &name: names) {
+        const MetricLabels labels{{"transport", transport}, {"type", name}};
+
+        received.packets.push_back(&metrics.counter("nfsput_packets_received_total", "Packets received", labels));
+        received.bytes.push_back(&metrics.counter("nfsput_bytes_received_total", "Bytes received", labels));
+        sent.packets.push_back(&metrics.counter("nfsput_packets_sent_total", "Packets sent", labels));
+        sent.bytes.push_back(&metrics.counter("nfsput_bytes_sent_total", "Bytes sent", labels));
+    }
+}
+
+void PacketMetrics::onReceived(const uint8_t type, const uint64_t bytes) const {
+    record(received, type, bytes);
+}
+
+void PacketMetrics::onSent(const uint8_t type, const uint64_t bytes) const {
+    record(sent, type, bytes);
+}
+
+void PacketMetrics::record(const Direction &direction, const uint8_t type, const uint64_t bytes) {
+    const size_t index = std::min<size_t>(type, direction.packets.size() - 1);
+    direction.packets[index]->inc();
+    direction.bytes[index]->inc(bytes);
+}
+
+Metrics &Metrics::getInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+Counter &Metrics::counter(const std::string &name, const std::string &help, const MetricLabels &labels) {
+    return *getSeries(name, help, Type::Counter, labels).counter;
+}
+
+Gauge &Metrics::gauge(const std::string &name, const std::string &help, const MetricLabels &labels) {
+    return *getSeries(name, help, Type::Gauge, labels).gauge;
+}
+
+Histogram &Metrics::histogram(const std::string &name, const std::string &help, const MetricLabels &labels) {
+    return *getSeries(name, help, Type::Histogram, labels).histogram;
+}
+
+void Metrics::addCollector(Collector collector) {
+    std::lock_guard lock(mtx);
+    collectors.push_back(std::move(collector));
+}
+
+Metrics::Series &Metrics::getSeries(const std::string &name, const std::string &help, const Type type,
+                                    const MetricLabels &labels) {
+    std::lock_guard lock(mtx);
+
+    auto [familyIt, familyCreated] = families.try_emplace(name, Family{help, type, {}});
+    auto &family = familyIt->second;
+    if (!familyCreated && family.type != type)
+        throw std::logic_error("Metric " + name + " registered with two different types");
+
+    auto [seriesIt, seriesCreated] = family.series.try_emplace(labelsKey(labels));
+    auto &series = seriesIt->second;
+    if (seriesCreated) {
+        series.labels = labels;
+        switch (type) {
+            case Type::Counter: series.counter = std::make_unique<Counter>();
+                break;
+            case Type::Gauge: series.gauge = std::make_unique<Gauge>();
+                break;
+            case Type::Histogram: series.histogram = std::make_unique<Histogram>();
+                break;
+        }
+    }
+
+    return series;
+}
+
+const char *Metrics::typeName(const Type type) {
+    switch (type) {
+        case Type::Counter: return "counter";
+        case Type::Gauge: return "gauge";
+        default: return "histogram";
+    }
+}
+
+std::string Metrics::render() {
+    std::string out;
+    MetricsWriter writer(out);
+
+    std::unique_lock lock(mtx);
+
+    for (const auto &[name, family]: families) {
+        writer.family(name, family.help, typeName(family.type));
+
+        for (const auto &series: family.series | std::views::values) {
+            switch (family.type) {
+                case Type::Counter:
+                    writer.sample(name, series.labels, series.counter->value());
+                    break;
+                case Type::Gauge:
+                    writer.sample(name, series.labels, static_cast<double>(series.gauge->value()));
+                    break;
+                case Type::Histogram:
+                    renderHistogram(writer, name, series);
+                    break;
+            }
+        }
+    }
+
+    /* Collectors may register metrics themselves, so they run without the lock */
+    const auto collectorsCopy = collectors;
+    lock.unlock();
+
+    for (const auto &collector: collectorsCopy)
+        collector(writer);
+
+    return out;
+}
+
+/* Buckets are exported four per power of two, up to the highest one that has any values */
+void Metrics::renderHistogram(MetricsWriter &writer, const std::string &name, const Series &series) {
+    const auto snapshot = series.histogram->snapshot();
+
+    size_t lastUsed = 0;
+    for (size_t i = 0; i < Histogram::BUCKET_COUNT; ++i) {
+        if (snapshot.buckets[i] > 0)
+            lastUsed = i;
+    }
+
+    const auto bucketName = name + "_bucket";
+    auto labels = series.labels;
+    labels.emplace_back("le", "");
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= lastUsed; ++i) {
+        cumulative += snapshot.buckets[i];
+        if (i % 4 != 3 && i != lastUsed)
+            continue;
+
+        labels.back().second = std::to_string(Histogram::bucketUpperBound(i));
+        writer.sample(bucketName, labels, cumulative);
+    }
+
+    labels.back().second = "+Inf";
+    writer.sample(bucketName, labels, snapshot.count);
+    writer.sample(name + "_sum", series.labels, snapshot.sum);
+    writer.sample(name + "_count", series.labels, snapshot.count);
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../shared/histogram.hpp"
+
+/* Process wide metrics exposed in the Prometheus text format.
+ * Counters and histograms are sharded per thread so hot paths on different threads never share a cache line. */
+
+using MetricLabels = std::vector<std::pair<std::string, std::string> >;
+
+class Counter {
+public:
+    void inc(const uint64_t amount = 1) {
+        shards[metricShardIndex()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::array<Shard, METRIC_SHARDS> shards{};
+};
+
+class Gauge {
+public:
+    void set(const int64_t newValue) {
+        current.store(newValue, std::memory_order_relaxed);
+    }
+
+    void add(const int64_t amount) {
+        current.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    int64_t value() const {
+        return current.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> current{0};
+};
+
+/* Builds the Prometheus text exposition, used by collectors for values that are sampled at scrape time */
+class MetricsWriter {
+public:
+    explicit MetricsWriter(std::string &out) : out(out) {
+    }
+
+    void family(std::string_view name, std::string_view help, std::string_view type);
+
+    void sample(std::string_view name, const MetricLabels &labels, double value);
+
+    void sample(std::string_view name, const MetricLabels &labels, uint64_t value);
+
+private:
+    std::string &out;
+
+    void appendLabels(const MetricLabels &labels);
+};
+
+/* Tracks packets and bytes per transport and packet type */
+class PacketMetrics {
+public:
+    PacketMetrics(const std::string &transport, const std::vector<std::string> &typeNames);
+
+    void onReceived(uint8_t type, uint64_t bytes) const;
+
+    void onSent(uint8_t type, uint64_t bytes) const;
+
+    Counter &checksumFailures;
+    Counter &deserializationErrors;
+
+private:
+    struct Direction {
+        std::vector<Counter *> packets;
+        std::vector<Counter *> bytes;
+    };
+
+    Direction received;
+    Direction sent;
+
+    static void record(const Direction &direction, uint8_t type, uint64_t bytes);
+};
+
+class Metrics {
+public:
+    using Collector = std::function<void(MetricsWriter &)>;
+
+    static Metrics &getInstance();
+
+    Metrics(const Metrics &) = delete;
+
+    Metrics &operator=(const Metrics &) = delete;
+
+    /* Returned references stay valid for the lifetime of the process, hot paths should cache them */
+    Counter &counter(const std::string &name, const std::string &help, const MetricLabels &labels = {});
+
+    Gauge &gauge(const std::string &name, const std::string &help, const MetricLabels &labels = {});
+
+    Histogram &histogram(const std::string &name, const std::string &help, const MetricLabels &labels = {});
+
+    /* Collectors run on every scrape, for values that are cheaper to sample than to track */
+    void addCollector(Collector collector);
+
+    [[nodiscard]]
+    std::string render();
+
+private:
+    enum class Type { Counter, Gauge, Histogram };
+
+    struct Series {
+        MetricLabels labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    struct Family {
+        std::string help;
+        Type type;
+        std::map<std::string, Series> series;
+    };
+
+    std::mutex mtx;
+    std::map<std::string, Family> families;
+    std::vector<Collector> collectors;
+
+    Metrics() = default;
+
+    Series &getSeries(const std::string &name, const std::string &help, Type type, const MetricLabels &labels);
+
+    static const char *typeName(Type type);
+
+    static void renderHistogram(MetricsWriter &writer, const std::string &name, const Series &series);
+};
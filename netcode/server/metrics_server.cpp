@@ -0,0 +1,93 @@
+#include "metrics_server.hpp"
+#include <arpa/inet.h>
+#include <cstring>
+#include <netdb.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "metrics.hpp"
+#include "../shared/logger.hpp"
+
+MetricsServer::MetricsServer() {
+    socketFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (socketFd < 0)
+        throw std::runtime_error(std::string("Failed to create metrics socket! ") + std::strerror(errno));
+
+    constexpr int one = 1;
+    setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+}
+
+MetricsServer::~MetricsServer() {
+    if (socketFd >= 0)
+        close(socketFd);
+}
+
+void MetricsServer::listen(const char *port) {
+    addrinfo *res, hints{};
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_family = AF_INET;
+
+    if (const int rv = getaddrinfo("127.0.0.1", port, &hints, &res)) {
+        LOG_ERROR("Metrics getaddrinfo failed: {}", gai_strerror(rv));
+        return;
+    }
+
+    const bool bound = ::bind(socketFd, res->ai_addr, res->ai_addrlen) == 0;
+    freeaddrinfo(res);
+
+    /* Metrics are optional, a second server on the same host should still be able to run */
+    if (!bound || ::listen(socketFd, 16)) {
+        LOG_ERROR("Metrics endpoint unavailable on port {}: {}", port, strerror(errno));
+        return;
+    }
+
+    LOG_INFO("Serving metrics on http://127.0.0.1:{}/metrics", port);
+    loop();
+}
+
+void MetricsServer::loop() const {
+    while (true) {
+        const int clientFd = accept(socketFd, nullptr, nullptr);
+        if (clientFd < 0)
+            continue;
+
+        /* One connection at a time, a silent client must not hold up every scrape after it */
+        constexpr timeval timeout{.tv_sec = IO_TIMEOUT_MS / 1000, .tv_usec = IO_TIMEOUT_MS % 1000 * 1000};
+        setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(clientFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        handleConnection(clientFd);
+        close(clientFd);
+    }
+}
+
+void MetricsServer::handleConnection(const int clientFd) {
+    /* Scrapers send a single small GET, we only look at the request line */
+    char request[1024];
+    const ssize_t bytesRead = recv(clientFd, request, sizeof(request) - 1, 0);
+    if (bytesRead <= 0)
+        return;
+    request[bytesRead] = '\0';
+
+    std::string response;
+    if (std::strncmp(request, "GET /metrics", 12) == 0) {
+        const auto body = Metrics::getInstance().render();
+        response = "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Connection: close\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    } else {
+        response = "HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    }
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+        const ssize_t n = ::send(clientFd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        sent += n;
+    }
+}
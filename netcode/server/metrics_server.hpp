@@ -0,0 +1,23 @@
+#pragma once
+
+/* Serves the metrics registry in the Prometheus text format over plain HTTP.
+ * Binds to loopback only, scrape it locally or through a tunnel. */
+class MetricsServer final {
+public:
+    /* A scraper that stalls mid-request or stops reading the response is dropped after this long */
+    static constexpr int IO_TIMEOUT_MS = 2000;
+
+    MetricsServer();
+
+    ~MetricsServer();
+
+    /* Blocks serving scrapes, returns only if the socket could not be set up */
+    void listen(const char *port);
+
+private:
+    int socketFd;
+
+    [[noreturn]] void loop() const;
+
+    static void handleConnection(int clientFd);
+};
@@ -0,0 +1,285 @@
+#include "room.hpp"
+
+#include <algorithm>
+#include <random>
+
+#include "tcp_server.hpp"
+#include "../shared/logger.hpp"
+#include "../shared/server_time.hpp"
+#include "../shared/packets/tcp/server/client_disconnected_packet.hpp"
+#include "../shared/packets/tcp/server/laps_update_packet.hpp"
+#include "../shared/packets/tcp/server/opponents_info_packet.hpp"
+#include "../shared/packets/tcp/server/race_start_countdown_packet.hpp"
+#include "../shared/packets/tcp/server/start_game_packet.hpp"
+#include "../shared/packets/tcp/server/time_until_start_packet.hpp"
+
+Room::Room(const uint32_t id, std::shared_ptr<ClientManager> clientManager, std::shared_ptr<UDPServer> udpServer)
+    : id(id), clientManager(std::move(clientManager)), loop(std::move(udpServer)) {
+}
+
+uint32_t Room::getId() const {
+    return id;
+}
+
+MatchPhase Room::getPhase() {
+    std::lock_guard lock(state.mtx);
+    return state.phase;
+}
+
+size_t Room::getClientCount() {
+    std::lock_guard lock(state.mtx);
+    return clientIds.size();
+}
+
+bool Room::addClient(ClientHandle &client) {
+    std::lock_guard lock(state.mtx);
+    if (state.phase != MatchPhase::Lobby || clientIds.size() >= MAX_PLAYERS)
+        return false;
+
+    /* Countdown starts when the first player joins an empty lobby */
+    if (clientIds.empty())
+        lobbyStartTime = std::chrono::steady_clock::now();
+
+    clientIds.push_back(client.id);
+    client.roomId = id;
+    return true;
+}
+
+void Room::removeClient(const ClientHandle &client) {
+    std::lock_guard lock(state.mtx);
+
+    const auto it = std::ranges::find(clientIds, client.id);
+    if (it == clientIds.end())
+        return;
+
+    clientIds.erase(it);
+
+    if (client.state == ClientStateLobby::InLobby) {
+        const auto [packet, packetSize] = TCPPacket::create<ClientDisconnectedPacket>(
+            client.nick.c_str(), client.nick.size());
+        broadcast(TCPPacket::serialize(packet), packetSize, ClientStateLobby::InLobby, &client);
+
+        TimeUntilStartPacket countdown{};
+        countdown.seconds = secondsUntilStart();
+        broadcast(TCPPacket::serialize(countdown), sizeof(countdown), ClientStateLobby::InLobby);
+    }
+
+    /* Everyone left the race, make the room available for a new lobby */
+    if (clientIds.empty() && state.phase != MatchPhase::Lobby)
+        reset();
+}
+
+int Room::timeUntilStart() {
+    std::lock_guard lock(state.mtx);
+    return secondsUntilStart();
+}
+
+void Room::tick() {
+    std::lock_guard lock(state.mtx);
+
+    switch (state.phase) {
+        case MatchPhase::Lobby:
+            if (!clientIds.empty() && secondsUntilStart() <= 0)
+                startRace();
+            break;
+
+        case MatchPhase::Running: {
+            std::vector<const ClientHandle *> recipients;
+            for (const auto &client: collectClients())
+                recipients.push_back(client.get());
+
+            loop.tick(recipients);
+            break;
+        }
+
+        case MatchPhase::Finished:
+            closeConnections();
+            reset();
+            break;
+    }
+}
+
+void Room::enqueueStateUpdate(const ClientState &clientState) {
+    loop.enqueueStateUpdate(clientState);
+}
+
+void Room::onClientGameLoaded(ClientHandle &client) {
+    std::lock_guard lock(state.mtx);
+    client.gameLoaded = true;
+
+    for (const auto &otherClient: collectClients()) {
+        if (otherClient->state == ClientStateLobby::InGame && !otherClient->gameLoaded)
+            return;
+    }
+
+    startRaceStartCountdown();
+}
+
+void Room::broadcastLapsUpdate(const ClientHandle &updatedClient) {
+    bool everyoneFinished = true;
+    {
+        std::lock_guard lock(state.mtx);
+
+        auto packet = LapsUpdatePacket();
+        packet.clientId = updatedClient.id;
+        packet.laps = updatedClient.laps;
+
+        broadcast(TCPPacket::serialize(packet), sizeof(packet), ClientStateLobby::InGame, &updatedClient);
+
+        if (state.phase != MatchPhase::Running)
+            return;
+
+        for (const auto &client: collectClients()) {
+            if (client->state == ClientStateLobby::InGame && client->laps < RACE_LAPS)
+                everyoneFinished = false;
+        }
+    }
+
+    if (everyoneFinished) {
+        LOG_INFO("Everyone in room {} finished the race", id);
+        endMatch();
+    }
+}
+
+void Room::endMatch() {
+    state.endMatch();
+}
+
+std::vector<std::string> Room::getNicksInLobby() {
+    std::lock_guard lock(state.mtx);
+
+    std::vector<std::string> nicks;
+    for (const auto &client: collectClients()) {
+        if (client->state == ClientStateLobby::InLobby)
+            nicks.push_back(client->nick);
+    }
+    return nicks;
+}
+
+void Room::sendToAllInLobby(const PacketBuffer &buf, const ssize_t size) {
+    std::lock_guard lock(state.mtx);
+    broadcast(buf, size, ClientStateLobby::InLobby);
+}
+
+void Room::sendToAllInLobbyExcept(const PacketBuffer &buf, const ssize_t size, const ClientHandle &except) {
+    std::lock_guard lock(state.mtx);
+    broadcast(buf, size, ClientStateLobby::InLobby, &except);
+}
+
+std::vector<std::shared_ptr<ClientHandle> > Room::collectClients() const {
+    std::vector<std::shared_ptr<ClientHandle> > clients;
+    clients.reserve(clientIds.size());
+
+    for (const auto clientId: clientIds) {
+        if (const auto client = clientManager->getClient(clientId))
+            clients.push_back(client);
+    }
+
+    return clients;
+}
+
+int Room::secondsUntilStart() const {
+    const auto now = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - lobbyStartTime).count();
+    const int remaining = lobbyEndTimeout - static_cast<int>(elapsed);
+    return remaining > 0 ? remaining : 0;
+}
+
+void Room::broadcast(const PacketBuffer &buf, const ssize_t size, const ClientStateLobby clientState,
+                     const ClientHandle *except) const {
+    for (const auto &client: collectClients()) {
+        if (client->state != clientState) continue;
+        if (except && client->id == except->id) continue;
+
+        TCPServer::send(*client, buf, size);
+    }
+}
+
+void Room::startRace() {
+    const auto clients = collectClients();
+
+    assignColors(clients);
+    state.phase = MatchPhase::Running;
+
+    LOG_INFO("Room {} started a race with {} players", id, clients.size());
+
+    uint8_t gridPosition = 0;
+    for (const auto &client: clients) {
+        if (!client->connected || client->state != ClientStateLobby::InLobby) continue;
+        client->state = ClientStateLobby::InGame;
+        client->gridPosition = gridPosition++;
+
+        auto packet = StartGamePacket();
+        packet.gridPosition = client->gridPosition;
+        packet.vehicleColor = client->vehicleColor;
+        const auto serialized = TCPPacket::serialize(packet);
+        TCPServer::send(*client, serialized, sizeof(packet));
+    }
+
+    for (const auto &client: clients) {
+        sendClientOpponentsInfo(*client, clients);
+    }
+}
+
+void Room::assignColors(const std::vector<std::shared_ptr<ClientHandle> > &clients) {
+    std::random_device rd;
+    std::mt19937 g(rd());
+    std::shuffle(colors.begin(), colors.end(), g);
+    size_t colorIndex = 0;
+
+    for (const auto &client: clients) {
+        if (!client->connected || client->state != ClientStateLobby::InLobby)
+            continue;
+
+        if (colorIndex >= colors.size()) {
+            LOG_WARN("Room {} has more players than colors, reusing colors", id);
+            colorIndex = 0;
+        }
+
+        client->vehicleColor = colors[colorIndex++];
+    }
+}
+
+void Room::sendClientOpponentsInfo(const ClientHandle &client,
+                                   const std::vector<std::shared_ptr<ClientHandle> > &clients) const {
+    std::vector<OpponentInfo> opponentInfos;
+
+    for (const auto &opponent: clients) {
+        if (opponent->id == client.id) continue;
+        if (opponent->state != ClientStateLobby::InGame) continue;
+
+        OpponentInfo info{
+            .id = opponent->id,
+            .vehicleColor = opponent->vehicleColor,
+            .gridPosition = opponent->gridPosition,
+            .nickname = opponent->nick
+        };
+
+        opponentInfos.push_back(info);
+    }
+
+    const auto packet = OpponentsInfoPacket(opponentInfos);
+    const auto packetSize = static_cast<ssize_t>(sizeof(packet.header) + packet.header.payloadSize);
+    TCPServer::send(client, TCPPacket::serialize(packet), packetSize);
+}
+
+void Room::startRaceStartCountdown() const {
+    auto packet = RaceStartCountdownPacket();
+    packet.secondsUntilStart = raceStartTimeout;
+    packet.raceStartServerUs = monotonicTimeUs() + static_cast<uint64_t>(raceStartTimeout) * 1'000'000;
+
+    broadcast(TCPPacket::serialize(packet), sizeof(packet), ClientStateLobby::InGame);
+}
+
+void Room::closeConnections() const {
+    for (const auto clientId: clientIds)
+        clientManager->requestDisconnect(clientId);
+}
+
+void Room::reset() {
+    clientIds.clear();
+    loop.reset();
+    state.phase = MatchPhase::Lobby;
+
+    LOG_INFO("Room {} has been reset", id);
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "client_manager.hpp"
+#include "loop.hpp"
+#include "server_state.hpp"
+#include "udp_server.hpp"
+#include "../shared/opponent_info.hpp"
+#include "../shared/packets/tcp/tcp_packet.hpp"
+#include "../shared/room_limits.hpp"
+
+/* A single lobby and the race that follows it. Owns its roster, snapshot loop and match phase. */
+class Room {
+public:
+    static constexpr size_t MAX_PLAYERS = MAX_PLAYERS_PER_ROOM;
+
+    Room(uint32_t id, std::shared_ptr<ClientManager> clientManager, std::shared_ptr<UDPServer> udpServer);
+
+    [[nodiscard]]
+    uint32_t getId() const;
+
+    [[nodiscard]]
+    MatchPhase getPhase();
+
+    [[nodiscard]]
+    size_t getClientCount();
+
+    /* Returns false if the room is not a lobby anymore or is already full */
+    bool addClient(ClientHandle &client);
+
+    void removeClient(const ClientHandle &client);
+
+    [[nodiscard]]
+    int timeUntilStart();
+
+    /* Called by the MatchManager worker owning this room, TICK_RATE times per second */
+    void tick();
+
+    void enqueueStateUpdate(const ClientState &clientState);
+
+    void onClientGameLoaded(ClientHandle &client);
+
+    /* Ends the race once every player still in it has done RACE_LAPS */
+    void broadcastLapsUpdate(const ClientHandle &updatedClient);
+
+    /* Expects state.mtx not to be held, the next tick hands the players back to the TCP thread */
+    void endMatch();
+
+    [[nodiscard]]
+    std::vector<std::string> getNicksInLobby();
+
+    void sendToAllInLobby(const PacketBuffer &buf, ssize_t size);
+
+    void sendToAllInLobbyExcept(const PacketBuffer &buf, ssize_t size, const ClientHandle &except);
+
+private:
+    const uint32_t id;
+    std::shared_ptr<ClientManager> clientManager;
+
+    /* Guards everything below */
+    ServerState state;
+    std::vector<uint16_t> clientIds;
+    Loop loop;
+
+    const int lobbyEndTimeout{15};
+    std::chrono::steady_clock::time_point lobbyStartTime;
+
+    const int raceStartTimeout{5};
+
+    std::vector<PlayerVehicleColor> colors = {
+        {255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 0},
+        {255, 0, 255}, {0, 255, 255}, {255, 165, 0}, {128, 0, 128}
+    };
+
+    /* Functions below expect state.mtx to be held by the caller */
+    [[nodiscard]]
+    std::vector<std::shared_ptr<ClientHandle> > collectClients() const;
+
+    [[nodiscard]]
+    int secondsUntilStart() const;
+
+    void broadcast(const PacketBuffer &buf, ssize_t size, ClientStateLobby clientState,
+                   const ClientHandle *except = nullptr) const;
+
+    void startRace();
+
+    void assignColors(const std::vector<std::shared_ptr<ClientHandle> > &clients);
+
+    void sendClientOpponentsInfo(const ClientHandle &client,
+                                 const std::vector<std::shared_ptr<ClientHandle> > &clients) const;
+
+    void startRaceStartCountdown() const;
+
+    /* Asks the TCP thread to disconnect everyone, it owns their sockets */
+    void closeConnections() const;
+
+    void reset();
+};
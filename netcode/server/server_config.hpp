@@ -0,0 +1,99 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tick_scheduler.hpp"
+
+constexpr const char *SERVER_USAGE =
+        "Usage: %s <port> [--workers N] [--tick sleep|hybrid|spin] [--spin-us N] [--pin-cpus 2,3,...]"
+        " [--fifo] [--busy-poll-us N] [--metrics-port N]\n";
+
+struct ServerConfig {
+    std::string port;
+    /* One per core, or a single one with the spin strategy unless --workers asks for more */
+    size_t workerCount = std::max(1u, std::thread::hardware_concurrency());
+
+    /* Template for every worker, the cpu field is filled in from workerCpus */
+    TickSchedulerConfig tick;
+
+    /* Worker i is pinned to workerCpus[i % size], empty disables pinning */
+    std::vector<int> workerCpus;
+
+    /* SO_BUSY_POLL on the UDP socket, 0 disables it */
+    int busyPollMicroseconds = 0;
+
+    /* Local Prometheus endpoint, "0" disables it */
+    std::string metricsPort = "9464";
+
+    /* Throws std::invalid_argument on malformed arguments */
+    static ServerConfig fromArgs(const int argc, char *argv[]) {
+        if (argc < 2)
+            throw std::invalid_argument("Missing port");
+
+        ServerConfig config;
+        config.port = argv[1];
+        std::optional<size_t> workers;
+
+        for (int i = 2; i < argc; ++i) {
+            const auto nextValue = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::invalid_argument(std::string("Missing value for ") + argv[i]);
+                return argv[++i];
+            };
+
+            if (std::strcmp(argv[i], "--workers") == 0)
+                workers = std::max(1ul, std::stoul(nextValue()));
+            else if (std::strcmp(argv[i], "--tick") == 0)
+                config.tick.strategy = parseTickStrategy(nextValue());
+            else if (std::strcmp(argv[i], "--spin-us") == 0)
+                config.tick.spinWindow = std::chrono::microseconds(std::stoul(nextValue()));
+            else if (std::strcmp(argv[i], "--pin-cpus") == 0)
+                config.workerCpus = parseCpuList(nextValue());
+            else if (std::strcmp(argv[i], "--fifo") == 0)
+                config.tick.realtime = true;
+            else if (std::strcmp(argv[i], "--busy-poll-us") == 0)
+                config.busyPollMicroseconds = std::stoi(nextValue());
+            else if (std::strcmp(argv[i], "--metrics-port") == 0)
+                config.metricsPort = nextValue();
+            else
+                throw std::invalid_argument(std::string("Unknown option ") + argv[i]);
+        }
+
+        /* A spinning worker keeps its core busy, one per core would leave nothing for the TCP and UDP threads */
+        if (workers)
+            config.workerCount = *workers;
+        else if (config.tick.strategy == TickStrategy::Spin)
+            config.workerCount = 1;
+
+        return config;
+    }
+
+    [[nodiscard]]
+    TickSchedulerConfig tickConfigForWorker(const size_t workerIndex) const {
+        auto workerConfig = tick;
+        if (!workerCpus.empty())
+            workerConfig.cpu = workerCpus[workerIndex % workerCpus.size()];
+        return workerConfig;
+    }
+
+private:
+    static std::vector<int> parseCpuList(const std::string &list) {
+        std::vector<int> cpus;
+        size_t start = 0;
+
+        while (start < list.size()) {
+            auto end = list.find(',', start);
+            if (end == std::string::npos) end = list.size();
+
+            cpus.push_back(std::stoi(list.substr(start, end - start)));
+            start = end + 1;
+        }
+
+        return cpus;
+    }
+};
@@ -1,6 +1,5 @@
 #pragma once
 #include <mutex>
-#include <condition_variable>
 
 enum class MatchPhase {
     Lobby,
@@ -8,15 +7,14 @@ enum class MatchPhase {
     Finished
 };
 
+/* State of a single room, every room owns one */
 struct ServerState {
     std::mutex mtx;
-    std::condition_variable cv;
     MatchPhase phase = MatchPhase::Lobby;
+    /* A room that reset to a lobby in the meantime stays one */
     void endMatch() {
-        {
-            std::lock_guard<std::mutex> lock(mtx);
+        std::lock_guard<std::mutex> lock(mtx);
+        if (phase == MatchPhase::Running)
             phase = MatchPhase::Finished;
-        }
-        cv.notify_all();
     }
-};
\ No newline at end of file
+};
@@ -4,33 +4,23 @@
 #include <fcntl.h>
 #include <cstring>
 #include <sys/epoll.h>
-#include <iostream>
 #include <utility>
 #include <netdb.h>
-#include <algorithm>
-#include <thread>
-#include <condition_variable>
-#include <ranges>
 
+#include "metrics.hpp"
+#include "../shared/logger.hpp"
 #include "../shared/packets/tcp/server/provide_name_packet.hpp"
-#include "../shared/packets/tcp/server/start_game_packet.hpp"
-#include "../shared/packets/tcp/server/client_disconnected_packet.hpp"
-#include "../shared/packets/tcp/server/laps_update_packet.hpp"
-#include "../shared/packets/tcp/server/opponents_info_packet.hpp"
-#include "../shared/packets/tcp/server/race_start_countdown_packet.hpp"
 #include "handlers/client_game_loaded_handler.hpp"
 #include "handlers/lap_count_handler.hpp"
 #include "handlers/name_handler.hpp"
 #include "handlers/udp_info_handler.hpp"
 
-#include <random>
-
 static int makeNonBlocking(const int fd) {
     const int flags = fcntl(fd, F_GETFL, 0);
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
-TCPServer::TCPServer(std::shared_ptr<ClientManager> clientManager, std::shared_ptr<ServerState> state) {
+TCPServer::TCPServer(std::shared_ptr<ClientManager> clientManager, std::shared_ptr<MatchManager> matchManager) {
     socketFd = ::socket(AF_INET, SOCK_STREAM, 0);
     if (socketFd < 0)
         throw std::runtime_error(std::string("Failed to create TcpBSDServer socket! ") + std::strerror(errno));
@@ -38,123 +28,14 @@ TCPServer::TCPServer(std::shared_ptr<ClientManager> clientManager, std::shared_p
     constexpr int one = 1;
     setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
     makeNonBlocking(socketFd);
-    //lobbyStartTime = std::chrono::steady_clock::now();
     this->clientManager = std::move(clientManager);
-    this->state = std::move(state);
+    this->matchManager = std::move(matchManager);
 };
 
 TCPServer::~TCPServer() {
     if (socketFd >= 0)
         close(socketFd);
 }
-void TCPServer::resetLobbyStartTime() {
-
-    lobbyStartTime = std::chrono::steady_clock::now();
-}
-void TCPServer::assignColors(){
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(colors.begin(), colors.end(), g);
-    auto &clients = clientManager->getAllClients();
-    size_t colorIndex = 0;
-
-    for (auto &pair : clients) {
-        auto &client = pair.second;
-
-        if (!client.connected || client.state != ClientStateLobby::InLobby)
-            continue;
-
-        if (colorIndex >= colors.size()) {
-            std::cerr << "Warning: more players than colors, reusing colors\n";
-            colorIndex = 0;
-        }
-
-        client.vehicleColor = colors[colorIndex++];
-    }
-}
-
-void TCPServer::resetLobby() {
-    std::lock_guard lock(state->mtx);
-    state->phase = MatchPhase::Lobby;
-
-    clientManager->resetAll();
-    resetLobbyStartTime();
-    std::cout << "Lobby has been reset\n";
-}
-int TCPServer::timeUntilStart() const {
-    const auto now = std::chrono::steady_clock::now();
-    const auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - lobbyStartTime).count();
-    const int remaining = lobbyEndTimeout - static_cast<int>(elapsed);
-    return remaining > 0 ? remaining : 0;
-}
-
-void TCPServer::countdownToLobbyEnd(){
-    std::thread([this]() {
-        while (true) {
-            {
-                std::lock_guard<std::mutex> lock(state->mtx);
-                if (state->phase == MatchPhase::Finished) {
-                    return;
-                }
-            }
-            const int connected = clientManager->getNumberOfConnectedClients();
-           if (connected == 0) {
-               // Freeze countdown until someone joins
-               std::this_thread::sleep_for(std::chrono::seconds(1));
-               continue;
-           }
-            const int remaining = timeUntilStart();
-            std::cout << "\rRace starts in: " << remaining << "s" << std::flush;
-
-            if (remaining <= 0) {
-                assignColors();
-                std::cout << "\nRace started!\n";
-                {
-                    std::lock_guard<std::mutex> lock(state->mtx);
-                    state->phase = MatchPhase::Running;
-
-                }
-                state->cv.notify_all();
-                auto &clients = clientManager->getAllClients();
-
-                for (auto &client: clients | std::views::values) {
-                    if (!client.connected || client.state != ClientStateLobby::InLobby) continue;
-                    client.state = ClientStateLobby::InGame;
-                    auto packet = StartGamePacket();
-                    packet.gridPosition = client.gridPosition;
-                    packet.vehicleColor = client.vehicleColor;
-                    const auto serialized = TCPPacket::serialize(packet);
-                    send(client, serialized, sizeof(packet));
-                }
-
-                for (auto &client: clients | std::views::values) {
-                    sendClientOpponentsInfo(client);
-                }
-
-                break;
-            }
-
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-        }
-    }).detach();
-}
-
-void TCPServer::startRaceStartCountdown() const {
-    auto packet = RaceStartCountdownPacket();
-    packet.secondsUntilStart = raceStartTimeout;
-    const auto serialized = TCPPacket::serialize(packet);
-
-    sendToAllInGame(serialized, sizeof(packet));
-}
-
-void TCPServer::broadcastLapsUpdate(const ClientHandle &updatedClient) const {
-    auto packet = LapsUpdatePacket();
-    packet.clientId = updatedClient.id;
-    packet.laps = updatedClient.laps;
-
-    sendToAllExcept(TCPPacket::serialize(packet), sizeof(packet), updatedClient);
-}
-
 void TCPServer::listen(const char *port) {
     addrinfo *res, hints{};
     hints.ai_socktype = SOCK_STREAM;
@@ -169,80 +50,71 @@ void TCPServer::listen(const char *port) {
     if (::listen(socketFd, SOMAXCONN))
         throw std::runtime_error(std::string("TcpBSDServer listen failed: ") + strerror(errno));
     freeaddrinfo(res);
-    //countdownToLobbyEnd();
     loop();
 }
 
 
-void TCPServer::send(const ClientHandle &client, const char *data, const ssize_t size) {
-    if (!client.connected) {
-        std::cout << "Tried to send to not connected" << std::endl;
-        return;
+namespace {
+    const PacketMetrics &packetMetrics() {
+        static const PacketMetrics metrics("tcp", {
+                                               "Name", "ProvideName", "NameTaken", "NameAccepted", "TimeUntilStart",
+                                               "UdpInfo", "StartGame", "ClientConnected", "ClientDisconnected",
+                                               "LobbyClientList", "OpponentsInfo", "ClientGameLoaded",
+                                               "RaceStartCountdown", "LapCount", "LapsUpdate"
+                                           });
+        return metrics;
     }
+}
 
-    const ssize_t bytesSent = ::send(client.tcpSocketFd, data, size, 0);
-
-    if (bytesSent <= 0 && errno != EWOULDBLOCK && errno != EAGAIN)
-        throw std::runtime_error(std::string("Failed to send TCP message: ") + strerror(errno));
-
-    /* TODO: Instead of busy waiting like this we should keep a queue for every client
-     * and poll their FDs to see when they're ready */
-    if (bytesSent <= 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
-        send(client, data, size);
+void TCPServer::send(const ClientHandle &client, const char *data, const ssize_t size) {
+    if (!client.connected) {
+        LOG_WARN("Tried to send to not connected client {}", client.id);
         return;
     }
 
-    if (bytesSent > 0 && bytesSent < size) {
-        const auto remainingBufferPtr = data + bytesSent;
-        const auto remainingSize = size - bytesSent;
-        send(client, remainingBufferPtr, remainingSize);
-    }
+    packetMetrics().onSent(static_cast<uint8_t>(data[0]), size);
+    if (!client.outbox.append(data, size))
+        LOG_WARN("Client {} fell {} bytes behind on TCP, dropping it", client.id, ClientOutbox::MAX_BYTES);
 }
 
 void TCPServer::send(const ClientHandle &client, const PacketBuffer &data, const ssize_t size) {
     send(client, data.get(), size);
 }
 
-void TCPServer::sendToAll(const PacketBuffer &data, const ssize_t size) const {
-    for (const auto &client: clientManager->getAllClients() | std::views::values) {
-        send(client, data, size);
-    }
-}
+void TCPServer::flush(ClientHandle &client) const {
+    switch (client.outbox.flush(client.tcpSocketFd)) {
+        case ClientOutbox::FlushResult::Done:
+            watchWritable(client, false);
+            break;
 
-void TCPServer::sendToAllExcept(const PacketBuffer &data, const ssize_t size, const ClientHandle &except) const {
-    for (const auto &client: clientManager->getAllClients() | std::views::values) {
-        if (client.id != except.id)
-            send(client, data, size);
-    }
-}
-void TCPServer::sendToAllInLobby(const PacketBuffer &buf, ssize_t size) const {
-    for (auto &pair : clientManager->getAllClients()) {
-        const auto &client = pair.second;
-        if (client.state == ClientStateLobby::InLobby) {
-            send(client, buf.get(), size);
-        }
-    }
-}
+        case ClientOutbox::FlushResult::Pending:
+            watchWritable(client, true);
+            break;
 
-void TCPServer::sendToAllInLobbyExcept(const PacketBuffer &buf, ssize_t size, const ClientHandle &exclude) const {
-    for (auto &pair : clientManager->getAllClients()) {
-        const auto &client = pair.second;
-        if (client.state == ClientStateLobby::InLobby && client.id != exclude.id) {
-            send(client, buf.get(), size);
-        }
+        case ClientOutbox::FlushResult::Failed:
+            LOG_WARN("Failed to send to client {}, disconnecting", client.id);
+            disconnect(client);
+            break;
     }
 }
 
-void TCPServer::sendToAllInGame(const PacketBuffer &data, const ssize_t size) const {
-    for (const auto &client: clientManager->getAllClients() | std::views::values) {
-        if (client.state == ClientStateLobby::InGame)
-            send(client, std::move(data), size);
-    }
+void TCPServer::disconnect(const ClientHandle &client) const {
+    /* The room notifies the rest of its lobby and frees up if this was its last player */
+    matchManager->removeClient(client);
+    clientManager->removeClient(client.tcpSocketFd);
 }
 
-void TCPServer::sendToAllExcept(const PacketBuffer &data, const ssize_t size, const uint16_t exceptId) const {
-    const auto client = clientManager->getClient(exceptId);
-    sendToAllExcept(data, size, *client);
+void TCPServer::watchWritable(ClientHandle &client, const bool writable) const {
+    if (client.outbox.waitingForWritable == writable)
+        return;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    if (writable)
+        ev.events |= EPOLLOUT;
+    ev.data.fd = client.tcpSocketFd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, client.tcpSocketFd, &ev);
+    client.outbox.waitingForWritable = writable;
 }
 
 void TCPServer::receivePacketFromClient(ClientHandle &client) {
@@ -256,8 +128,8 @@ void TCPServer::receivePacketFromClient(ClientHandle &client) {
     std::memcpy(&header, headerBuf, sizeof(TCPPacketHeader));
 
     if (header.payloadSize > MAX_TCP_PAYLOAD_SIZE) {
-        std::cerr << "Client sent a packet with payload too large! Size: " << header.payloadSize << std::endl;
-        clientManager->removeClient(client.tcpSocketFd);
+        LOG_WARN("Client fd={} sent a packet with payload too large! Size: {}", client.tcpSocketFd, header.payloadSize);
+        disconnect(client);
         return;
     }
 
@@ -274,6 +146,8 @@ void TCPServer::receivePacketFromClient(ClientHandle &client) {
 
 void TCPServer::handlePacket(TCPPacketType type, const PacketBuffer &payload, const ssize_t size,
                              ClientHandle &client) {
+    packetMetrics().onReceived(static_cast<uint8_t>(type), sizeof(TCPPacketHeader) + size);
+
     try {
         switch (type) {
             case TCPPacketType::Name:
@@ -285,7 +159,7 @@ void TCPServer::handlePacket(TCPPacketType type, const PacketBuffer &payload, co
                 break;
 
             case TCPPacketType::ClientGameLoaded:
-                ClientGameLoadedHandler::handle(client, clientManager, this);
+                ClientGameLoadedHandler::handle(client, this);
                 break;
 
             case TCPPacketType::LapCount:
@@ -293,57 +167,33 @@ void TCPServer::handlePacket(TCPPacketType type, const PacketBuffer &payload, co
                 break;
 
             default:
-                std::cerr << "Received a packet with unknown id: " << static_cast<uint8_t>(type) << std::endl;
+                LOG_WARN("Received a packet with unknown id: {}", static_cast<uint8_t>(type));
         }
     } catch (DeserializationError &e) {
-        std::cerr << "Error while deserializing packet: " << e.what() << std::endl;
-    }
-}
-void TCPServer::notifyClientDisconnected(const ClientHandle& client) const {
-    const auto [packet,packetSize] = TCPPacket::create<ClientDisconnectedPacket>(
-        client.nick.c_str(), client.nick.size());
-    const auto buf = TCPPacket::serialize(packet);
-
-    sendToAllInLobbyExcept(std::move(buf),
-                           packetSize,
-                           client);
-}
-
-void TCPServer::sendClientOpponentsInfo(const ClientHandle &client) const {
-    std::vector<OpponentInfo> opponentInfos;
-
-    for (const auto &opponent: clientManager->getAllClients() | std::views::values) {
-        if (opponent.id == client.id) continue;
-        if (opponent.state != ClientStateLobby::InGame) continue;
-
-        OpponentInfo info{
-            .id = opponent.id,
-            .vehicleColor = opponent.vehicleColor,
-            .gridPosition = opponent.gridPosition,
-            .nickname = opponent.nick
-        };
-
-        opponentInfos.push_back(info);
+        packetMetrics().deserializationErrors.inc();
+        LOG_WARN("Error while deserializing packet: {}", e.what());
     }
-
-    const auto packet = OpponentsInfoPacket(opponentInfos);
-    const auto packetSize = static_cast<ssize_t>(sizeof(packet.header) + packet.header.payloadSize);
-    send(client, TCPPacket::serialize(packet), packetSize);
 }
-
 [[noreturn]]
 void TCPServer::loop() {
-    int efd = epoll_create1(0);
-    if (efd < 0)
+    epollFd = epoll_create1(0);
+    if (epollFd < 0)
         throw std::runtime_error(std::string("epoll_create1 failed: ") + strerror(errno));
     epoll_event ev{};
     ev.events = EPOLLIN;
     ev.data.fd = socketFd;
-    epoll_ctl(efd, EPOLL_CTL_ADD, socketFd, &ev);
-    std::cout << "waiting for clients...\n";
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, socketFd, &ev);
+
+    /* Other threads queue sends and disconnects, the sockets are only written and closed here */
+    const int requestsFd = clientManager->getTcpEventFd();
+    epoll_event rev{};
+    rev.events = EPOLLIN;
+    rev.data.fd = requestsFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, requestsFd, &rev);
+    LOG_INFO("Waiting for clients...");
     epoll_event events[64];
     while (true) {
-        int n = epoll_wait(efd, events, 64, -1);
+        int n = epoll_wait(epollFd, events, 64, -1);
         if (n < 0)
             throw std::runtime_error(std::string("epoll_wait failed: ") + strerror(errno));
         for (int i = 0; i < n; ++i) {
@@ -355,7 +205,7 @@ void TCPServer::loop() {
                     const int cfd = accept(socketFd, reinterpret_cast<sockaddr *>(&cli), &clilen);
                     if (cfd < 0) break;
                     makeNonBlocking(cfd);
-                    auto *client = clientManager->newClient(cli, cfd);
+                    const auto client = clientManager->newClient(cli, cfd);
                     client->state = ClientStateLobby::WaitingForNick;
                     auto packet = ProvideNamePacket();
                     const auto packetBuf = TCPPacket::serialize(packet);
@@ -364,52 +214,35 @@ void TCPServer::loop() {
                     epoll_event cev{};
                     cev.events = EPOLLIN | EPOLLRDHUP;
                     cev.data.fd = cfd;
-                    epoll_ctl(efd, EPOLL_CTL_ADD, cfd, &cev);
-                    std::cout << "\nAccepted client fd=" << cfd << "\n";
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, cfd, &cev);
+                    LOG_INFO("Accepted client fd={}", cfd);
                 }
                 continue;
             }
-            if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                auto client = clientManager->getClientByFd(fd);
-
-                if (client && client->state == ClientStateLobby::InLobby) {
-                    notifyClientDisconnected(*client);
+            if (fd == requestsFd) {
+                const auto [disconnects, flushes] = clientManager->takeTcpRequests();
+                for (const auto clientId: flushes) {
+                    if (const auto client = clientManager->getClient(clientId))
+                        flush(*client);
+                }
+                for (const auto clientId: disconnects) {
+                    if (const auto client = clientManager->getClient(clientId))
+                        disconnect(*client);
                 }
-                clientManager->removeClient(fd);
-
-                TimeUntilStartPacket countdown{};
-                countdown.seconds = timeUntilStart();
-                auto countdownBuf = TCPPacket::serialize(countdown);
-                sendToAllInLobby(countdownBuf, sizeof(countdown));
                 continue;
             }
-            if (events[i].events & EPOLLIN) {
-                const auto client = clientManager->getClientByFd(fd);
-                if (!client) continue;
 
-                receivePacketFromClient(*clientManager->getClientByFd(fd));
+            const auto client = clientManager->getClientByFd(fd);
+            if (!client) continue;
+
+            if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                disconnect(*client);
+                continue;
             }
+            if (events[i].events & EPOLLOUT)
+                flush(*client);
+            if (events[i].events & EPOLLIN && client->connected)
+                receivePacketFromClient(*client);
         }
     }
 }
-
-void TCPServer::broadcastPlayers() const {
-    const auto &clients = clientManager->getAllClients();
-    size_t connectedCount = 0;
-    for (const auto &[id, client]: clients) {
-        if (client.connected && client.state == ClientStateLobby::InLobby)
-            ++connectedCount;
-    }
-    std::string lobbyMessage = "Player Count (" + std::to_string(connectedCount) + "):\n";
-
-    int index = 1;
-    for (const auto &[id, client]: clients) {
-        if (!client.connected || client.state != ClientStateLobby::InLobby) continue;
-        lobbyMessage += std::to_string(index++) + ". " + client.nick + "\n";
-    }
-    lobbyMessage += "Race starts in: " + std::to_string(timeUntilStart()) + "s\n";
-    for (const auto &[id, client]: clients) {
-        if (!client.connected || client.state != ClientStateLobby::InLobby) continue;
-        send(client, lobbyMessage.c_str(), lobbyMessage.size());
-    }
-}
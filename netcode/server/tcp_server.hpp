@@ -1,84 +1,46 @@
 #pragma once
 
 #include "client_manager.hpp"
-#include <chrono>
-#include <condition_variable>
+#include "match_manager.hpp"
 #include "../shared/packets/tcp/tcp_packet.hpp"
-#include "server_state.hpp"
-#include "../shared/opponent_info.hpp"
 
 
 #define MAX_PACKET_SIZE 1024
 
 class TCPServer final {
 public:
-    explicit TCPServer(std::shared_ptr<ClientManager> clientManager, std::shared_ptr<ServerState> state);
+    explicit TCPServer(std::shared_ptr<ClientManager> clientManager, std::shared_ptr<MatchManager> matchManager);
 
     ~TCPServer();
 
     std::shared_ptr<ClientManager> clientManager;
-    std::shared_ptr<ServerState> state;
+    std::shared_ptr<MatchManager> matchManager;
 
     void listen(const char *port);
 
     //void addMessageListener(std::function<void(const Packet &)>) override;
 
+    /* Safe from any thread, never blocks. Queues the packet in the client's outbox for the TCP thread to write. */
     static void send(const ClientHandle &client, const char *data, ssize_t size);
 
     //void send(ClientHandle client, const std::unique_ptr<char[]> &data, ssize_t size) const;
-    //void sendToAll(const PacketBuffer &data, ssize_t size) const override;
 
     static void send(const ClientHandle &client, const PacketBuffer &data, ssize_t size);
 
-    void sendToAll(const PacketBuffer &data, ssize_t size) const;
-
-    void sendToAllExcept(const PacketBuffer &data, ssize_t size, const ClientHandle &except) const;
-
-    void sendToAllExcept(const PacketBuffer &data, ssize_t size, uint16_t exceptId) const;
-
-    void sendToAllInLobby(const PacketBuffer &buf, ssize_t size) const;
-
-    void sendToAllInLobbyExcept(const PacketBuffer &data, ssize_t size, const ClientHandle &except) const;
-
-    void sendToAllInGame(const PacketBuffer &data, ssize_t size) const;
-
     void receivePacketFromClient(ClientHandle &client);
 
     void handlePacket(TCPPacketType type, const PacketBuffer &payload, ssize_t size, ClientHandle &client);
 
-    void notifyClientDisconnected(const ClientHandle &client) const;
-
-    void sendClientOpponentsInfo(const ClientHandle &client) const;
-
-    [[nodiscard]]
-    int timeUntilStart() const;
-
-    void countdownToLobbyEnd();
-
-    void assignColors();
-
-    void startRaceStartCountdown() const;
-
-    void resetLobbyStartTime();
-
-    void resetLobby();
-
-    void broadcastLapsUpdate(const ClientHandle &updatedClient) const;
-
 private:
     int socketFd;
+    int epollFd = -1;
 
-    const int lobbyEndTimeout{15};
-    std::chrono::steady_clock::time_point lobbyStartTime;
+    /* Writes out what the client's outbox holds, waits for EPOLLOUT if the socket is full */
+    void flush(ClientHandle &client) const;
 
-    std::vector<PlayerVehicleColor> colors = {
-        {255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 0},
-        {255, 0, 255}, {0, 255, 255}, {255, 165, 0}, {128, 0, 128}
-    };
+    void disconnect(const ClientHandle &client) const;
 
-    const int raceStartTimeout{5};
+    void watchWritable(ClientHandle &client, bool writable) const;
 
     [[noreturn]] void loop();
-
-    void broadcastPlayers() const;
 };
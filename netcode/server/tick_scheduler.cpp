@@ -0,0 +1,123 @@
+#include "tick_scheduler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../shared/logger.hpp"
+
+using namespace std::chrono;
+
+static void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+TickStrategy parseTickStrategy(const std::string &name) {
+    if (name == "sleep") return TickStrategy::Sleep;
+    if (name == "hybrid") return TickStrategy::Hybrid;
+    if (name == "spin") return TickStrategy::Spin;
+
+    throw std::invalid_argument("Unknown tick strategy: " + name + " (expected sleep, hybrid or spin)");
+}
+
+TickScheduler::TickScheduler(const nanoseconds period, const TickSchedulerConfig &config)
+    : period(period), config(config), nextTick(steady_clock::now() + period) {
+}
+
+void TickScheduler::applyThreadSettings() const {
+    if (config.cpu >= 0) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(config.cpu, &cpuSet);
+
+        if (const int rv = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet))
+            LOG_WARN("Failed to pin tick thread to CPU {}: {}", config.cpu, strerror(rv));
+    }
+
+    if (config.realtime) {
+        sched_param param{};
+        param.sched_priority = config.realtimePriority;
+
+        /* Not being allowed to is fine, we just keep running with the default policy */
+        if (const int rv = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+            LOG_WARN("SCHED_FIFO not permitted for tick thread: {}", strerror(rv));
+    }
+}
+
+nanoseconds TickScheduler::waitForNextTick() {
+    switch (config.strategy) {
+        case TickStrategy::Sleep:
+            std::this_thread::sleep_until(nextTick);
+            break;
+
+        case TickStrategy::Hybrid:
+            std::this_thread::sleep_until(nextTick - config.spinWindow);
+            spinUntil(nextTick);
+            break;
+
+        case TickStrategy::Spin:
+            spinUntil(nextTick);
+            break;
+    }
+
+    const auto now = steady_clock::now();
+    const auto lateness = duration_cast<nanoseconds>(now - nextTick);
+    recordLateness(lateness);
+
+    nextTick += period;
+    if (now >= nextTick) {
+        const auto behind = (now - nextTick) / period + 1;
+        skippedTicks += behind;
+        nextTick += behind * period;
+    }
+
+    return lateness;
+}
+
+LatenessPercentiles TickScheduler::getLatenessPercentiles() const {
+    const auto count = std::min(latenessSampleCount, LATENESS_WINDOW);
+    if (count == 0)
+        return {};
+
+    std::vector<uint32_t> sorted(latenessSamples.begin(), latenessSamples.begin() + static_cast<long>(count));
+    std::ranges::sort(sorted);
+
+    const auto at = [&](const double quantile) {
+        const auto index = std::min(count - 1, static_cast<size_t>(quantile * static_cast<double>(count)));
+        return microseconds(sorted[index]);
+    };
+
+    return {
+        .p50 = at(0.5),
+        .p99 = at(0.99),
+        .p999 = at(0.999),
+        .max = microseconds(sorted.back())
+    };
+}
+
+uint64_t TickScheduler::getSkippedTicks() const {
+    return skippedTicks;
+}
+
+steady_clock::time_point TickScheduler::getNextTick() const {
+    return nextTick;
+}
+
+void TickScheduler::spinUntil(const steady_clock::time_point deadline) {
+    while (steady_clock::now() < deadline)
+        cpuRelax();
+}
+
+void TickScheduler::recordLateness(const nanoseconds lateness) {
+    const auto us = std::max<int64_t>(0, duration_cast<microseconds>(lateness).count());
+    latenessSamples[latenessSampleCount % LATENESS_WINDOW] = static_cast<uint32_t>(std::min<int64_t>(us, UINT32_MAX));
+    latenessSampleCount++;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum class TickStrategy {
+    /* Plain sleep_until, cheapest but wakeup jitter is up to the kernel */
+    Sleep,
+    /* Sleep until shortly before the deadline, then spin the rest */
+    Hybrid,
+    /* Never sleep, burns the whole core */
+    Spin
+};
+
+struct TickSchedulerConfig {
+    TickStrategy strategy = TickStrategy::Sleep;
+
+    /* How long before the deadline the Hybrid strategy stops sleeping and starts spinning */
+    std::chrono::microseconds spinWindow{500};
+
+    /* CPU to pin the ticking thread to, -1 leaves it to the scheduler */
+    int cpu = -1;
+
+    /* Run the ticking thread with SCHED_FIFO, needs CAP_SYS_NICE or a suitable RLIMIT_RTPRIO */
+    bool realtime = false;
+    int realtimePriority = 50;
+};
+
+struct LatenessPercentiles {
+    std::chrono::microseconds p50{};
+    std::chrono::microseconds p99{};
+    std::chrono::microseconds p999{};
+    std::chrono::microseconds max{};
+};
+
+TickStrategy parseTickStrategy(const std::string &name);
+
+/* Fixed rate tick clock that records how late every wakeup was */
+class TickScheduler {
+public:
+    TickScheduler(std::chrono::nanoseconds period, const TickSchedulerConfig &config);
+
+    /* Applies pinning and scheduling policy to the calling thread */
+    void applyThreadSettings() const;
+
+    /* Blocks until the next tick deadline. If we are more than a whole period behind
+     * the missed ticks are skipped instead of being run back to back */
+    std::chrono::nanoseconds waitForNextTick();
+
+    [[nodiscard]]
+    LatenessPercentiles getLatenessPercentiles() const;
+
+    [[nodiscard]]
+    uint64_t getSkippedTicks() const;
+
+    [[nodiscard]]
+    std::chrono::steady_clock::time_point getNextTick() const;
+
+private:
+    static constexpr size_t LATENESS_WINDOW = 1024;
+
+    const std::chrono::nanoseconds period;
+    const TickSchedulerConfig config;
+
+    std::chrono::steady_clock::time_point nextTick;
+    uint64_t skippedTicks = 0;
+
+    std::array<uint32_t, LATENESS_WINDOW> latenessSamples{};
+    size_t latenessSampleCount = 0;
+
+    static void spinUntil(std::chrono::steady_clock::time_point deadline);
+
+    void recordLateness(std::chrono::nanoseconds lateness);
+};
@@ -2,15 +2,27 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <cstring>
-#include <format>
-#include <iostream>
 #include <utility>
 #include <netdb.h>
-#include <ranges>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
 
+#include "../shared/logger.hpp"
 #include "../shared/packets/udp/udp_packet.hpp"
 #include "../shared/packets/udp/client/state_packet.hpp"
+#include "match_manager.hpp"
+#include "metrics.hpp"
 #include "handlers/state_handler.hpp"
+#include "handlers/time_sync_handler.hpp"
+
+namespace {
+    const PacketMetrics &packetMetrics() {
+        static const PacketMetrics metrics("udp", {
+                                               "State", "OpponentStates", "Ping", "TimeSyncRequest", "TimeSyncResponse"
+                                           });
+        return metrics;
+    }
+}
 
 UDPServer::UDPServer(std::shared_ptr<ClientManager> clientManager) {
     socketFd = ::socket(AF_INET, SOCK_DGRAM, 0);
@@ -21,6 +33,15 @@ UDPServer::UDPServer(std::shared_ptr<ClientManager> clientManager) {
     setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
 
     this->clientManager = std::move(clientManager);
+
+    Metrics::getInstance().addCollector([fd = socketFd](MetricsWriter &writer) {
+        int queued = 0;
+        if (ioctl(fd, SIOCOUTQ, &queued) < 0)
+            return;
+
+        writer.family("nfsput_udp_send_queue_bytes", "Bytes waiting in the UDP socket send queue", "gauge");
+        writer.sample("nfsput_udp_send_queue_bytes", {}, static_cast<uint64_t>(queued));
+    });
 };
 
 UDPServer::~UDPServer() {
@@ -28,6 +49,15 @@ UDPServer::~UDPServer() {
         close(socketFd);
 }
 
+void UDPServer::setMatchManager(std::shared_ptr<MatchManager> manager) {
+    matchManager = std::move(manager);
+}
+
+void UDPServer::setBusyPoll(const int microseconds) const {
+    if (setsockopt(socketFd, SOL_SOCKET, SO_BUSY_POLL, &microseconds, sizeof(microseconds)))
+        LOG_WARN("Failed to enable SO_BUSY_POLL on UDP socket: {}", strerror(errno));
+}
+
 void UDPServer::listen(const char *port) {
     addrinfo *res, hints{};
     hints.ai_socktype = SOCK_DGRAM;
@@ -42,38 +72,35 @@ void UDPServer::listen(const char *port) {
     loop();
 }
 
-void UDPServer::send(const ClientHandle client, const PacketBuffer &data, const ssize_t size) const {
+void UDPServer::send(const ClientHandle &client, const PacketBuffer &data, const ssize_t size) const {
     if (!client.connected) {
-        std::cout << "Tried to send to not connected" << std::endl;
+        LOG_WARN("Tried to send to not connected client {}", client.id);
         return;
     }
 
-    const ssize_t bytesSent = ::sendto(socketFd, data.get(), size, 0,
-                                       reinterpret_cast<const sockaddr *>(&client.udpAddr),
-                                       sizeof(client.udpAddr));
+    /* Room workers send from here, a full socket buffer or a bad address drops the datagram instead of stalling
+     * or taking down every room on the worker */
+    const auto address = client.getUdpAddr();
+    const ssize_t bytesSent = ::sendto(socketFd, data.get(), size, MSG_DONTWAIT,
+                                       reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+
+    if (bytesSent < 0) {
+        static auto &sendErrors = Metrics::getInstance().counter(
+            "nfsput_udp_send_errors_total", "Datagrams dropped because sendto failed");
+        sendErrors.inc();
+        LOG_WARN("Failed to send UDP message to client {}: {}", client.id, strerror(errno));
+        return;
+    }
 
-    if (bytesSent <= 0)
-        throw std::runtime_error(std::string("Failed to UDP message: ") + strerror(errno));
+    packetMetrics().onSent(static_cast<uint8_t>(data[0]), bytesSent);
 }
 
 void UDPServer::sendToAll(const PacketBuffer &data, const ssize_t size) const {
-    for (const auto client: clientManager->getAllClients() | std::views::values) {
-        send(client, data, size);
+    for (const auto &client: clientManager->getAllClients()) {
+        send(*client, data, size);
     }
 }
 
-void UDPServer::sendToAllExcept(const PacketBuffer &data, const ssize_t size, const ClientHandle &except) const {
-    for (const auto client: clientManager->getAllClients() | std::views::values) {
-        if (client.id != except.id)
-            send(client, data, size);
-    }
-}
-
-void UDPServer::sendToAllExcept(const PacketBuffer &data, const ssize_t size, const uint16_t exceptId) const {
-    const auto client = clientManager->getClient(exceptId);
-    sendToAllExcept(data, size, *client);
-}
-
 [[noreturn]]
 void UDPServer::loop() const {
     while (true) {
@@ -86,7 +113,7 @@ void UDPServer::loop() const {
                                            reinterpret_cast<sockaddr *>(&sender), &senderSize);
 
         if (bytesRead < 0) {
-            perror("recvfrom");
+            LOG_WARN("recvfrom failed: {}", strerror(errno));
             continue;
         }
 
@@ -101,33 +128,40 @@ void UDPServer::loop() const {
 }
 
 void UDPServer::handlePacket(const PacketBuffer &buf, const ssize_t size, ClientHandle &client) const {
+    const auto receivedUs = monotonicTimeUs();
+
     const bool isValid = UDPPacket::validate(buf, size);
     if (!isValid) {
-        std::cerr << "Received a packet with invalid checksum." << std::endl;
+        packetMetrics().checksumFailures.inc();
+        LOG_WARN("Received a packet with invalid checksum from client {}", client.id);
         return;
     }
 
     UDPPacketType type;
     std::memcpy(&type, buf.get(), sizeof(UDPPacketType));
+    packetMetrics().onReceived(static_cast<uint8_t>(type), size);
 
     try {
         switch (type) {
             case UDPPacketType::State:
-                StateHandler::handle(UDPPacket::deserialize<StatePacket>(buf, size), client);
+                StateHandler::handle(UDPPacket::deserialize<StatePacket>(buf, size), client, *matchManager);
                 break;
 
             case UDPPacketType::Ping:
                 // This packet is only used to open the firewall on the client's side to let us
                 // send them UDP data later, ignore
                 break;
+
+            case UDPPacketType::TimeSyncRequest:
+                TimeSyncHandler::handle(UDPPacket::deserialize<TimeSyncRequestPacket>(buf, size), client, *this,
+                                        receivedUs);
+                break;
+
             default:
-                std::cerr << "Received packet with an unknown type: " << static_cast<uint8_t>(type) << std::endl;
+                LOG_WARN("Received packet with an unknown type: {}", static_cast<uint8_t>(type));
         }
     } catch (DeserializationError &e) {
-        std::cerr << "Error while deserializing packet: " << e.what() << std::endl;
+        packetMetrics().deserializationErrors.inc();
+        LOG_WARN("Error while deserializing packet from client {}: {}", client.id, e.what());
     }
 }
-
-std::unordered_map<uint16_t, ClientHandle> &UDPServer::getAllClients() const {
-    return clientManager->getAllClients();
-}
@@ -5,29 +5,31 @@
 
 #define MAX_PACKET_SIZE 1024
 
+class MatchManager;
+
 class UDPServer final : public BSDServer {
 public:
     explicit UDPServer(std::shared_ptr<ClientManager> clientManager);
 
     ~UDPServer() override;
 
-    void listen(const char *port) override;
+    void setMatchManager(std::shared_ptr<MatchManager> manager);
 
-    void send(ClientHandle client, const PacketBuffer &data, ssize_t size) const override;
+    /* Lets the kernel busy poll the device queue on blocking reads for up to the given time */
+    void setBusyPoll(int microseconds) const;
 
-    void sendToAll(const PacketBuffer &data, ssize_t size) const override;
+    void listen(const char *port) override;
 
-    void sendToAllExcept(const PacketBuffer &data, ssize_t size, const ClientHandle &except) const;
+    void send(const ClientHandle &client, const PacketBuffer &data, ssize_t size) const override;
 
-    void sendToAllExcept(const PacketBuffer &data, ssize_t size, uint16_t exceptId) const;
+    void sendToAll(const PacketBuffer &data, ssize_t size) const override;
 
     void handlePacket(const PacketBuffer &buf, ssize_t size, ClientHandle &client) const;
 
-    [[nodiscard]]
-    std::unordered_map<uint16_t, ClientHandle> &getAllClients() const;
-
 private:
     int socketFd;
 
+    std::shared_ptr<MatchManager> matchManager;
+
     [[noreturn]] void loop() const;
 };
@@ -10,6 +10,12 @@ typedef uint8_t ClientInputs;
 #define INPUT_LEFT (1 << 3)
 #define INPUT_RIGHT (1 << 4)
 
+/* Inputs the sender held at one of its upload ticks, frame counts those ticks */
+struct __attribute__((packed)) InputSample {
+    uint32_t frame;
+    ClientInputs inputs;
+};
+
 inline ClientInputs buildInputBitmap(const bool left, const bool right, const bool handbrake, const bool forward,
                                      const bool backward) {
     uint8_t result = 0;
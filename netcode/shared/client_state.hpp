@@ -1,9 +1,13 @@
 #pragma once
 
 #include <cstdint>
+#include "../shared/latency_trace.hpp"
 #include "../shared/packets/udp/client/state_packet.hpp"
 
 struct __attribute__((packed)) ClientState {
     uint16_t clientId;
     char state[STATE_PAYLOAD_SIZE];
+    LatencyTrace trace;
+    /* Forwarded from the newest StatePacket, so a lost snapshot doesn't lose the inputs behind it */
+    InputSample recentInputs[INPUT_REDUNDANCY];
 };
@@ -0,0 +1,56 @@
+#include "histogram.hpp"
+
+namespace {
+    std::atomic<size_t> nextShard{0};
+}
+
+size_t metricShardIndex() {
+    thread_local const size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+    return shard;
+}
+
+Histogram::Histogram() {
+    for (auto &shard: shards)
+        shard = std::make_unique<Shard>();
+}
+
+uint64_t Histogram::bucketUpperBound(const size_t index) {
+    if (index < SUB_BUCKETS)
+        return index;
+
+    const unsigned exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    const uint64_t subBucket = index % SUB_BUCKETS;
+    const unsigned shift = exponent - SUB_BUCKET_BITS;
+
+    return ((SUB_BUCKETS + subBucket + 1) << shift) - 1;
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot result;
+
+    for (const auto &shard: shards) {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i)
+            result.buckets[i] += shard->buckets[i].load(std::memory_order_relaxed);
+
+        result.count += shard->count.load(std::memory_order_relaxed);
+        result.sum += shard->sum.load(std::memory_order_relaxed);
+    }
+
+    return result;
+}
+
+uint64_t Histogram::Snapshot::quantile(const double q) const {
+    if (count == 0)
+        return 0;
+
+    const auto rank = static_cast<uint64_t>(q * static_cast<double>(count - 1)) + 1;
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return bucketUpperBound(i);
+    }
+
+    return bucketUpperBound(BUCKET_COUNT - 1);
+}
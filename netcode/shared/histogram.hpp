@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/* Every thread records into one of these, the server's Counter uses the same shards */
+constexpr size_t METRIC_SHARDS = 8;
+
+/* Shard of the calling thread, threads are spread round robin */
+size_t metricShardIndex();
+
+/* Log-linear histogram in the spirit of HdrHistogram.
+ * Every power of two is split into SUB_BUCKETS linear buckets, so values are kept with ~6% relative precision
+ * from 0 up to 2^MAX_EXPONENT, larger values land in the last bucket. */
+class Histogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 4;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr unsigned MAX_EXPONENT = 40;
+    static constexpr size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void observe(const uint64_t value) {
+        auto &shard = *shards[metricShardIndex()];
+        shard.buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.count.fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static size_t bucketIndex(const uint64_t value) {
+        if (value < SUB_BUCKETS)
+            return value;
+
+        const unsigned exponent = std::bit_width(value) - 1;
+        if (exponent > MAX_EXPONENT)
+            return BUCKET_COUNT - 1;
+
+        const auto subBucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + subBucket;
+    }
+
+    /* Largest value that still falls into the bucket */
+    static uint64_t bucketUpperBound(size_t index);
+
+    struct Snapshot {
+        std::array<uint64_t, BUCKET_COUNT> buckets{};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        /* Upper bound of the bucket holding the given quantile, 0 when empty */
+        [[nodiscard]]
+        uint64_t quantile(double q) const;
+    };
+
+    [[nodiscard]]
+    Snapshot snapshot() const;
+
+    Histogram();
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+    };
+
+    std::array<std::unique_ptr<Shard>, METRIC_SHARDS> shards;
+};
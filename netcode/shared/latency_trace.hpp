@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+
+/* When a state passed each hop on its way from one player's keyboard to everyone else.
+ * Wall clock microseconds truncated to 32 bits, so the clients and the server have to share a clock:
+ * the same machine, or hosts kept in sync with NTP/PTP. Zero means the hop wasn't stamped. */
+struct __attribute__((packed)) LatencyTrace {
+    uint32_t inputSampledUs;
+    uint32_t clientSentUs;
+    uint32_t serverReceivedUs;
+    uint32_t serverSentUs;
+};
+
+inline uint32_t traceTimestampUs() {
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    const auto us = static_cast<uint64_t>(now.tv_sec) * 1'000'000 + static_cast<uint64_t>(now.tv_nsec) / 1000;
+    /* Zero is reserved for "not stamped" */
+    return static_cast<uint32_t>(us) | 1;
+}
+
+/* Time between two stamps, robust to the 71 minute wrap around. Negative if the clocks disagree. */
+inline int64_t traceElapsedUs(const uint32_t from, const uint32_t to) {
+    return static_cast<int32_t>(to - from);
+}
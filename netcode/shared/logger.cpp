@@ -0,0 +1,252 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <strings.h>
+#include "logger.hpp"
+
+std::atomic<LogLevel> Logger::minLevel{LogLevel::Info};
+
+namespace {
+    constexpr int64_t NS_PER_SECOND = 1'000'000'000;
+    constexpr auto DRAIN_INTERVAL = std::chrono::milliseconds(2);
+
+    const char *levelName(const LogLevel level) {
+        switch (level) {
+            case LogLevel::Debug: return "DEBUG";
+            case LogLevel::Info: return "INFO";
+            case LogLevel::Warn: return "WARN";
+            case LogLevel::Error: return "ERROR";
+            default: return "?";
+        }
+    }
+
+    LogLevel levelFromEnv() {
+        const char *value = std::getenv("NFSPUT_LOG_LEVEL");
+        if (!value)
+            return LogLevel::Info;
+
+        if (strcasecmp(value, "debug") == 0) return LogLevel::Debug;
+        if (strcasecmp(value, "warn") == 0) return LogLevel::Warn;
+        if (strcasecmp(value, "error") == 0) return LogLevel::Error;
+        if (strcasecmp(value, "off") == 0) return LogLevel::Off;
+        return LogLevel::Info;
+    }
+
+    /* Marks the thread's ring as abandoned when the thread exits */
+    struct ThreadRingHandle {
+        LogRing *ring = nullptr;
+
+        ~ThreadRingHandle() {
+            if (ring)
+                ring->abandoned.store(true, std::memory_order_release);
+        }
+    };
+
+    /* Decodes one argument from the record and appends it to the output */
+    size_t appendArg(const LogRecord &record, size_t offset, std::string &out) {
+        const auto type = static_cast<LogArgType>(record.args[offset++]);
+
+        switch (type) {
+            case LogArgType::Int: {
+                int64_t value;
+                std::memcpy(&value, record.args + offset, sizeof(value));
+                out += std::to_string(value);
+                return offset + sizeof(value);
+            }
+            case LogArgType::UInt: {
+                uint64_t value;
+                std::memcpy(&value, record.args + offset, sizeof(value));
+                out += std::to_string(value);
+                return offset + sizeof(value);
+            }
+            case LogArgType::Double: {
+                double value;
+                std::memcpy(&value, record.args + offset, sizeof(value));
+                char buf[32];
+                const int len = std::snprintf(buf, sizeof(buf), "%g", value);
+                out.append(buf, len);
+                return offset + sizeof(value);
+            }
+            case LogArgType::Bool: {
+                out += record.args[offset] ? "true" : "false";
+                return offset + 1;
+            }
+            case LogArgType::Char: {
+                out += record.args[offset];
+                return offset + 1;
+            }
+            case LogArgType::String: {
+                uint16_t length;
+                std::memcpy(&length, record.args + offset, sizeof(length));
+                offset += sizeof(length);
+                out.append(record.args + offset, length);
+                return offset + length;
+            }
+        }
+
+        return record.argsSize;
+    }
+}
+
+Logger &Logger::getInstance() {
+    /* Leaked on purpose, detached threads may still log into their rings while static destructors run */
+    static Logger *instance = new Logger();
+
+    /* Whatever was logged before exit still gets written out */
+    static struct Stopper {
+        ~Stopper() {
+            instance->stop();
+        }
+    } stopper;
+
+    return *instance;
+}
+
+Logger::Logger() {
+    minLevel.store(levelFromEnv(), std::memory_order_relaxed);
+    drainThread = std::thread(&Logger::drainLoop, this);
+}
+
+void Logger::stop() {
+    running.store(false, std::memory_order_release);
+    if (drainThread.joinable())
+        drainThread.join();
+}
+
+void Logger::setLevel(const LogLevel level) {
+    minLevel.store(level, std::memory_order_relaxed);
+}
+
+bool Logger::admit(LogSite &site, const int64_t nowNs, uint32_t &suppressedBefore) {
+    auto windowStart = site.windowStart.load(std::memory_order_relaxed);
+
+    if (nowNs - windowStart >= NS_PER_SECOND &&
+        site.windowStart.compare_exchange_strong(windowStart, nowNs, std::memory_order_relaxed)) {
+        site.windowCount.store(1, std::memory_order_relaxed);
+        suppressedBefore = site.suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    if (site.windowCount.fetch_add(1, std::memory_order_relaxed) < RATE_LIMIT_PER_SECOND)
+        return true;
+
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+LogRing &Logger::getThreadRing() {
+    thread_local ThreadRingHandle handle;
+
+    if (!handle.ring) {
+        auto ring = std::make_unique<LogRing>();
+        handle.ring = ring.get();
+
+        std::lock_guard lock(ringsMtx);
+        rings.push_back(std::move(ring));
+    }
+
+    return *handle.ring;
+}
+
+void Logger::flush() {
+    const auto ticket = flushRequests.fetch_add(1, std::memory_order_acq_rel) + 1;
+    while (flushesDone.load(std::memory_order_acquire) < ticket && running.load(std::memory_order_acquire))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void Logger::drainLoop() {
+    std::string out, err;
+    std::vector<LogRing *> snapshot;
+
+    while (running.load(std::memory_order_acquire)) {
+        const auto requested = flushRequests.load(std::memory_order_acquire);
+
+        if (!drainOnce(out, err, snapshot))
+            std::this_thread::sleep_for(DRAIN_INTERVAL);
+
+        flushesDone.store(requested, std::memory_order_release);
+    }
+
+    drainOnce(out, err, snapshot);
+}
+
+bool Logger::drainOnce(std::string &out, std::string &err, std::vector<LogRing *> &snapshot) {
+    {
+        std::lock_guard lock(ringsMtx);
+
+        /* Free rings of exited threads once everything they logged has been written */
+        std::erase_if(rings, [](const std::unique_ptr<LogRing> &ring) {
+            return ring->abandoned.load(std::memory_order_acquire) && !ring->peek();
+        });
+
+        snapshot.clear();
+        for (const auto &ring: rings)
+            snapshot.push_back(ring.get());
+    }
+
+    out.clear();
+    err.clear();
+
+    for (LogRing *ring: snapshot) {
+        while (const LogRecord *record = ring->peek()) {
+            formatRecord(*record, record->site->level >= LogLevel::Warn ? err : out);
+            ring->pop();
+        }
+    }
+
+    if (const auto droppedCount = dropped.exchange(0, std::memory_order_relaxed); droppedCount > 0)
+        err += "[logger] dropped " + std::to_string(droppedCount) + " messages, log ring full\n";
+
+    if (!out.empty()) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
+
+    if (!err.empty()) {
+        std::fwrite(err.data(), 1, err.size(), stderr);
+        std::fflush(stderr);
+    }
+
+    return !out.empty() || !err.empty();
+}
+
+void Logger::formatRecord(const LogRecord &record, std::string &out) {
+    const time_t seconds = record.timestampNs / NS_PER_SECOND;
+    const auto millis = static_cast<int>(record.timestampNs % NS_PER_SECOND / 1'000'000);
+
+    tm time{};
+    localtime_r(&seconds, &time);
+
+    char prefix[48];
+    const int prefixLen = std::snprintf(prefix, sizeof(prefix), "%02d:%02d:%02d.%03d [%s] ",
+                                        time.tm_hour, time.tm_min, time.tm_sec, millis,
+                                        levelName(record.site->level));
+    out.append(prefix, prefixLen);
+
+    size_t argOffset = 0;
+    for (const char *c = record.site->format; *c; ++c) {
+        if (c[0] == '{' && c[1] == '{') {
+            out += '{';
+            ++c;
+        } else if (c[0] == '}' && c[1] == '}') {
+            out += '}';
+            ++c;
+        } else if (c[0] == '{' && c[1] == '}') {
+            if (argOffset < record.argsSize)
+                argOffset = appendArg(record, argOffset, out);
+            else
+                out += "{?}";
+            ++c;
+        } else {
+            out += *c;
+        }
+    }
+
+    if (record.truncated)
+        out += " [truncated]";
+
+    if (record.suppressed > 0)
+        out += " (" + std::to_string(record.suppressed) + " similar messages suppressed)";
+
+    out += '\n';
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/* Asynchronous logger for hot paths.
+ * Call sites only copy their arguments in binary form into a per-thread ring,
+ * formatting and the actual terminal writes happen on a background drain thread.
+ *
+ * Usage: LOG_WARN("Received a packet with invalid checksum from client {}", client.id); */
+
+enum class LogLevel : uint8_t {
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+/* One per call site, created by the LOG_* macros */
+struct LogSite {
+    const char *format;
+    LogLevel level;
+
+    /* Rate limiting state, a site may log up to RATE_LIMIT_PER_SECOND messages per second */
+    std::atomic<int64_t> windowStart{0};
+    std::atomic<uint32_t> windowCount{0};
+    std::atomic<uint32_t> suppressed{0};
+
+    constexpr LogSite(const char *format, const LogLevel level) : format(format), level(level) {
+    }
+};
+
+enum class LogArgType : uint8_t {
+    Int,
+    UInt,
+    Double,
+    Bool,
+    Char,
+    String
+};
+
+constexpr size_t LOG_ARGS_CAPACITY = 160;
+
+struct LogRecord {
+    int64_t timestampNs;
+    const LogSite *site;
+    uint32_t suppressed;
+    uint16_t argsSize;
+    bool truncated;
+    char args[LOG_ARGS_CAPACITY];
+};
+
+/* Single producer (the owning thread), single consumer (the drain thread) */
+class LogRing {
+public:
+    static constexpr size_t CAPACITY = 512;
+
+    LogRecord *tryClaim() {
+        const auto head = this->head.load(std::memory_order_relaxed);
+        if (head - tail.load(std::memory_order_acquire) == CAPACITY)
+            return nullptr;
+
+        return &records[head % CAPACITY];
+    }
+
+    void publish() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    const LogRecord *peek() const {
+        const auto tail = this->tail.load(std::memory_order_relaxed);
+        if (tail == head.load(std::memory_order_acquire))
+            return nullptr;
+
+        return &records[tail % CAPACITY];
+    }
+
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /* Set when the owning thread exits, the drain thread frees the ring once it is empty */
+    std::atomic<bool> abandoned{false};
+
+private:
+    std::array<LogRecord, CAPACITY> records{};
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+class LogArgWriter {
+public:
+    explicit LogArgWriter(LogRecord &record) : record(record) {
+        record.argsSize = 0;
+        record.truncated = false;
+    }
+
+    template<typename T>
+    void write(const T &value) {
+        using V = std::remove_cvref_t<T>;
+
+        if constexpr (std::is_same_v<V, bool>) {
+            writeTagged(LogArgType::Bool, static_cast<uint8_t>(value));
+        } else if constexpr (std::is_same_v<V, char>) {
+            writeTagged(LogArgType::Char, value);
+        } else if constexpr (std::is_enum_v<V>) {
+            write(static_cast<std::underlying_type_t<V> >(value));
+        } else if constexpr (std::is_integral_v<V> && std::is_signed_v<V>) {
+            writeTagged(LogArgType::Int, static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<V>) {
+            writeTagged(LogArgType::UInt, static_cast<uint64_t>(value));
+        } else if constexpr (std::is_floating_point_v<V>) {
+            writeTagged(LogArgType::Double, static_cast<double>(value));
+        } else if constexpr (std::is_pointer_v<V> && std::is_convertible_v<V, const char *>) {
+            /* A string_view of a null pointer is undefined */
+            writeString(value ? std::string_view(value) : std::string_view("(null)"));
+        } else if constexpr (std::is_convertible_v<const V &, std::string_view>) {
+            writeString(std::string_view(value));
+        } else {
+            static_assert(sizeof(V) == 0, "Unsupported log argument type");
+        }
+    }
+
+private:
+    LogRecord &record;
+
+    template<typename T>
+    void writeTagged(const LogArgType type, const T value) {
+        if (record.truncated || record.argsSize + 1 + sizeof(T) > LOG_ARGS_CAPACITY) {
+            record.truncated = true;
+            return;
+        }
+
+        record.args[record.argsSize++] = static_cast<char>(type);
+        std::memcpy(record.args + record.argsSize, &value, sizeof(T));
+        record.argsSize += sizeof(T);
+    }
+
+    void writeString(const std::string_view value) {
+        constexpr size_t headerSize = 1 + sizeof(uint16_t);
+        if (record.truncated || record.argsSize + headerSize > LOG_ARGS_CAPACITY) {
+            record.truncated = true;
+            return;
+        }
+
+        const auto length = static_cast<uint16_t>(
+            std::min(value.size(), LOG_ARGS_CAPACITY - record.argsSize - headerSize));
+        if (length < value.size())
+            record.truncated = true;
+
+        record.args[record.argsSize++] = static_cast<char>(LogArgType::String);
+        std::memcpy(record.args + record.argsSize, &length, sizeof(length));
+        record.argsSize += sizeof(length);
+        std::memcpy(record.args + record.argsSize, value.data(), length);
+        record.argsSize += length;
+    }
+};
+
+class Logger {
+public:
+    static constexpr uint32_t RATE_LIMIT_PER_SECOND = 20;
+
+    static Logger &getInstance();
+
+    Logger(const Logger &) = delete;
+
+    Logger &operator=(const Logger &) = delete;
+
+    static bool isEnabled(const LogLevel level) {
+        return level >= minLevel.load(std::memory_order_relaxed);
+    }
+
+    static void setLevel(LogLevel level);
+
+    template<typename... Args>
+    void log(LogSite &site, const Args &... args) {
+        const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        uint32_t suppressedBefore = 0;
+        if (!admit(site, now, suppressedBefore))
+            return;
+
+        LogRing &ring = getThreadRing();
+        LogRecord *record = ring.tryClaim();
+        if (!record) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        record->timestampNs = now;
+        record->site = &site;
+        record->suppressed = suppressedBefore;
+
+        LogArgWriter writer(*record);
+        (writer.write(args), ...);
+
+        ring.publish();
+    }
+
+    /* Blocks until everything logged before the call has been written out */
+    void flush();
+
+private:
+    static std::atomic<LogLevel> minLevel;
+
+    std::mutex ringsMtx;
+    std::vector<std::unique_ptr<LogRing> > rings;
+
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> flushRequests{0};
+    std::atomic<uint64_t> flushesDone{0};
+
+    std::atomic<bool> running{true};
+    std::thread drainThread;
+
+    Logger();
+
+    /* Joins the drain thread after a last pass, the logger itself is never destroyed */
+    void stop();
+
+    static bool admit(LogSite &site, int64_t nowNs, uint32_t &suppressedBefore);
+
+    LogRing &getThreadRing();
+
+    void drainLoop();
+
+    bool drainOnce(std::string &out, std::string &err, std::vector<LogRing *> &snapshot);
+
+    static void formatRecord(const LogRecord &record, std::string &out);
+};
+
+#define NFS_LOG(logLevel, fmt, ...)                                                                                    \
+    do {                                                                                                               \
+        if (Logger::isEnabled(logLevel)) {                                                                             \
+            static LogSite nfsLogSite_{fmt, logLevel};                                                                 \
+            Logger::getInstance().log(nfsLogSite_ __VA_OPT__(, ) __VA_ARGS__);                                         \
+        }                                                                                                              \
+    } while (0)
+
+#define LOG_DEBUG(fmt, ...) NFS_LOG(LogLevel::Debug, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_INFO(fmt, ...) NFS_LOG(LogLevel::Info, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_WARN(fmt, ...) NFS_LOG(LogLevel::Warn, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_ERROR(fmt, ...) NFS_LOG(LogLevel::Error, fmt __VA_OPT__(, ) __VA_ARGS__)
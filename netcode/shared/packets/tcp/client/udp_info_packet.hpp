@@ -1,7 +1,7 @@
 #pragma once
 #include "netcode/shared/packets/tcp/tcp_packet_header.hpp"
 
-constexpr int UDP_INFO_PAYLOAD_SIZE = 32;
+constexpr int UDP_INFO_PAYLOAD_SIZE = sizeof(uint16_t);
 
 struct __attribute__((packed)) UdpInfoPacket {
     TCPPacketHeader header{
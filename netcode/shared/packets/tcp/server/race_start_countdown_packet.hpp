@@ -1,12 +1,15 @@
 #pragma once
 #include "../tcp_packet_header.hpp"
 
-constexpr int RACE_START_COUNTDOWN_PAYLOAD_SIZE = sizeof(uint8_t);
+constexpr int RACE_START_COUNTDOWN_PAYLOAD_SIZE = sizeof(uint8_t) + sizeof(uint64_t);
 
 struct __attribute__((packed)) RaceStartCountdownPacket {
     TCPPacketHeader header{
         .type = TCPPacketType::RaceStartCountdown,
         .payloadSize = RACE_START_COUNTDOWN_PAYLOAD_SIZE
     };
+    /* Fallback for clients whose clock isn't synchronized yet */
     uint8_t secondsUntilStart{};
+    /* On the server's monotonicTimeUs timeline, see ClockSync */
+    uint64_t raceStartServerUs{};
 };
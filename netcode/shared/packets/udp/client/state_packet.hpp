@@ -5,17 +5,30 @@
 #include "../udp_packet_header.hpp"
 #include "../udp_packet.hpp"
 #include "LinearMath/btTransform.h"
+#include "../../../client_inputs.hpp"
+#include "../../../latency_trace.hpp"
 
 constexpr int STATE_PAYLOAD_SIZE = 81;
 
+/* Input samples repeated in every state packet, a loss only costs inputs once this many packets in a row are gone */
+constexpr int INPUT_REDUNDANCY = 8;
+
 typedef char StateBuffer[STATE_PAYLOAD_SIZE];
 
+/* Everything between the header and the checksum, the vehicle state, its latency trace and the recent inputs */
+constexpr uint16_t STATE_PACKET_PAYLOAD_SIZE = STATE_PAYLOAD_SIZE + sizeof(LatencyTrace)
+                                               + INPUT_REDUNDANCY * sizeof(InputSample);
+
 struct __attribute__((packed)) StatePacket {
     UDPPacketHeader header{
         .type = UDPPacketType::State,
-        .payloadSize = STATE_PAYLOAD_SIZE,
+        .payloadSize = STATE_PACKET_PAYLOAD_SIZE,
         .id = 0
     };
     char payload[STATE_PAYLOAD_SIZE]{};
+    /* Only the client fields are stamped here */
+    LatencyTrace trace{};
+    /* Inputs of the sender's last upload ticks, newest first, the newest one is the same as in payload */
+    InputSample recentInputs[INPUT_REDUNDANCY]{};
     uint32_t checksum{};
 };
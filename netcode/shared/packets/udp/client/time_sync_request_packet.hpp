@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+
+#include "../udp_packet_header.hpp"
+
+constexpr int TIME_SYNC_REQUEST_PAYLOAD_SIZE = sizeof(uint64_t);
+
+/* First half of the NTP style exchange, header id is a sequence number echoed back in the response */
+struct __attribute__((packed)) TimeSyncRequestPacket {
+    UDPPacketHeader header{
+        .type = UDPPacketType::TimeSyncRequest,
+        .payloadSize = TIME_SYNC_REQUEST_PAYLOAD_SIZE,
+        .id = 0
+    };
+    /* Client's monotonicTimeUs */
+    uint64_t clientSentUs{};
+    uint32_t checksum{};
+};
@@ -5,8 +5,10 @@
 
 constexpr ssize_t OPPONENT_STATES_PACKET_SIZE_WITHOUT_DATA = sizeof(UDPPacketHeader)
                                                              + sizeof(uint8_t)
+                                                             + sizeof(uint64_t)
                                                              + sizeof(uint32_t);
 
+/* Header id is the room's tick number, so every packet of one tick shares it */
 struct OpponentStatesPacket {
     UDPPacketHeader header{
         .type = UDPPacketType::OpponentStates,
@@ -14,6 +16,8 @@ struct OpponentStatesPacket {
         .id = 0
     };
     uint8_t statesCount{};
+    /* When the server ticked, on its monotonicTimeUs timeline */
+    uint64_t serverTimeUs{};
     std::vector<ClientState> states{};
     uint32_t checksum{};
 };
@@ -22,6 +26,7 @@ struct OpponentStatesPacket {
 inline size_t getOpponentStatePacketSize(const OpponentStatesPacket &packet) {
     return sizeof(packet.header)
            + sizeof(packet.statesCount)
+           + sizeof(packet.serverTimeUs)
            + sizeof(ClientState) * packet.statesCount
            + sizeof(packet.checksum);
 }
@@ -36,6 +41,9 @@ inline PacketBuffer serializeOpponentState(const OpponentStatesPacket &packet) {
     std::memcpy(buf.get() + currentSize, &packet.statesCount, sizeof(packet.statesCount));
     currentSize += sizeof(packet.statesCount);
 
+    std::memcpy(buf.get() + currentSize, &packet.serverTimeUs, sizeof(packet.serverTimeUs));
+    currentSize += sizeof(packet.serverTimeUs);
+
     for (const auto &state: packet.states) {
         std::memcpy(buf.get() + currentSize, &state, sizeof(state));
         currentSize += sizeof(state);
@@ -62,6 +70,10 @@ inline OpponentStatesPacket deserializeOpponentState(const PacketBuffer &buf, co
         throw DeserializationError("Received position packet with invalid checksum.");
     }
 
+    if (size < 0 || size < OPPONENT_STATES_PACKET_SIZE_WITHOUT_DATA) {
+        throw DeserializationError("Received opponent states packet too small to contain header.");
+    }
+
     size_t currentOffset = 0;
     std::memcpy(&packet.header, buf.get(), sizeof(packet.header));
     currentOffset += sizeof(packet.header);
@@ -69,6 +81,14 @@ inline OpponentStatesPacket deserializeOpponentState(const PacketBuffer &buf, co
     std::memcpy(&packet.statesCount, buf.get() + currentOffset, sizeof(packet.statesCount));
     currentOffset += sizeof(packet.statesCount);
 
+    std::memcpy(&packet.serverTimeUs, buf.get() + currentOffset, sizeof(packet.serverTimeUs));
+    currentOffset += sizeof(packet.serverTimeUs);
+
+    const size_t expectedSize = OPPONENT_STATES_PACKET_SIZE_WITHOUT_DATA + sizeof(ClientState) * packet.statesCount;
+    if (static_cast<size_t>(size) != expectedSize) {
+        throw DeserializationError("Received opponent states packet with invalid states count.");
+    }
+
     for (int i = 0; i < packet.statesCount; ++i) {
         ClientState state{};
         std::memcpy(&state, buf.get() + currentOffset, sizeof(ClientState));
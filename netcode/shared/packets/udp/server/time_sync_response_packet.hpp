@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+#include "../udp_packet_header.hpp"
+
+constexpr int TIME_SYNC_RESPONSE_PAYLOAD_SIZE = 3 * sizeof(uint64_t);
+
+struct __attribute__((packed)) TimeSyncResponsePacket {
+    UDPPacketHeader header{
+        .type = UDPPacketType::TimeSyncResponse,
+        .payloadSize = TIME_SYNC_RESPONSE_PAYLOAD_SIZE,
+        .id = 0
+    };
+    /* Copied from the request, on the client's clock */
+    uint64_t clientSentUs{};
+    /* Server's monotonicTimeUs */
+    uint64_t serverReceivedUs{};
+    uint64_t serverSentUs{};
+    uint32_t checksum{};
+};
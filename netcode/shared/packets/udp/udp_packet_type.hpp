@@ -6,4 +6,6 @@ enum class UDPPacketType : uint8_t {
     State,
     OpponentStates,
     Ping,
+    TimeSyncRequest,
+    TimeSyncResponse,
 };
@@ -0,0 +1,243 @@
+#include "physics_world.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "logger.hpp"
+#include "LinearMath/btThreads.h"
+
+#if NFSPUT_BULLET_MULTITHREADED
+#include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h"
+#include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
+
+namespace {
+    /* Same as btDefaultVehicleRaycaster, except that only static and kinematic bodies are hit */
+    class StaticVehicleRaycaster : public btVehicleRaycaster {
+        struct StaticRayCallback : btCollisionWorld::ClosestRayResultCallback {
+            using ClosestRayResultCallback::ClosestRayResultCallback;
+
+            [[nodiscard]]
+            bool needsCollision(btBroadphaseProxy *proxy) const override {
+                const auto object = static_cast<const btCollisionObject *>(proxy->m_clientObject);
+                return object->isStaticOrKinematicObject() && ClosestRayResultCallback::needsCollision(proxy);
+            }
+        };
+
+        btDynamicsWorld *dynamicsWorld;
+
+    public:
+        explicit StaticVehicleRaycaster(btDynamicsWorld *world) : dynamicsWorld(world) {
+        }
+
+        void *castRay(const btVector3 &from, const btVector3 &to, btVehicleRaycasterResult &result) override {
+            StaticRayCallback rayCallback(from, to);
+            dynamicsWorld->rayTest(from, to, rayCallback);
+
+            if (!rayCallback.hasHit())
+                return nullptr;
+
+            const btRigidBody *body = btRigidBody::upcast(rayCallback.m_collisionObject);
+            if (!body || !body->hasContactResponse())
+                return nullptr;
+
+            result.m_hitPointInWorld = rayCallback.m_hitPointWorld;
+            result.m_hitNormalInWorld = rayCallback.m_hitNormalWorld.normalized();
+            result.m_distFraction = rayCallback.m_closestHitFraction;
+            return const_cast<btRigidBody *>(body);
+        }
+    };
+
+    /* btDiscreteDynamicsWorld runs its actions one after another. Registered as a single action, this updates all of
+     * its vehicles with btParallelFor instead. Each vehicle only writes to its own chassis, the raycaster keeps the
+     * wheels off every other dynamic body. */
+    class ParallelVehicleAction : public btActionInterface {
+        struct UpdateBody : btIParallelForBody {
+            const btAlignedObjectArray<btRaycastVehicle *> &vehicles;
+            btCollisionWorld *world;
+            btScalar timeStep;
+
+            UpdateBody(const btAlignedObjectArray<btRaycastVehicle *> &vehicles, btCollisionWorld *world,
+                       const btScalar timeStep) : vehicles(vehicles), world(world), timeStep(timeStep) {
+            }
+
+            void forLoop(const int begin, const int end) const override {
+                for (int i = begin; i < end; ++i)
+                    vehicles[i]->updateAction(world, timeStep);
+            }
+        };
+
+        btAlignedObjectArray<btRaycastVehicle *> vehicles;
+
+    public:
+        void add(btRaycastVehicle *vehicle) {
+            vehicles.push_back(vehicle);
+        }
+
+        void remove(btRaycastVehicle *vehicle) {
+            vehicles.remove(vehicle);
+        }
+
+        void updateAction(btCollisionWorld *world, const btScalar timeStep) override {
+            /* A vehicle is a few raycasts, batches keep the scheduling cost below the work */
+            constexpr int grainSize = 4;
+            btParallelFor(0, vehicles.size(), grainSize, UpdateBody(vehicles, world, timeStep));
+        }
+
+        void debugDraw(btIDebugDraw *debugDrawer) override {
+            for (int i = 0; i < vehicles.size(); ++i)
+                vehicles[i]->debugDraw(debugDrawer);
+        }
+    };
+
+    class VehicleDynamicsWorldMt : public btDiscreteDynamicsWorldMt {
+    public:
+        ParallelVehicleAction vehicles;
+
+        VehicleDynamicsWorldMt(btDispatcher *dispatcher, btBroadphaseInterface *broadphase,
+                               btConstraintSolverPoolMt *solverPool, btConstraintSolver *solver,
+                               btCollisionConfiguration *collisionConfig)
+            : btDiscreteDynamicsWorldMt(dispatcher, broadphase, solverPool, solver, collisionConfig) {
+            addAction(&vehicles);
+        }
+
+        ~VehicleDynamicsWorldMt() override {
+            removeAction(&vehicles);
+        }
+    };
+}
+#endif
+
+PhysicsWorld::PhysicsWorld(const int threads) {
+    broadphase = std::make_unique<btDbvtBroadphase>();
+
+#if NFSPUT_BULLET_MULTITHREADED
+    if (threads > 1 && installTaskScheduler(threads)) {
+        btDefaultCollisionConstructionInfo constructionInfo;
+        /* Pairs are created from every thread at once, a pool that doesn't run out keeps them off the heap */
+        constructionInfo.m_defaultMaxPersistentManifoldPoolSize = 8192;
+        constructionInfo.m_defaultMaxCollisionAlgorithmPoolSize = 8192;
+        collisionConfig = std::make_unique<btDefaultCollisionConfiguration>(constructionInfo);
+
+        /* Pairs handed to each task of the narrowphase */
+        constexpr int dispatcherGrainSize = 40;
+        dispatcher = std::make_unique<btCollisionDispatcherMt>(collisionConfig.get(), dispatcherGrainSize);
+
+        /* One solver per thread for the islands, and a parallel one for the island too big to share out */
+        auto pool = std::make_unique<btConstraintSolverPoolMt>(BT_MAX_THREAD_COUNT);
+        solver = std::make_unique<btSequentialImpulseConstraintSolverMt>();
+        world = std::make_unique<VehicleDynamicsWorldMt>(dispatcher.get(), broadphase.get(), pool.get(),
+                                                         solver.get(), collisionConfig.get());
+        solverPool = std::move(pool);
+        multithreaded = true;
+        return;
+    }
+#else
+    if (threads > 1)
+        LOG_WARN("Bullet was built without NFSPUT_BULLET_MULTITHREADED, running physics on one thread");
+#endif
+
+    collisionConfig = std::make_unique<btDefaultCollisionConfiguration>();
+    dispatcher = std::make_unique<btCollisionDispatcher>(collisionConfig.get());
+    solver = std::make_unique<btSequentialImpulseConstraintSolver>();
+    world = std::make_unique<btDiscreteDynamicsWorld>(dispatcher.get(), broadphase.get(), solver.get(),
+                                                      collisionConfig.get());
+}
+
+bool PhysicsWorld::installTaskScheduler(const int threads) {
+#if NFSPUT_BULLET_MULTITHREADED
+    static btITaskScheduler *scheduler = btCreateDefaultTaskScheduler();
+    if (!scheduler) {
+        LOG_WARN("Bullet has no task scheduler on this platform, running physics on one thread");
+        return false;
+    }
+
+    scheduler->setNumThreads(std::min(threads, scheduler->getMaxNumThreads()));
+    btSetTaskScheduler(scheduler);
+    return true;
+#else
+    (void) threads;
+    return false;
+#endif
+}
+
+btDiscreteDynamicsWorld *PhysicsWorld::get() const {
+    return world.get();
+}
+
+bool PhysicsWorld::isMultithreaded() const {
+    return multithreaded;
+}
+
+bool PhysicsWorld::multithreadingAvailable() {
+#if NFSPUT_BULLET_MULTITHREADED
+    return true;
+#else
+    return false;
+#endif
+}
+
+int PhysicsWorld::threadsFromEnv() {
+    const char *value = std::getenv("NFSPUT_PHYSICS_THREADS");
+    if (!value || !*value)
+        return 1;
+
+    char *end;
+    const auto threads = std::strtoul(value, &end, 10);
+    if (*end != '\0' || threads == 0 || threads > BT_MAX_THREAD_COUNT) {
+        LOG_WARN("Ignoring invalid NFSPUT_PHYSICS_THREADS {}", value);
+        return 1;
+    }
+
+    return static_cast<int>(threads);
+}
+
+void PhysicsWorld::addVehicle(btDynamicsWorld *world, btRaycastVehicle *vehicle) {
+#if NFSPUT_BULLET_MULTITHREADED
+    if (const auto worldMt = dynamic_cast<VehicleDynamicsWorldMt *>(world)) {
+        worldMt->vehicles.add(vehicle);
+        return;
+    }
+#endif
+    world->addVehicle(vehicle);
+}
+
+void PhysicsWorld::removeVehicle(btDynamicsWorld *world, btRaycastVehicle *vehicle) {
+#if NFSPUT_BULLET_MULTITHREADED
+    if (const auto worldMt = dynamic_cast<VehicleDynamicsWorldMt *>(world)) {
+        worldMt->vehicles.remove(vehicle);
+        return;
+    }
+#endif
+    world->removeVehicle(vehicle);
+}
+
+void PhysicsWorld::addActionBeforeVehicles(btDynamicsWorld *world, btActionInterface *action) {
+#if NFSPUT_BULLET_MULTITHREADED
+    if (const auto worldMt = dynamic_cast<VehicleDynamicsWorldMt *>(world)) {
+        /* The vehicles were added with the world, put them back behind the action */
+        worldMt->removeAction(&worldMt->vehicles);
+        worldMt->addAction(action);
+        worldMt->addAction(&worldMt->vehicles);
+        return;
+    }
+#endif
+    world->addAction(action);
+}
+
+bool PhysicsWorld::runsVehiclesInParallel(const btDynamicsWorld *world) {
+#if NFSPUT_BULLET_MULTITHREADED
+    return dynamic_cast<const VehicleDynamicsWorldMt *>(world) != nullptr;
+#else
+    (void) world;
+    return false;
+#endif
+}
+
+btVehicleRaycaster *PhysicsWorld::createRaycaster(btDynamicsWorld *world) {
+#if NFSPUT_BULLET_MULTITHREADED
+    if (runsVehiclesInParallel(world))
+        return new StaticVehicleRaycaster(world);
+#endif
+    return new btDefaultVehicleRaycaster(world);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <memory>
+
+#include "btBulletDynamicsCommon.h"
+
+/* A Bullet dynamics world and everything it is built from, with no rendering attached, so the client and a headless
+ * server world share it. With more than one thread it is Bullet's multithreaded world: islands are solved by a pool
+ * of constraint solvers, narrowphase pairs are dispatched in parallel and the vehicles are updated in parallel too.
+ * That needs a build with NFSPUT_BULLET_MULTITHREADED, otherwise the world stays single threaded. */
+class PhysicsWorld {
+    /* Declared in construction order, the world is destroyed before what it refers to */
+    std::unique_ptr<btDefaultCollisionConfiguration> collisionConfig;
+    std::unique_ptr<btCollisionDispatcher> dispatcher;
+    std::unique_ptr<btBroadphaseInterface> broadphase;
+    std::unique_ptr<btConstraintSolver> solverPool;
+    std::unique_ptr<btConstraintSolver> solver;
+    std::unique_ptr<btDiscreteDynamicsWorld> world;
+
+    bool multithreaded = false;
+
+    /* Bullet has one task scheduler per process, shared by every multithreaded world */
+    static bool installTaskScheduler(int threads);
+
+public:
+    explicit PhysicsWorld(int threads = 1);
+
+    PhysicsWorld(const PhysicsWorld &) = delete;
+
+    PhysicsWorld &operator=(const PhysicsWorld &) = delete;
+
+    [[nodiscard]]
+    btDiscreteDynamicsWorld *get() const;
+
+    [[nodiscard]]
+    bool isMultithreaded() const;
+
+    /* Whether this build can run a world on more than one thread */
+    static bool multithreadingAvailable();
+
+    /* NFSPUT_PHYSICS_THREADS, 1 when unset */
+    static int threadsFromEnv();
+
+    /* Vehicles go through these instead of the world, in a multithreaded world they are updated as one parallel
+     * batch rather than as separate actions */
+    static void addVehicle(btDynamicsWorld *world, btRaycastVehicle *vehicle);
+
+    static void removeVehicle(btDynamicsWorld *world, btRaycastVehicle *vehicle);
+
+    /* An action updated before every vehicle of the world, however they are added. In a plain world actions run in
+     * the order they were added, so this has to come before the first vehicle. */
+    static void addActionBeforeVehicles(btDynamicsWorld *world, btActionInterface *action);
+
+    /* Whether the world is one of ours updating its vehicles in parallel */
+    static bool runsVehiclesInParallel(const btDynamicsWorld *world);
+
+    /* Wheel raycaster for a vehicle in the given world. In a multithreaded world the wheels only see static and
+     * kinematic bodies, so no two vehicles updated in parallel push on the same body. */
+    static btVehicleRaycaster *createRaycaster(btDynamicsWorld *world);
+};
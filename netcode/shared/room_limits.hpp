@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/* Players racing in one room, one per starting position */
+constexpr size_t MAX_PLAYERS_PER_ROOM = 8;
+
+/* Laps every player has to complete before the room ends the race */
+constexpr uint8_t RACE_LAPS = 3;
@@ -0,0 +1,10 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+/* The timeline all peers agree on is the server's steady clock in microseconds. The server reads it directly,
+ * clients estimate it with ClockSync. It is also each machine's local clock for the sync exchange. */
+inline uint64_t monotonicTimeUs() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
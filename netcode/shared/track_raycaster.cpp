@@ -0,0 +1,407 @@
+#include "track_raycaster.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "physics_world.hpp"
+
+namespace {
+    /* Below this the ray runs parallel to the triangle */
+    constexpr float PARALLEL_EPSILON = 1e-12f;
+
+    bool sameRay(const btVector3 &a, const btVector3 &b) {
+        return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
+    }
+
+    /* Everything but the track, whose hits come from the grid */
+    struct OtherBodiesCallback : btCollisionWorld::ClosestRayResultCallback {
+        const btCollisionShape *trackShape;
+        bool staticOrKinematicOnly;
+
+        OtherBodiesCallback(const btVector3 &from, const btVector3 &to, const btCollisionShape *trackShape,
+                            const bool staticOrKinematicOnly)
+            : ClosestRayResultCallback(from, to), trackShape(trackShape),
+              staticOrKinematicOnly(staticOrKinematicOnly) {
+        }
+
+        [[nodiscard]]
+        bool needsCollision(btBroadphaseProxy *proxy) const override {
+            const auto object = static_cast<const btCollisionObject *>(proxy->m_clientObject);
+            if (object->getCollisionShape() == trackShape || !object->hasContactResponse())
+                return false;
+            if (staticOrKinematicOnly && !object->isStaticOrKinematicObject())
+                return false;
+
+            return ClosestRayResultCallback::needsCollision(proxy);
+        }
+    };
+}
+
+TrackRaycaster::TrackRaycaster(const btCollisionShape *shape, const float *vertices, const int32_t *indices,
+                               const uint32_t triangleCount) : shape(shape) {
+    if (triangleCount == 0) {
+        cellStart.assign(1, 0);
+        return;
+    }
+
+    float maxX = -INFINITY, maxZ = -INFINITY;
+    minX = INFINITY;
+    minZ = INFINITY;
+    for (uint32_t i = 0; i < triangleCount * 3; ++i) {
+        const float *vertex = vertices + indices[i] * 3;
+        minX = std::min(minX, vertex[0]);
+        maxX = std::max(maxX, vertex[0]);
+        minZ = std::min(minZ, vertex[2]);
+        maxZ = std::max(maxZ, vertex[2]);
+    }
+
+    while (true) {
+        columns = static_cast<int>((maxX - minX) / cellSize) + 1;
+        rows = static_cast<int>((maxZ - minZ) / cellSize) + 1;
+        if (static_cast<size_t>(columns) * static_cast<size_t>(rows) <= MAX_CELLS)
+            break;
+        cellSize *= 2;
+    }
+
+    const auto cellCount = static_cast<size_t>(columns) * static_cast<size_t>(rows);
+
+    /* Cells a triangle's footprint on the ground plane covers */
+    const auto forEachCell = [&](const uint32_t triangle, const auto &visit) {
+        const float *a = vertices + indices[triangle * 3] * 3;
+        const float *b = vertices + indices[triangle * 3 + 1] * 3;
+        const float *c = vertices + indices[triangle * 3 + 2] * 3;
+
+        const int column0 = columnOf(std::min({a[0], b[0], c[0]}));
+        const int column1 = columnOf(std::max({a[0], b[0], c[0]}));
+        const int row0 = rowOf(std::min({a[2], b[2], c[2]}));
+        const int row1 = rowOf(std::max({a[2], b[2], c[2]}));
+
+        for (int row = row0; row <= row1; ++row) {
+            for (int column = column0; column <= column1; ++column)
+                visit(static_cast<size_t>(row) * columns + column);
+        }
+    };
+
+    std::vector<uint32_t> triangleCounts(cellCount, 0);
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+        forEachCell(triangle, [&](const size_t cell) { ++triangleCounts[cell]; });
+
+    cellStart.resize(cellCount + 1);
+    cellStart[0] = 0;
+    for (size_t cell = 0; cell < cellCount; ++cell)
+        cellStart[cell + 1] = cellStart[cell] + (triangleCounts[cell] + 3) / 4;
+
+    packets.assign(cellStart[cellCount], TrianglePacket{});
+
+    std::vector<uint32_t> filled(cellCount, 0);
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+        const float *a = vertices + indices[triangle * 3] * 3;
+        const float *b = vertices + indices[triangle * 3 + 1] * 3;
+        const float *c = vertices + indices[triangle * 3 + 2] * 3;
+
+        forEachCell(triangle, [&](const size_t cell) {
+            const uint32_t slot = filled[cell]++;
+            TrianglePacket &packet = packets[cellStart[cell] + slot / 4];
+            const uint32_t lane = slot % 4;
+
+            for (int axis = 0; axis < 3; ++axis) {
+                packet.v0[axis][lane] = a[axis];
+                packet.edge1[axis][lane] = b[axis] - a[axis];
+                packet.edge2[axis][lane] = c[axis] - a[axis];
+            }
+        });
+    }
+}
+
+int TrackRaycaster::columnOf(const float x) const {
+    return std::clamp(static_cast<int>(std::floor((x - minX) / cellSize)), 0, columns - 1);
+}
+
+int TrackRaycaster::rowOf(const float z) const {
+    return std::clamp(static_cast<int>(std::floor((z - minZ) / cellSize)), 0, rows - 1);
+}
+
+/* Möller-Trumbore. The vector and the scalar path do the same operations in the same order, so without contraction
+ * into FMAs (see -ffp-contract) they agree to the bit and deterministic runs don't depend on the instruction set. */
+int TrackRaycaster::intersect(const TrianglePacket &packet, const btVector3 &from, const btVector3 &direction,
+                              btScalar &best) {
+    alignas(16) float t[4];
+    int hits = 0;
+
+#if defined(__SSE__)
+    const __m128 ox = _mm_set1_ps(from.x()), oy = _mm_set1_ps(from.y()), oz = _mm_set1_ps(from.z());
+    const __m128 dx = _mm_set1_ps(direction.x()), dy = _mm_set1_ps(direction.y()), dz = _mm_set1_ps(direction.z());
+
+    const __m128 e1x = _mm_load_ps(packet.edge1[0]), e1y = _mm_load_ps(packet.edge1[1]);
+    const __m128 e1z = _mm_load_ps(packet.edge1[2]);
+    const __m128 e2x = _mm_load_ps(packet.edge2[0]), e2y = _mm_load_ps(packet.edge2[1]);
+    const __m128 e2z = _mm_load_ps(packet.edge2[2]);
+
+    const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    const __m128 tx = _mm_sub_ps(ox, _mm_load_ps(packet.v0[0]));
+    const __m128 ty = _mm_sub_ps(oy, _mm_load_ps(packet.v0[1]));
+    const __m128 tz = _mm_sub_ps(oz, _mm_load_ps(packet.v0[2]));
+    const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)),
+                                invDet);
+
+    const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+    const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)),
+                                invDet);
+    const __m128 hitT = _mm_mul_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 mask = _mm_cmpgt_ps(absDet, _mm_set1_ps(PARALLEL_EPSILON));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(hitT, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(hitT, _mm_set1_ps(best)));
+
+    hits = _mm_movemask_ps(mask);
+    _mm_store_ps(t, hitT);
+#else
+    for (int lane = 0; lane < 4; ++lane) {
+        const float e1x = packet.edge1[0][lane], e1y = packet.edge1[1][lane], e1z = packet.edge1[2][lane];
+        const float e2x = packet.edge2[0][lane], e2y = packet.edge2[1][lane], e2z = packet.edge2[2][lane];
+        const float dx = direction.x(), dy = direction.y(), dz = direction.z();
+
+        const float px = dy * e2z - dz * e2y;
+        const float py = dz * e2x - dx * e2z;
+        const float pz = dx * e2y - dy * e2x;
+        const float det = e1x * px + e1y * py + e1z * pz;
+        const float invDet = 1.0f / det;
+
+        const float tx = from.x() - packet.v0[0][lane];
+        const float ty = from.y() - packet.v0[1][lane];
+        const float tz = from.z() - packet.v0[2][lane];
+        const float u = (tx * px + ty * py + tz * pz) * invDet;
+
+        const float qx = ty * e1z - tz * e1y;
+        const float qy = tz * e1x - tx * e1z;
+        const float qz = tx * e1y - ty * e1x;
+        const float v = (dx * qx + dy * qy + dz * qz) * invDet;
+        t[lane] = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+
+        if (std::fabs(det) > PARALLEL_EPSILON && u >= 0 && v >= 0 && u + v <= 1.0f && t[lane] >= 0 && t[lane] <= best)
+            hits |= 1 << lane;
+    }
+#endif
+
+    int closest = -1;
+    for (int lane = 0; lane < 4; ++lane) {
+        if ((hits & (1 << lane)) && t[lane] <= best) {
+            best = t[lane];
+            closest = lane;
+        }
+    }
+
+    return closest;
+}
+
+bool TrackRaycaster::castRay(const btVector3 &from, const btVector3 &to, Hit &hit) const {
+    hit.found = false;
+    hit.fraction = 1;
+    if (packets.empty())
+        return false;
+
+    const btVector3 direction = to - from;
+    const int column0 = columnOf(std::min(from.x(), to.x()));
+    const int column1 = columnOf(std::max(from.x(), to.x()));
+    const int row0 = rowOf(std::min(from.z(), to.z()));
+    const int row1 = rowOf(std::max(from.z(), to.z()));
+
+    btScalar best = 1;
+    const TrianglePacket *closestPacket = nullptr;
+    int closestLane = -1;
+
+    for (int row = row0; row <= row1; ++row) {
+        for (int column = column0; column <= column1; ++column) {
+            const size_t cell = static_cast<size_t>(row) * columns + column;
+            for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; ++i) {
+                if (const int lane = intersect(packets[i], from, direction, best); lane >= 0) {
+                    closestPacket = &packets[i];
+                    closestLane = lane;
+                }
+            }
+        }
+    }
+
+    if (!closestPacket)
+        return false;
+
+    fillHit(*closestPacket, closestLane, from, direction, best, hit);
+    return true;
+}
+
+void TrackRaycaster::fillHit(const TrianglePacket &packet, const int lane, const btVector3 &from,
+                             const btVector3 &direction, const btScalar fraction, Hit &hit) {
+    const btVector3 edge1(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+    const btVector3 edge2(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+    btVector3 normal = edge1.cross(edge2).normalized();
+    if (normal.dot(direction) > 0)
+        normal = -normal;
+
+    hit.point = from + direction * fraction;
+    hit.normal = normal;
+    hit.fraction = fraction;
+    hit.found = true;
+}
+
+void TrackRaycaster::castRays(const std::vector<Ray> &rays) const {
+    /* Kept between calls so a step doesn't allocate, one per casting thread */
+    thread_local std::vector<BatchedRay> batch;
+    batch.clear();
+
+    for (const auto &ray: rays) {
+        if (packets.empty()) {
+            castRay(ray.from, ray.to, *ray.hit);
+            continue;
+        }
+
+        const int column = columnOf(ray.from.x());
+        const int row = rowOf(ray.from.z());
+        if (column != columnOf(ray.to.x()) || row != rowOf(ray.to.z())) {
+            castRay(ray.from, ray.to, *ray.hit);
+            continue;
+        }
+
+        batch.push_back({static_cast<size_t>(row) * columns + column, &ray, ray.to - ray.from, 1, nullptr, -1});
+    }
+
+    /* Within a cell every ray meets the packets in the same order as in castRay, the hits come out identical */
+    std::ranges::sort(batch, {}, &BatchedRay::cell);
+
+    for (size_t first = 0; first < batch.size();) {
+        const size_t cell = batch[first].cell;
+        size_t last = first + 1;
+        while (last < batch.size() && batch[last].cell == cell)
+            ++last;
+
+        for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; ++i) {
+            for (size_t r = first; r < last; ++r) {
+                BatchedRay &ray = batch[r];
+                if (const int lane = intersect(packets[i], ray.ray->from, ray.direction, ray.best); lane >= 0) {
+                    ray.packet = &packets[i];
+                    ray.lane = lane;
+                }
+            }
+        }
+
+        for (size_t r = first; r < last; ++r) {
+            const BatchedRay &ray = batch[r];
+            Hit &hit = *ray.ray->hit;
+            if (ray.packet) {
+                fillHit(*ray.packet, ray.lane, ray.ray->from, ray.direction, ray.best, hit);
+            } else {
+                hit.found = false;
+                hit.fraction = 1;
+            }
+        }
+
+        first = last;
+    }
+}
+
+const btCollisionShape *TrackRaycaster::getShape() const {
+    return shape;
+}
+
+WheelRaycaster::WheelRaycaster(const TrackRaycaster &track, btDynamicsWorld *world, btRigidBody *trackBody)
+    : track(track), world(world), trackBody(trackBody),
+      staticOrKinematicOnly(PhysicsWorld::runsVehiclesInParallel(world)) {
+}
+
+WheelRaycaster *WheelRaycaster::create(const TrackRaycaster &track, btDynamicsWorld *world) {
+    const auto &objects = world->getCollisionObjectArray();
+    for (int i = 0; i < objects.size(); ++i) {
+        if (objects[i]->getCollisionShape() != track.getShape())
+            continue;
+
+        if (const auto body = btRigidBody::upcast(objects[i]); body && body->isStaticObject())
+            return new WheelRaycaster(track, world, body);
+    }
+
+    return nullptr;
+}
+
+void WheelRaycaster::queue(btRaycastVehicle &vehicle, std::vector<TrackRaycaster::Ray> &rays) {
+    clearQueued();
+
+    for (int i = 0; i < vehicle.getNumWheels(); ++i) {
+        btWheelInfo &wheel = vehicle.getWheelInfo(i);
+
+        /* Mirrors btRaycastVehicle::rayCast, the ray has to come out bit-identical to be found again */
+        vehicle.updateWheelTransformsWS(wheel, false);
+        const btScalar rayLength = wheel.getSuspensionRestLength() + wheel.m_wheelsRadius;
+        const btVector3 rayVector = wheel.m_raycastInfo.m_wheelDirectionWS * rayLength;
+        const btVector3 &from = wheel.m_raycastInfo.m_hardPointWS;
+
+        queueRay(from, from + rayVector, rays);
+    }
+}
+
+void WheelRaycaster::clearQueued() {
+    preparedCount = 0;
+}
+
+void WheelRaycaster::queueRay(const btVector3 &from, const btVector3 &to, std::vector<TrackRaycaster::Ray> &rays) {
+    if (preparedCount == MAX_WHEELS)
+        return;
+
+    Prepared &slot = prepared[preparedCount++];
+    slot.from = from;
+    slot.to = to;
+    slot.hit.found = false;
+    rays.push_back({from, to, &slot.hit});
+}
+
+void *WheelRaycaster::castRay(const btVector3 &from, const btVector3 &to, btVehicleRaycasterResult &result) {
+    TrackRaycaster::Hit trackHit;
+    bool answered = false;
+
+    for (int i = 0; i < preparedCount && !answered; ++i) {
+        if (sameRay(prepared[i].from, from) && sameRay(prepared[i].to, to)) {
+            trackHit = prepared[i].hit;
+            answered = true;
+        }
+    }
+
+    if (!answered)
+        track.castRay(from, to, trackHit);
+
+    /* Only what lies before the track can be hit instead of it */
+    const btVector3 end = trackHit.found ? trackHit.point : to;
+    OtherBodiesCallback callback(from, end, track.getShape(), staticOrKinematicOnly);
+    if (!trackHit.found || trackHit.fraction > 0)
+        world->rayTest(from, end, callback);
+
+    if (callback.hasHit()) {
+        if (const btRigidBody *body = btRigidBody::upcast(callback.m_collisionObject)) {
+            result.m_hitPointInWorld = callback.m_hitPointWorld;
+            result.m_hitNormalInWorld = callback.m_hitNormalWorld.normalized();
+            result.m_distFraction = callback.m_closestHitFraction * (trackHit.found ? trackHit.fraction : 1);
+            return const_cast<btRigidBody *>(body);
+        }
+    }
+
+    if (!trackHit.found)
+        return nullptr;
+
+    result.m_hitPointInWorld = trackHit.point;
+    result.m_hitNormalInWorld = trackHit.normal;
+    result.m_distFraction = trackHit.fraction;
+    return trackBody;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "btBulletDynamicsCommon.h"
+
+/* Wheel raycasts against a static track mesh without going through the world. The triangles are bucketed into a
+ * 2D grid over the ground plane, packed four to a packet so a ray is tested against four of them at once, and a
+ * short wheel ray only looks at the one or two cells under it. Read only once built, any thread may cast. */
+class TrackRaycaster {
+public:
+    struct Hit {
+        btVector3 point;
+        /* Facing the start of the ray, like Bullet reports it */
+        btVector3 normal;
+        btScalar fraction = 1;
+        bool found = false;
+    };
+
+    struct Ray {
+        btVector3 from;
+        btVector3 to;
+        Hit *hit;
+    };
+
+private:
+    /* Metres per grid cell side, grown for huge tracks so the grid stays under MAX_CELLS */
+    static constexpr float CELL_SIZE = 4.0f;
+    static constexpr size_t MAX_CELLS = 1 << 22;
+
+    /* Structure of arrays, lane i of every member is triangle i. Unused lanes have zero edges and never hit. */
+    struct alignas(16) TrianglePacket {
+        float v0[3][4];
+        float edge1[3][4];
+        float edge2[3][4];
+    };
+
+    /* A ray of castRays within a single cell, with its closest hit so far */
+    struct BatchedRay {
+        size_t cell;
+        const Ray *ray;
+        btVector3 direction;
+        btScalar best;
+        const TrianglePacket *packet;
+        int lane;
+    };
+
+    const btCollisionShape *shape;
+
+    float cellSize = CELL_SIZE;
+    float minX = 0, minZ = 0;
+    int columns = 0, rows = 0;
+
+    /* Packets of cell i are [cellStart[i], cellStart[i + 1]) */
+    std::vector<uint32_t> cellStart;
+    std::vector<TrianglePacket> packets;
+
+    [[nodiscard]]
+    int columnOf(float x) const;
+
+    [[nodiscard]]
+    int rowOf(float z) const;
+
+    /* Lowers best to the closest hit in the packet, returns its lane or -1 */
+    static int intersect(const TrianglePacket &packet, const btVector3 &from, const btVector3 &direction,
+                         btScalar &best);
+
+    static void fillHit(const TrianglePacket &packet, int lane, const btVector3 &from, const btVector3 &direction,
+                        btScalar fraction, Hit &hit);
+
+public:
+    /* vertices are 3 floats each, indices 3 per triangle. shape is the one the track body collides with. */
+    TrackRaycaster(const btCollisionShape *shape, const float *vertices, const int32_t *indices,
+                   uint32_t triangleCount);
+
+    /* Closest hit on the track between from and to */
+    bool castRay(const btVector3 &from, const btVector3 &to, Hit &hit) const;
+
+    /* Same hits as castRay for each ray. Rays are grouped by the cell they lie in and every packet of a cell is
+     * tested against all of its rays while loaded, a ray crossing cells is cast on its own. */
+    void castRays(const std::vector<Ray> &rays) const;
+
+    [[nodiscard]]
+    const btCollisionShape *getShape() const;
+};
+
+/* A vehicle's raycaster in a world whose static ground is the track. The track is hit through the TrackRaycaster,
+ * anything else (other cars, props) through the world, and the world ray ends at the track hit so it stays short.
+ * Hits can be cast ahead for all vehicles at once with queue, btRaycastVehicle then finds its rays already answered. */
+class WheelRaycaster : public btVehicleRaycaster {
+    static constexpr int MAX_WHEELS = 8;
+
+    struct Prepared {
+        btVector3 from;
+        btVector3 to;
+        TrackRaycaster::Hit hit;
+    };
+
+    const TrackRaycaster &track;
+    btDynamicsWorld *world;
+    btRigidBody *trackBody;
+    /* In a multithreaded world only static and kinematic bodies may be hit, see PhysicsWorld::createRaycaster */
+    bool staticOrKinematicOnly;
+
+    std::array<Prepared, MAX_WHEELS> prepared{};
+    int preparedCount = 0;
+
+public:
+    WheelRaycaster(const TrackRaycaster &track, btDynamicsWorld *world, btRigidBody *trackBody);
+
+    /* nullptr when no body in the world collides with the track's shape */
+    static WheelRaycaster *create(const TrackRaycaster &track, btDynamicsWorld *world);
+
+    /* Adds the rays the wheels of the vehicle cast in the coming step, exactly as btRaycastVehicle computes them.
+     * The hits are written back by TrackRaycaster::castRays. */
+    void queue(btRaycastVehicle &vehicle, std::vector<TrackRaycaster::Ray> &rays);
+
+    /* Starts a new set of queued rays */
+    void clearQueued();
+
+    void queueRay(const btVector3 &from, const btVector3 &to, std::vector<TrackRaycaster::Ray> &rays);
+
+    void *castRay(const btVector3 &from, const btVector3 &to, btVehicleRaycasterResult &result) override;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+
+/* Bounded single producer single consumer queue. Both ends are wait-free and nothing is allocated after
+ * construction. Each side keeps a cached copy of the other side's index so the shared cache line is only
+ * touched when the ring looks full or empty. */
+template<typename T, size_t Capacity>
+class SpscRing {
+    static_assert(std::has_single_bit(Capacity), "Capacity must be a power of two");
+
+    static constexpr size_t MASK = Capacity - 1;
+
+    /* Written by the consumer only */
+    alignas(64) std::atomic<size_t> head{0};
+    size_t cachedTail = 0;
+
+    /* Written by the producer only */
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t cachedHead = 0;
+
+    alignas(64) std::array<T, Capacity> slots{};
+
+public:
+    /* Producer side, false if the ring is full */
+    bool tryPush(const T &value) {
+        const auto currentTail = tail.load(std::memory_order_relaxed);
+
+        if (currentTail - cachedHead == Capacity) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (currentTail - cachedHead == Capacity)
+                return false;
+        }
+
+        slots[currentTail & MASK] = value;
+        tail.store(currentTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side, false if the ring is empty */
+    bool tryPop(T &value) {
+        const auto currentHead = head.load(std::memory_order_relaxed);
+
+        if (currentHead == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (currentHead == cachedTail)
+                return false;
+        }
+
+        value = slots[currentHead & MASK];
+        head.store(currentHead + 1, std::memory_order_release);
+        return true;
+    }
+
+    static constexpr size_t capacity() {
+        return Capacity;
+    }
+};
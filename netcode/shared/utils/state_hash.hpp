@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/* 64-bit FNV-1a over raw bytes. Floats are hashed by their bits, so two states only hash the same when they are
+ * bit-identical, which is exactly what a determinism check wants. */
+class StateHash {
+    static constexpr uint64_t OFFSET_BASIS = 0xcbf29ce484222325ULL;
+    static constexpr uint64_t PRIME = 0x100000001b3ULL;
+
+    uint64_t hash = OFFSET_BASIS;
+
+public:
+    void add(const void *data, const size_t size) {
+        const auto bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= PRIME;
+        }
+    }
+
+    template<typename T>
+    void add(const T &value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        add(bytes, sizeof(T));
+    }
+
+    [[nodiscard]]
+    uint64_t value() const {
+        return hash;
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/* Latest value mailbox between one writer and one reader. The writer fills its own slot and swaps it with the
+ * shared middle one, the reader swaps the middle one with its own when something new was published. Neither
+ * side ever waits and the reader always sees a complete value, though values it was too slow for are skipped. */
+template<typename T>
+class TripleBuffer {
+    /* Index of the middle slot in the low bits, set while it holds a value the reader hasn't taken */
+    static constexpr uint8_t FRESH = 0x4;
+    static constexpr uint8_t INDEX_MASK = 0x3;
+
+    alignas(64) std::atomic<uint8_t> middle{1};
+
+    /* Writer only */
+    alignas(64) uint8_t back = 0;
+
+    /* Reader only */
+    alignas(64) uint8_t front = 2;
+
+    std::array<T, 3> slots{};
+
+public:
+    /* Writer side, fill it and then publish() */
+    T &writeSlot() {
+        return slots[back];
+    }
+
+    void publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    void write(const T &value) {
+        writeSlot() = value;
+        publish();
+    }
+
+    /* Reader side, true if a newer value than the one in readSlot() was taken */
+    bool fetch() {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+            return false;
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    [[nodiscard]]
+    const T &readSlot() const {
+        return slots[front];
+    }
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstring>
+
+#include "client_inputs.hpp"
+#include "packets/udp/client/state_packet.hpp"
+#include "LinearMath/btTransform.h"
+#include "LinearMath/btVector3.h"
+
+/* What a client tells everyone else about its car every frame */
+struct VehicleState {
+    btTransform transform;
+    btVector3 velocity;
+    btScalar steeringAngle;
+    ClientInputs inputs;
+};
+
+/* Layout: btTransformFloatData(64), velocity(3 floats), steering angle(float), ..., inputs in the last byte */
+inline void packVehicleState(const VehicleState &vehicleState, StateBuffer buf) {
+    btTransformFloatData transformData{};
+    vehicleState.transform.serialize(transformData);
+
+    const float velocityData[3] = {
+        vehicleState.velocity.getX(), vehicleState.velocity.getY(), vehicleState.velocity.getZ()
+    };
+
+    constexpr auto transformSize = sizeof(btTransformFloatData);
+    constexpr auto velocitySize = sizeof(velocityData);
+
+    std::memset(buf, 0, STATE_PAYLOAD_SIZE);
+    std::memcpy(buf, &transformData, transformSize);
+    std::memcpy(buf + transformSize, velocityData, velocitySize);
+    std::memcpy(buf + transformSize + velocitySize, &vehicleState.steeringAngle, sizeof(btScalar));
+    std::memcpy(buf + STATE_PAYLOAD_SIZE - sizeof(ClientInputs), &vehicleState.inputs, sizeof(ClientInputs));
+}
+
+inline VehicleState unpackVehicleState(const char *state) {
+    btTransformFloatData transformData{};
+    float velocityData[3];
+
+    VehicleState vehicleState{};
+
+    std::memcpy(&transformData, state, sizeof(transformData));
+    std::memcpy(&velocityData, state + sizeof(transformData), sizeof(velocityData));
+    std::memcpy(&vehicleState.steeringAngle, state + sizeof(transformData) + sizeof(velocityData),
+                sizeof(btScalar));
+    std::memcpy(&vehicleState.inputs, state + STATE_PAYLOAD_SIZE - sizeof(ClientInputs), sizeof(ClientInputs));
+
+    vehicleState.transform.deSerialize(transformData);
+    vehicleState.velocity = btVector3(velocityData[0], velocityData[1], velocityData[2]);
+
+    return vehicleState;
+}
@@ -1,8 +1,9 @@
 #include "opponent.hpp"
-#include <iostream>
 #include <random>
 
+#include "determinism.hpp"
 #include "opponent_path.hpp"
+#include "netcode/shared/logger.hpp"
 #include "glm/detail/_noise.hpp"
 
 glm::vec3 Opponent::bezierPoint(const float t, const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2) {
@@ -54,8 +55,7 @@ glm::vec3 Opponent::findLookaheadPoint(const glm::vec3 &currentPos) const {
 void Opponent::randomizePath() {
     constexpr float PATH_CHANGE_PROBABILITY = 0.1f;
 
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
+    static std::mt19937 gen = Determinism::getInstance().makeRandomEngine();
     static std::uniform_real_distribution dist(0.0f, 1.0f);
 
     if (dist(gen) > PATH_CHANGE_PROBABILITY)
@@ -73,13 +73,13 @@ void Opponent::randomizePath() {
 
     unsigned int closestWaypoint = 0;
 
-    std::cout << "DOT " << dot << std::endl;
+    LOG_DEBUG("Switching path, dot to new waypoint {}", dot);
     if (dot >= 0.0f)
         closestWaypoint = seekClosestSmallerWaypoint(path);
     else
         closestWaypoint = seekClosestBiggerWaypoint(path);
 
-    std::cout << currentWaypoint << "  " << closestWaypoint << std::endl;
+    LOG_DEBUG("Waypoint {} -> {}", currentWaypoint, closestWaypoint);
     waypoints = path;
     currentWaypoint = closestWaypoint;
 }
@@ -98,7 +98,7 @@ unsigned int Opponent::seekClosestBiggerWaypoint(const std::vector<glm::vec3> &n
             continue;
         }
 
-        std::cout << "DISTANCE  " << distance << "  " << lastDistance;
+        LOG_DEBUG("Waypoint distance {} last {}", distance, lastDistance);
         if (distance > lastDistance)
             return (newWaypointIndex) % waypoints.size();
 
@@ -106,7 +106,7 @@ unsigned int Opponent::seekClosestBiggerWaypoint(const std::vector<glm::vec3> &n
     }
 
     /* Fallback */
-    std::cout << "Fallback was called when seeking for closest waypoint forward" << std::endl;
+    LOG_DEBUG("Fallback was called when seeking for closest waypoint forward");
     return (currentWaypoint + WAYPOINT_SEEK_DEPTH) % waypoints.size();
 }
 
@@ -133,7 +133,7 @@ unsigned int Opponent::seekClosestSmallerWaypoint(const std::vector<glm::vec3> &
     }
 
     /* Fallback */
-    std::cout << "Fallback was called when seeking for closest waypoint backward" << std::endl;
+    LOG_DEBUG("Fallback was called when seeking for closest waypoint backward");
     return (currentWaypoint - WAYPOINT_SEEK_DEPTH) % waypoints.size();
 }
 
@@ -4,6 +4,8 @@
 #include <random>
 #include <nlohmann/json.hpp>
 
+#include "determinism.hpp"
+
 OpponentPathGenerator &OpponentPathGenerator::getInstance() {
     static OpponentPathGenerator instance;
     return instance;
@@ -124,8 +126,7 @@ std::vector<glm::vec3> OpponentPathGenerator::getRandomPathFromMemory() {
         exit(1);
     }
 
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
+    static std::mt19937 gen = Determinism::getInstance().makeRandomEngine();
     static std::uniform_int_distribution<unsigned long> dist(0, paths.size() - 1);
 
     const size_t randomIndex = dist(gen);
@@ -162,8 +163,7 @@ std::vector<glm::vec3> OpponentPathGenerator::getRandomPathFromFile(const std::s
         return path;
     }
 
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
+    static std::mt19937 gen = Determinism::getInstance().makeRandomEngine();
     static std::uniform_int_distribution<unsigned long> dist(0, data["paths"].size() - 1);
 
     size_t randomIndex = dist(gen);
@@ -1,17 +1,91 @@
 #include "physics.hpp"
 
+#include <cstdlib>
 #include <memory>
 
-#include "model.hpp"
+#include "determinism.hpp"
+#include "vehicle_factory.hpp"
 #include "BulletCollision/CollisionDispatch/btGhostObject.h"
+#include "netcode/shared/logger.hpp"
 
-Physics::Physics() {
-    collisionConfig = new btDefaultCollisionConfiguration();
-    dispatcher = new btCollisionDispatcher(collisionConfig);
-    broadphase = new btDbvtBroadphase();
-    solver = new btSequentialImpulseConstraintSolver();
-    dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfig);
+Physics::Physics() : world(threadsFromEnv()) {
+    dynamicsWorld = world.get();
     debugDrawer = new DebugDrawer(dynamicsWorld);
+
+    const int tickRate = tickRateFromEnv();
+    fixedTimeStep = btScalar(1) / static_cast<btScalar>(tickRate);
+    maxStepsPerFrame = maxStepsPerFrameFromEnv(tickRate);
+
+    dynamicsWorld->setGravity(btVector3(0, -9.81f, 0));
+
+    ghostPairCallback = std::make_unique<btGhostPairCallback>();
+    dynamicsWorld->getPairCache()->setInternalGhostPairCallback(ghostPairCallback.get());
+
+    dynamicsWorld->setInternalTickCallback(onPreTick, this, true);
+    /* No vehicle exists yet, the action is first in line */
+    PhysicsWorld::addActionBeforeVehicles(dynamicsWorld, &preVehiclesAction);
+}
+
+Physics::PreVehiclesAction::PreVehiclesAction(Physics &physics) : physics(physics) {
+}
+
+void Physics::PreVehiclesAction::updateAction(btCollisionWorld *, btScalar) {
+    if (physics.preVehiclesCallback)
+        physics.preVehiclesCallback();
+}
+
+void Physics::PreVehiclesAction::debugDraw(btIDebugDraw *) {
+}
+
+int Physics::tickRateFromEnv() {
+    const char *value = std::getenv("NFSPUT_PHYSICS_RATE");
+    if (!value || !*value)
+        return DEFAULT_TICK_RATE;
+
+    char *end;
+    const auto rate = std::strtoul(value, &end, 10);
+    if (*end != '\0' || (rate != 60 && rate != 120 && rate != 240)) {
+        LOG_WARN("Ignoring invalid NFSPUT_PHYSICS_RATE {}, expected 60, 120 or 240", value);
+        return DEFAULT_TICK_RATE;
+    }
+
+    return static_cast<int>(rate);
+}
+
+int Physics::maxStepsPerFrameFromEnv(const int tickRate) {
+    /* Enough to keep up with 15 fps */
+    const int defaultSteps = tickRate / 15;
+
+    const char *value = std::getenv("NFSPUT_PHYSICS_MAX_STEPS");
+    if (!value || !*value)
+        return defaultSteps;
+
+    char *end;
+    const auto steps = std::strtoul(value, &end, 10);
+    if (*end != '\0' || steps == 0 || steps > 64) {
+        LOG_WARN("Ignoring invalid NFSPUT_PHYSICS_MAX_STEPS {}", value);
+        return defaultSteps;
+    }
+
+    return static_cast<int>(steps);
+}
+
+int Physics::threadsFromEnv() {
+    const int threads = PhysicsWorld::threadsFromEnv();
+
+    /* Bullet's threads pick up work in whatever order they get to it */
+    if (threads > 1 && Determinism::getInstance().isEnabled()) {
+        LOG_WARN("Deterministic mode runs physics on one thread, ignoring NFSPUT_PHYSICS_THREADS {}", threads);
+        return 1;
+    }
+
+    return threads;
+}
+
+void Physics::onPreTick(btDynamicsWorld *world, const btScalar timeStep) {
+    const auto physics = static_cast<Physics *>(world->getWorldUserInfo());
+    if (physics->preTickCallback)
+        physics->preTickCallback(timeStep);
 }
 
 Physics &Physics::getInstance() {
@@ -19,10 +93,15 @@ Physics &Physics::getInstance() {
     return instance;
 }
 
-void Physics::initPhysics(const std::unique_ptr<btTriangleMesh> &triMesh) {
+void Physics::initPhysics(std::unique_ptr<TrackCollision> collision) {
+    if (trackCollision) {
+        auto previous = releaseTrack();
+        parkedTracks[previous->getTrackFile()] = std::move(previous);
+    }
+
     /* Add static map body to the world */
-    constexpr bool useQuantizedAabbCompression = true;
-    groundShape = new btBvhTriangleMeshShape(triMesh.get(), useQuantizedAabbCompression);
+    trackCollision = std::move(collision);
+    btBvhTriangleMeshShape *groundShape = trackCollision->getShape();
     groundShape->setMargin(0.02f);
 
     groundMotion = new btDefaultMotionState(btTransform::getIdentity());
@@ -31,34 +110,109 @@ void Physics::initPhysics(const std::unique_ptr<btTriangleMesh> &triMesh) {
     groundRigidBody = new btRigidBody(groundCI);
 
     dynamicsWorld->addRigidBody(groundRigidBody);
+}
 
-    /* Config */
-    dynamicsWorld->setGravity(btVector3(0, -9.81f, 0));
+bool Physics::swapTrack(const std::string &trackFile, const Model &trackModel) {
+    if (trackCollision && trackCollision->getTrackFile() == trackFile)
+        return true;
+
+    if (const auto vehicles = VehicleFactory::getInstance().countInUse(dynamicsWorld); vehicles > 0) {
+        LOG_WARN("Not swapping in track {} while {} vehicles are in the world", trackFile, vehicles);
+        return false;
+    }
+
+    if (auto parked = parkedTracks.extract(trackFile)) {
+        LOG_INFO("Swapping in parked track {}", trackFile);
+        initPhysics(std::move(parked.mapped()));
+        return true;
+    }
+
+    auto collision = TrackCollision::load(trackFile, trackModel);
+    if (!collision) {
+        LOG_WARN("Keeping the current track, {} could not be loaded", trackFile);
+        return false;
+    }
 
-    dynamicsWorld->getPairCache()->setInternalGhostPairCallback(new btGhostPairCallback());
+    initPhysics(std::move(collision));
+    return true;
 }
 
-void Physics::stepSimulation(const btScalar timeStep) const {
-    dynamicsWorld->stepSimulation(timeStep);
+std::unique_ptr<TrackCollision> Physics::releaseTrack() {
+    if (!trackCollision)
+        return nullptr;
+
+    VehicleFactory::getInstance().releaseWorld(dynamicsWorld);
+
+    dynamicsWorld->removeRigidBody(groundRigidBody);
+    delete groundRigidBody;
+    delete groundMotion;
+    groundRigidBody = nullptr;
+    groundMotion = nullptr;
+
+    return std::move(trackCollision);
 }
 
-std::unique_ptr<btTriangleMesh> Physics::
-btTriMeshFromModel(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices) {
-    auto triMesh = std::make_unique<btTriangleMesh>();
+void Physics::resetDynamics() {
+    btBroadphaseInterface *broadphase = dynamicsWorld->getBroadphase();
+    btDispatcher *dispatcher = dynamicsWorld->getDispatcher();
+
+    const auto &objects = dynamicsWorld->getCollisionObjectArray();
+    for (int i = 0; i < objects.size(); ++i) {
+        btCollisionObject *object = objects[i];
+        /* Frees the pair's collision algorithm and its manifold, the dispatcher builds fresh ones on the next step */
+        broadphase->getOverlappingPairCache()->cleanProxyFromPairs(object->getBroadphaseHandle(), dispatcher);
+
+        if (const auto body = btRigidBody::upcast(object); body && !body->isStaticOrKinematicObject()) {
+            body->setLinearVelocity(btVector3(0, 0, 0));
+            body->setAngularVelocity(btVector3(0, 0, 0));
+            body->clearForces();
+        }
+    }
+
+    dynamicsWorld->getConstraintSolver()->reset();
+    accumulator = 0;
+}
 
-    for (size_t i = 0; i < indices.size(); i += 3) {
-        const Vertex &v0 = vertices[indices[i]];
-        const Vertex &v1 = vertices[indices[i + 1]];
-        const Vertex &v2 = vertices[indices[i + 2]];
+int Physics::stepSimulation(const btScalar frameTime) {
+    accumulator += frameTime;
 
-        btVector3 bv0(v0.Position.x, v0.Position.y, v0.Position.z);
-        btVector3 bv1(v1.Position.x, v1.Position.y, v1.Position.z);
-        btVector3 bv2(v2.Position.x, v2.Position.y, v2.Position.z);
+    int steps = static_cast<int>(accumulator / fixedTimeStep);
+    accumulator -= static_cast<btScalar>(steps) * fixedTimeStep;
 
-        triMesh->addTriangle(bv0, bv1, bv2);
+    if (steps > maxStepsPerFrame) {
+        steps = maxStepsPerFrame;
+        accumulator = 0;
     }
 
-    return triMesh;
+    /* One step per call, so the motion states are synchronized after each one and not extrapolated by Bullet */
+    for (int i = 0; i < steps; ++i) {
+        dynamicsWorld->stepSimulation(fixedTimeStep, 0);
+
+        if (postStepCallback)
+            postStepCallback();
+    }
+
+    return steps;
+}
+
+void Physics::setPreTickCallback(PreTickCallback callback) {
+    preTickCallback = std::move(callback);
+}
+
+void Physics::setPostStepCallback(PostStepCallback callback) {
+    postStepCallback = std::move(callback);
+}
+
+void Physics::setPreVehiclesCallback(PreVehiclesCallback callback) {
+    preVehiclesCallback = std::move(callback);
+}
+
+btScalar Physics::getFixedTimeStep() const {
+    return fixedTimeStep;
+}
+
+btScalar Physics::getInterpolationAlpha() const {
+    return accumulator / fixedTimeStep;
 }
 
 // btRigidBody *Physics::getCarChassis() const {
@@ -72,3 +226,11 @@ DebugDrawer *Physics::getDebugDrawer() const {
 btDynamicsWorld *Physics::getDynamicsWorld() const {
     return dynamicsWorld;
 }
+
+btBvhTriangleMeshShape *Physics::getGroundShape() const {
+    return trackCollision->getShape();
+}
+
+const TrackRaycaster *Physics::getTrackRaycaster() const {
+    return trackCollision ? trackCollision->getRaycaster() : nullptr;
+}
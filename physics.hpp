@@ -1,24 +1,76 @@
 #pragma once
+#include <functional>
+#include <map>
 #include <memory>
+#include <string>
 
 #include "physics_debug.hpp"
 #include "model.hpp"
+#include "track_collision.hpp"
 #include "btBulletDynamicsCommon.h"
+#include "netcode/shared/physics_world.hpp"
 
+/* Steps the main world at a fixed rate, whatever the frame rate. Frame time is collected in an accumulator and
+ * spent in whole steps, the remainder is used to interpolate what gets drawn. */
 class Physics {
-    DebugDrawer *debugDrawer;
-    btDefaultCollisionConfiguration *collisionConfig;
-    btCollisionDispatcher *dispatcher;
-    btBroadphaseInterface *broadphase;
-    btSequentialImpulseConstraintSolver *solver;
+public:
+    using PreTickCallback = std::function<void(btScalar timeStep)>;
+    using PostStepCallback = std::function<void()>;
+    using PreVehiclesCallback = std::function<void()>;
+
+    /* Ticks per second, NFSPUT_PHYSICS_RATE picks one of 60, 120 or 240 */
+    static constexpr int DEFAULT_TICK_RATE = 120;
+
+private:
+    /* Declared before the world, which still refers to the ground while it is torn down */
+    std::unique_ptr<TrackCollision> trackCollision;
+    /* Tracks swapped out of the world, by track file. Kept loaded so swapping back to one is instant. */
+    std::map<std::string, std::unique_ptr<TrackCollision> > parkedTracks;
+
+    /* NFSPUT_PHYSICS_THREADS picks how many threads step it */
+    PhysicsWorld world;
     btDynamicsWorld *dynamicsWorld;
+    DebugDrawer *debugDrawer;
 
-    btBvhTriangleMeshShape *groundShape{};
     btDefaultMotionState *groundMotion{};
     btRigidBody *groundRigidBody{};
 
+    /* Keeps the overlaps of ghost objects, like the lap checkpoints, up to date */
+    std::unique_ptr<btOverlappingPairCallback> ghostPairCallback;
+
+    btScalar fixedTimeStep;
+    /* Bounds the cost of a frame. Time beyond it is dropped, the game slows down instead of spiralling. */
+    int maxStepsPerFrame;
+    btScalar accumulator = 0;
+
+    PreTickCallback preTickCallback;
+    PostStepCallback postStepCallback;
+    PreVehiclesCallback preVehiclesCallback;
+
+    /* Calls preVehiclesCallback from inside the step */
+    class PreVehiclesAction : public btActionInterface {
+        Physics &physics;
+
+    public:
+        explicit PreVehiclesAction(Physics &physics);
+
+        void updateAction(btCollisionWorld *collisionWorld, btScalar timeStep) override;
+
+        void debugDraw(btIDebugDraw *debugDrawer) override;
+    };
+
+    PreVehiclesAction preVehiclesAction{*this};
+
     Physics();
 
+    static void onPreTick(btDynamicsWorld *world, btScalar timeStep);
+
+    static int tickRateFromEnv();
+
+    static int maxStepsPerFrameFromEnv(int tickRate);
+
+    static int threadsFromEnv();
+
 public:
     static Physics &getInstance();
 
@@ -31,16 +83,42 @@ public:
 
     Physics &operator=(Physics &&) = delete;
 
-    void initPhysics(const std::unique_ptr<btTriangleMesh> &triMesh);
+    /* Makes the track the static ground of the world, in place of the current one */
+    void initPhysics(std::unique_ptr<TrackCollision> collision);
+
+    /* Puts the given track in the world, taken from the parked tracks when it was there before and loaded, from its
+     * collision cache when possible, otherwise. The track swapped out is parked. Refused, returning false, while the
+     * world has vehicles, their wheels are cast against the track they were built on. */
+    bool swapTrack(const std::string &trackFile, const Model &trackModel);
 
-    /* Not yet implemented.
-     * Implement when we in need to reload maps */
-    // void exitPhysics();
+    /* Takes the track out of the world and hands it over. Pooled vehicle parts cast their wheels against it, so the
+     * VehicleFactory pool of the world goes with it. */
+    std::unique_ptr<TrackCollision> releaseTrack();
 
-    void stepSimulation(btScalar timeStep) const;
+    /* Forgets what the last race left in the world, the contact manifolds of the overlapping pairs, the solver's
+     * state, the velocities of dynamic bodies and the time not yet stepped. The pairs themselves stay until the
+     * broadphase sees the bodies apart. Static bodies and the track's BVH stay as they are. */
+    void resetDynamics();
 
-    static std::unique_ptr<btTriangleMesh> btTriMeshFromModel(const std::vector<Vertex> &vertices,
-                                                              const std::vector<unsigned int> &indices);
+    /* Adds the frame time to the accumulator and runs as many fixed steps as it holds, returns how many */
+    int stepSimulation(btScalar frameTime);
+
+    /* Runs inside every fixed step before Bullet integrates it, controls are applied here */
+    void setPreTickCallback(PreTickCallback callback);
+
+    /* Runs after every fixed step, once Bullet has synchronized the motion states */
+    void setPostStepCallback(PostStepCallback callback);
+
+    /* Runs inside every fixed step once the bodies are integrated, right before the vehicles cast their wheel rays
+     * from where the chassis now are */
+    void setPreVehiclesCallback(PreVehiclesCallback callback);
+
+    [[nodiscard]]
+    btScalar getFixedTimeStep() const;
+
+    /* How far the frame is between the last two steps, 0 at the previous one and 1 at the newest */
+    [[nodiscard]]
+    btScalar getInterpolationAlpha() const;
 
     // [[nodiscard]]
     // btRigidBody *getCarChassis() const;
@@ -50,4 +128,11 @@ public:
 
     [[nodiscard]]
     btDynamicsWorld *getDynamicsWorld() const;
+
+    [[nodiscard]]
+    btBvhTriangleMeshShape *getGroundShape() const;
+
+    /* nullptr until initPhysics */
+    [[nodiscard]]
+    const TrackRaycaster *getTrackRaycaster() const;
 };
@@ -32,7 +32,7 @@ void DebugDrawer::disable() {
 }
 
 void DebugDrawer::toggle() {
-    enabled = !enabled;
+    enabled = !enabled.load();
 }
 
 void DebugDrawer::clear() {
@@ -65,13 +65,23 @@ void DebugDrawer::setVertexColor(const glm::vec3 &color) {
     vertexColor = color;
 }
 
-void DebugDrawer::draw(const glm::mat4 &PVM) {
-    if (!enabled) {
+void DebugDrawer::collect(std::vector<float> &lines) {
+    lines.clear();
+    if (!enabled)
         return;
-    }
 
     dynamicsWorld->debugDrawWorld();
 
+    /* The swap keeps both vectors' capacity */
+    std::swap(lineVertices, lines);
+    clear();
+}
+
+void DebugDrawer::draw(const glm::mat4 &PVM, const std::vector<float> &lines) {
+    if (!enabled || lines.empty()) {
+        return;
+    }
+
     shader->use();
     shader->setUniform("PVM", PVM);
     shader->setUniform("color", vertexColor);
@@ -79,16 +89,13 @@ void DebugDrawer::draw(const glm::mat4 &PVM) {
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
-    glBufferData(GL_ARRAY_BUFFER, static_cast<long>(lineVertices.size() * sizeof(float)), lineVertices.data(),
-                 GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<long>(lines.size() * sizeof(float)), lines.data(), GL_DYNAMIC_DRAW);
 
-    glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(lineVertices.size() / 3));
+    glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(lines.size() / 3));
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
     /* TODO: add Shader::disable() */
     glUseProgram(0);
-
-    clear();
 }
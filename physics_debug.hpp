@@ -2,12 +2,14 @@
 #include <shader.hpp>
 
 #include "LinearMath/btIDebugDraw.h"
+#include <atomic>
 #include <glm/glm.hpp>
 
 #include "BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h"
 
+/* Lines are collected on the simulation thread with collect() and drawn on the render thread with draw() */
 class DebugDrawer : public btIDebugDraw {
-    bool enabled;
+    std::atomic<bool> enabled;
 
     int m_debugMode;
 
@@ -53,5 +55,9 @@ public:
 
     void setVertexColor(const glm::vec3 &color);
 
-    void draw(const glm::mat4 &PVM);
+    /* Simulation thread. Swaps the world's wireframe into lines, nothing when disabled. */
+    void collect(std::vector<float> &lines);
+
+    /* Render thread, lines as filled by collect() */
+    void draw(const glm::mat4 &PVM, const std::vector<float> &lines);
 };
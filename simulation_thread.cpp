@@ -0,0 +1,86 @@
+#include "simulation_thread.hpp"
+
+#include <chrono>
+
+#include "determinism.hpp"
+
+SimulationThread::SimulationThread(StepFunction step) : step(std::move(step)) {
+}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start() {
+    if (running.exchange(true))
+        return;
+
+    thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    }
+    cv.notify_one();
+
+    if (thread.joinable())
+        thread.join();
+}
+
+void SimulationThread::submit(const FrameInput &input) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if (hasPending) {
+            pending.frameTime += input.frameTime;
+            pending.inputs = input.inputs;
+            pending.inputSampledUs = input.inputSampledUs;
+            pending.addWaypoint |= input.addWaypoint;
+            pending.saveWaypoints |= input.saveWaypoints;
+            pending.printPosition |= input.printPosition;
+            pending.resetToGrid |= input.resetToGrid;
+        } else {
+            pending = input;
+            hasPending = true;
+        }
+    }
+    cv.notify_one();
+}
+
+const FrameState &SimulationThread::fetch() {
+    bool fresh = frames.fetch();
+    while (!fresh && !hasFrame) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        fresh = frames.fetch();
+    }
+
+    hasFrame = true;
+    return frames.readSlot();
+}
+
+void SimulationThread::run() {
+    /* The environment is per thread and this is the one stepping the world */
+    Determinism::getInstance().configureFloatingPoint();
+
+    uint64_t frame = 0;
+
+    while (true) {
+        FrameInput input;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] { return hasPending || !running; });
+            if (!running)
+                return;
+
+            input = pending;
+            hasPending = false;
+        }
+
+        auto &out = frames.writeSlot();
+        out.frame = ++frame;
+        step(input, out);
+        frames.publish();
+    }
+}
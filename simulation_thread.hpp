@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "frame_state.hpp"
+#include "netcode/shared/client_inputs.hpp"
+#include "netcode/shared/utils/triple_buffer.hpp"
+
+/* What the render thread hands over for one frame */
+struct FrameInput {
+    float frameTime;
+    ClientInputs inputs;
+    /* See LatencyTrace::inputSampledUs */
+    uint32_t inputSampledUs;
+
+    /* Key presses whose handlers read the simulation */
+    bool addWaypoint;
+    bool saveWaypoints;
+    bool printPosition;
+    bool resetToGrid;
+};
+
+/* Runs the simulation of frame N+1 while the render thread draws frame N. The render thread submits its inputs
+ * and takes the newest finished FrameState, the simulation thread owns the physics world and everything in it. */
+class SimulationThread {
+public:
+    using StepFunction = std::function<void(const FrameInput &input, FrameState &out)>;
+
+    explicit SimulationThread(StepFunction step);
+
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread &) = delete;
+
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    void start();
+
+    void stop();
+
+    /* Render thread. Inputs the simulation hasn't picked up yet are merged, their frame times add up. */
+    void submit(const FrameInput &input);
+
+    /* Render thread. The newest finished frame, waits only for the very first one. */
+    const FrameState &fetch();
+
+private:
+    StepFunction step;
+    TripleBuffer<FrameState> frames;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    FrameInput pending{};
+    bool hasPending = false;
+
+    /* Render thread only */
+    bool hasFrame = false;
+
+    std::atomic<bool> running{false};
+    std::thread thread;
+
+    void run();
+};
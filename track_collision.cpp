@@ -0,0 +1,286 @@
+#include "track_collision.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "collision_mesh.hpp"
+#include "model.hpp"
+#include "netcode/shared/logger.hpp"
+#include "netcode/shared/utils/state_hash.hpp"
+
+struct TrackCollision::Header {
+    static constexpr char MAGIC[8] = {'N', 'F', 'S', 'P', 'B', 'V', 'H', '\0'};
+    /* Bump whenever the layout below or the way the mesh is built changes */
+    static constexpr uint32_t VERSION = 2;
+
+    char magic[8];
+    uint32_t version;
+    /* The serialized BVH is laid out for one btScalar size */
+    uint32_t scalarSize;
+    uint64_t trackHash;
+
+    float aabbMin[3];
+    float aabbMax[3];
+
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+
+    /* From the start of the image. Vertices are 3 floats, triangles 3 int32 indices, the BVH is 16 byte aligned. */
+    uint64_t verticesOffset;
+    uint64_t indicesOffset;
+    uint64_t bvhOffset;
+    uint64_t bvhSize;
+};
+
+namespace {
+    constexpr size_t BVH_ALIGNMENT = 16;
+
+    size_t alignUp(const size_t value, const size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    btIndexedMesh indexedMesh(const void *vertices, const uint32_t vertexCount, const void *indices,
+                              const uint32_t triangleCount) {
+        btIndexedMesh mesh;
+        mesh.m_numTriangles = static_cast<int>(triangleCount);
+        mesh.m_triangleIndexBase = static_cast<const unsigned char *>(indices);
+        mesh.m_triangleIndexStride = 3 * sizeof(int32_t);
+        mesh.m_numVertices = static_cast<int>(vertexCount);
+        mesh.m_vertexBase = static_cast<const unsigned char *>(vertices);
+        mesh.m_vertexStride = 3 * sizeof(float);
+        mesh.m_indexType = PHY_INTEGER;
+        mesh.m_vertexType = PHY_FLOAT;
+        return mesh;
+    }
+}
+
+std::unique_ptr<TrackCollision> TrackCollision::load(const std::string &trackFile, const Model &trackModel) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto elapsedMs = [&start] {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    const std::string cachePath = std::string(MODELS_PATH) + trackFile + ".collision";
+    const auto settings = CollisionMeshSettings::fromEnv();
+    const uint64_t trackHash = hashTrack(std::string(MODELS_PATH) + trackFile, settings);
+
+    std::unique_ptr<TrackCollision> collision(new TrackCollision(trackFile));
+
+    if (collision->mapFile(cachePath)) {
+        if (collision->attach(trackHash)) {
+            LOG_INFO("Track collision loaded from {} in {} ms", cachePath, elapsedMs());
+            return collision;
+        }
+
+        LOG_INFO("Track collision cache {} is stale, rebuilding it", cachePath);
+        collision = std::unique_ptr<TrackCollision>(new TrackCollision(trackFile));
+    }
+
+    size_t size;
+    void *built = buildImage(trackModel, settings, trackHash, size);
+
+    if (writeFile(cachePath, built, size) && collision->mapFile(cachePath) && collision->attach(trackHash)) {
+        btAlignedFree(built);
+        LOG_INFO("Track collision built and cached to {} in {} ms", cachePath, elapsedMs());
+        return collision;
+    }
+
+    /* Still usable, only the next launch will have to build it again */
+    collision = std::unique_ptr<TrackCollision>(new TrackCollision(trackFile));
+    collision->image = built;
+    collision->imageSize = size;
+    if (!collision->attach(trackHash)) {
+        LOG_WARN("Track collision built from {} is not usable", trackFile);
+        return nullptr;
+    }
+
+    LOG_WARN("Track collision built in {} ms but could not be cached to {}", elapsedMs(), cachePath);
+    return collision;
+}
+
+TrackCollision::TrackCollision(std::string trackFile) : trackFile(std::move(trackFile)) {
+}
+
+TrackCollision::~TrackCollision() {
+    raycaster.reset();
+    shape.reset();
+    meshInterface.reset();
+
+    /* The tree lives in the image, its arrays don't own their memory */
+    if (bvh)
+        bvh->~btOptimizedBvh();
+
+    if (imageMapped)
+        munmap(image, imageSize);
+    else if (image)
+        btAlignedFree(image);
+}
+
+bool TrackCollision::attach(const uint64_t trackHash) {
+    if (imageSize < sizeof(Header))
+        return false;
+
+    const auto base = static_cast<unsigned char *>(image);
+    Header header{};
+    std::memcpy(&header, base, sizeof(header));
+
+    if (std::memcmp(header.magic, Header::MAGIC, sizeof(header.magic)) != 0 || header.version != Header::VERSION ||
+        header.scalarSize != sizeof(btScalar) || header.trackHash != trackHash)
+        return false;
+
+    const uint64_t verticesEnd = header.verticesOffset + uint64_t{header.vertexCount} * 3 * sizeof(float);
+    const uint64_t indicesEnd = header.indicesOffset + uint64_t{header.triangleCount} * 3 * sizeof(int32_t);
+    if (verticesEnd > imageSize || indicesEnd > imageSize || header.bvhOffset % BVH_ALIGNMENT != 0 ||
+        header.bvhOffset + header.bvhSize > imageSize)
+        return false;
+
+    meshInterface = std::make_unique<btTriangleIndexVertexArray>();
+    meshInterface->addIndexedMesh(indexedMesh(base + header.verticesOffset, header.vertexCount,
+                                              base + header.indicesOffset, header.triangleCount), PHY_INTEGER);
+    /* Saves the shape a pass over every vertex to find its bounds */
+    meshInterface->setPremadeAabb(btVector3(header.aabbMin[0], header.aabbMin[1], header.aabbMin[2]),
+                                  btVector3(header.aabbMax[0], header.aabbMax[1], header.aabbMax[2]));
+
+    bvh = btOptimizedBvh::deSerializeInPlace(base + header.bvhOffset, static_cast<unsigned>(header.bvhSize), false);
+    if (!bvh)
+        return false;
+
+    constexpr bool useQuantizedAabbCompression = true;
+    constexpr bool buildBvh = false;
+    shape = std::make_unique<btBvhTriangleMeshShape>(meshInterface.get(), useQuantizedAabbCompression, buildBvh);
+    shape->setOptimizedBvh(bvh);
+
+    const auto start = std::chrono::steady_clock::now();
+    raycaster = std::make_unique<TrackRaycaster>(shape.get(),
+                                                 reinterpret_cast<const float *>(base + header.verticesOffset),
+                                                 reinterpret_cast<const int32_t *>(base + header.indicesOffset),
+                                                 header.triangleCount);
+    LOG_INFO("Track raycast grid built in {} ms", std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - start).count());
+
+    return true;
+}
+
+bool TrackCollision::mapFile(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+        close(fd);
+        return false;
+    }
+
+    /* Private and writable, deserializing the BVH writes its object over the first bytes of the tree. Only those
+     * pages get copied, the rest stay shared with the page cache. */
+    void *mapping = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        LOG_WARN("Could not map track collision cache {}: {}", path, strerror(errno));
+        return false;
+    }
+
+    image = mapping;
+    imageSize = st.st_size;
+    imageMapped = true;
+    return true;
+}
+
+void *TrackCollision::buildImage(const Model &trackModel, const CollisionMeshSettings &settings,
+                                 const uint64_t trackHash, size_t &size) {
+    const auto [vertices, indices] = CollisionMesh::build(trackModel.getMeshes(), settings);
+
+    Header header{};
+    std::memcpy(header.magic, Header::MAGIC, sizeof(header.magic));
+    header.version = Header::VERSION;
+    header.scalarSize = sizeof(btScalar);
+    header.trackHash = trackHash;
+    header.vertexCount = static_cast<uint32_t>(vertices.size() / 3);
+    header.triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+    /* Built over the vectors, then the tree is serialized next to a copy of them */
+    btTriangleIndexVertexArray buildInterface;
+    buildInterface.addIndexedMesh(indexedMesh(vertices.data(), header.vertexCount, indices.data(),
+                                              header.triangleCount), PHY_INTEGER);
+    btBvhTriangleMeshShape buildShape(&buildInterface, true, true);
+
+    const btVector3 &aabbMin = buildShape.getLocalAabbMin();
+    const btVector3 &aabbMax = buildShape.getLocalAabbMax();
+    for (int i = 0; i < 3; ++i) {
+        header.aabbMin[i] = static_cast<float>(aabbMin[i]);
+        header.aabbMax[i] = static_cast<float>(aabbMax[i]);
+    }
+
+    const btOptimizedBvh *builtBvh = buildShape.getOptimizedBvh();
+
+    header.verticesOffset = sizeof(Header);
+    header.indicesOffset = header.verticesOffset + vertices.size() * sizeof(float);
+    header.bvhOffset = alignUp(header.indicesOffset + indices.size() * sizeof(int32_t), BVH_ALIGNMENT);
+    header.bvhSize = builtBvh->calculateSerializeBufferSize();
+    size = header.bvhOffset + header.bvhSize;
+
+    const auto base = static_cast<unsigned char *>(btAlignedAlloc(size, BVH_ALIGNMENT));
+    std::memset(base, 0, size);
+    std::memcpy(base, &header, sizeof(header));
+    std::memcpy(base + header.verticesOffset, vertices.data(), vertices.size() * sizeof(float));
+    std::memcpy(base + header.indicesOffset, indices.data(), indices.size() * sizeof(int32_t));
+    builtBvh->serializeInPlace(base + header.bvhOffset, static_cast<unsigned>(header.bvhSize), false);
+
+    return base;
+}
+
+bool TrackCollision::writeFile(const std::string &path, const void *data, const size_t size) {
+    /* Renamed into place once complete, a crash midway never leaves a truncated cache behind */
+    const std::string tmpPath = path + ".tmp";
+
+    FILE *file = std::fopen(tmpPath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    const bool written = std::fwrite(data, 1, size, file) == size;
+    if (std::fclose(file) != 0 || !written || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t TrackCollision::hashTrack(const std::string &path, const CollisionMeshSettings &settings) {
+    StateHash hash;
+    settings.hash(hash);
+
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        LOG_WARN("Could not read {} to key its collision cache", path);
+        return hash.value();
+    }
+
+    char buffer[1 << 16];
+    size_t bytesRead;
+    while ((bytesRead = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        hash.add(buffer, bytesRead);
+
+    std::fclose(file);
+    return hash.value();
+}
+
+const std::string &TrackCollision::getTrackFile() const {
+    return trackFile;
+}
+
+btBvhTriangleMeshShape *TrackCollision::getShape() const {
+    return shape.get();
+}
+
+const TrackRaycaster *TrackCollision::getRaycaster() const {
+    return raycaster.get();
+}
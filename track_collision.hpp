@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "btBulletDynamicsCommon.h"
+#include "netcode/shared/track_raycaster.hpp"
+
+class Model;
+struct CollisionMeshSettings;
+
+/* The collision mesh of a track and its BVH. The mesh is built by CollisionMesh, and together with the serialized
+ * btOptimizedBvh it is cached in a file next to the track, keyed by the hash of the track file and of the
+ * CollisionMeshSettings. Later launches memory-map the cache and Bullet reads the mesh and the tree straight out of
+ * the mapping. */
+class TrackCollision {
+    struct Header;
+
+    std::string trackFile;
+
+    /* The cache image, either mapped from the file or on the heap when the file couldn't be written */
+    void *image = nullptr;
+    size_t imageSize = 0;
+    bool imageMapped = false;
+
+    std::unique_ptr<btTriangleIndexVertexArray> meshInterface;
+    btOptimizedBvh *bvh = nullptr;
+    std::unique_ptr<btBvhTriangleMeshShape> shape;
+    /* Wheel raycasts, its grid is rebuilt from the image on every load */
+    std::unique_ptr<TrackRaycaster> raycaster;
+
+    explicit TrackCollision(std::string trackFile);
+
+    /* Sets up the shape over the image, false when the image isn't a valid cache of this track */
+    bool attach(uint64_t trackHash);
+
+    bool mapFile(const std::string &path);
+
+    static void *buildImage(const Model &trackModel, const CollisionMeshSettings &settings, uint64_t trackHash,
+                            size_t &size);
+
+    static bool writeFile(const std::string &path, const void *data, size_t size);
+
+    /* The track file and the settings its collision mesh is built with */
+    static uint64_t hashTrack(const std::string &path, const CollisionMeshSettings &settings);
+
+public:
+    /* trackFile is relative to MODELS_PATH, like for Model. The meshes of trackModel are only read when the cache is
+     * missing or was made from a different track file. nullptr when even the freshly built mesh can't be used. */
+    static std::unique_ptr<TrackCollision> load(const std::string &trackFile, const Model &trackModel);
+
+    ~TrackCollision();
+
+    TrackCollision(const TrackCollision &) = delete;
+
+    TrackCollision &operator=(const TrackCollision &) = delete;
+
+    [[nodiscard]]
+    const std::string &getTrackFile() const;
+
+    [[nodiscard]]
+    btBvhTriangleMeshShape *getShape() const;
+
+    [[nodiscard]]
+    const TrackRaycaster *getRaycaster() const;
+};
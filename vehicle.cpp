@@ -4,65 +4,15 @@
 #include <utility>
 
 #include "glm/gtc/type_ptr.hpp"
+#include "netcode/shared/utils/state_hash.hpp"
 
 void Vehicle::createBtVehicle() {
-    auto boxShape = new btBoxShape(config.chassisHalfExtents);
-
-    chassisShape = new btCompoundShape();
-
-    btTransform massTransform;
-    massTransform.setIdentity();
-    /* By raising the boxShape child up we lower the center of mass
-     * (the boxShape is higher  but center of mass stays the same) */
-    massTransform.setOrigin(btVector3(0, config.centerOfMassOffset, 0));
-
-    chassisShape->addChildShape(massTransform, boxShape);
-
-    /* This part is taken from Bullet example.
-     * I don't know what it's supposed to do,
-     * but I feel like the car has more grip at the rear
-     * even though this support shape is on the front? */
-    const auto suppShape = new btBoxShape(btVector3(0.5f, 0.1f, 0.5f));
-    btTransform suppLocalTrans;
-    suppLocalTrans.setIdentity();
-    suppLocalTrans.setOrigin(btVector3(0, 1.0, 2.0));
-    chassisShape->addChildShape(suppLocalTrans, suppShape);
-
-    btTransform chassisTransform;
-    chassisTransform.setIdentity();
-    chassisTransform.setOrigin(config.position);
-    chassisTransform.setRotation(config.rotation);
-
-    btVector3 inertia(0, 0, 0);
-    chassisShape->calculateLocalInertia(config.mass, inertia);
-
-    chassisMotion = new btDefaultMotionState(chassisTransform);
-    const btRigidBody::btRigidBodyConstructionInfo carCI(config.mass, chassisMotion, chassisShape, inertia);
-    chassis = new btRigidBody(carCI);
-
-    const btRaycastVehicle::btVehicleTuning tuning;
-    raycaster = new btDefaultVehicleRaycaster(dynamicsWorld);
-    btVehicle = new btRaycastVehicle(tuning, chassis, raycaster);
-    chassis->setActivationState(DISABLE_DEACTIVATION);
-
-    const auto wheelDir = config.wheelDirectionCS0;
-    const auto wheelAxle = config.wheelAxleCS;
-    const auto suspensionRest = config.suspensionRestLength;
-    const auto wheelRadius = config.wheelRadius;
-
-    for (const auto [connectionPoint, isFrontWheel]: config.wheels) {
-        btVehicle->addWheel(connectionPoint, wheelDir, wheelAxle, suspensionRest, wheelRadius, tuning,
-                            isFrontWheel);
-    }
+    parts = VehicleFactory::getInstance().acquire(config, dynamicsWorld);
 
-    for (int i = 0; i < btVehicle->getNumWheels(); i++) {
-        btWheelInfo &wheel = btVehicle->getWheelInfo(i);
-        wheel.m_suspensionStiffness = config.suspensionStiffness;
-        wheel.m_wheelsDampingRelaxation = config.dampingRelaxation;
-        wheel.m_wheelsDampingCompression = config.dampingCompression;
-        wheel.m_frictionSlip = config.frictionSlip;
-        wheel.m_rollInfluence = config.rollInfluence;
-    }
+    chassisMotion = &parts->motion;
+    chassis = parts->chassis.get();
+    wheelRaycaster = parts->wheelRaycaster;
+    btVehicle = parts->vehicle.get();
 }
 
 float Vehicle::calculateSteeringIncrement(const float speed) const {
@@ -80,26 +30,30 @@ float Vehicle::getEngineBoost() const {
     return 1.0f + boost;
 }
 
-Vehicle::Vehicle(VehicleConfig config, std::shared_ptr<Model> vehicleModel): config(std::move(config)) {
-    dynamicsWorld = Physics::getInstance().getDynamicsWorld();
+Vehicle::Vehicle(VehicleConfig config, std::shared_ptr<Model> vehicleModel)
+    : Vehicle(std::move(config), std::move(vehicleModel), Physics::getInstance().getDynamicsWorld()) {
+}
+
+Vehicle::Vehicle(VehicleConfig config, std::shared_ptr<Model> vehicleModel, btDynamicsWorld *world)
+    : dynamicsWorld(world), config(std::move(config)) {
     model = std::move(vehicleModel);
     createBtVehicle();
+
+    currentTransform = btVehicle->getChassisWorldTransform();
+    previousTransform = currentTransform;
+    renderTransform = currentTransform;
 }
 
 Vehicle::~Vehicle() {
-    dynamicsWorld->removeAction(btVehicle);
+    PhysicsWorld::removeVehicle(dynamicsWorld, btVehicle);
     dynamicsWorld->removeRigidBody(btVehicle->getRigidBody());
 
-    delete chassisShape;
-    delete chassisMotion;
-    delete chassis;
-    delete raycaster;
-    delete btVehicle;
+    VehicleFactory::getInstance().release(std::move(parts));
 }
 
 void Vehicle::addToWorld() const {
     dynamicsWorld->addRigidBody(chassis);
-    dynamicsWorld->addVehicle(btVehicle);
+    PhysicsWorld::addVehicle(dynamicsWorld, btVehicle);
 }
 
 btRaycastVehicle *Vehicle::getBtVehicle() const {
@@ -135,10 +89,68 @@ glm::vec3 Vehicle::getPosition() const {
     return {pos.x, pos.y, pos.z};
 }
 
+void Vehicle::recordPhysicsState() {
+    previousTransform = currentTransform;
+    currentTransform = btVehicle->getChassisWorldTransform();
+}
+
+void Vehicle::updateRenderTransform(const btScalar alpha) {
+    renderTransform.setOrigin(previousTransform.getOrigin().lerp(currentTransform.getOrigin(), alpha));
+    renderTransform.setRotation(previousTransform.getRotation().slerp(currentTransform.getRotation(), alpha));
+}
+
+void Vehicle::setRenderTransform(const btTransform &transform) {
+    renderTransform = transform;
+}
+
+const btTransform &Vehicle::getRenderTransform() const {
+    return renderTransform;
+}
+
+glm::mat4 Vehicle::getRenderModelMatrix() const {
+    btScalar btMatrix[16];
+    renderTransform.getOpenGLMatrix(btMatrix);
+    glm::mat4 modelMatrix = glm::make_mat4(btMatrix);
+    modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, config.centerOfMassOffset, 0.0f));
+    return modelMatrix;
+}
+
+btTransform Vehicle::getRenderWheelTransform(const int wheelIndex) const {
+    /* Wheels are placed by the newest step, keep them where they are relative to the chassis */
+    const auto &wheelTransform = btVehicle->getWheelInfo(wheelIndex).m_worldTransform;
+    return renderTransform * btVehicle->getChassisWorldTransform().inverseTimes(wheelTransform);
+}
+
 bool Vehicle::getIsBraking() const {
     return isBraking;
 }
 
+float Vehicle::getSteering() const {
+    return lastSteering;
+}
+
+void Vehicle::restoreState(const btTransform &transform, const btVector3 &linearVelocity,
+                           const btVector3 &angularVelocity, const float steering) {
+    chassis->setCenterOfMassTransform(transform);
+    chassisMotion->setWorldTransform(transform);
+    chassis->setLinearVelocity(linearVelocity);
+    chassis->setAngularVelocity(angularVelocity);
+    chassis->clearForces();
+
+    btVehicle->setSteeringValue(steering, 0);
+    btVehicle->setSteeringValue(steering, 1);
+    lastSteering = steering;
+
+    btVehicle->resetSuspension();
+    for (int i = 0; i < btVehicle->getNumWheels(); ++i)
+        btVehicle->updateWheelTransform(i, false);
+
+    /* A teleport, nothing to blend from */
+    previousTransform = transform;
+    currentTransform = transform;
+    renderTransform = transform;
+}
+
 void Vehicle::updateControls(const bool forward, const bool backward, const bool handbrake, const bool left,
                              const bool right, const float dt) {
     float appliedEngineForce = 0.0f;
@@ -240,6 +252,58 @@ void Vehicle::printDebugPosition() const {
             << rot.getZ() << " " << rot.getW() << std::endl;
 }
 
+void Vehicle::captureFrame(VehicleFrame &frame, const float frameTime) {
+    frame.model = model;
+    frame.modelMatrix = getRenderModelMatrix();
+    frame.bodyColor = config.bodyColor;
+    frame.brakeLights = {config.brakeLights[0], config.brakeLights[1]};
+    frame.isBraking = isBraking;
+    frame.isPlayerVehicle = config.isPlayerVehicle;
+    frame.nickname = config.nickname;
+
+    const float speed = btVehicle->getCurrentSpeedKmHour() / 3.6f;
+    const float deltaRotation = speed * frameTime / config.wheelRadius;
+
+    frame.wheelCount = std::min(btVehicle->getNumWheels(), VehicleFrame::MAX_WHEELS);
+    for (int i = 0; i < frame.wheelCount; ++i) {
+        frame.wheelTransforms[i] = getRenderWheelTransform(i);
+        frame.wheelRotations[i] = applyRotationToWheel(i, deltaRotation);
+    }
+}
+
+void Vehicle::hashState(StateHash &hash) const {
+    /* The fourth component of btVector3 is padding, only the three real ones are hashed */
+    const auto addVector = [&hash](const btVector3 &v) {
+        hash.add(v.x());
+        hash.add(v.y());
+        hash.add(v.z());
+    };
+
+    const auto &transform = chassis->getCenterOfMassTransform();
+    for (int row = 0; row < 3; ++row)
+        addVector(transform.getBasis()[row]);
+    addVector(transform.getOrigin());
+
+    addVector(chassis->getLinearVelocity());
+    addVector(chassis->getAngularVelocity());
+    hash.add(lastSteering);
+
+    for (int i = 0; i < btVehicle->getNumWheels(); ++i) {
+        const auto &wheel = btVehicle->getWheelInfo(i);
+        hash.add(wheel.m_raycastInfo.m_suspensionLength);
+        hash.add(wheel.m_rotation);
+        hash.add(wheel.m_deltaRotation);
+        hash.add(wheel.m_steering);
+        hash.add(wheel.m_engineForce);
+        hash.add(wheel.m_brake);
+    }
+}
+
+void Vehicle::queueWheelRays(std::vector<TrackRaycaster::Ray> &rays) const {
+    if (wheelRaycaster)
+        wheelRaycaster->queue(*btVehicle, rays);
+}
+
 void Vehicle::freeze() const {
     const auto body = btVehicle->getRigidBody();
     body->setCollisionFlags(body->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
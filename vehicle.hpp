@@ -1,23 +1,32 @@
 #pragma once
+#include "frame_state.hpp"
 #include "physics.hpp"
 #include "vehicle_config.hpp"
+#include "vehicle_factory.hpp"
+
+class StateHash;
 
 class Vehicle {
     btDynamicsWorld *dynamicsWorld;
 
     VehicleConfig config;
 
-    btCompoundShape *chassisShape{};
+    /* Owns everything below, from VehicleFactory and given back to it */
+    std::unique_ptr<VehicleParts> parts;
     btMotionState *chassisMotion{};
     btRigidBody *chassis{};
-
-    btVehicleRaycaster *raycaster{};
+    WheelRaycaster *wheelRaycaster{};
     btRaycastVehicle *btVehicle{};
 
     std::shared_ptr<Model> model;
 
     float wheelRollingRotation[4] = {0, 0, 0, 0};
 
+    /* Chassis after the last two fixed steps and the pose drawn between them, see Physics::getInterpolationAlpha */
+    btTransform previousTransform;
+    btTransform currentTransform;
+    btTransform renderTransform;
+
     float lastSteering = 0.0f;
 
     bool isBraking = false;
@@ -33,6 +42,9 @@ class Vehicle {
 public:
     explicit Vehicle(VehicleConfig config, std::shared_ptr<Model> vehicleModel);
 
+    /* Vehicle living in a world other than the main one, see RollbackWorld */
+    Vehicle(VehicleConfig config, std::shared_ptr<Model> vehicleModel, btDynamicsWorld *world);
+
     ~Vehicle();
 
     void addToWorld() const;
@@ -58,9 +70,36 @@ public:
     [[nodiscard]]
     glm::vec3 getPosition() const;
 
+    /* Main world, after every fixed step */
+    void recordPhysicsState();
+
+    /* Once per frame after the steps, blends the last two recorded states */
+    void updateRenderTransform(btScalar alpha);
+
+    /* For poses not coming from the fixed steps, like interpolated or smoothed opponents */
+    void setRenderTransform(const btTransform &transform);
+
+    [[nodiscard]]
+    const btTransform &getRenderTransform() const;
+
+    /* Like getOpenGLModelMatrix, but at the drawn pose */
+    [[nodiscard]]
+    glm::mat4 getRenderModelMatrix() const;
+
+    /* The wheel as it sits on the drawn chassis */
+    [[nodiscard]]
+    btTransform getRenderWheelTransform(int wheelIndex) const;
+
     [[nodiscard]]
     bool getIsBraking() const;
 
+    [[nodiscard]]
+    float getSteering() const;
+
+    /* Teleports the chassis with its velocities and steering, the wheels settle on the next raycast */
+    void restoreState(const btTransform &transform, const btVector3 &linearVelocity, const btVector3 &angularVelocity,
+                      float steering);
+
     void updateControls(bool forward, bool backward, bool handbrake, bool left, bool right, float dt);
 
     /**
@@ -73,6 +112,15 @@ public:
 
     float applyRotationToWheel(size_t wheelIndex, float deltaRotation);
 
+    /* Simulation thread, once per frame after updateRenderTransform. Also rolls the wheels by the frame's distance. */
+    void captureFrame(VehicleFrame &frame, float frameTime);
+
+    /* Everything a step carries over to the next one, see Determinism */
+    void hashState(StateHash &hash) const;
+
+    /* Adds the rays the wheels cast in the coming step, see VehicleManager::castWheelRays */
+    void queueWheelRays(std::vector<TrackRaycaster::Ray> &rays) const;
+
     void printDebugPosition() const;
 
     void freeze() const;
@@ -2,6 +2,8 @@
 
 #include <btBulletDynamicsCommon.h>
 #include <BulletDynamics/Vehicle/btRaycastVehicle.h>
+#include <glm/glm.hpp>
+#include <string>
 #include <vector>
 
 struct WheelPlacement {
@@ -0,0 +1,142 @@
+#include "vehicle_factory.hpp"
+
+#include <new>
+
+#include "physics.hpp"
+
+VehicleFactory::ChassisShape::ChassisShape(const VehicleConfig &config)
+    : box(config.chassisHalfExtents), support(btVector3(0.5f, 0.1f, 0.5f)) {
+    btTransform massTransform;
+    massTransform.setIdentity();
+    /* By raising the boxShape child up we lower the center of mass
+     * (the boxShape is higher  but center of mass stays the same) */
+    massTransform.setOrigin(btVector3(0, config.centerOfMassOffset, 0));
+
+    compound.addChildShape(massTransform, &box);
+
+    /* This part is taken from Bullet example.
+     * I don't know what it's supposed to do,
+     * but I feel like the car has more grip at the rear
+     * even though this support shape is on the front? */
+    btTransform supportTransform;
+    supportTransform.setIdentity();
+    supportTransform.setOrigin(btVector3(0, 1.0, 2.0));
+    compound.addChildShape(supportTransform, &support);
+}
+
+VehicleFactory &VehicleFactory::getInstance() {
+    /* Never destroyed, vehicles held by other singletons give their parts back during static destruction */
+    static auto instance = new VehicleFactory();
+    return *instance;
+}
+
+btCompoundShape *VehicleFactory::getChassisShape(const VehicleConfig &config) {
+    const auto &halfExtents = config.chassisHalfExtents;
+    const ChassisKey key{halfExtents.x(), halfExtents.y(), halfExtents.z(), config.centerOfMassOffset};
+
+    auto &shape = chassisShapes[key];
+    if (!shape)
+        shape = std::make_unique<ChassisShape>(config);
+
+    return &shape->compound;
+}
+
+std::unique_ptr<VehicleParts> VehicleFactory::createParts(const VehicleConfig &config, btDynamicsWorld *world) {
+    auto parts = std::make_unique<VehicleParts>();
+    parts->world = world;
+
+    /* Only a placeholder, setUp builds the body the car drives with */
+    const btRigidBody::btRigidBodyConstructionInfo placeholderCI(0.0f, &parts->motion, getChassisShape(config));
+    parts->chassis = std::make_unique<btRigidBody>(placeholderCI);
+
+    if (const auto track = Physics::getInstance().getTrackRaycaster())
+        parts->wheelRaycaster = WheelRaycaster::create(*track, world);
+    parts->raycaster.reset(parts->wheelRaycaster
+                               ? parts->wheelRaycaster
+                               : PhysicsWorld::createRaycaster(world));
+
+    const btRaycastVehicle::btVehicleTuning tuning;
+    parts->vehicle = std::make_unique<btRaycastVehicle>(tuning, parts->chassis.get(), parts->raycaster.get());
+
+    return parts;
+}
+
+void VehicleFactory::setUp(VehicleParts &parts, const VehicleConfig &config) {
+    btCompoundShape *shape = getChassisShape(config);
+
+    btTransform chassisTransform;
+    chassisTransform.setIdentity();
+    chassisTransform.setOrigin(config.position);
+    chassisTransform.setRotation(config.rotation);
+    parts.motion = btDefaultMotionState(chassisTransform);
+
+    btVector3 inertia(0, 0, 0);
+    shape->calculateLocalInertia(config.mass, inertia);
+
+    /* A new body in the same memory, nothing of the previous car carries over. The raycast vehicle keeps
+     * pointing at it. */
+    const btRigidBody::btRigidBodyConstructionInfo carCI(config.mass, &parts.motion, shape, inertia);
+    parts.chassis->~btRigidBody();
+    new(parts.chassis.get()) btRigidBody(carCI);
+    parts.chassis->setActivationState(DISABLE_DEACTIVATION);
+
+    /* Shrinking keeps the storage for the new wheels. The speed the vehicle reports stays the previous car's until
+     * its first update. */
+    btRaycastVehicle &vehicle = *parts.vehicle;
+    vehicle.m_wheelInfo.resize(0);
+
+    const btRaycastVehicle::btVehicleTuning tuning;
+    for (const auto [connectionPoint, isFrontWheel]: config.wheels) {
+        vehicle.addWheel(connectionPoint, config.wheelDirectionCS0, config.wheelAxleCS, config.suspensionRestLength,
+                         config.wheelRadius, tuning, isFrontWheel);
+    }
+
+    for (int i = 0; i < vehicle.getNumWheels(); i++) {
+        btWheelInfo &wheel = vehicle.getWheelInfo(i);
+        wheel.m_suspensionStiffness = config.suspensionStiffness;
+        wheel.m_wheelsDampingRelaxation = config.dampingRelaxation;
+        wheel.m_wheelsDampingCompression = config.dampingCompression;
+        wheel.m_frictionSlip = config.frictionSlip;
+        wheel.m_rollInfluence = config.rollInfluence;
+    }
+
+    if (parts.wheelRaycaster)
+        parts.wheelRaycaster->clearQueued();
+}
+
+std::unique_ptr<VehicleParts> VehicleFactory::acquire(const VehicleConfig &config, btDynamicsWorld *world) {
+    auto &pool = pools[world];
+
+    std::unique_ptr<VehicleParts> parts;
+    if (pool.empty()) {
+        parts = createParts(config, world);
+    } else {
+        parts = std::move(pool.back());
+        pool.pop_back();
+    }
+
+    setUp(*parts, config);
+    ++inUse[world];
+    return parts;
+}
+
+void VehicleFactory::release(std::unique_ptr<VehicleParts> parts) {
+    --inUse[parts->world];
+    pools[parts->world].push_back(std::move(parts));
+}
+
+void VehicleFactory::reserve(const VehicleConfig &config, btDynamicsWorld *world, const size_t count) {
+    auto &pool = pools[world];
+    pool.reserve(count);
+    while (pool.size() < count)
+        pool.push_back(createParts(config, world));
+}
+
+void VehicleFactory::releaseWorld(btDynamicsWorld *world) {
+    pools.erase(world);
+}
+
+size_t VehicleFactory::countInUse(btDynamicsWorld *world) const {
+    const auto count = inUse.find(world);
+    return count == inUse.end() ? 0 : count->second;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "vehicle_config.hpp"
+
+class WheelRaycaster;
+
+/* The Bullet objects behind one car, handed out by VehicleFactory and given back to it when the car goes away */
+struct VehicleParts {
+    btDynamicsWorld *world{};
+    btDefaultMotionState motion;
+    std::unique_ptr<btRigidBody> chassis;
+    std::unique_ptr<btVehicleRaycaster> raycaster;
+    /* Same object as raycaster when the world's ground is the track, nullptr otherwise */
+    WheelRaycaster *wheelRaycaster{};
+    std::unique_ptr<btRaycastVehicle> vehicle;
+};
+
+/* Builds the Bullet side of vehicles. Collision shapes never change once built and are shared by every car with the
+ * same chassis. Bodies, raycasters and raycast vehicles of removed cars are pooled per world and set up again for the
+ * next car, so once the pool holds a grid's worth, spawning one doesn't allocate. */
+class VehicleFactory {
+    struct ChassisShape {
+        btBoxShape box;
+        btBoxShape support;
+        btCompoundShape compound;
+
+        explicit ChassisShape(const VehicleConfig &config);
+    };
+
+    /* Half extents and center of mass offset, all the chassis shape is built from */
+    using ChassisKey = std::tuple<btScalar, btScalar, btScalar, btScalar>;
+
+    std::map<ChassisKey, std::unique_ptr<ChassisShape> > chassisShapes;
+    std::map<btDynamicsWorld *, std::vector<std::unique_ptr<VehicleParts> > > pools;
+    /* Parts handed out and not given back yet, by world */
+    std::map<btDynamicsWorld *, size_t> inUse;
+
+    VehicleFactory() = default;
+
+    btCompoundShape *getChassisShape(const VehicleConfig &config);
+
+    std::unique_ptr<VehicleParts> createParts(const VehicleConfig &config, btDynamicsWorld *world);
+
+    /* Makes pooled or fresh parts into the car described by config */
+    void setUp(VehicleParts &parts, const VehicleConfig &config);
+
+public:
+    static VehicleFactory &getInstance();
+
+    /* Singleton safety */
+    VehicleFactory(const VehicleFactory &) = delete;
+
+    VehicleFactory &operator=(const VehicleFactory &) = delete;
+
+    VehicleFactory(VehicleFactory &&) = delete;
+
+    VehicleFactory &operator=(VehicleFactory &&) = delete;
+
+    /* Parts of a car with the given config, not added to the world yet */
+    std::unique_ptr<VehicleParts> acquire(const VehicleConfig &config, btDynamicsWorld *world);
+
+    /* Takes back the parts of a car already removed from its world */
+    void release(std::unique_ptr<VehicleParts> parts);
+
+    /* Fills the pool of the world up to count parts, so spawning that many cars later doesn't allocate */
+    void reserve(const VehicleConfig &config, btDynamicsWorld *world, size_t count);
+
+    /* Drops the pooled parts of a world about to be destroyed, its raycasters refer to it */
+    void releaseWorld(btDynamicsWorld *world);
+
+    /* Cars of the world still holding their parts */
+    [[nodiscard]]
+    size_t countInUse(btDynamicsWorld *world) const;
+};
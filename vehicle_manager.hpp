@@ -34,6 +34,30 @@ public:
         );
     }
 
+    /* Physics post step callback */
+    void recordPhysicsStates() const {
+        for (const auto &vehicle: vehicles)
+            vehicle->recordPhysicsState();
+    }
+
+    /* Physics pre vehicles callback. Casts the wheel rays of every vehicle against the track in one batch, so the
+     * vehicles find them answered. */
+    void castWheelRays() {
+        const auto track = Physics::getInstance().getTrackRaycaster();
+        if (!track)
+            return;
+
+        wheelRays.clear();
+        for (const auto &vehicle: vehicles)
+            vehicle->queueWheelRays(wheelRays);
+        track->castRays(wheelRays);
+    }
+
+    void updateRenderTransforms(const btScalar alpha) const {
+        for (const auto &vehicle: vehicles)
+            vehicle->updateRenderTransform(alpha);
+    }
+
     [[nodiscard]]
     const std::vector<std::shared_ptr<Vehicle> > &getVehicles() const {
         return vehicles;
@@ -43,4 +67,7 @@ private:
     VehicleManager() = default;
 
     std::vector<std::shared_ptr<Vehicle> > vehicles;
+
+    /* Reused between steps */
+    std::vector<TrackRaycaster::Ray> wheelRays;
 };